@@ -432,6 +432,10 @@ return -- default actionName key binding
         actionName = "builtin.createEmptyWindow",
         keys       = { "Ctrl+N" },
     },
+    {
+        actionName = "builtin.toggleFollowMode",
+        keys       = { "Alt+K,F" },
+    },
     {
         actionName = "builtin.executeLuaScript",
         keys       = { "Alt+L" },
@@ -0,0 +1,147 @@
+/////////////////////////////////////////////////////////////////////////////////////
+//
+//   LucED - The Lucid Editor
+//
+//   Copyright (C) 2005-2010 Oliver Schmidt, oliver at luced dot de
+//
+//   This program is free software; you can redistribute it and/or modify it
+//   under the terms of the GNU General Public License Version 2 as published
+//   by the Free Software Foundation in June 1991.
+//
+//   This program is distributed in the hope that it will be useful, but WITHOUT
+//   ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+//   FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+//   more details.
+//
+//   You should have received a copy of the GNU General Public License along with
+//   this program; if not, write to the Free Software Foundation, Inc.,
+//   51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+//
+/////////////////////////////////////////////////////////////////////////////////////
+
+
+#include "config.h"
+
+#include <string.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__)) && defined(__SSE2__)
+#  define USE_SSE2 1
+#  include <emmintrin.h>
+#  if __GNUC__ >= 5 || defined(__clang__)
+#    define USE_AVX2 1
+#    include <immintrin.h>
+#  endif
+#endif
+
+#include "AsciiScanner.hpp"
+
+using namespace LucED;
+
+namespace
+{
+
+long getPrefixLengthWordwise(const byte* ptr, long length)
+{
+    long i = 0;
+    
+    for (; i + 8 <= length; i += 8)
+    {
+        unsigned long long word;
+        memcpy(&word, ptr + i, 8);
+        
+        if ((word & 0x8080808080808080ULL) != 0) {
+            break;
+        }
+    }
+    while (i < length && (ptr[i] & 0x80) == 0) {
+        ++i;
+    }
+    return i;
+}
+
+#if USE_SSE2
+
+long getPrefixLengthSse2(const byte* ptr, long length)
+{
+    long i = 0;
+    
+    // The high bits of four blocks are tested together, movemask 
+    // collects the high bit of each byte.
+
+    for (; i + 64 <= length; i += 64)
+    {
+        __m128i b0 = _mm_loadu_si128((const __m128i*)(ptr + i));
+        __m128i b1 = _mm_loadu_si128((const __m128i*)(ptr + i + 16));
+        __m128i b2 = _mm_loadu_si128((const __m128i*)(ptr + i + 32));
+        __m128i b3 = _mm_loadu_si128((const __m128i*)(ptr + i + 48));
+        
+        if (_mm_movemask_epi8(_mm_or_si128(_mm_or_si128(b0, b1), _mm_or_si128(b2, b3))) != 0) {
+            break;
+        }
+    }
+    for (; i + 16 <= length; i += 16)
+    {
+        int mask = _mm_movemask_epi8(_mm_loadu_si128((const __m128i*)(ptr + i)));
+        if (mask != 0) {
+            return i + __builtin_ctz(mask);
+        }
+    }
+    return i + getPrefixLengthWordwise(ptr + i, length - i);
+}
+
+#endif // USE_SSE2
+
+#if USE_AVX2
+
+__attribute__((target("avx2")))
+long getPrefixLengthAvx2(const byte* ptr, long length)
+{
+    long i = 0;
+    
+    for (; i + 64 <= length; i += 64)
+    {
+        __m256i b0 = _mm256_loadu_si256((const __m256i*)(ptr + i));
+        __m256i b1 = _mm256_loadu_si256((const __m256i*)(ptr + i + 32));
+        
+        if (_mm256_movemask_epi8(_mm256_or_si256(b0, b1)) != 0) {
+            break;
+        }
+    }
+    for (; i + 32 <= length; i += 32)
+    {
+        unsigned int mask = _mm256_movemask_epi8(_mm256_loadu_si256((const __m256i*)(ptr + i)));
+        if (mask != 0) {
+            return i + __builtin_ctz(mask);
+        }
+    }
+    // no SSE2 code here: switching from AVX to SSE instructions is slow
+    // on some processors, this matters for the many short ASCII runs of
+    // non-latin texts
+
+    return i + getPrefixLengthWordwise(ptr + i, length - i);
+}
+
+#endif // USE_AVX2
+
+} // anonymous namespace
+
+
+AsciiScanner::PrefixLengthFunction* AsciiScanner::selectPrefixLengthFunction()
+{
+#if USE_AVX2
+    __builtin_cpu_init();
+
+    if (__builtin_cpu_supports("avx2")) {
+        return &getPrefixLengthAvx2;
+    } else {
+        return &getPrefixLengthSse2;
+    }
+#elif USE_SSE2
+    return &getPrefixLengthSse2;
+#else
+    return &getPrefixLengthWordwise;
+#endif
+}
+
+
+AsciiScanner::PrefixLengthFunction* AsciiScanner::prefixLengthFunction = AsciiScanner::selectPrefixLengthFunction();
@@ -0,0 +1,58 @@
+/////////////////////////////////////////////////////////////////////////////////////
+//
+//   LucED - The Lucid Editor
+//
+//   Copyright (C) 2005-2010 Oliver Schmidt, oliver at luced dot de
+//
+//   This program is free software; you can redistribute it and/or modify it
+//   under the terms of the GNU General Public License Version 2 as published
+//   by the Free Software Foundation in June 1991.
+//
+//   This program is distributed in the hope that it will be useful, but WITHOUT
+//   ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+//   FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+//   more details.
+//
+//   You should have received a copy of the GNU General Public License along with
+//   this program; if not, write to the Free Software Foundation, Inc.,
+//   51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+//
+/////////////////////////////////////////////////////////////////////////////////////
+
+
+#ifndef ASCII_SCANNER_HPP
+#define ASCII_SCANNER_HPP
+
+#include "types.hpp"
+
+namespace LucED
+{
+
+/**
+ * Finds the end of ASCII runs in memory.
+ *
+ * On x86 processors 16 or 32 bytes are checked at once using SSE2 or
+ * AVX2 instructions, the best variant is selected at runtime like in 
+ * NewlineCounter.
+ */
+class AsciiScanner
+{
+public:
+    /**
+     * Returns the number of ASCII bytes at the beginning of ptr.
+     */
+    static long getPrefixLength(const byte* ptr, long length) {
+        return prefixLengthFunction(ptr, length);
+    }
+
+private:
+    typedef long PrefixLengthFunction(const byte* ptr, long length);
+
+    static PrefixLengthFunction* prefixLengthFunction;
+
+    static PrefixLengthFunction* selectPrefixLengthFunction();
+};
+
+} // namespace LucED
+
+#endif // ASCII_SCANNER_HPP
@@ -44,6 +44,10 @@ void BasicRegex::initialize(const char* expr, CreateOptions createOptions)
     const char* errortext;
     int errorpos;
 
+    const bool isStudyRequested = createOptions.isSet(STUDY);
+    createOptions.clear(STUDY);
+
+    study = NULL;
     re = pcre_compile(expr, 
                       createOptions.getOptions()|PCRE_UTF8|PCRE_NO_UTF8_CHECK, 
                       &errortext,
@@ -52,9 +56,37 @@ void BasicRegex::initialize(const char* expr, CreateOptions createOptions)
     if (re == NULL) {
         throw RegexException(errortext, errorpos);
     }
+    if (isStudyRequested)
+    {
+        // pcre_study returns NULL without errortext if there 
+        // is nothing to gain for this regex
+
+        study = pcre_study(re, 0, &errortext);
+        if (errortext != NULL) {
+            pcre_free(re);
+            re = NULL;
+            throw RegexException(errortext, 0);
+        }
+    }
     pcre_refcount(re, +1);
 }
 
+
+void BasicRegex::release()
+{
+    if (re != NULL) {
+        int refCount = pcre_refcount(re, -1);
+        if (refCount == 0) {
+            if (study != NULL) {
+                pcre_free(study);
+            }
+            pcre_free(re);
+        }
+        re    = NULL;
+        study = NULL;
+    }
+}
+
     
     
 BasicRegex::BasicRegex(const String& expr, CreateOptions createOptions)
@@ -71,7 +103,8 @@ BasicRegex::BasicRegex(const ByteArray& expr, CreateOptions createOptions)
 
 BasicRegex::BasicRegex(const BasicRegex& src)
 {
-    re = src.re;
+    re    = src.re;
+    study = src.study;
     if (re != NULL) {
         pcre_refcount(re, +1);
     }
@@ -80,30 +113,19 @@ BasicRegex::BasicRegex(const BasicRegex& src)
 
 BasicRegex& BasicRegex::operator=(const BasicRegex& src)
 {
-    pcre* oldRe = re;
-    re = src.re;
-    if (re != NULL) {
-        pcre_refcount(re, +1);
-    }
-    if (oldRe != NULL) {
-        int refCount = pcre_refcount(oldRe, -1);
-        if (refCount == 0) {
-            pcre_free(oldRe);
-        }
+    if (src.re != NULL) {
+        pcre_refcount(src.re, +1);
     }
+    release();
+    re    = src.re;
+    study = src.study;
     return *this;
 }
 
 
 BasicRegex::~BasicRegex()
 {
-    if (re != NULL) {
-        int refCount = pcre_refcount(re, -1);
-        if (refCount == 0) {
-            pcre_free(re);
-            re = NULL;
-        }
-    }
+    release();
 }
 
 
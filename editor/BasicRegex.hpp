@@ -27,6 +27,7 @@
 #include "String.hpp"
 #include "MemArray.hpp"
 #include "ByteArray.hpp"
+#include "RawPtr.hpp"
 #include "BasicRegexTypes.hpp"
 
 namespace LucED
@@ -35,7 +36,7 @@ namespace LucED
 class BasicRegex : public BasicRegexTypes
 {
 public:
-    BasicRegex() : re(NULL) {
+    BasicRegex() : re(NULL), study(NULL) {
         pcre_callout = pcreCalloutCallback;
     }
     BasicRegex(const String&    expr, CreateOptions createOptions = CreateOptions());
@@ -64,7 +65,7 @@ public:
     {
         ASSERT(pcre_callout == pcreCalloutCallback);
 
-        return pcre_exec(re, NULL, subject, length, startoffset, matchOptions.getOptions()|PCRE_NO_UTF8_CHECK, 
+        return pcre_exec(re, study, subject, length, startoffset, matchOptions.getOptions()|PCRE_NO_UTF8_CHECK, 
                 ovector.getPtr(0), ovector.getLength()) > 0;
     }
     
@@ -81,28 +82,171 @@ public:
                     calloutData.calloutFunction = calloutFunctionX;
                     
         pcre_extra extra;
-                   extra.flags        = PCRE_EXTRA_CALLOUT_DATA;
-                   extra.callout_data = &calloutData;
+        initExtra(&extra, &calloutData);
         
         bool rslt = pcre_exec(re, &extra, subject, length, startoffset, matchOptions.getOptions()|PCRE_NO_UTF8_CHECK, 
                     ovector.getPtr(0), ovector.getLength()) > 0;
 
         return rslt;
     }
-    
-    
+
+    /**
+     * Finds a match in a subject that is not stored contiguously.
+     *
+     * The Subject must provide getContiguousAmount(pos, maxAmount, const byte**),
+     * copyTo(byte*, pos, amount) and operator[]. The match must start in [startOffset, endOffset],
+     * bytes in [beginOffset, startOffset) are only visible for lookbehind
+     * assertions. If lastStartOffset is not -1, matches starting after it
+     * are not searched for, so that the subject is not scanned beyond it
+     * if there is no match.
+     *
+     * The subject is matched in windows. A window lying within one segment
+     * is matched in place, otherwise it is copied into windowBuffer. A window
+     * is enlarged as long as pcre reports a partial match at its end and it
+     * is moved forward if there is no match within it. Positions in ovector
+     * are relative to the subject, positions in callout blocks are relative
+     * to the current window.
+     */
+    template<class Subject
+            > bool findMatchInSegments(void* object, CalloutFunction* calloutFunctionX,
+                                       RawPtr<Subject> subject,
+                                       long beginOffset, long startOffset, long endOffset,
+                                       MatchOptions matchOptions, MemArray<int>& ovector,
+                                       RawPtr<ByteArray> windowBuffer,
+                                       long lastStartOffset = -1) const
+    {
+        ASSERT(0 <= beginOffset && beginOffset <= startOffset && startOffset <= endOffset);
+
+        if (lastStartOffset == -1) {
+            lastStartOffset = endOffset;
+        }
+
+        const long lookBehindLength = startOffset - beginOffset;
+
+        long windowLength = INITIAL_WINDOW_LENGTH;
+
+        for (;;)
+        {
+            long windowBegin = startOffset - lookBehindLength;
+            long windowEnd   = startOffset + windowLength;
+
+            if (windowBegin < beginOffset) {
+                windowBegin = beginOffset;
+            }
+            if (windowEnd >= endOffset) {
+                windowEnd = endOffset;
+            } else {
+                while (windowEnd > startOffset && isUtf8FollowerByte((*subject)[windowEnd])) {
+                    --windowEnd;
+                }
+            }
+            while (windowBegin > beginOffset && isUtf8FollowerByte((*subject)[windowBegin])) {
+                --windowBegin;
+            }
+            const bool isLastWindow = (windowEnd == endOffset);
+
+            const long  length = windowEnd - windowBegin;
+            const byte* ptr;
+
+            if (subject->getContiguousAmount(windowBegin, length, &ptr) < length) {
+                windowBuffer->clear();
+                subject->copyTo(windowBuffer->appendAmount(length), windowBegin, length);
+                ptr = windowBuffer->getPtr();
+            }
+
+            MatchOptions options = matchOptions;
+            if (windowBegin > beginOffset) {
+                options |= NOTBOL;
+            }
+            CalloutData calloutData;
+                        calloutData.object = object;
+                        calloutData.calloutFunction = calloutFunctionX;
+
+            pcre_extra extra;
+            initExtra(&extra, &calloutData);
+
+            int rc = pcre_exec(re, &extra, (const char*) ptr, length, startOffset - windowBegin,
+                               options.getOptions()|PCRE_NO_UTF8_CHECK|(isLastWindow ? 0 : PCRE_PARTIAL_HARD),
+                               ovector.getPtr(0), ovector.getLength());
+            if (rc > 0)
+            {
+                if (ovector[0] + windowBegin > lastStartOffset) {
+                    return false;
+                }
+                for (int i = 0, n = ovector.getLength(); i < n; ++i) {
+                    if (ovector[i] >= 0) {
+                        ovector[i] += windowBegin;
+                    }
+                }
+                return true;
+            }
+            else if (   isLastWindow || rc != PCRE_ERROR_PARTIAL
+                     && (rc != PCRE_ERROR_NOMATCH || matchOptions.isSet(ANCHORED)))
+            {
+                return false;
+            }
+            else if (rc == PCRE_ERROR_PARTIAL)
+            {
+                // a match may start at ovector[0] but needs more bytes
+
+                if (ovector[0] + windowBegin > startOffset) {
+                    startOffset = ovector[0] + windowBegin;
+                }
+                if (startOffset > lastStartOffset) {
+                    return false;
+                }
+                windowLength = 2 * (windowEnd - startOffset) + INITIAL_WINDOW_LENGTH;
+            }
+            else {
+                // no match can start before windowEnd
+
+                if (windowEnd > startOffset) {
+                    startOffset = windowEnd;
+                }
+                if (startOffset > lastStartOffset) {
+                    return false;
+                }
+                windowLength = INITIAL_WINDOW_LENGTH;
+            }
+        }
+    }
+
 private:
+    enum { INITIAL_WINDOW_LENGTH = 64 * 1024 };
+
+    static bool isUtf8FollowerByte(byte b) {
+        return (b & 0xC0) == 0x80;
+    }
+
 
     void initialize(const char* expr, CreateOptions createOptions);
+    void release();
 
     struct CalloutData
     {
         void* object;
         CalloutFunction* calloutFunction;
     };
+
+    /**
+     * Merges the study data, if the regex was created with STUDY,
+     * with the callout data into extra.
+     */
+    void initExtra(pcre_extra* extra, CalloutData* calloutData) const
+    {
+        if (study != NULL) {
+            *extra = *study;
+        } else {
+            extra->flags = 0;
+        }
+        extra->flags       |= PCRE_EXTRA_CALLOUT_DATA;
+        extra->callout_data = calloutData;
+    }
+
     static int pcreCalloutCallback(pcre_callout_block*);
     static const unsigned char* pcreCharTable;
     pcre* re;
+    pcre_extra* study; // shared between copies like re, freed with it
 };
 
 } // namespace LucED
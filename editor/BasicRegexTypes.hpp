@@ -36,7 +36,8 @@ public:
     {
         MULTILINE = PCRE_MULTILINE,
         EXTENDED = PCRE_EXTENDED,
-        IGNORE_CASE = PCRE_CASELESS
+        IGNORE_CASE = PCRE_CASELESS,
+        STUDY = 0x40000000 // not a pcre option: pcre_study the compiled regex
     };
     typedef OptionBits<CreateOption> CreateOptions;
     
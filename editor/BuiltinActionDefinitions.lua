@@ -377,6 +377,10 @@ return
                                                   classes     = { "EditorTopWinActions", },
     },
         
+    { name = "toggleFollowMode",                  description = "", 
+                                                  classes     = { "EditorTopWinActions", },
+    },
+        
     { name = "executeLuaScript",                  description = "", 
                                                   classes     = { "EditorTopWinActions", },
     },
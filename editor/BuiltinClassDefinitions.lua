@@ -46,6 +46,8 @@ return
                      },
                      { name = "bindActionKey"
                      },
+                     { name = "getHistoryMemoryUsage"
+                     },
                    }
     },
     {
@@ -130,6 +132,8 @@ return
                      },
                      { name = "setCurrentActionCategory"
                      },
+                     { name = "getHistoryMemoryUsage"
+                     },
                    }
     },
     {
@@ -0,0 +1,185 @@
+/////////////////////////////////////////////////////////////////////////////////////
+//
+//   LucED - The Lucid Editor
+//
+//   Copyright (C) 2005-2010 Oliver Schmidt, oliver at luced dot de
+//
+//   This program is free software; you can redistribute it and/or modify it
+//   under the terms of the GNU General Public License Version 2 as published
+//   by the Free Software Foundation in June 1991.
+//
+//   This program is distributed in the hope that it will be useful, but WITHOUT
+//   ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+//   FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+//   more details.
+//
+//   You should have received a copy of the GNU General Public License along with
+//   this program; if not, write to the Free Software Foundation, Inc.,
+//   51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+//
+/////////////////////////////////////////////////////////////////////////////////////
+
+#include <string.h>
+
+#include "ByteCompressor.hpp"
+#include "MemArray.hpp"
+
+using namespace LucED;
+
+namespace // anonymous namespace
+{
+
+// token: 4 bits literal length, 4 bits match length - MIN_MATCH_LENGTH,
+// a value of 15 is continued by bytes that are added until a byte < 255.
+// The match offset follows the literals as two bytes in little endian order.
+// The last token has literals only.
+
+const int  MIN_MATCH_LENGTH = 4;
+const long MAX_OFFSET       = 0xFFFF;
+const int  HASH_BITS        = 14;
+
+inline unsigned long getHash(const byte* p)
+{
+    unsigned long v =  (unsigned long) p[0]
+                    | ((unsigned long) p[1] <<  8)
+                    | ((unsigned long) p[2] << 16)
+                    | ((unsigned long) p[3] << 24);
+
+    return ((v * 2654435761UL) & 0xFFFFFFFFUL) >> (32 - HASH_BITS);
+}
+
+inline void appendLength(RawPtr<ByteBuffer> output, long length)
+{
+    while (length >= 255) {
+        output->append(255);
+        length -= 255;
+    }
+    output->append((byte) length);
+}
+
+inline void appendSequence(RawPtr<ByteBuffer> output, 
+                           const byte* literals, long literalLength, 
+                           long offset, long matchLength)
+{
+    long m = (matchLength > 0) ? matchLength - MIN_MATCH_LENGTH : 0;
+    
+    output->append((byte)(  ((literalLength < 15 ? literalLength : 15) << 4)
+                          |  (m             < 15 ? m             : 15)));
+    if (literalLength >= 15) {
+        appendLength(output, literalLength - 15);
+    }
+    output->append(literals, literalLength);
+
+    if (matchLength > 0)
+    {
+        output->append((byte)(offset & 0xFF));
+        output->append((byte)(offset >> 8));
+        if (m >= 15) {
+            appendLength(output, m - 15);
+        }
+    }
+}
+
+inline bool readLength(const byte** p, const byte* end, long* length)
+{
+    byte b;
+    do {
+        if (*p >= end) {
+            return false;
+        }
+        b        = *(*p)++;
+        *length += b;
+    } while (b == 255);
+    
+    return true;
+}
+
+} // anonymous namespace
+
+
+void ByteCompressor::compress(const byte* data, long length, RawPtr<ByteBuffer> output)
+{
+    MemArray<long> table(1 << HASH_BITS);
+    
+    for (long i = 0; i < table.getLength(); ++i) {
+        table[i] = -1;
+    }
+    long literalBegin = 0;
+    long i            = 0;
+
+    while (i + MIN_MATCH_LENGTH <= length)
+    {
+        unsigned long h         = getHash(data + i);
+        long          candidate = table[h];
+        
+        table[h] = i;
+
+        if (   candidate >= 0 && i - candidate <= MAX_OFFSET
+            && memcmp(data + candidate, data + i, MIN_MATCH_LENGTH) == 0)
+        {
+            long matchLength = MIN_MATCH_LENGTH;
+
+            while (i + matchLength < length && data[candidate + matchLength] == data[i + matchLength]) {
+                ++matchLength;
+            }
+            appendSequence(output, data + literalBegin, i - literalBegin, i - candidate, matchLength);
+            
+            i           += matchLength;
+            literalBegin = i;
+        }
+        else {
+            ++i;
+        }
+    }
+    appendSequence(output, data + literalBegin, length - literalBegin, 0, 0);
+}
+
+
+bool ByteCompressor::decompress(const byte* data, long length, RawPtr<ByteBuffer> output)
+{
+    const byte* p   = data;
+    const byte* end = data + length;
+
+    while (p < end)
+    {
+        byte token         = *p++;
+        long literalLength = token >> 4;
+        
+        if (literalLength == 15 && !readLength(&p, end, &literalLength)) {
+            return false;
+        }
+        if (literalLength > end - p) {
+            return false;
+        }
+        output->append(p, literalLength);
+        p += literalLength;
+
+        if (p == end) {
+            break; // last sequence
+        }
+        if (end - p < 2) {
+            return false;
+        }
+        long offset      = p[0] | (p[1] << 8);
+        long matchLength = token & 0x0F;
+        p += 2;
+
+        if (matchLength == 15 && !readLength(&p, end, &matchLength)) {
+            return false;
+        }
+        matchLength += MIN_MATCH_LENGTH;
+        
+        long outputLength = output->getLength();
+
+        if (offset == 0 || offset > outputLength) {
+            return false;
+        }
+        byte*       dest = output->appendAmount(matchLength);
+        const byte* src  = dest - offset;
+
+        for (long j = 0; j < matchLength; ++j) {  // may overlap
+            dest[j] = src[j];
+        }
+    }
+    return true;
+}
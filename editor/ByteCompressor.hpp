@@ -0,0 +1,61 @@
+/////////////////////////////////////////////////////////////////////////////////////
+//
+//   LucED - The Lucid Editor
+//
+//   Copyright (C) 2005-2010 Oliver Schmidt, oliver at luced dot de
+//
+//   This program is free software; you can redistribute it and/or modify it
+//   under the terms of the GNU General Public License Version 2 as published
+//   by the Free Software Foundation in June 1991.
+//
+//   This program is distributed in the hope that it will be useful, but WITHOUT
+//   ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+//   FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+//   more details.
+//
+//   You should have received a copy of the GNU General Public License along with
+//   this program; if not, write to the Free Software Foundation, Inc.,
+//   51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+//
+/////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef BYTE_COMPRESSOR_HPP
+#define BYTE_COMPRESSOR_HPP
+
+#include "types.hpp"
+#include "RawPtr.hpp"
+#include "ByteBuffer.hpp"
+
+namespace LucED
+{
+
+/**
+ * Fast LZ77 style compression for data that is kept in memory
+ * for a while but only rarely needed, e.g. old undo history.
+ *
+ * The compressed data is a sequence of literal runs, each followed by a
+ * back reference of at least MIN_MATCH_LENGTH bytes within the previous 
+ * 64KB. Compression ratio is traded for speed: there is only one
+ * candidate per hash value.
+ */
+class ByteCompressor
+{
+public:
+    /**
+     * Appends the compressed data to output.
+     */
+    static void compress(const byte* data, long length, RawPtr<ByteBuffer> output);
+
+    /**
+     * Appends the decompressed data to output. Returns false if the 
+     * compressed data is corrupt.
+     */
+    static bool decompress(const byte* data, long length, RawPtr<ByteBuffer> output);
+
+private:
+    ByteCompressor();
+};
+
+} // namespace LucED
+
+#endif // BYTE_COMPRESSOR_HPP
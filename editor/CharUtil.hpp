@@ -34,6 +34,7 @@ extern "C"
 }
 
 #include "types.hpp"
+#include "AsciiScanner.hpp"
 
 namespace LucED
 {
@@ -44,9 +45,129 @@ public:
     static bool isAsciiChar(byte b)  {
         return (b & 0x80) == 0x00;             // 0x80 = 1000 0000
     }                                          // 0x00 = 0000 0000
+    /**
+     * Returns the number of ASCII bytes at the beginning of bytes.
+     */
+    static long getAsciiPrefixLength(const byte* bytes, long length) {
+        return AsciiScanner::getPrefixLength(bytes, length);
+    }
     static bool isUft8FollowerChar(byte b) { 
         return (b & 0xC0) == 0x80;             // 0xC0 = 1100 0000
     }                                          // 0x80 = 1000 0000
+
+    /**
+     * Returns the number of bytes at the beginning that form valid UTF-8, 
+     * i.e. complete sequences without overlong forms, surrogates or 
+     * characters above U+10FFFF.
+     */
+    static long getValidUtf8PrefixLength(const byte* bytes, long length)
+    {
+        long i = 0;
+        
+        while (i < length)
+        {
+            // short ASCII runs between multibyte characters are skipped
+            // here, only long runs are worth calling the AsciiScanner
+
+            long shortRunEnd = (length - i > 16) ? i + 16 : length;
+
+            while (i < shortRunEnd && isAsciiChar(bytes[i])) {
+                ++i;
+            }
+            if (i == shortRunEnd) {
+                i += getAsciiPrefixLength(bytes + i, length - i);
+            }
+            if (i == length) {
+                break;
+            }
+            byte b = bytes[i];
+            int  n;
+            byte minSecond = 0x80;
+            byte maxSecond = 0xBF;
+            
+            if      (0xC2 <= b && b <= 0xDF) { n = 1; }
+            else if (b == 0xE0)              { n = 2; minSecond = 0xA0; }
+            else if (b == 0xED)              { n = 2; maxSecond = 0x9F; }
+            else if (0xE1 <= b && b <= 0xEF) { n = 2; }
+            else if (b == 0xF0)              { n = 3; minSecond = 0x90; }
+            else if (0xF1 <= b && b <= 0xF3) { n = 3; }
+            else if (b == 0xF4)              { n = 3; maxSecond = 0x8F; }
+            else {
+                break;
+            }
+            if (   i + n >= length
+                || bytes[i + 1] < minSecond || bytes[i + 1] > maxSecond
+                || (n >= 2 && !isUft8FollowerChar(bytes[i + 2]))
+                || (n >= 3 && !isUft8FollowerChar(bytes[i + 3])))
+            {
+                break;
+            }
+            i += n + 1;
+        }
+        return i;
+    }
+    
+    /**
+     * Returns the number of wide characters that begin within bytes in
+     * the sense of Utf8Parser::isBeginOfWChar(): every byte that is not a
+     * follower byte begins a character and so does a follower byte right 
+     * after an ASCII byte. isAfterAsciiChar tells if the byte before bytes 
+     * is an ASCII byte or if bytes is the begin of the text.
+     *
+     * Eight bytes are processed at once.
+     */
+    static long getNumberOfWCharBegins(const byte* bytes, long length, bool isAfterAsciiChar)
+    {
+        long rslt = 0;
+        long i    = 0;
+        
+        for (; i + 8 <= length; i += 8)
+        {
+            rslt += countHighBits(getWCharBeginBits(bytes + i, isAfterAsciiChar));
+            isAfterAsciiChar = isAsciiChar(bytes[i + 7]);
+        }
+        for (; i < length; ++i)
+        {
+            if (isAfterAsciiChar || !isUft8FollowerChar(bytes[i])) {
+                ++rslt;
+            }
+            isAfterAsciiChar = isAsciiChar(bytes[i]);
+        }
+        return rslt;
+    }
+    
+    /**
+     * Returns the offset of the wide character with index *wcharIndex,
+     * counted as in getNumberOfWCharBegins(). If bytes contains not enough 
+     * wide characters, length is returned and *wcharIndex is decremented
+     * by the number of wide characters within bytes.
+     */
+    static long getOffsetOfWCharBegin(const byte* bytes, long length, long* wcharIndex, 
+                                      bool isAfterAsciiChar)
+    {
+        long i = 0;
+        
+        for (; i + 8 <= length; i += 8)
+        {
+            long n = countHighBits(getWCharBeginBits(bytes + i, isAfterAsciiChar));
+            if (n > *wcharIndex) {
+                break;
+            }
+            *wcharIndex -= n;
+            isAfterAsciiChar = isAsciiChar(bytes[i + 7]);
+        }
+        for (; i < length; ++i)
+        {
+            if (isAfterAsciiChar || !isUft8FollowerChar(bytes[i])) {
+                if (*wcharIndex == 0) {
+                    return i;
+                }
+                *wcharIndex -= 1;
+            }
+            isAfterAsciiChar = isAsciiChar(bytes[i]);
+        }
+        return length;
+    }
     
     static int getNumberOfStrictUtf8FollowerChars(byte b)
     {
@@ -90,6 +211,43 @@ public:
             return unicodeChar;
         }
     }
+
+private:
+    static const unsigned long long HIGH_BITS = 0x8080808080808080ULL;
+
+    /**
+     * The bytes are composed in little endian order on every platform,
+     * so that shifting left moves each byte onto its successor.
+     */
+    static unsigned long long getWord(const byte* bytes)
+    {
+        return  (unsigned long long) bytes[0]
+             | ((unsigned long long) bytes[1] <<  8)
+             | ((unsigned long long) bytes[2] << 16)
+             | ((unsigned long long) bytes[3] << 24)
+             | ((unsigned long long) bytes[4] << 32)
+             | ((unsigned long long) bytes[5] << 40)
+             | ((unsigned long long) bytes[6] << 48)
+             | ((unsigned long long) bytes[7] << 56);
+    }
+    
+    /**
+     * Returns the high bit of every byte that begins a wide character.
+     */
+    static unsigned long long getWCharBeginBits(const byte* bytes, bool isAfterAsciiChar)
+    {
+        unsigned long long word           = getWord(bytes);
+        unsigned long long followerBits   =  word & ~(word << 1) & HIGH_BITS; // 10xx xxxx
+        unsigned long long afterAsciiBits = ((~word & HIGH_BITS) << 8) 
+                                          | (isAfterAsciiChar ? 0x80 : 0x00);
+
+        return (~followerBits & HIGH_BITS) | (followerBits & afterAsciiBits);
+    }
+    
+    static long countHighBits(unsigned long long bits)
+    {
+        return (long)(((bits >> 7) * 0x0101010101010101ULL) >> 56);
+    }
 };
 
 } // namespace LucED
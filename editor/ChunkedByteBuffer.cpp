@@ -0,0 +1,555 @@
+/////////////////////////////////////////////////////////////////////////////////////
+//
+//   LucED - The Lucid Editor
+//
+//   Copyright (C) 2005-2010 Oliver Schmidt, oliver at luced dot de
+//
+//   This program is free software; you can redistribute it and/or modify it
+//   under the terms of the GNU General Public License Version 2 as published
+//   by the Free Software Foundation in June 1991.
+//
+//   This program is distributed in the hope that it will be useful, but WITHOUT
+//   ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+//   FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+//   more details.
+//
+//   You should have received a copy of the GNU General Public License along with
+//   this program; if not, write to the Free Software Foundation, Inc.,
+//   51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+//
+/////////////////////////////////////////////////////////////////////////////////////
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "util.hpp"
+#include "ChunkedByteBuffer.hpp"
+#include "TextSnapshot.hpp"
+
+using namespace LucED;
+
+
+ChunkedByteBuffer::~ChunkedByteBuffer()
+{
+    for (long i = 0; i < chunks.getLength(); ++i) {
+        freeChunk(chunks[i]);
+    }
+}
+
+
+byte* ChunkedByteBuffer::allocate(long size)
+{
+    byte* rslt = (byte*) malloc(size);
+    if (rslt == NULL) {
+        fprintf(stderr, "Out of Memory!\n");
+        abort();
+    }
+    return rslt;
+}
+
+
+void ChunkedByteBuffer::freeChunk(const Chunk& chunk)
+{
+    if (chunk.capacity > 0) {
+        free(chunk.data);
+    }
+    else if (chunk.block != NULL) {
+        releaseBlock(chunk.block);
+    }
+}
+
+
+void ChunkedByteBuffer::releaseBlock(SharedBlock* block)
+{
+    block->refCounter -= 1;
+
+    if (block->refCounter == 0) {
+        free(block->memory);
+        delete block;
+    }
+}
+
+
+long ChunkedByteBuffer::getChunkIndexForPos(long pos) const
+{
+    ASSERT(0 <= pos && pos <= getLength());
+
+    long i = chunkLengths.getIndexForSum(pos);
+    if (i == chunks.getLength() && i > 0) {
+        i -= 1; // end of text belongs to the last chunk
+    }
+    return i;
+}
+
+
+void ChunkedByteBuffer::cacheChunkForPos(long pos) const
+{
+    ASSERT(0 <= pos && pos < getLength());
+
+    long i = chunkLengths.getIndexForSum(pos);
+
+    cachedBegin = chunkLengths.getSumBefore(i);
+    cachedEnd   = cachedBegin + chunkLengths.get(i);
+    cachedData  = chunks[i].data;
+}
+
+
+const byte* ChunkedByteBuffer::getAmount(long pos, long amount) const
+{
+    ASSERT(0 <= pos && 0 <= amount && pos + amount <= getLength());
+
+    if (chunks.getLength() > 0)
+    {
+        long i     = getChunkIndexForPos(pos);
+        long begin = chunkLengths.getSumBefore(i);
+
+        if (pos + amount <= begin + chunkLengths.get(i)) {
+            return chunks[i].data + (pos - begin);
+        }
+    }
+    if (scratchBuffer.getLength() > 2 * amount + MAX_CHUNK_SIZE) {
+        ByteBuffer emptyBuffer;
+        scratchBuffer.takeOver(&emptyBuffer);
+    }
+    scratchBuffer.clear();
+    copyTo(scratchBuffer.appendAmount(amount), pos, amount);
+
+    return scratchBuffer.getTotalAmount();
+}
+
+
+long ChunkedByteBuffer::getContiguousAmount(long pos, long maxAmount, const byte** rslt) const
+{
+    ASSERT(0 <= pos && 0 <= maxAmount && pos + maxAmount <= getLength());
+
+    if (maxAmount == 0) {
+        *rslt = NULL;
+        return 0;
+    }
+    if (pos < cachedBegin || pos >= cachedEnd) {
+        cacheChunkForPos(pos);
+    }
+    *rslt = cachedData + (pos - cachedBegin);
+
+    return util::minimum(maxAmount, cachedEnd - pos);
+}
+
+
+void ChunkedByteBuffer::copyTo(byte* dest, long pos, long amount) const
+{
+    ASSERT(0 <= pos && 0 <= amount && pos + amount <= getLength());
+
+    if (amount > 0)
+    {
+        long i      = getChunkIndexForPos(pos);
+        long offset = pos - chunkLengths.getSumBefore(i);
+
+        while (amount > 0)
+        {
+            long n = util::minimum(amount, chunkLengths.get(i) - offset);
+            memcpy(dest, chunks[i].data + offset, n);
+            dest   += n;
+            amount -= n;
+            offset  = 0;
+            i      += 1;
+        }
+    }
+}
+
+
+void ChunkedByteBuffer::makeChunkWritable(long i, long neededCapacity)
+{
+    Chunk& chunk  = chunks[i];
+    long   length = chunkLengths.get(i);
+
+    ASSERT(length <= neededCapacity);
+
+    if (chunk.block != NULL && chunk.block->refCounter == 1)
+    {
+        // no snapshot refers to this memory any more, so it can be written again
+
+        SharedBlock* block = chunk.block;
+
+        memmove(block->memory, chunk.data, length);
+        chunk.data     = block->memory;
+        chunk.capacity = block->capacity;
+        chunk.block    = NULL;
+        delete block;
+    }
+    if (chunk.capacity < neededCapacity)
+    {
+        long newCapacity = util::maximum(neededCapacity,
+                                         util::minimum(2 * util::maximum(chunk.capacity, length),
+                                                       (long) MAX_CHUNK_SIZE));
+        if (chunk.capacity > 0) {
+            byte* newData = (byte*) realloc(chunk.data, newCapacity);
+            if (newData == NULL) {
+                fprintf(stderr, "Out of Memory!\n");
+                abort();
+            }
+            chunk.data = newData;
+        } else {
+            byte* newData = allocate(newCapacity);
+            memcpy(newData, chunk.data, length);
+            if (chunk.block != NULL) {
+                releaseBlock(chunk.block);
+                chunk.block = NULL;
+            }
+            chunk.data = newData;
+        }
+        chunk.capacity = newCapacity;
+    }
+}
+
+
+void ChunkedByteBuffer::createChunks(const Segment* segments, int numberOfSegments,
+                                     MemArray<Chunk>* newChunks, MemArray<long>* newLengths)
+{
+    long totalLength = 0;
+    for (int s = 0; s < numberOfSegments; ++s) {
+        totalLength += segments[s].length;
+    }
+    long numberOfChunks = util::roundedUpDiv(totalLength, (long) TARGET_CHUNK_SIZE);
+
+    int  s       = 0;
+    long sOffset = 0;
+
+    for (long k = 0; k < numberOfChunks; ++k)
+    {
+        long chunkLength = totalLength / numberOfChunks
+                         + ((k < totalLength % numberOfChunks) ? 1 : 0);
+        Chunk chunk;
+        chunk.data     = allocate(chunkLength);
+        chunk.capacity = chunkLength;
+        chunk.block    = NULL;
+
+        long filled = 0;
+        while (filled < chunkLength)
+        {
+            ASSERT(s < numberOfSegments);
+            long n = util::minimum(chunkLength - filled, segments[s].length - sOffset);
+            memcpy(chunk.data + filled, segments[s].data + sOffset, n);
+            filled  += n;
+            sOffset += n;
+            if (sOffset == segments[s].length) {
+                s      += 1;
+                sOffset = 0;
+            }
+        }
+        newChunks->append(chunk);
+        newLengths->append(chunkLength);
+    }
+}
+
+
+void ChunkedByteBuffer::replaceChunks(long i, long amount, const MemArray<Chunk>& newChunks,
+                                                           const MemArray<long>&  newLengths)
+{
+    ASSERT(newChunks.getLength() == newLengths.getLength());
+
+    chunks.removeAmount(i, amount);
+    chunks.insert(i, newChunks);
+    chunkLengths.replace(i, amount, newLengths.getPtr(0), newLengths.getLength());
+}
+
+
+void ChunkedByteBuffer::mergeSmallChunks(long i)
+{
+    for (long j = util::minimum(i, chunks.getLength() - 2); j >= 0 && j >= i - 1; --j)
+    {
+        long length1 = chunkLengths.get(j);
+        long length2 = chunkLengths.get(j + 1);
+
+        if (   (length1 < MIN_CHUNK_SIZE || length2 < MIN_CHUNK_SIZE)
+            && length1 + length2 <= MAX_CHUNK_SIZE)
+        {
+            makeChunkWritable(j, length1 + length2);
+            memcpy(chunks[j].data + length1, chunks[j + 1].data, length2);
+            freeChunk(chunks[j + 1]);
+            chunks.remove(j + 1);
+            chunkLengths.remove(j + 1);
+            chunkLengths.add(j, length2);
+        }
+    }
+}
+
+
+void ChunkedByteBuffer::insert(long pos, const byte* source, long amount)
+{
+    ASSERT(0 <= pos && pos <= getLength());
+
+    if (amount <= 0) {
+        return;
+    }
+    invalidateCache();
+
+    if (chunks.getLength() == 0)
+    {
+        MemArray<Chunk> newChunks;
+        MemArray<long>  newLengths;
+        Segment         segment = { source, amount };
+
+        createChunks(&segment, 1, &newChunks, &newLengths);
+        replaceChunks(0, 0, newChunks, newLengths);
+        return;
+    }
+
+    long i      = getChunkIndexForPos(pos);
+    long offset = pos - chunkLengths.getSumBefore(i);
+
+    if (   offset == 0 && i > 0
+        && chunks[i - 1].capacity > 0
+        && chunkLengths.get(i - 1) + amount <= MAX_CHUNK_SIZE)
+    {
+        // append to previous chunk instead of prepending to this one
+
+        i     -= 1;
+        offset = chunkLengths.get(i);
+    }
+    long length = chunkLengths.get(i);
+
+    if (length + amount <= MAX_CHUNK_SIZE)
+    {
+        makeChunkWritable(i, length + amount);
+
+        byte* data = chunks[i].data;
+        memmove(data + offset + amount, data + offset, length - offset);
+        memcpy (data + offset,          source,        amount);
+
+        chunkLengths.add(i, amount);
+    }
+    else
+    {
+        const byte* data = chunks[i].data;
+
+        Segment segments[3] = { { data,          offset          },
+                                { source,        amount          },
+                                { data + offset, length - offset } };
+        MemArray<Chunk> newChunks;
+        MemArray<long>  newLengths;
+
+        createChunks(segments, 3, &newChunks, &newLengths);
+        freeChunk(chunks[i]);
+        replaceChunks(i, 1, newChunks, newLengths);
+    }
+}
+
+
+void ChunkedByteBuffer::removeAmount(long pos, long amount)
+{
+    ASSERT(0 <= pos && 0 <= amount && pos + amount <= getLength());
+
+    if (amount <= 0) {
+        return;
+    }
+    invalidateCache();
+
+    long i1      = getChunkIndexForPos(pos);
+    long offset1 = pos - chunkLengths.getSumBefore(i1);
+    long length1 = chunkLengths.get(i1);
+
+    if (offset1 + amount <= length1)
+    {
+        Chunk& chunk = chunks[i1];
+
+        if (amount == length1)
+        {
+            freeChunk(chunk);
+            chunks.remove(i1);
+            chunkLengths.remove(i1);
+            i1 -= 1;
+        }
+        else if (chunk.capacity > 0)
+        {
+            memmove(chunk.data + offset1, chunk.data + offset1 + amount, length1 - (offset1 + amount));
+            chunkLengths.add(i1, -amount);
+        }
+        else if (offset1 == 0)
+        {
+            chunk.data += amount;
+            chunkLengths.add(i1, -amount);
+        }
+        else if (offset1 + amount == length1)
+        {
+            chunkLengths.add(i1, -amount);
+        }
+        else
+        {
+            // split read-only chunk without copying
+
+            MemArray<Chunk> newChunks(2);
+            MemArray<long>  newLengths(2);
+
+            newChunks[0].data     = chunk.data;
+            newChunks[0].capacity = 0;
+            newChunks[0].block    = chunk.block;
+            newLengths[0]         = offset1;
+            newChunks[1].data     = chunk.data + offset1 + amount;
+            newChunks[1].capacity = 0;
+            newChunks[1].block    = chunk.block;
+            newLengths[1]         = length1 - (offset1 + amount);
+
+            if (chunk.block != NULL) {
+                chunk.block->refCounter += 1;
+            }
+
+            replaceChunks(i1, 1, newChunks, newLengths);
+        }
+    }
+    else
+    {
+        long i2      = getChunkIndexForPos(pos + amount - 1);
+        long offset2 = pos + amount - chunkLengths.getSumBefore(i2);
+        long length2 = chunkLengths.get(i2);
+
+        MemArray<Chunk> newChunks;
+        MemArray<long>  newLengths;
+
+        if (offset1 > 0) {
+            newChunks .append(chunks[i1]);
+            newLengths.append(offset1);
+        } else {
+            freeChunk(chunks[i1]);
+        }
+        for (long i = i1 + 1; i < i2; ++i) {
+            freeChunk(chunks[i]);
+        }
+        if (offset2 < length2) {
+            Chunk chunk = chunks[i2];
+            if (chunk.capacity > 0) {
+                memmove(chunk.data, chunk.data + offset2, length2 - offset2);
+            } else {
+                chunk.data += offset2;
+            }
+            newChunks .append(chunk);
+            newLengths.append(length2 - offset2);
+        } else {
+            freeChunk(chunks[i2]);
+        }
+        replaceChunks(i1, i2 - i1 + 1, newChunks, newLengths);
+
+        if (offset1 == 0) {
+            i1 -= 1;
+        }
+    }
+    if (i1 >= 0) {
+        mergeSmallChunks(i1);
+    } else if (chunks.getLength() > 0) {
+        mergeSmallChunks(0);
+    }
+}
+
+
+void ChunkedByteBuffer::clear()
+{
+    invalidateCache();
+
+    for (long i = 0; i < chunks.getLength(); ++i) {
+        freeChunk(chunks[i]);
+    }
+    chunks.clear();
+    chunkLengths.clear();
+
+    sharedBuffer.invalidate();
+    mappedMemory.invalidate();
+
+    ByteBuffer emptyScratchBuffer;
+    scratchBuffer.takeOver(&emptyScratchBuffer);
+}
+
+
+void ChunkedByteBuffer::takeOver(RawPtr<ByteBuffer> buffer)
+{
+    clear();
+
+    sharedBuffer = SharedByteBuffer::create(buffer);
+
+    createSharedChunks(sharedBuffer->getPtr(), sharedBuffer->getLength());
+}
+
+
+void ChunkedByteBuffer::takeOver(MappedMemory::Ptr memory)
+{
+    clear();
+
+    mappedMemory = memory;
+
+    createSharedChunks(mappedMemory->getPtr(), mappedMemory->getLength());
+}
+
+
+void ChunkedByteBuffer::createSharedChunks(const byte* data, long length)
+{
+    MemArray<Chunk> newChunks;
+    MemArray<long>  newLengths;
+
+    for (long p = 0; p < length; p += TARGET_CHUNK_SIZE)
+    {
+        Chunk chunk;
+        chunk.data     = const_cast<byte*>(data + p); // never written, because capacity == 0
+        chunk.capacity = 0;
+        chunk.block    = NULL;
+        newChunks .append(chunk);
+        newLengths.append(util::minimum(length - p, (long) TARGET_CHUNK_SIZE));
+    }
+    replaceChunks(0, 0, newChunks, newLengths);
+}
+
+
+void ChunkedByteBuffer::releaseMappedMemory()
+{
+    if (mappedMemory.isValid())
+    {
+        invalidateCache();
+
+        const byte* begin = mappedMemory->getPtr();
+        const byte* end   = begin + mappedMemory->getLength();
+
+        for (long i = 0; i < chunks.getLength(); ++i)
+        {
+            if (chunks[i].capacity == 0 && begin <= chunks[i].data && chunks[i].data < end) {
+                makeChunkWritable(i, chunkLengths.get(i));
+            }
+        }
+        mappedMemory.invalidate();
+    }
+}
+
+
+TextSnapshot::Ptr ChunkedByteBuffer::createSnapshot()
+{
+    TextSnapshot::Ptr rslt = TextSnapshot::create();
+
+    long pos = 0;
+
+    for (long i = 0; i < chunks.getLength(); ++i)
+    {
+        Chunk& chunk  = chunks[i];
+        long   length = chunkLengths.getSumBefore(i + 1) - pos;
+
+        if (chunk.capacity > 0)
+        {
+            SharedBlock* block = new SharedBlock;
+            block->refCounter  = 1;
+            block->memory      = chunk.data;
+            block->capacity    = chunk.capacity;
+
+            chunk.capacity = 0;
+            chunk.block    = block;
+        }
+        if (chunk.block != NULL) {
+            chunk.block->refCounter += 1;
+            rslt->sharedBlocks.append(chunk.block);
+        }
+        rslt->appendSegment(chunk.data, length);
+        pos += length;
+    }
+    if (sharedBuffer.isValid()) {
+        rslt->sharedObjects.append(sharedBuffer);
+    }
+    if (mappedMemory.isValid()) {
+        rslt->sharedObjects.append(mappedMemory);
+    }
+    return rslt;
+}
@@ -0,0 +1,220 @@
+/////////////////////////////////////////////////////////////////////////////////////
+//
+//   LucED - The Lucid Editor
+//
+//   Copyright (C) 2005-2010 Oliver Schmidt, oliver at luced dot de
+//
+//   This program is free software; you can redistribute it and/or modify it
+//   under the terms of the GNU General Public License Version 2 as published
+//   by the Free Software Foundation in June 1991.
+//
+//   This program is distributed in the hope that it will be useful, but WITHOUT
+//   ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+//   FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+//   more details.
+//
+//   You should have received a copy of the GNU General Public License along with
+//   this program; if not, write to the Free Software Foundation, Inc.,
+//   51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+//
+/////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef CHUNKED_BYTE_BUFFER_HPP
+#define CHUNKED_BYTE_BUFFER_HPP
+
+#include "debug.hpp"
+#include "types.hpp"
+#include "NonCopyable.hpp"
+#include "RawPointable.hpp"
+#include "RawPtr.hpp"
+#include "MemArray.hpp"
+#include "ByteBuffer.hpp"
+#include "PrefixSumArray.hpp"
+#include "MappedMemory.hpp"
+#include "HeapObject.hpp"
+#include "OwningPtr.hpp"
+
+namespace LucED
+{
+
+class TextSnapshot;
+
+/**
+ * Byte buffer that is split into chunks of limited size.
+ *
+ * The chunk containing a position is found in O(log n), so that inserting
+ * and removing at arbitrary positions only moves the bytes of one chunk
+ * instead of the whole text as in a gap buffer.
+ *
+ * Chunks may also refer to read-only memory that was taken over as a whole
+ * (see takeOver()), e.g. to a memory mapped file. Such chunks are copied into
+ * own memory only when they are modified.
+ *
+ * The same is used for snapshots: createSnapshot() makes all chunks read-only
+ * and shares their memory with the snapshot.
+ */
+class ChunkedByteBuffer : public RawPointable,
+                          private NonCopyable
+{
+public:
+    ChunkedByteBuffer()
+        : cachedBegin(0),
+          cachedEnd(0),
+          cachedData(NULL)
+    {}
+
+    ~ChunkedByteBuffer();
+
+    long getLength() const {
+        return chunkLengths.getTotalSum();
+    }
+
+    byte operator[](long pos) const {
+        if (pos < cachedBegin || pos >= cachedEnd) {
+            cacheChunkForPos(pos);
+        }
+        return cachedData[pos - cachedBegin];
+    }
+
+    /**
+     * The returned pointer is valid until the next modification or
+     * until the next call of getAmount().
+     */
+    const byte* getAmount(long pos, long amount) const;
+
+    void insert(long pos, const byte* source, long amount);
+    void removeAmount(long pos, long amount);
+    void clear();
+
+    /**
+     * Takes over the content of the buffer without copying it.
+     */
+    void takeOver(RawPtr<ByteBuffer> buffer);
+
+    /**
+     * Takes over the mapped memory without copying it.
+     */
+    void takeOver(MappedMemory::Ptr memory);
+
+    bool hasMappedMemory() const {
+        return mappedMemory.isValid();
+    }
+
+    bool wasMappedFileTruncated() const {
+        return mappedMemory.isValid() && mappedMemory->wasTruncated();
+    }
+
+    /**
+     * Copies all chunks still referring to mapped memory into own memory
+     * and releases the mapping, e.g. before the mapped file is overwritten.
+     */
+    void releaseMappedMemory();
+
+    /**
+     * Returns the number of bytes that can be read contiguously
+     * at pos, but not more than maxAmount.
+     */
+    long getContiguousAmount(long pos, long maxAmount, const byte** rslt) const;
+
+    void copyTo(byte* dest, long pos, long amount) const;
+
+    long getNumberOfChunks() const {
+        return chunks.getLength();
+    }
+
+    /**
+     * Must be called in the main thread. The snapshot may be read
+     * by other threads, but it must be released in the main thread.
+     */
+    OwningPtr<TextSnapshot> createSnapshot();
+
+private:
+    friend class TextSnapshot;
+
+    /**
+     * Reference counted memory of a chunk that was made read-only
+     * by createSnapshot().
+     */
+    struct SharedBlock
+    {
+        long  refCounter;
+        byte* memory;
+        long  capacity;
+    };
+
+    class SharedByteBuffer : public HeapObject
+    {
+    public:
+        typedef OwningPtr<SharedByteBuffer> Ptr;
+
+        static Ptr create(RawPtr<ByteBuffer> buffer) {
+            return Ptr(new SharedByteBuffer(buffer));
+        }
+        const byte* getPtr() const {
+            return buffer.getTotalAmount();
+        }
+        long getLength() const {
+            return buffer.getLength();
+        }
+    private:
+        SharedByteBuffer(RawPtr<ByteBuffer> buffer) {
+            this->buffer.takeOver(buffer);
+        }
+        ByteBuffer buffer;
+    };
+
+    static void releaseBlock(SharedBlock* block);
+
+    enum
+    {
+        TARGET_CHUNK_SIZE =  32 * 1024,
+        MAX_CHUNK_SIZE    =  64 * 1024,
+        MIN_CHUNK_SIZE    =   4 * 1024
+    };
+
+    struct Chunk
+    {
+        byte*        data;
+        long         capacity; // 0 for chunks referring to shared read-only memory
+        SharedBlock* block;    // not NULL for chunks made read-only by createSnapshot()
+    };
+
+    struct Segment
+    {
+        const byte* data;
+        long        length;
+    };
+
+    void cacheChunkForPos(long pos) const;
+    void invalidateCache() {
+        cachedBegin = 0;
+        cachedEnd   = 0;
+        cachedData  = NULL;
+    }
+    long getChunkIndexForPos(long pos) const;
+
+    void makeChunkWritable(long i, long neededCapacity);
+    void createChunks(const Segment* segments, int numberOfSegments,
+                      MemArray<Chunk>* newChunks, MemArray<long>* newLengths);
+    void replaceChunks(long i, long amount, const MemArray<Chunk>& newChunks,
+                                            const MemArray<long>&  newLengths);
+    void mergeSmallChunks(long i);
+    void createSharedChunks(const byte* data, long length);
+
+    static byte* allocate(long size);
+    static void freeChunk(const Chunk& chunk);
+
+    MemArray<Chunk>    chunks;
+    PrefixSumArray     chunkLengths;
+    SharedByteBuffer::Ptr sharedBuffer;
+    MappedMemory::Ptr     mappedMemory;
+
+    mutable ByteBuffer  scratchBuffer;
+    mutable long        cachedBegin;
+    mutable long        cachedEnd;
+    mutable const byte* cachedData;
+};
+
+} // namespace LucED
+
+#endif // CHUNKED_BYTE_BUFFER_HPP
@@ -89,6 +89,30 @@ return
                     type    = "long",
                     default = 200000,
                 },
+                {   name    = "chunkedStorageMinLength",
+                    type    = "long",
+                    default = 4000000,
+                },
+                {   name    = "undoMemoryPerBuffer",
+                    type    = "long",
+                    default = 32000000,
+                },
+                {   name    = "undoMemoryTotal",
+                    type    = "long",
+                    default = 256000000,
+                },
+                {   name    = "mappedFileMinLength",
+                    type    = "long",
+                    default = 64000000,
+                },
+                {   name    = "progressiveLoadingMinLength",
+                    type    = "long",
+                    default = 8000000,
+                },
+                {   name    = "useAtomicSaving",
+                    type    = "bool",
+                    default = true,
+                },
                 {   name    = "buttonInnerSpacing",
                     type    = "int",
                     default = 2,
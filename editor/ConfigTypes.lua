@@ -22,11 +22,11 @@ local function nullableConverterMethod(typeName, methodName)
 end
 
 local function basicRegexConverter(luaVarName)
-    return "BasicRegex("..luaVarName..".toString())"
+    return "BasicRegex("..luaVarName..".toString(), BasicRegex::STUDY)"
 end
 local function nullableRegexConverter(luaVarName)
     return "("..luaVarName..".isNil() ? Nullable<BasicRegex>()"
-                                  .." : Nullable<BasicRegex>("..luaVarName..".toString()))"
+                                  .." : Nullable<BasicRegex>(BasicRegex("..luaVarName..".toString(), BasicRegex::STUDY)))"
 end
 
 local typeInfos =
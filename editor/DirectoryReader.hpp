@@ -69,20 +69,24 @@ public:
         }
     }
     bool isFile() {
-        if (dirent == NULL) {
-            return false;
-        } else {
-            if (!wasStat) {
-                String fileName = String() << path << "/" << dirent->d_name;
-                if (stat(fileName.toCString(), &statInfo) == -1) {
-                    throw FileException(errno, String() << "error accessing file '" << fileName << "': " << strerror(errno));
-                }
-                wasStat = true;
+        return dirent != NULL && S_ISREG(getStatInfo().st_mode);
+    }
+    bool isDirectory() {
+        return dirent != NULL && S_ISDIR(getStatInfo().st_mode);
+    }
+
+private:
+    const struct stat& getStatInfo() {
+        if (!wasStat) {
+            String fileName = String() << path << "/" << dirent->d_name;
+            if (stat(fileName.toCString(), &statInfo) == -1) {
+                throw FileException(errno, String() << "error accessing file '" << fileName << "': " << strerror(errno));
             }
-            return S_ISREG(statInfo.st_mode);
+            wasStat = true;
         }
+        return statInfo;
     }
-private:
+
     String path;
     DIR* dir;
     struct dirent* dirent;
@@ -0,0 +1,276 @@
+/////////////////////////////////////////////////////////////////////////////////////
+//
+//   LucED - The Lucid Editor
+//
+//   Copyright (C) 2005-2010 Oliver Schmidt, oliver at luced dot de
+//
+//   This program is free software; you can redistribute it and/or modify it
+//   under the terms of the GNU General Public License Version 2 as published
+//   by the Free Software Foundation in June 1991.
+//
+//   This program is distributed in the hope that it will be useful, but WITHOUT
+//   ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+//   FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+//   more details.
+//
+//   You should have received a copy of the GNU General Public License along with
+//   this program; if not, write to the Free Software Foundation, Inc.,
+//   51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+//
+/////////////////////////////////////////////////////////////////////////////////////
+
+#include <stdio.h>
+
+#include "EditingHistory.hpp"
+#include "ByteCompressor.hpp"
+#include "GlobalConfig.hpp"
+#include "SystemException.hpp"
+#include "util.hpp"
+
+using namespace LucED;
+
+namespace // anonymous namespace
+{
+
+const long SEGMENT_LENGTH = 1024 * 1024;
+
+long totalMemoryUsage  = 0;
+long totalSpilledLength = 0;
+
+/**
+ * Anonymous temporary file for compressed segments. The file
+ * is only appended to and truncated when no segment is left in it.
+ */
+class SpillFile
+{
+public:
+    /**
+     * Returns the file position or -1 if the data could not be written.
+     */
+    static long write(const byte* data, long length)
+    {
+        if (file == NULL) {
+            file = tmpfile();
+            if (file == NULL) {
+                return -1;
+            }
+        }
+        long pos = fileLength;
+        
+        if (   fseek(file, pos, SEEK_SET) != 0
+            || fwrite(data, 1, length, file) != (size_t) length
+            || fflush(file) != 0)
+        {
+            return -1;
+        }
+        fileLength += length;
+        usedLength += length;
+        return pos;
+    }
+    
+    static void read(long pos, byte* data, long length)
+    {
+        if (   fseek(file, pos, SEEK_SET) != 0
+            || fread(data, 1, length, file) != (size_t) length)
+        {
+            throw SystemException("error reading undo history from temporary file");
+        }
+    }
+    
+    static void release(long length)
+    {
+        usedLength -= length;
+        
+        if (usedLength == 0) {
+            fclose(file);
+            file       = NULL;
+            fileLength = 0;
+        }
+    }
+
+private:
+    static FILE* file;
+    static long  fileLength;
+    static long  usedLength;
+};
+
+FILE* SpillFile::file       = NULL;
+long  SpillFile::fileLength = 0;
+long  SpillFile::usedLength = 0;
+
+} // anonymous namespace
+
+
+EditingHistory::~EditingHistory()
+{
+    releaseSegments();
+    addToTotalMemoryUsage(-accountedMemoryUsage);
+}
+
+
+long EditingHistory::getTotalMemoryUsage()
+{
+    return totalMemoryUsage;
+}
+
+
+long EditingHistory::getTotalSpilledLength()
+{
+    return totalSpilledLength;
+}
+
+
+void EditingHistory::addToTotalMemoryUsage(long delta)
+{
+    totalMemoryUsage += delta;
+}
+
+
+void EditingHistory::limitMemoryUsage()
+{
+    ConfigData::GeneralConfig::Ptr config = GlobalConfig::getConfigData()->getGeneralConfig();
+    
+    long maxUndoLength = config->getUndoMemoryPerBuffer();
+    long undoLength    = historyDataIndex - segmentsLength;
+    
+    if (maxUndoLength > 0 && undoLength > maxUndoLength)
+    {
+        // compress down to half of the limit, so that historyData 
+        // does not have to be moved for every new action
+
+        compressOldData(undoLength - maxUndoLength / 2);
+    }
+    updateMemoryUsage();
+
+    long maxTotalMemory = config->getUndoMemoryTotal();
+
+    if (maxTotalMemory > 0 && totalMemoryUsage > maxTotalMemory) {
+        spillSegments(maxTotalMemory);
+    }
+}
+
+
+void EditingHistory::compressOldData(long amount)
+{
+    ASSERT(amount <= historyDataIndex - segmentsLength);
+    
+    for (long pos = 0; pos < amount; )
+    {
+        long         length  = util::minimum(SEGMENT_LENGTH, amount - pos);
+        Segment::Ptr segment = Segment::create(length);
+        
+        ByteCompressor::compress(historyData.getAmount(pos, length), length, &segment->compressedData);
+        
+        compressedLength += segment->compressedData.getLength();
+        segments.append(segment);
+        pos += length;
+    }
+    // copy the rest, so that the memory is really freed
+
+    long            restLength = historyData.getLength() - amount;
+    MemBuffer<byte> rest;
+    rest.append(historyData.getAmount(amount, restLength), restLength);
+    historyData.takeOver(&rest);
+
+    segmentsLength += amount;
+}
+
+
+void EditingHistory::restoreSegmentsBehind(long pos)
+{
+    if (pos >= segmentsLength) {
+        return;
+    }
+    // restore at least as much as is already uncompressed, so that
+    // undoing many actions does not move historyData for every segment
+
+    long targetLength = util::minimum(pos, segmentsLength - historyData.getLength());
+    long i            = segments.getLength();
+    long length       = 0;
+    
+    while (segmentsLength - length > targetLength && i > 0) {
+        --i;
+        length += segments[i]->length;
+    }
+    ByteBuffer restoredData;
+    ByteBuffer compressedData;
+    
+    for (long j = i; j < segments.getLength(); ++j)
+    {
+        Segment::Ptr segment = segments[j];
+        
+        if (segment->filePos >= 0)
+        {
+            compressedData.clear();
+            SpillFile::read(segment->filePos, 
+                            compressedData.appendAmount(segment->spilledLength), 
+                            segment->spilledLength);
+            SpillFile::release(segment->spilledLength);
+            spilledLength      -= segment->spilledLength;
+            totalSpilledLength -= segment->spilledLength;
+            segment->filePos    = -1;
+
+            ByteCompressor::decompress(compressedData.getPtr(0), compressedData.getLength(), &restoredData);
+        }
+        else
+        {
+            compressedLength -= segment->compressedData.getLength();
+            
+            ByteCompressor::decompress(segment->compressedData.getAmount(0, segment->compressedData.getLength()), 
+                                       segment->compressedData.getLength(), &restoredData);
+        }
+    }
+    if (restoredData.getLength() != length) {
+        throw SystemException("undo history data is corrupt");
+    }
+    segments.removeAmount(i, segments.getLength() - i);
+    
+    memcpy(historyData.insertAmount(0, length), restoredData.getPtr(0), length);
+    segmentsLength -= length;
+
+    updateMemoryUsage();
+}
+
+
+void EditingHistory::spillSegments(long maxTotalMemory)
+{
+    for (long i = 0; i < segments.getLength() && totalMemoryUsage > maxTotalMemory; ++i)
+    {
+        Segment::Ptr segment = segments[i];
+        
+        if (segment->filePos < 0)
+        {
+            long length = segment->compressedData.getLength();
+            long pos    = SpillFile::write(segment->compressedData.getAmount(0, length), length);
+
+            if (pos < 0) {
+                break;
+            }
+            segment->filePos       = pos;
+            segment->spilledLength = length;
+            
+            ByteBuffer emptyBuffer;
+            segment->compressedData.takeOver(&emptyBuffer);
+
+            compressedLength   -= length;
+            spilledLength      += length;
+            totalSpilledLength += length;
+            updateMemoryUsage();
+        }
+    }
+}
+
+
+void EditingHistory::releaseSegments()
+{
+    for (long i = 0; i < segments.getLength(); ++i) {
+        if (segments[i]->filePos >= 0) {
+            SpillFile::release(segments[i]->spilledLength);
+        }
+    }
+    segments.clear();
+    totalSpilledLength -= spilledLength;
+    segmentsLength      = 0;
+    compressedLength    = 0;
+    spilledLength       = 0;
+}
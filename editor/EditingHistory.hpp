@@ -27,12 +27,26 @@
 #include "HeapObject.hpp"
 #include "OwningPtr.hpp"
 #include "MemBuffer.hpp"
+#include "ByteBuffer.hpp"
+#include "ObjectArray.hpp"
 #include "Flags.hpp"
 
 
 namespace LucED
 {
 
+/**
+ * Undo and redo history of a TextData object.
+ *
+ * The removed bytes of delete and replace actions are kept in historyData
+ * in the order of the actions, followed by the inserted bytes of undone
+ * insert and replace actions. The
+ * oldest part of historyData is moved into compressed segments when the
+ * undo data of one history exceeds the configured limit, and compressed
+ * segments are spilled into an anonymous temporary file when all
+ * histories together exceed their limit. Segments are restored when
+ * undo reaches them.
+ */
 class EditingHistory : public HeapObject
 {
 public:
@@ -57,7 +71,8 @@ public:
         ACTION_NONE,
         ACTION_INSERT,
         ACTION_DELETE,
-        ACTION_SELECT
+        ACTION_SELECT,
+        ACTION_REPLACE
     };
     
     enum ActionFlag {
@@ -77,6 +92,7 @@ public:
         ActionType  type;
         long        textDataPos;
         long        length;
+        long        oldLength;    // only for ACTION_REPLACE
         ActionFlags flags;
     };
     
@@ -94,7 +110,7 @@ public:
             actions.removeTail(nextActionIndex);
             actions[nextActionIndex - 1].length += length;
 
-            historyData.removeTail(historyDataIndex);
+            removeRedoData();
         }
         else
         {
@@ -106,8 +122,9 @@ public:
             actions[nextActionIndex].flags.clear();
             nextActionIndex += 1;
 
-            historyData.removeTail(historyDataIndex);
+            removeRedoData();
         }
+        limitMemoryUsage();
     }
     
     void rememberDeleteAction(long beginIndex, long length, const byte* data)
@@ -118,7 +135,7 @@ public:
          && getPreviousActionTextPos() <= beginIndex + length)
         {
             actions.removeTail(nextActionIndex);
-            historyData.removeTail(historyDataIndex);
+            removeRedoData();
             
             long lengthBefore = getPreviousActionTextPos() - beginIndex;
             long lengthAfter = beginIndex + length - getPreviousActionTextPos();
@@ -128,7 +145,10 @@ public:
 
             if (lengthBefore > 0)
             {
-                memcpy(historyData.insertAmount(historyDataIndex - getPreviousActionLength(),
+                long insertPos = historyDataIndex - getPreviousActionLength();
+                restoreSegmentsBehind(insertPos);
+                
+                memcpy(historyData.insertAmount(insertPos - segmentsLength,
                                                 lengthBefore),
                        data,
                        lengthBefore);
@@ -139,7 +159,7 @@ public:
             }
             if (lengthAfter > 0)
             {
-                memcpy(historyData.insertAmount(historyDataIndex,
+                memcpy(historyData.insertAmount(historyDataIndex - segmentsLength,
                                                 lengthAfter),
                        data + lengthBefore,
                        lengthAfter);
@@ -158,13 +178,38 @@ public:
             actions[nextActionIndex].flags.clear();
             nextActionIndex += 1;
 
-            historyData.removeTail(historyDataIndex);
-            historyData.appendAmount(length);
-            memcpy(historyData.getAmount(historyDataIndex, length),
+            removeRedoData();
+            memcpy(historyData.appendAmount(length),
                    data,
                    length);
             historyDataIndex += length;
         }
+        limitMemoryUsage();
+    }
+    
+    /**
+     * Remembers a bulk modification as one action: the oldLength bytes
+     * at beginIndex, given by oldData, were replaced by length bytes.
+     */
+    void rememberReplaceAction(long beginIndex, long oldLength, long length, const byte* oldData)
+    {
+        actions.removeTail(nextActionIndex);
+        actions.appendAmount(1);
+        actions[nextActionIndex].type        = ACTION_REPLACE;
+        actions[nextActionIndex].textDataPos = beginIndex;
+        actions[nextActionIndex].length      = length;
+        actions[nextActionIndex].oldLength   = oldLength;
+        actions[nextActionIndex].flags.clear();
+        actions[nextActionIndex].flags.set(FLAG_MERGE_STOP);
+        nextActionIndex += 1;
+
+        removeRedoData();
+        memcpy(historyData.appendAmount(oldLength),
+               oldData,
+               oldLength);
+        historyDataIndex += oldLength;
+
+        limitMemoryUsage();
     }
     
     void rememberSelectAction(long beginIndex, long length)
@@ -177,7 +222,8 @@ public:
         actions[nextActionIndex].flags.clear();
         nextActionIndex += 1;
     
-        historyData.removeTail(historyDataIndex);
+        removeRedoData();
+        limitMemoryUsage();
     }
     
     void setSectionMarkOnHistoryTop() {
@@ -231,6 +277,14 @@ public:
         savedActionIndex = nextActionIndex - 1;
     }
     
+    long getPreviousActionIndex() const {
+        return nextActionIndex - 1;
+    }
+    
+    void setSavedActionIndex(long actionIndex) {
+        savedActionIndex = actionIndex;
+    }
+    
     ActionType getPreviousActionType() const
     {
         if (nextActionIndex == 0) {
@@ -252,6 +306,12 @@ public:
         return actions[nextActionIndex - 1].length;
     }
     
+    long getPreviousActionOldLength() const
+    {
+        ASSERT(getPreviousActionType() == ACTION_REPLACE);
+        return actions[nextActionIndex - 1].oldLength;
+    }
+    
     bool isLastAction() const
     {
         return nextActionIndex == actions.getLength();
@@ -286,16 +346,23 @@ public:
         return actions[nextActionIndex].length;
     }
     
+    long getNextActionOldLength() const
+    {
+        ASSERT(getNextActionType() == ACTION_REPLACE);
+        return actions[nextActionIndex].oldLength;
+    }
+    
     void undoInsertAction(const byte* insertedText)
     {
         ASSERT(getPreviousActionType() == ACTION_INSERT);
         long length = getPreviousActionLength();
         
-        memcpy(historyData.insertAmount(historyDataIndex, length),
+        memcpy(historyData.insertAmount(historyDataIndex - segmentsLength, length),
                insertedText,
                length);
                 
         nextActionIndex -= 1;
+        updateMemoryUsage();
     }
 
     const byte* getContentForRedoInsertAction() const
@@ -304,7 +371,7 @@ public:
 
         long length = getNextActionLength();
 
-        return historyData.getAmount(historyDataIndex, length);
+        return historyData.getAmount(historyDataIndex - segmentsLength, length);
     }
 
     void redoInsertAction()
@@ -312,17 +379,20 @@ public:
         ASSERT(getNextActionType() == ACTION_INSERT);
         long length = getNextActionLength();
 
-        historyData.removeAmount(historyDataIndex, length);
+        historyData.removeAmount(historyDataIndex - segmentsLength, length);
         nextActionIndex += 1;
+        updateMemoryUsage();
     }
 
-    const byte* getContentForUndoDeleteAction() const
+    const byte* getContentForUndoDeleteAction()
     {
         ASSERT(getPreviousActionType() == ACTION_DELETE);
 
         long length = getPreviousActionLength();
 
-        return historyData.getAmount(historyDataIndex - length, length);
+        restoreSegmentsBehind(historyDataIndex - length);
+
+        return historyData.getAmount(historyDataIndex - length - segmentsLength, length);
     }
     
     void undoDeleteAction()
@@ -330,9 +400,12 @@ public:
         ASSERT(getPreviousActionType() == ACTION_DELETE);
         long length = getPreviousActionLength();
         
-        historyData.removeAmount(historyDataIndex - length, length);
+        restoreSegmentsBehind(historyDataIndex - length);
+
+        historyData.removeAmount(historyDataIndex - length - segmentsLength, length);
         historyDataIndex -= length;
         nextActionIndex -= 1;
+        updateMemoryUsage();
     }
     
     void redoDeleteAction(const byte* deletedText, long length)
@@ -340,12 +413,67 @@ public:
         ASSERT(getNextActionType() == ACTION_DELETE);
         ASSERT(length == getNextActionLength());
         
-        memcpy(historyData.insertAmount(historyDataIndex, length),
+        memcpy(historyData.insertAmount(historyDataIndex - segmentsLength, length),
                deletedText,
                length);
         
         historyDataIndex += length;
         nextActionIndex += 1;
+        updateMemoryUsage();
+    }
+    
+    const byte* getContentForUndoReplaceAction()
+    {
+        ASSERT(getPreviousActionType() == ACTION_REPLACE);
+
+        long oldLength = getPreviousActionOldLength();
+
+        restoreSegmentsBehind(historyDataIndex - oldLength);
+
+        return historyData.getAmount(historyDataIndex - oldLength - segmentsLength, oldLength);
+    }
+    
+    void undoReplaceAction(const byte* replacingText)
+    {
+        ASSERT(getPreviousActionType() == ACTION_REPLACE);
+        long length    = getPreviousActionLength();
+        long oldLength = getPreviousActionOldLength();
+        
+        restoreSegmentsBehind(historyDataIndex - oldLength);
+
+        historyData.removeAmount(historyDataIndex - oldLength - segmentsLength, oldLength);
+        historyDataIndex -= oldLength;
+
+        memcpy(historyData.insertAmount(historyDataIndex - segmentsLength, length),
+               replacingText,
+               length);
+        nextActionIndex -= 1;
+        updateMemoryUsage();
+    }
+    
+    const byte* getContentForRedoReplaceAction() const
+    {
+        ASSERT(getNextActionType() == ACTION_REPLACE);
+
+        long length = getNextActionLength();
+
+        return historyData.getAmount(historyDataIndex - segmentsLength, length);
+    }
+
+    void redoReplaceAction(const byte* replacedText)
+    {
+        ASSERT(getNextActionType() == ACTION_REPLACE);
+        long length    = getNextActionLength();
+        long oldLength = getNextActionOldLength();
+
+        historyData.removeAmount(historyDataIndex - segmentsLength, length);
+
+        memcpy(historyData.insertAmount(historyDataIndex - segmentsLength, oldLength),
+               replacedText,
+               oldLength);
+        historyDataIndex += oldLength;
+        nextActionIndex += 1;
+        updateMemoryUsage();
     }
     
     void undoSelectAction()
@@ -367,6 +495,8 @@ public:
         savedActionIndex = -1;
         actions.clear();
         historyData.clear();
+        releaseSegments();
+        updateMemoryUsage();
     }
     
     SectionHolder::Ptr getSectionHolder() {
@@ -376,20 +506,96 @@ public:
         return sectionHolder;
     }
 
+    /**
+     * Bytes in memory: actions, uncompressed and compressed data.
+     */
+    long getMemoryUsage() const {
+        return accountedMemoryUsage;
+    }
+    
+    /**
+     * Compressed bytes in the temporary file.
+     */
+    long getSpilledLength() const {
+        return spilledLength;
+    }
+    
+    static long getTotalMemoryUsage();
+    static long getTotalSpilledLength();
+    
+    ~EditingHistory();
+
 private:
+    class Segment : public HeapObject
+    {
+    public:
+        typedef OwningPtr<Segment> Ptr;
+        
+        static Ptr create(long length) {
+            return Ptr(new Segment(length));
+        }
+        
+        const long      length;          // uncompressed
+        ByteBuffer      compressedData;  // empty if spilled
+        long            spilledLength;
+        long            filePos;         // -1 if not spilled
+
+    private:
+        Segment(long length)
+            : length(length),
+              spilledLength(0),
+              filePos(-1)
+        {}
+    };
 
     EditingHistory()
         : nextActionIndex(0),
           historyDataIndex(0),
-          savedActionIndex(-1)
+          savedActionIndex(-1),
+          segmentsLength(0),
+          compressedLength(0),
+          spilledLength(0),
+          accountedMemoryUsage(0)
     {}
+
+    void removeRedoData() {
+        historyData.removeTail(historyDataIndex - segmentsLength);
+    }
+
+
+    void updateMemoryUsage() {
+        long usage = actions.getLength() * sizeof(Action) 
+                   + historyData.getLength()
+                   + compressedLength;
+
+        addToTotalMemoryUsage(usage - accountedMemoryUsage);
+        accountedMemoryUsage = usage;
+    }
+    
+    void limitMemoryUsage();
+    void compressOldData(long amount);
+    void spillSegments(long maxTotalMemory);
+    void releaseSegments();
+
+    /**
+     * Restores compressed segments, so that historyData contains pos.
+     */
+    void restoreSegmentsBehind(long pos);
+
+    static void addToTotalMemoryUsage(long delta);
     
     MemBuffer<Action> actions;
-    MemBuffer<byte>   historyData;
+    MemBuffer<byte>   historyData;    // historyData[0] is at position segmentsLength
     long              nextActionIndex;
     long              historyDataIndex;
     long              savedActionIndex;
     SectionHolder::Ptr sectionHolder;
+
+    ObjectArray< OwningPtr<Segment> > segments;
+    long                              segmentsLength;   // uncompressed
+    long                              compressedLength; // compressed in memory
+    long                              spilledLength;
+    long                              accountedMemoryUsage;
 };
 
 } // namespace LucED
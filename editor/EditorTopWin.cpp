@@ -50,6 +50,8 @@
 #include "GlobalLuaInterpreter.hpp"
 #include "QualifiedName.hpp"
 #include "EncodingConverter.hpp"
+#include "FileSaver.hpp"
+#include "FileWatcher.hpp"
 #include "LuaErrorHandler.hpp"
 #include "UserDefinedActionMethods.hpp"
 
@@ -149,7 +151,7 @@ public:
                 editorTopWin->invokeSaveAsPanel(newCallback(this, &ActionInterface::handleSaveKey));
             }
             else {
-                editorTopWin->save();
+                editorTopWin->saveInBackground();
             }
         } catch (...) {
             editorTopWin->handleCatchedException();
@@ -188,6 +190,11 @@ public:
         newWin->show();
     }
     
+    virtual void toggleFollowMode()
+    {
+        editorTopWin->setFollowMode(!editorTopWin->isFollowMode());
+    }
+    
 private:
     ActionInterface(RawPtr<EditorTopWin> editorTopWin)
         : editorTopWin(editorTopWin)
@@ -240,6 +247,10 @@ EditorTopWin::EditorTopWin(HilitedText::Ptr hilitedText, int width, int height)
       hasInvokedPanelFocus(false),
       hasMessageBox(false),
       isMessageBoxModal(false),
+      followModeFlag(false),
+      isFollowTimerPending(false),
+      isFileWatched(false),
+      hasFileChangeBeenNotified(false),
       actionMethodContainer(ActionMethodContainer::create()),
       actionKeySequenceHandler(actionMethodContainer)
 {
@@ -271,6 +282,7 @@ EditorTopWin::EditorTopWin(HilitedText::Ptr hilitedText, int width, int height)
     textData->registerReadOnlyListener          (newCallback(this,       &EditorTopWin::handleChangedReadOnlyFlag));
     textData->registerFileNameListener          (newCallback(this,       &EditorTopWin::handleNewFileName));
     textData->registerLengthListener            (newCallback(statusLine, &StatusLine  ::setFileLength));
+    textData->registerLoadingProgressListener   (newCallback(this,       &EditorTopWin::handleLoadingProgress));
 
     textEditor->registerCursorPositionDataListener(newCallback(statusLine, &StatusLine::setCursorPositionData));
     
@@ -339,11 +351,16 @@ void EditorTopWin::treatConfigUpdate()
         newLanguageMode = GlobalConfig::getInstance()->getDefaultLanguageMode();
     }
     else {
+        // the beginning of the text is enough for detecting mode and encoding
+
+        long detectionLength = util::minimum(textData->getLength(), (long) LanguageModeSelectors::DETECTION_LENGTH);
+
         GlobalConfig::LanguageModeAndEncoding result = GlobalConfig::getInstance()
                                                        ->getLanguageModeAndEncodingForFileNameAndContent
                                                          (
                                                              textData->getFileName(), 
-                                                             textData->getByteBuffer()
+                                                             textData->getAmount(0, detectionLength),
+                                                             detectionLength
                                                          );
         if (result.encoding.getLength() > 0) {
             textData->setEncoding(result.encoding);
@@ -562,7 +579,10 @@ void EditorTopWin::treatFocusIn()
         } else {
             textEditor->treatFocusIn();
         }
-        checkForFileModifications();
+        if (!isFileWatched || hasFileChangeBeenNotified) {
+            hasFileChangeBeenNotified = false;
+            checkForFileModifications();
+        }
     }
     LucedLuaInterface::getInstance()->setCurrentView(getViewLuaInterface());
 }
@@ -571,6 +591,11 @@ bool EditorTopWin::checkForFileModifications()
 {
     try
     {
+        textData->checkMappedFile();
+
+        if (followModeFlag) {
+            followFile();
+        }
         textData->checkFileInfo();
     
         if (   textData->wasFileModifiedOnDisk() 
@@ -613,6 +638,78 @@ void EditorTopWin::doNotReloadFile()
     textData->setIgnoreModifiedOnDiskFlag(true);
 }
 
+void EditorTopWin::setFollowMode(bool followMode)
+{
+    if (followMode != followModeFlag)
+    {
+        followModeFlag = followMode;
+        
+        if (followModeFlag) {
+            statusLine->setMessage("Following file");
+            if (isFileWatched) {
+                try {
+                    followFile();
+                }
+                catch (...) {
+                    handleCatchedException();
+                }
+            }
+            else if (!isFollowTimerPending) {
+                handleFollowTimer();
+            }
+        } else {
+            statusLine->clearMessage();
+        }
+        setWindowTitle();
+    }
+}
+
+/**
+ * Appended bytes are inserted at the end of the text. If the cursor was 
+ * at the end, it stays there. A file that was changed in another way,
+ * e.g. a rotated log file, is reloaded if the text is unmodified.
+ */
+void EditorTopWin::followFile()
+{
+    bool wasCursorAtEnd = (textEditor->getCursorTextPosition() == textData->getLength());
+
+    if (textData->appendFileGrowth())
+    {
+        if (wasCursorAtEnd && textEditor->getCursorTextPosition() != textData->getLength()) {
+            textEditor->moveCursorToTextPosition(textData->getLength());
+            textEditor->assureCursorVisible();
+        }
+    }
+    else
+    {
+        textData->checkFileInfo();
+
+        if (textData->wasFileModifiedOnDisk() && !textData->getModifiedFlag()) {
+            textData->reloadFile();
+        }
+    }
+}
+
+void EditorTopWin::handleFollowTimer()
+{
+    isFollowTimerPending = false;
+
+    if (followModeFlag && !isFileWatched)
+    {
+        try {
+            followFile();
+        }
+        catch (...) {
+            setFollowMode(false);
+            handleCatchedException();
+            return;
+        }
+        EventDispatcher::getInstance()->registerTimerCallback(Seconds(0), MicroSeconds(FOLLOW_INTERVAL_MICROSECS),
+                                                              newCallback(this, &EditorTopWin::handleFollowTimer));
+        isFollowTimerPending = true;
+    }
+}
+
 void EditorTopWin::treatFocusOut()
 {
     if (actionKeySequenceHandler.isWithinSequence())
@@ -769,8 +866,16 @@ void EditorTopWin::setWindowTitle()
     
     title << EncodingConverter::convertLocaleToUtf8StringIgnoreErrors(file.getBaseName());
 
-    if (textData->getModifiedFlag() == true
-     && textData->isReadOnly())
+    if (textData->isLoading())
+    {
+        title << " (loading)";
+    }
+    else if (followModeFlag)
+    {
+        title << " (following)";
+    }
+    else if (textData->getModifiedFlag() == true
+          && textData->isReadOnly())
     {
         title << " (read only, modified)";
     } else if (textData->isReadOnly()) {
@@ -790,6 +895,45 @@ void EditorTopWin::setWindowTitle()
 void EditorTopWin::handleNewFileName(const String& fileName)
 {
     setWindowTitle();
+    watchFile();
+}
+
+void EditorTopWin::watchFile()
+{
+    RawPtr<FileWatcher> fileWatcher = FileWatcher::getInstance();
+
+    fileWatcher->removeWatchesFor(this);
+
+    isFileWatched = !textData->isFileNamePseudo()
+                 && fileWatcher->watchFile(textData->getFileName(),
+                                           newCallback(this, &EditorTopWin::handleFileChangedOnDisk));
+
+    if (!isFileWatched && followModeFlag && !isFollowTimerPending) {
+        handleFollowTimer();
+    }
+}
+
+/**
+ * Windows without focus check their file at the next focus in.
+ */
+void EditorTopWin::handleFileChangedOnDisk(const String& fileName)
+{
+    if (followModeFlag)
+    {
+        try {
+            followFile();
+        }
+        catch (...) {
+            setFollowMode(false);
+            handleCatchedException();
+        }
+    }
+    else if (hasFocus()) {
+        checkForFileModifications();
+    }
+    else {
+        hasFileChangeBeenNotified = true;
+    }
 }
 
 void EditorTopWin::handleChangedReadOnlyFlag(bool readOnlyFlag)
@@ -802,26 +946,76 @@ void EditorTopWin::handleChangedModifiedFlag(bool modifiedFlag)
     setWindowTitle();
 }
 
-void EditorTopWin::save()
+void EditorTopWin::handleLoadingProgress(int percentage)
 {
-    {
-        GlobalConfig::LanguageModeAndEncoding result = GlobalConfig::getInstance()
-                                                       ->getLanguageModeAndEncodingForFileNameAndContent
-                                                         (
-                                                             textData->getFileName(), 
-                                                             textData->getByteBuffer()
-                                                         );
-        if (result.encoding.getLength() > 0 && EncodingConverter::canConvertFromTo("UTF-8", result.encoding)) {
-            textData->setEncoding(result.encoding);
-        }
-        if (result.languageMode != textEditor->getHilitedText()->getLanguageMode()) {
-            textEditor->getHilitedText()->setLanguageMode(result.languageMode);
-        }
+    if (percentage >= 0) {
+        statusLine->setMessage(String() << "Loading file... " << percentage << "%");
+    } else {
+        statusLine->clearMessage();
     }
+    setWindowTitle();
+}
+
+void EditorTopWin::handleLoadingError(const String& errorMessage)
+{
+    setMessageBox(MessageBoxParameter().setTitle("Error loading file")
+                                       .setMessage(String() << errorMessage
+                                                            << "\n\nThe text is incomplete and will not be saved over the file."));
+}
+
+void EditorTopWin::prepareSaving()
+{
+    // the beginning of the text is enough for detecting mode and encoding
+
+    long detectionLength = util::minimum(textData->getLength(), (long) LanguageModeSelectors::DETECTION_LENGTH);
+
+    GlobalConfig::LanguageModeAndEncoding result = GlobalConfig::getInstance()
+                                                   ->getLanguageModeAndEncodingForFileNameAndContent
+                                                     (
+                                                         textData->getFileName(), 
+                                                         textData->getAmount(0, detectionLength),
+                                                         detectionLength
+                                                     );
+    if (result.encoding.getLength() > 0 && EncodingConverter::canConvertFromTo("UTF-8", result.encoding)) {
+        textData->setEncoding(result.encoding);
+    }
+    if (result.languageMode != textEditor->getHilitedText()->getLanguageMode()) {
+        textEditor->getHilitedText()->setLanguageMode(result.languageMode);
+    }
+}
+
+void EditorTopWin::save()
+{
+    prepareSaving();
     textData->save();
     GlobalConfig::getInstance()->notifyAboutNewFileContent(textData->getFileName());
 }
 
+void EditorTopWin::saveInBackground()
+{
+    prepareSaving();
+    statusLine->setMessage("Saving file...");
+    try {
+        FileSaver::start(textEditor->getTextData(), newCallback(this, &EditorTopWin::handleSavingFinished));
+    } catch (...) {
+        statusLine->clearMessage();
+        throw;
+    }
+}
+
+void EditorTopWin::handleSavingFinished(const FileSaver::Result& result)
+{
+    statusLine->clearMessage();
+    try {
+        if (result.hasError()) {
+            result.throwError();
+        }
+        GlobalConfig::getInstance()->notifyAboutNewFileContent(textData->getFileName());
+    } catch (...) {
+        handleCatchedException();
+    }
+}
+
 
 void EditorTopWin::saveAndClose()
 {
@@ -42,6 +42,7 @@
 #include "FocusableElement.hpp"
 #include "ActionMethodContainer.hpp"
 #include "ViewLuaInterface.hpp"
+#include "FileSaver.hpp"
                 
 namespace LucED
 {
@@ -92,6 +93,12 @@ public:
     void closeMessageBox();
 
     void setMessageBox(const MessageBoxParameter& p);
+
+    /**
+     * Shows an error that occurred while the file was loaded
+     * in the background, see FileLoader.
+     */
+    void handleLoadingError(const String& errorMessage);
     
     bool hasUnsavedData() const {
         return textData->getModifiedFlag();
@@ -100,6 +107,23 @@ public:
     void requestCloseWindowAndDiscardChanges();
     void save();
     void saveAndClose();
+
+    /**
+     * Saves a snapshot of the text while editing continues.
+     */
+    void saveInBackground();
+
+    /**
+     * In follow mode bytes appended to the file are appended to the text,
+     * e.g. for watching log files. The file is checked whenever the
+     * FileWatcher reports a change, or periodically if the file cannot
+     * be watched.
+     */
+    void setFollowMode(bool followMode);
+
+    bool isFollowMode() const {
+        return followModeFlag;
+    }
     
     bool checkForFileModifications();
     
@@ -127,6 +151,8 @@ private:
     class ActionInterface;
     class ShellInvocationHandler;
     
+    enum { FOLLOW_INTERVAL_MICROSECS = 500 * 1000 };
+
     EditorTopWin(HilitedText::Ptr hilitedText, int width, int height);
 
     void treatConfigUpdate();
@@ -136,12 +162,20 @@ private:
     void invokePanel(DialogPanel::Ptr panel);
     
     void handleNewFileName(const String& fileName);
+    void handleFileChangedOnDisk(const String& fileName);
     void handleChangedModifiedFlag(bool modifiedFlag);
     void handleChangedReadOnlyFlag(bool readOnlyFlag);
+    void handleLoadingProgress(int percentage);
+    void handleSavingFinished(const FileSaver::Result& result);
     void handleBeforeMouseClick();
         
+    void prepareSaving();
+
     void reloadFile();
     void doNotReloadFile();
+    void watchFile();
+    void followFile();
+    void handleFollowTimer();
     
     void setWindowTitle();
     
@@ -170,6 +204,11 @@ private:
     
     SaveAsPanel::Ptr    saveAsPanel;
     
+    bool                followModeFlag;
+    bool                isFollowTimerPending;
+    bool                isFileWatched;
+    bool                hasFileChangeBeenNotified;
+    
     ScrollableTextGuiCompound::Ptr scrollableTextCompound;
     
     KeyModifier             combinationKeyModifier;
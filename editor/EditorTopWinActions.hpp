@@ -139,6 +139,11 @@ public:
         topWinActionInterface->createEmptyWindow();
     }
     
+    void toggleFollowMode()
+    {
+        topWinActionInterface->toggleFollowMode();
+    }
+    
     void requestProgramTermination()
     {
         WindowCloser::start();
@@ -34,6 +34,8 @@
 #include "EncodingException.hpp"
 #include "ByteArray.hpp"
 #include "System.hpp"
+#include "TextStorage.hpp"
+#include "TextSnapshot.hpp"
 
 using namespace LucED;
 
@@ -48,6 +50,24 @@ namespace // anonymous namespace
         UNKNOWN_ERROR
     };
 
+    bool isIncompleteUtf8Sequence(const char* p, const char* endPtr)
+    {
+        if ((*p & 0xC0) != 0xC0) {
+            return false;
+        }
+        const char* sequenceEnd = p + 1 + CharUtil::getNumberOfStrictUtf8FollowerChars(*p);
+        
+        if (sequenceEnd <= endPtr) {
+            return false;
+        }
+        for (++p; p < endPtr; ++p) {
+            if ((*p & 0xC0) != 0x80) {
+                return false;
+            }
+        }
+        return true;
+    }
+
 } // anonymous namespace
 
 class EncodingConverter::LowLevelConverter : public NonCopyable
@@ -71,6 +91,10 @@ public:
           toCodeset(toCodeset),
     #if LUCED_USE_ICONV
           iconvHandle((iconv_t)(-1)),
+          asciiUnitLength(0),
+          isBigEndian(false),
+          isByteOrderUnknown(false),
+          isByteOrderFromMark(false),
     #endif
           convertDirection(CANNOT_CONVERT)
     {
@@ -85,46 +109,13 @@ public:
     #if LUCED_USE_ICONV
         if (convertDirection == CONVERT_WITH_ICONV)
         {
-            size_t rslt;
-      
-        #if ICONV_USES_CONST_POINTER
-            rslt = iconv(iconvHandle, inbuf,  inbytesleft,
-                                     outbuf, outbytesleft);
-        #else
-            rslt = iconv(iconvHandle, (char**)inbuf,  inbytesleft,
-                                             outbuf, outbytesleft);
-        #endif
-      
-            if (rslt == (size_t)(-1)) {
-                if (errno == E2BIG) {
-                    // The output buffer has no more room for the next converted character. 
-                    // In this case it sets errno to E2BIG and returns (size_t)(-1).
-                    return OUTPUT_BUFFER_TOO_SMALL;
-                }
-                else if (errno == EINVAL || errno == EILSEQ) {
-                    // An incomplete multibyte sequence is encountered in the input, and the 
-                    // input byte sequence terminates after it. In this case it sets errno 
-                    // to EINVAL and returns (size_t)(-1). *inbuf is left pointing to the 
-                    // beginning of the incomplete multibyte sequence.
-                    //
-                    // An invalid multibyte sequence is encountered in the input. In this 
-                    // case it sets errno to EILSEQ and returns (size_t)(-1). *inbuf is 
-                    // left pointing to the beginning of the invalid multibyte sequence.
-                    return INVALID_SEQUENCE;
-                }
-                else {
-                    // should not happen
-                    return UNKNOWN_ERROR;
-                }
+            if (isByteOrderUnknown) {
+                detectByteOrder(*inbuf, *inbytesleft);
+            }
+            if (asciiUnitLength > 0) {
+                return convertWithAsciiFastPath(inbuf, inbytesleft, outbuf, outbytesleft);
             } else {
-                // The input byte sequence has been entirely converted, i.e. *inbytesleft has 
-                // gone down to 0. In this case iconv returns the number of non-reversible 
-                // conversions performed during this call.
-                if (rslt == 0) {
-                    return CONVERSION_OK;
-                } else {
-                    return NON_REVERSIBLE_CONVERSIONS_OCCURRED;
-                }
+                return convertWithIconv(inbuf, inbytesleft, outbuf, outbytesleft);
             }
         }
         else
@@ -151,7 +142,7 @@ public:
                             if (rslt == CONVERSION_OK) { rslt = OUTPUT_BUFFER_TOO_SMALL; }
                             goto End;
                         }
-                        while (p < endP && CharUtil::isAsciiChar(*p)) { ++p; }
+                        p += CharUtil::getAsciiPrefixLength((const byte*) p, endP - p);
             
                         size_t amount = p - inPtr;
             
@@ -162,13 +153,13 @@ public:
                         
                         while (inPtr < inEndPtr && !CharUtil::isAsciiChar(*inPtr))
                         {
-                            // ignore this, because we always get the full input:
-                            //    
-                            // int number = CharUtil::getNumberOfStrictUtf8FollowerChars(*inPtr);
-                            // if (inPtr + number < inEndPtr) {
-                            //     rslt = INVALID_SEQUENCE;
-                            //     goto End;
-                            // }
+                            if (isIncompleteUtf8Sequence(inPtr, inEndPtr))
+                            {
+                                // like iconv: the input may be continued by the next call
+
+                                if (rslt == CONVERSION_OK) { rslt = INVALID_SEQUENCE; }
+                                goto End;
+                            }
                             Adapter adapter((const byte*)inPtr, inEndPtr - inPtr);
                             long    pos = 0;
                             int c = Utf8Parser<Adapter>(&adapter).getWCharAndIncrementPos(&pos);
@@ -207,7 +198,7 @@ public:
                             if (rslt == CONVERSION_OK) { rslt = OUTPUT_BUFFER_TOO_SMALL; }
                             goto End;
                         }
-                        while (p < endP && CharUtil::isAsciiChar(*p)) { ++p; }
+                        p += CharUtil::getAsciiPrefixLength((const byte*) p, endP - p);
             
                         size_t amount = p - inPtr;
             
@@ -256,6 +247,246 @@ public:
         }
     }
     
+#if LUCED_USE_ICONV
+
+    LowLevelResult convertWithIconv(const char**  inbuf, size_t*  inbytesleft,
+                                          char** outbuf, size_t* outbytesleft)
+    {
+        size_t rslt;
+  
+    #if ICONV_USES_CONST_POINTER
+        rslt = iconv(iconvHandle, inbuf,  inbytesleft,
+                                 outbuf, outbytesleft);
+    #else
+        rslt = iconv(iconvHandle, (char**)inbuf,  inbytesleft,
+                                         outbuf, outbytesleft);
+    #endif
+  
+        if (rslt == (size_t)(-1)) {
+            if (errno == E2BIG) {
+                // The output buffer has no more room for the next converted character. 
+                // In this case it sets errno to E2BIG and returns (size_t)(-1).
+                return OUTPUT_BUFFER_TOO_SMALL;
+            }
+            else if (errno == EINVAL || errno == EILSEQ) {
+                // An incomplete multibyte sequence is encountered in the input, and the 
+                // input byte sequence terminates after it. In this case it sets errno 
+                // to EINVAL and returns (size_t)(-1). *inbuf is left pointing to the 
+                // beginning of the incomplete multibyte sequence.
+                //
+                // An invalid multibyte sequence is encountered in the input. In this 
+                // case it sets errno to EILSEQ and returns (size_t)(-1). *inbuf is 
+                // left pointing to the beginning of the invalid multibyte sequence.
+                return INVALID_SEQUENCE;
+            }
+            else {
+                // should not happen
+                return UNKNOWN_ERROR;
+            }
+        } else {
+            // The input byte sequence has been entirely converted, i.e. *inbytesleft has 
+            // gone down to 0. In this case iconv returns the number of non-reversible 
+            // conversions performed during this call.
+            if (rslt == 0) {
+                return CONVERSION_OK;
+            } else {
+                return NON_REVERSIBLE_CONVERSIONS_OCCURRED;
+            }
+        }
+    }
+
+    /**
+     * Runs of ASCII characters are copied without iconv, only the bytes 
+     * between these runs are converted by iconv.
+     */
+    LowLevelResult convertWithAsciiFastPath(const char**  inbuf, size_t*  inbytesleft,
+                                                  char** outbuf, size_t* outbytesleft)
+    {
+        LowLevelResult rslt = CONVERSION_OK;
+
+        const char* inPtr  = *inbuf;
+        char*       outPtr = *outbuf;
+
+        const char* const  inEndPtr =  *inbuf +  *inbytesleft;
+        const char* const outEndPtr = *outbuf + *outbytesleft;
+
+        while (inPtr < inEndPtr)
+        {
+            long runLength  = getAsciiRunLength(inPtr, inEndPtr);
+            long copyLength = util::minimum(runLength, (long)(outEndPtr - outPtr));
+
+            copyAsciiRun(inPtr, copyLength, outPtr);
+
+            inPtr  += copyLength * asciiUnitLength;
+            outPtr += copyLength;
+
+            if (copyLength < runLength) {
+                if (rslt == CONVERSION_OK) { rslt = OUTPUT_BUFFER_TOO_SMALL; }
+                break;
+            }
+            if (inPtr == inEndPtr) {
+                break;
+            }
+            const char* spanEndPtr = findNextAsciiRun(inPtr + asciiUnitLength, inEndPtr);
+            
+            for (;;)
+            {
+                size_t inLeft  = spanEndPtr - inPtr;
+                size_t outLeft = outEndPtr  - outPtr;
+
+                LowLevelResult spanRslt = convertWithIconv(&inPtr, &inLeft, &outPtr, &outLeft);
+
+                if (spanRslt == INVALID_SEQUENCE && errno == EINVAL && spanEndPtr < inEndPtr)
+                {
+                    // the run was not ASCII, but the end of a multibyte character
+
+                    spanEndPtr = util::minimum(spanEndPtr + asciiUnitLength, inEndPtr);
+                }
+                else if (spanRslt == NON_REVERSIBLE_CONVERSIONS_OCCURRED) {
+                    rslt = spanRslt;
+                    break;
+                }
+                else if (spanRslt != CONVERSION_OK) {
+                    rslt = spanRslt;
+                    goto End;
+                }
+                else {
+                    break;
+                }
+            }
+        }
+    End:
+        *inbuf        = inPtr;
+        *outbuf       = outPtr;
+        *inbytesleft  = inEndPtr - inPtr;
+        *outbytesleft = outEndPtr - outPtr;
+
+        return rslt;
+    }
+
+    bool isAsciiUnit(const char* p) const
+    {
+        if (asciiUnitLength == 1) {
+            return CharUtil::isAsciiChar(p[0]);
+        } else if (isBigEndian) {
+            return p[0] == 0 && CharUtil::isAsciiChar(p[1]);
+        } else {
+            return p[1] == 0 && CharUtil::isAsciiChar(p[0]);
+        }
+    }
+
+    /**
+     * Returns the number of ASCII characters at p.
+     */
+    long getAsciiRunLength(const char* p, const char* endPtr) const
+    {
+        if (asciiUnitLength == 1) {
+            return CharUtil::getAsciiPrefixLength((const byte*) p, endPtr - p);
+        }
+        const char* p0 = p;
+        while (endPtr - p >= 2 && isAsciiUnit(p)) {
+            p += 2;
+        }
+        return (p - p0) / 2;
+    }
+
+    void copyAsciiRun(const char* from, long numberOfChars, char* to) const
+    {
+        if (asciiUnitLength == 1) {
+            memcpy(to, from, numberOfChars);
+        } else {
+            const int offset = isBigEndian ? 1 : 0;
+            for (long i = 0; i < numberOfChars; ++i) {
+                to[i] = from[2 * i + offset];
+            }
+        }
+    }
+
+    /**
+     * Short runs are converted by iconv, because the call overhead
+     * would outweigh the gain.
+     */
+    const char* findNextAsciiRun(const char* p, const char* endPtr) const
+    {
+        const char* runBegin  = p;
+        long        runLength = 0;
+
+        while (endPtr - p >= asciiUnitLength)
+        {
+            if (isAsciiUnit(p)) {
+                if (++runLength >= MIN_ASCII_RUN_LENGTH) {
+                    return runBegin;
+                }
+            } else {
+                runLength = 0;
+                runBegin  = p + asciiUnitLength;
+            }
+            p += asciiUnitLength;
+        }
+        return endPtr;
+    }
+
+    void detectByteOrder(const char* inbuf, size_t inbytesleft)
+    {
+        // iconv itself takes the byte order from the byte order mark
+
+        isByteOrderUnknown = false;
+
+        if (inbytesleft >= 2 && (byte) inbuf[0] == 0xFF && (byte) inbuf[1] == 0xFE) {
+            asciiUnitLength     = 2;
+            isBigEndian         = false;
+            isByteOrderFromMark = true;
+        }
+        else if (inbytesleft >= 2 && (byte) inbuf[0] == 0xFE && (byte) inbuf[1] == 0xFF) {
+            asciiUnitLength     = 2;
+            isBigEndian         = true;
+            isByteOrderFromMark = true;
+        }
+    }
+
+    /**
+     * True, if iconv maps all ASCII characters onto themselves. This is
+     * not the case for stateful encodings like ISO-2022-JP, where escape
+     * sequences or shift characters change the meaning of the following
+     * ASCII bytes.
+     */
+    bool isAsciiMappedOntoItself()
+    {
+        char allAsciiChars[128];
+        
+        for (int i = 0; i < 128; ++i) {
+            allAsciiChars[i] = (char) i;
+        }
+        return    isMappedOntoItself(allAsciiChars, sizeof(allAsciiChars))
+               && isMappedOntoItself("\x1b$B0!\x1b(B",    8)  // ISO-2022-JP
+               && isMappedOntoItself("\x1b$)C\x0e0!\x0f", 8)  // ISO-2022-KR
+               && isMappedOntoItself("\x1b$)A\x0e0!\x0f", 8); // ISO-2022-CN
+    }
+    
+    bool isMappedOntoItself(const char* input, long length)
+    {
+        char output[4 * 128];
+        
+        ASSERT(length <= 128);
+        
+        const char* inPtr   = input;
+        size_t      inLeft  = length;
+        char*       outPtr  = output;
+        size_t      outLeft = sizeof(output);
+        
+        LowLevelResult rslt = convertWithIconv(&inPtr, &inLeft, &outPtr, &outLeft);
+        
+        bool isIdentity =    rslt == CONVERSION_OK 
+                          && outPtr - output == length
+                          && memcmp(input, output, length) == 0;
+
+        iconv(iconvHandle, NULL, NULL, NULL, NULL);
+
+        return isIdentity;
+    }
+
+#endif // LUCED_USE_ICONV
+
     bool isValid() const {
         return (convertDirection != CANNOT_CONVERT);
     }
@@ -281,6 +512,12 @@ public:
             
             if (iconvHandle == (iconv_t)(-1)) { convertDirection = CANNOT_CONVERT; }
             else                              { convertDirection = CONVERT_WITH_ICONV; }
+
+            if (isByteOrderFromMark) {
+                // the new iconv handle does not know the byte order mark
+                asciiUnitLength     = 0;
+                isByteOrderFromMark = false;
+            }
         }
     #endif
     }
@@ -329,15 +566,39 @@ private:
 
             if (iconvHandle == (iconv_t)(-1)) { convertDirection = CANNOT_CONVERT; }
             else                              { convertDirection = CONVERT_WITH_ICONV; }
+            
+            if (convertDirection == CONVERT_WITH_ICONV)
+            {
+                if (to == "utf8" && (from == "utf16le" || from == "ucs2le")) {
+                    asciiUnitLength = 2;
+                    isBigEndian     = false;
+                }
+                else if (to == "utf8" && (from == "utf16be" || from == "ucs2be")) {
+                    asciiUnitLength = 2;
+                    isBigEndian     = true;
+                }
+                else if (to == "utf8" && from == "utf16") {
+                    isByteOrderUnknown = true;
+                }
+                else if (isAsciiMappedOntoItself()) {
+                    asciiUnitLength = 1;
+                }
+            }
         #else
             convertDirection = CANNOT_CONVERT;
         #endif    
         }
     }
+    enum { MIN_ASCII_RUN_LENGTH = 16 };
+
     String           fromCodeset;
     String           toCodeset;
 #if LUCED_USE_ICONV
     iconv_t          iconvHandle;
+    int              asciiUnitLength; // 0: no ASCII fast path, 1: bytes, 2: UTF-16 units
+    bool             isBigEndian;
+    bool             isByteOrderUnknown;
+    bool             isByteOrderFromMark;
 #endif
     ConvertDirection convertDirection;
 };
@@ -494,11 +755,71 @@ void EncodingConverter::convertInPlace(RawPtr<ByteBuffer> buffer)
 void EncodingConverter::convertToFile(const ByteBuffer&  buffer, 
                                       const File&        file)
 {
-    bool hasErrors       = false;
-    bool hasInvalidBytes = false;
+    long length = buffer.getLength();
+    convertToFile(buffer.getAmount(0, length), length, file);
+}
+
+
+namespace // anonymous namespace
+{
+    enum 
+    {
+        MAX_OUT_BUFFER_LENGTH = 1000000,
+        STITCH_LENGTH         = 16,
+        MAX_SEQUENCE_LENGTH   = 8
+    };
+
+    class ContiguousSource : public RawPointable
+    {
+    public:
+        ContiguousSource(const byte* data)
+            : data(data)
+        {}
+        long getContiguousAmount(long pos, long maxAmount, const byte** rslt) const {
+            *rslt = data + pos;
+            return maxAmount;
+        }
+        void copyTo(byte* dest, long pos, long amount) const {
+            memcpy(dest, data + pos, amount);
+        }
+    private:
+        const byte* data;
+    };
+
+} // anonymous namespace
 
+
+void EncodingConverter::convertToFile(const byte*  data,
+                                      long         length,
+                                      const File&  file)
+{
     File::Writer::Ptr fileWriter = file.openForWriting();
+
+    ContiguousSource source(data);
     
+    convertSegmentsToWriter<ContiguousSource>(&source, length, fileWriter);
+}
+
+
+void EncodingConverter::convertToWriter(const TextStorage& text, File::Writer::Ptr writer)
+{
+    convertSegmentsToWriter<TextStorage>(&text, text.getLength(), writer);
+}
+
+
+void EncodingConverter::convertToWriter(const TextSnapshot& text, File::Writer::Ptr writer)
+{
+    convertSegmentsToWriter<TextSnapshot>(&text, text.getLength(), writer);
+}
+
+
+template<class Source
+        > void EncodingConverter::convertSegmentsToWriter(RawPtr<const Source> source, long length, 
+                                                          File::Writer::Ptr fileWriter)
+{
+    bool hasErrors       = false;
+    bool hasInvalidBytes = false;
+
     LowLevelConverter lowLevelConverter(fromCodeset, toCodeset);
     
     if (!lowLevelConverter.isValid())
@@ -508,91 +829,270 @@ void EncodingConverter::convertToFile(const ByteBuffer&  buffer,
                                        << ": " << strerror(errno));
     }
     
-    long fromLength = buffer.getLength();
-
-    const char*   fromPtr0      = (char*) buffer.getAmount(0, fromLength);
-    const char*   fromPtr1      = fromPtr0;
-    size_t        fromBytesLeft = fromLength;
-    
     ByteArray outBuffer;
+    byte      stitchBuffer[STITCH_LENGTH];
 
-    long nextOutBufferSize = 1000000;
+    long nextOutBufferSize = MAX_OUT_BUFFER_LENGTH;
     
-    if (2 * fromLength < nextOutBufferSize) {
-        nextOutBufferSize = 2 * fromLength;
+    if (2 * length < nextOutBufferSize) {
+        nextOutBufferSize = 2 * length;
     }
-    while (fromBytesLeft > 0)
+    long pos = 0;
+    
+    while (pos < length)
     {
-        const long outBufferSize = nextOutBufferSize;
+        const byte* window;
+        long        windowLength = source->getContiguousAmount(pos, length - pos, &window);
         
-        outBuffer.increaseTo(outBufferSize);
+        if (windowLength < STITCH_LENGTH && pos + windowLength < length)
+        {
+            // a multibyte sequence may continue in the next segment
 
-        char*   toPtr0        = (char*)    outBuffer.getPtr(0);
-        char*   toPtr1        = toPtr0;
-        size_t  outBytesLeft  = outBufferSize;
+            windowLength = util::minimum((long) STITCH_LENGTH, length - pos);
+            source->copyTo(stitchBuffer, pos, windowLength);
+            window = stitchBuffer;
+        }
+        const bool isLastWindow = (pos + windowLength == length);
+
+        const char*   fromPtr0      = (const char*) window;
+        const char*   fromPtr1      = fromPtr0;
+        size_t        fromBytesLeft = windowLength;
         
-        LowLevelResult rslt = lowLevelConverter.convert(&fromPtr1, &fromBytesLeft,
-                                                        &toPtr1,   &outBytesLeft);
-        if (rslt == OUTPUT_BUFFER_TOO_SMALL)
+        while (fromBytesLeft > 0)
         {
-            if (outBytesLeft > 0) {
-                nextOutBufferSize += outBytesLeft;
+            const long outBufferSize = nextOutBufferSize;
+            
+            outBuffer.increaseTo(outBufferSize);
+    
+            char*   toPtr0        = (char*)    outBuffer.getPtr(0);
+            char*   toPtr1        = toPtr0;
+            size_t  outBytesLeft  = outBufferSize;
+            
+            LowLevelResult rslt = lowLevelConverter.convert(&fromPtr1, &fromBytesLeft,
+                                                            &toPtr1,   &outBytesLeft);
+            if (rslt == OUTPUT_BUFFER_TOO_SMALL)
+            {
+                if (outBytesLeft > 0) {
+                    nextOutBufferSize += outBytesLeft;
+                }
             }
-        }
-        else if (rslt == INVALID_SEQUENCE)
-        {
-            if (outBytesLeft > 0 && fromBytesLeft > 0)
+            else if (rslt == INVALID_SEQUENCE && !isLastWindow && fromBytesLeft < MAX_SEQUENCE_LENGTH)
             {
-                *(toPtr1++) = *(fromPtr1++);
-                --outBytesLeft;
-                --fromBytesLeft;
-                hasErrors       = true;
-                hasInvalidBytes = true;
-                lowLevelConverter.reset();
+                // incomplete sequence at the end of the segment, 
+                // it is converted with the next window
+                
+                fileWriter->write(toPtr0, toPtr1 - toPtr0);
+                break;
             }
-            else {
+            else if (rslt == INVALID_SEQUENCE)
+            {
+                if (outBytesLeft > 0 && fromBytesLeft > 0)
+                {
+                    *(toPtr1++) = *(fromPtr1++);
+                    --outBytesLeft;
+                    --fromBytesLeft;
+                    hasErrors       = true;
+                    hasInvalidBytes = true;
+                    lowLevelConverter.reset();
+                }
+                else {
+                    // should not happen
+                    fileWriter->write(toPtr0, toPtr1 - toPtr0);
+                    fileWriter->write(fromPtr1, fromBytesLeft);
+                    throw SystemException(String() << "Error converting from codeset " << fromCodeset
+                                                   << " to codeset " << toCodeset
+                                                   << ": invalid byte sequence at position " 
+                                                   << (long)(pos + (fromPtr1 - fromPtr0)));
+                }
+            }
+            else if (rslt == NON_REVERSIBLE_CONVERSIONS_OCCURRED)
+            {
+                hasErrors = true;
+            }
+            else if (rslt != CONVERSION_OK) 
+            {
                 // should not happen
                 fileWriter->write(toPtr0, toPtr1 - toPtr0);
                 fileWriter->write(fromPtr1, fromBytesLeft);
                 throw SystemException(String() << "Error converting from codeset " << fromCodeset
                                                << " to codeset " << toCodeset
-                                               << ": invalid byte sequence at position " 
-                                               << (long)(fromPtr1 - fromPtr0));
+                                               << " at position " << (long)(pos + (fromPtr1 - fromPtr0))
+                                               << ": " << strerror(errno));
             }
-        }
-        else if (rslt == NON_REVERSIBLE_CONVERSIONS_OCCURRED)
-        {
-            hasErrors = true;
-        }
-        else if (rslt != CONVERSION_OK) 
-        {
-            // should not happen
             fileWriter->write(toPtr0, toPtr1 - toPtr0);
-            fileWriter->write(fromPtr1, fromBytesLeft);
-            throw SystemException(String() << "Error converting from codeset " << fromCodeset
-                                           << " to codeset " << toCodeset
-                                           << " at position " << (long)(fromPtr1 - fromPtr0)
-                                           << ": " << strerror(errno));
         }
-        fileWriter->write(toPtr0, toPtr1 - toPtr0);
+        pos += fromPtr1 - fromPtr0;
     }
     if (hasErrors) {
         if (hasInvalidBytes) {
             throw EncodingException(String() << "Error converting from codeset " << fromCodeset
                                              << " to codeset " << toCodeset
-                                             << " while writing to file '" << file.getAbsoluteName()
+                                             << " while writing to file '" << fileWriter->getFileName()
                                              << "': non-convertible bytes occurred.");
         
         } else {
             throw EncodingException(String() << "Error converting from codeset " << fromCodeset
                                              << " to codeset " << toCodeset
-                                             << " while writing to file '" << file.getAbsoluteName()
+                                             << " while writing to file '" << fileWriter->getFileName()
                                              << "': non-reversible conversions performed.");
         }
     }
 }
 
 
+class EncodingConverter::StreamImpl : public EncodingConverter::Stream
+{
+public:
+    static Stream::Ptr create(const String& fromCodeset, const String& toCodeset) {
+        return Stream::Ptr(new StreamImpl(fromCodeset, toCodeset));
+    }
+
+    virtual void convert(const byte* data, long length, RawPtr<ByteBuffer> output)
+    {
+        long pos = 0;
+        
+        while (pendingLength > 0 && pos < length)
+        {
+            // complete the sequence from the last piece with the beginning of this piece
+            
+            long n = util::minimum(length - pos, (long) STITCH_LENGTH - pendingLength);
+            memcpy(pendingBytes + pendingLength, data + pos, n);
+            
+            long stitchLength = pendingLength + n;
+            long processed    = convertPiece(pendingBytes, stitchLength, false, output);
+            
+            if (processed >= pendingLength) {
+                pos          += processed - pendingLength;
+                pendingLength = 0;
+            } else {
+                memmove(pendingBytes, pendingBytes + processed, stitchLength - processed);
+                pendingLength = stitchLength - processed;
+                pos          += n;
+            }
+        }
+        if (pos < length)
+        {
+            pos += convertPiece(data + pos, length - pos, false, output);
+            
+            pendingLength = length - pos;
+            memcpy(pendingBytes, data + pos, pendingLength);
+        }
+    }
+
+    virtual void finish(RawPtr<ByteBuffer> output)
+    {
+        if (pendingLength > 0) {
+            convertPiece(pendingBytes, pendingLength, true, output);
+            pendingLength = 0;
+        }
+        if (hasErrors) {
+            if (hasInvalidBytes) {
+                throw EncodingException(String() << "Error converting from codeset " << fromCodeset
+                                                 << " to codeset " << toCodeset
+                                                 << ": non-convertible bytes occurred.");
+            } else {
+                throw EncodingException(String() << "Error converting from codeset " << fromCodeset
+                                                 << " to codeset " << toCodeset
+                                                 << ": non-reversible conversions performed.");
+            }
+        }
+    }
+
+private:
+    StreamImpl(const String& fromCodeset, const String& toCodeset)
+        : fromCodeset(fromCodeset),
+          toCodeset(toCodeset),
+          lowLevelConverter(fromCodeset, toCodeset),
+          pendingLength(0),
+          nextOutBufferSize(MAX_OUT_BUFFER_LENGTH),
+          hasErrors(false),
+          hasInvalidBytes(false)
+    {
+        if (!lowLevelConverter.isValid())
+        {
+            throw SystemException(String() << "Cannot convert from codeset " << fromCodeset
+                                           << " to codeset " << toCodeset
+                                           << ": " << strerror(errno));
+        }
+    }
+
+    /**
+     * Returns the number of processed bytes. If isLastPiece is false, an 
+     * incomplete sequence at the end is not processed.
+     */
+    long convertPiece(const byte* data, long length, bool isLastPiece, RawPtr<ByteBuffer> output)
+    {
+        const char* fromPtr0      = (const char*) data;
+        const char* fromPtr1      = fromPtr0;
+        size_t      fromBytesLeft = length;
+        
+        while (fromBytesLeft > 0)
+        {
+            const long outBufferSize = nextOutBufferSize;
+            const long outPos        = output->getLength();
+            
+            char*  toPtr0       = (char*) output->appendAmount(outBufferSize);
+            char*  toPtr1       = toPtr0;
+            size_t outBytesLeft = outBufferSize;
+            
+            LowLevelResult rslt = lowLevelConverter.convert(&fromPtr1, &fromBytesLeft,
+                                                            &toPtr1,   &outBytesLeft);
+            output->removeTail(outPos + (toPtr1 - toPtr0));
+            
+            if (rslt == OUTPUT_BUFFER_TOO_SMALL)
+            {
+                if (outBytesLeft > 0) {
+                    nextOutBufferSize += outBytesLeft;
+                }
+            }
+            else if (rslt == INVALID_SEQUENCE && !isLastPiece && fromBytesLeft < MAX_SEQUENCE_LENGTH)
+            {
+                // may be completed by the next piece
+                break;
+            }
+            else if (rslt == INVALID_SEQUENCE)
+            {
+                if (fromBytesLeft > 0)
+                {
+                    output->append((byte) *(fromPtr1++));
+                    --fromBytesLeft;
+                    hasErrors       = true;
+                    hasInvalidBytes = true;
+                    lowLevelConverter.reset();
+                }
+            }
+            else if (rslt == NON_REVERSIBLE_CONVERSIONS_OCCURRED)
+            {
+                hasErrors = true;
+            }
+            else if (rslt != CONVERSION_OK) 
+            {
+                // should not happen
+                throw SystemException(String() << "Error converting from codeset " << fromCodeset
+                                               << " to codeset " << toCodeset
+                                               << ": " << strerror(errno));
+            }
+        }
+        return fromPtr1 - fromPtr0;
+    }
+
+    String            fromCodeset;
+    String            toCodeset;
+    LowLevelConverter lowLevelConverter;
+    byte              pendingBytes[STITCH_LENGTH];
+    long              pendingLength;
+    long              nextOutBufferSize;
+    bool              hasErrors;
+    bool              hasInvalidBytes;
+};
+
+
+EncodingConverter::Stream::Ptr EncodingConverter::createStream() const
+{
+    return StreamImpl::create(fromCodeset, toCodeset);
+}
+
+
 String EncodingConverter::convertStringToString(const String& fromString)
 {
     ByteBuffer buffer;
@@ -32,10 +32,15 @@
 #include "ByteBuffer.hpp"
 #include "RawPtr.hpp"
 #include "File.hpp"
+#include "HeapObject.hpp"
+#include "OwningPtr.hpp"
 
 namespace LucED
 {
 
+class TextStorage;
+class TextSnapshot;
+
 class EncodingConverter
 {
 public:
@@ -123,13 +128,54 @@ public:
     
     void convertInPlace(RawPtr<ByteBuffer> buffer);
     void convertToFile (const ByteBuffer&  buffer, const File& file);
+    void convertToFile (const byte* data, long length, const File& file);
+
+    /**
+     * Converts the text segment by segment, only a few bytes around
+     * segment borders are copied. The writer is not committed.
+     */
+    void convertToWriter(const TextStorage&  text, File::Writer::Ptr writer);
+    void convertToWriter(const TextSnapshot& text, File::Writer::Ptr writer);
 
     String convertStringToString(const String& fromString);
     
+    /**
+     * Converts a text that is given piece by piece, e.g. while it is being
+     * read from a file, so that the whole text never has to be buffered.
+     * Multibyte sequences may be split between the pieces.
+     */
+    class Stream : public HeapObject
+    {
+    public:
+        typedef OwningPtr<Stream> Ptr;
+        
+        /**
+         * Appends the converted bytes to output. Bytes of an incomplete
+         * multibyte sequence at the end are kept for the next piece.
+         */
+        virtual void convert(const byte* data, long length, RawPtr<ByteBuffer> output) = 0;
+        
+        /**
+         * Converts the bytes that were kept from the last piece. Throws an
+         * EncodingException if bytes could not be converted, the output
+         * is complete nevertheless.
+         */
+        virtual void finish(RawPtr<ByteBuffer> output) = 0;
+
+    protected:
+        Stream()
+        {}
+    };
+    
+    Stream::Ptr createStream() const;
     
 private:
+    class StreamImpl;
     class LowLevelConverter;
     
+    template<class Source
+            > void convertSegmentsToWriter(RawPtr<const Source> source, long length, File::Writer::Ptr writer);
+    
     class Adapter : public RawPointable
     {
     public:
@@ -136,10 +136,8 @@ EventDispatcher::EventDispatcher()
       lastX11EventTime(CurrentTime),
       mutex(Mutex::create())
 {
-    
-    x11FileDescriptor = ConnectionNumber(GuiRoot::getInstance()->getDisplay());
-
-    System::setCloseOnExecFlag(x11FileDescriptor);
+    // The X11 connection is not needed before the event loop runs, so
+    // texts can be processed without display, e.g. by the benchmarks.
 
     if (!hasSignalHandlers)
     {
@@ -189,6 +187,11 @@ EventDispatcher::EventDispatcher()
             sigdelset(&enabledSignalBlockMask, SIGTSTP); // Terminal stop signal.
             sigdelset(&enabledSignalBlockMask, SIGCONT); // Continue executing, if stopped.
             
+            // a blocked SIGBUS kills the process without invoking the 
+            // handler of MappedMemory for truncated files
+            
+            sigdelset(&enabledSignalBlockMask,  SIGBUS);
+            sigdelset(&disabledSignalBlockMask, SIGBUS);
         }
         hasSignalHandlers = true;
     }
@@ -401,6 +404,7 @@ void EventDispatcher::doEventLoop()
     XEvent             event;
     TimePeriod         remainingTime;
     Display*           display = GuiRoot::getInstance()->getDisplay();
+    int                x11FileDescriptor = ConnectionNumber(display);
     
     bool hasSomethingDone = true;
 
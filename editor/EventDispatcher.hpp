@@ -148,7 +148,6 @@ private:
     priority_queue<TimerRegistration> timers;
     
     bool doQuit;
-    int  x11FileDescriptor;
 
     CallbackContainer<> updateCallbacks;
     
@@ -24,11 +24,20 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
+#include <limits.h>
 #include <unistd.h>
 #include <errno.h>
 #include <string.h>
 
 #include "config.h"
+
+#if HAVE_LINUX_XATTR_FUNCTIONS
+#  include <sys/xattr.h>
+#endif
+#include "debug.hpp"
+#include "util.hpp"
 #include "File.hpp"
 #include "ByteArray.hpp"
 #include "Regex.hpp"
@@ -86,6 +95,48 @@ void File::loadInto(RawPtr<ByteBuffer> buffer) const
     }
 }
 
+MappedMemory::Ptr File::mapForReading() const
+{
+    int fd = open(name.toCString(), O_RDONLY);
+
+    if (fd == -1) {
+        throw FileException(errno, String() << "error opening file '" << name << "' for reading: " << strerror(errno));
+    }
+    struct stat statData;
+
+    if (fstat(fd, &statData) == -1) {
+        int errnoValue = errno;
+        close(fd);
+        throw FileException(errnoValue, String() << "error accessing file '" << name << "': " << strerror(errnoValue));
+    }
+    long  len  = statData.st_size;
+    void* data = NULL;
+
+    if (len > 0)
+    {
+        data = mmap(NULL, len, PROT_READ, MAP_PRIVATE, fd, 0);
+
+        if (data == MAP_FAILED) {
+            int errnoValue = errno;
+            close(fd);
+            throw FileException(errnoValue, String() << "error mapping file '" << name << "': " << strerror(errnoValue));
+        }
+    }
+    if (close(fd) == -1) {
+        int errnoValue = errno;
+        if (len > 0) {
+            munmap(data, len);
+        }
+        throw FileException(errnoValue, String() << "error closing file '" << name << "' after mapping: " << strerror(errnoValue));
+    }
+    MappedMemory::Ptr rslt = MappedMemory::create(data, len);
+    
+    if (!rslt.isValid()) {
+        munmap(data, len);
+    }
+    return rslt;
+}
+
 File::Writer::Ptr File::openForWriting() const
 {
     int fd = open(name.toCString(), O_CREAT|O_WRONLY|O_TRUNC, S_IRUSR|S_IWUSR|S_IRGRP|S_IWGRP|S_IROTH|S_IWOTH);
@@ -96,20 +147,260 @@ File::Writer::Ptr File::openForWriting() const
     return Writer::create(fd, name);
 }
 
+/**
+ * Copies the extended attributes of the file, e.g. its ACLs, to the
+ * file descriptor. Returns false if not all attributes could be copied.
+ */
+static bool copyExtendedAttributes(const String& fileName, int fd)
+{
+#if HAVE_LINUX_XATTR_FUNCTIONS
+    ssize_t listLength = listxattr(fileName.toCString(), NULL, 0);
+    
+    if (listLength == -1) {
+        return errno == ENOTSUP; // file system without extended attributes
+    }
+    ByteArray names;
+    ByteArray value;
+    
+    names.appendAmount(listLength + 1);
+    
+    listLength = listxattr(fileName.toCString(), (char*) names.getPtr(0), listLength);
+    if (listLength == -1) {
+        return false;
+    }
+    names[listLength] = 0;
+    
+    for (long i = 0; i < listLength; i += strlen((const char*) names.getPtr(i)) + 1)
+    {
+        const char* name = (const char*) names.getPtr(i);
+
+        ssize_t valueLength = getxattr(fileName.toCString(), name, NULL, 0);
+        if (valueLength == -1) {
+            return false;
+        }
+        value.clear();
+        value.appendAmount(valueLength + 1);
+        
+        valueLength = getxattr(fileName.toCString(), name, value.getPtr(0), valueLength);
+        
+        if (valueLength == -1 || fsetxattr(fd, name, value.getPtr(0), valueLength, 0) == -1) {
+            return false;
+        }
+    }
+    return true;
+#else
+    return true;
+#endif
+}
+
+File::Writer::Ptr File::openForAtomicWriting() const
+{
+    String targetName = getAbsoluteNameWithResolvedLinks();
+    
+    struct stat targetStat;
+    bool        targetExists = (stat(targetName.toCString(), &targetStat) == 0);
+    
+    if (targetExists && (!S_ISREG(targetStat.st_mode) || targetStat.st_nlink > 1)) {
+        return Writer::Ptr();
+    }
+    ByteArray tempName;
+              tempName.appendString(String() << File(targetName).getDirName() 
+                                             << "/." << File(targetName).getBaseName() << ".XXXXXX");
+              tempName.append(0);
+    
+    int fd = mkstemp((char*) tempName.getPtr(0));
+    
+    if (fd == -1) {
+        if (errno == EACCES || errno == EPERM || errno == EROFS) {
+            return Writer::Ptr();
+        }
+        throw FileException(errno, String() << "error creating temporary file for '" << targetName << "': " << strerror(errno));
+    }
+    Writer::Ptr rslt = Writer::create(fd, targetName, (const char*) tempName.getPtr(0));
+    
+    if (targetExists)
+    {
+        if (fchown(fd, targetStat.st_uid, targetStat.st_gid) == -1)
+        {
+            // not possible for other users' files: replacing them would
+            // change their ownership, so they are written in place
+            
+            struct stat tempStat;
+            
+            if (   fstat(fd, &tempStat) == -1
+                || tempStat.st_uid != targetStat.st_uid
+                || tempStat.st_gid != targetStat.st_gid)
+            {
+                return Writer::Ptr();
+            }
+        }
+        if (fchmod(fd, targetStat.st_mode & 07777) == -1) {
+            throw FileException(errno, String() << "error setting permissions of file '" << targetName << "': " << strerror(errno));
+        }
+        if (!copyExtendedAttributes(targetName, fd)) {
+            return Writer::Ptr();
+        }
+    }
+    else
+    {
+        // not umask() here: this may run in a saving thread
+        
+        if (fchmod(fd, 0666 & ~System::getInstance()->getFileCreationMask()) == -1) {
+            throw FileException(errno, String() << "error setting permissions of file '" << targetName << "': " << strerror(errno));
+        }
+    }
+    return rslt;
+}
+
 File::Writer::~Writer()
 {
+    if (!isCommitted) 
+    {
+        if (tempName.getLength() > 0) {
+            close(fd);
+            unlink(tempName.toCString());
+        }
+        else if (close(fd) == -1) {
+            throw FileException(errno, String() << "error closing file '" << name << "' after writing: " << strerror(errno));
+        }
+    }
+}
+
+void File::Writer::commit()
+{
+    ASSERT(!isCommitted);
+    
+    if (fsync(fd) == -1 && errno != EINVAL && errno != EROFS) {
+        throw FileException(errno, String() << "error syncing file '" << name << "': " << strerror(errno));
+    }
+    isCommitted = true;
+    
     if (close(fd) == -1) {
-        throw FileException(errno, String() << "error closing file '" << name << "' after writing: " << strerror(errno));
+        int errnoValue = errno;
+        if (tempName.getLength() > 0) {
+            unlink(tempName.toCString());
+        }
+        throw FileException(errnoValue, String() << "error closing file '" << name << "' after writing: " << strerror(errnoValue));
+    }
+    if (tempName.getLength() > 0)
+    {
+        if (rename(tempName.toCString(), name.toCString()) == -1) {
+            int errnoValue = errno;
+            unlink(tempName.toCString());
+            throw FileException(errnoValue, String() << "error renaming temporary file to '" << name << "': " << strerror(errnoValue));
+        }
+        // the rename itself must also survive a crash
+
+        int dirFd = open(File(name).getDirName().toCString(), O_RDONLY);
+        if (dirFd != -1) {
+            fsync(dirFd);
+            close(dirFd);
+        }
+    }
+}
+
+File::Reader::Ptr File::openForReading() const
+{
+    int fd = open(name.toCString(), O_RDONLY);
+
+    if (fd == -1) {
+        throw FileException(errno, String() << "error opening file '" << name << "' for reading: " << strerror(errno));
+    }
+    return Reader::create(fd, name);
+}
+
+File::Reader::~Reader()
+{
+    close(fd);
+}
+
+long File::Reader::read(byte* buffer, long length) const
+{
+    long rslt;
+    do {
+        rslt = ::read(fd, buffer, length);
+    } while (rslt == -1 && errno == EINTR);
+
+    if (rslt == -1) {
+        throw FileException(errno, String() << "error reading from file '" << name << "': " << strerror(errno));
+    }
+    return rslt;
+}
+
+long File::Reader::readAt(byte* buffer, long offset, long length) const
+{
+    long rslt = 0;
+
+    while (rslt < length)
+    {
+        long n;
+        do {
+            n = ::pread(fd, buffer + rslt, length - rslt, offset + rslt);
+        } while (n == -1 && errno == EINTR);
+
+        if (n == -1) {
+            throw FileException(errno, String() << "error reading from file '" << name << "': " << strerror(errno));
+        }
+        if (n == 0) {
+            break;
+        }
+        rslt += n;
     }
+    return rslt;
 }
 
 void File::Writer::write(const char* data, long length) const
 {
-    if (length <= 0) {
-        return;
+    while (length > 0)
+    {
+        long rslt = ::write(fd, data, length);
+        if (rslt == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            throw FileException(errno, String() << "error writing to file '" << name << "': " << strerror(errno));
+        }
+        data   += rslt;
+        length -= rslt;
     }
-    if (::write(fd, data, length) == -1) {
-        throw FileException(errno, String() << "error writing to file '" << name << "': " << strerror(errno));
+}
+
+void File::Writer::writev(const struct iovec* buffers, long count) const
+{
+    struct iovec batch[IOV_MAX];
+    
+    while (count > 0)
+    {
+        const int batchLength = util::minimum(count, (long) IOV_MAX);
+
+        memcpy(batch, buffers, batchLength * sizeof(struct iovec));
+        
+        struct iovec* b = batch;
+        int           n = batchLength;
+        
+        while (n > 0)
+        {
+            long rslt = ::writev(fd, b, n);
+            if (rslt == -1) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                throw FileException(errno, String() << "error writing to file '" << name << "': " << strerror(errno));
+            }
+            // skip the written buffers after partial writes
+            
+            while (n > 0 && rslt >= (long) b->iov_len) {
+                rslt -= b->iov_len;
+                ++b;
+                --n;
+            }
+            if (n > 0) {
+                b->iov_base  = (char*) b->iov_base + rslt;
+                b->iov_len  -= rslt;
+            }
+        }
+        buffers += batchLength;
+        count   -= batchLength;
     }
 }
 
@@ -287,6 +578,9 @@ File::Info File::getInfo() const
         Info rslt;
         rslt.isFileFlag                  = S_ISREG(statData.st_mode);
         rslt.isDirectoryFlag             = S_ISDIR(statData.st_mode);
+        rslt.length                      = statData.st_size;
+        rslt.device                      = statData.st_dev;
+        rslt.inode                       = statData.st_ino;
 
         TimePeriod timePeriodSincePosixEpoch;
         {
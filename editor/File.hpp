@@ -22,6 +22,9 @@
 #ifndef FILE_HPP
 #define FILE_HPP
 
+#include <sys/types.h>
+#include <sys/uio.h>
+
 #include "String.hpp"
 
 #include "NonCopyable.hpp"
@@ -30,6 +33,7 @@
 #include "Seconds.hpp"
 #include "MicroSeconds.hpp"
 #include "Nullable.hpp"
+#include "MappedMemory.hpp"
 
 namespace LucED
 {
@@ -45,7 +49,10 @@ public:
             : isFileFlag(false),
               isDirectoryFlag(false),
               isWritableFlag(false),
-              existsFlag(false)
+              existsFlag(false),
+              length(0),
+              device(0),
+              inode(0)
         {}
         bool isFile() const {
             ASSERT(existsFlag);
@@ -59,6 +66,10 @@ public:
             ASSERT(existsFlag);
             return isWritableFlag;
         }
+        long getLength() const {
+            ASSERT(existsFlag);
+            return length;
+        }
         TimeStamp getLastModifiedTime() const {
             ASSERT(existsFlag);
             return lastModifiedTime.get();
@@ -66,12 +77,22 @@ public:
         bool exists() const {
             return existsFlag;
         }
+        /**
+         * True if both refer to the same inode, i.e. the file was 
+         * not replaced in the meantime.
+         */
+        bool isSameFileAs(const Info& rhs) const {
+            return existsFlag && rhs.existsFlag && device == rhs.device && inode == rhs.inode;
+        }
     private:
         friend class File;
         bool                isFileFlag;
         bool                isDirectoryFlag;
         bool                isWritableFlag;
         bool                existsFlag;
+        long                length;
+        dev_t               device;
+        ino_t               inode;
         Nullable<TimeStamp> lastModifiedTime;
     };
     
@@ -84,11 +105,64 @@ public:
         
         void write(const char* data, long length) const;
         
+        /**
+         * Writes all buffers, count may exceed IOV_MAX.
+         */
+        void writev(const struct iovec* buffers, long count) const;
+        
+        /**
+         * Syncs the written data to disk and closes the file. For writers
+         * created by openForAtomicWriting() the temporary file then 
+         * replaces the target file. If a writer is destroyed without
+         * being committed, its temporary file is removed.
+         */
+        void commit();
+        
+        String getFileName() const {
+            return name;
+        }
+        
+    private:
+        static Ptr create(int fd, const String& name, const String& tempName = String()) {
+            return Ptr(new Writer(fd, name, tempName));
+        }
+        explicit Writer(int fd, const String& name, const String& tempName)
+            : fd(fd),
+              name(name),
+              tempName(tempName),
+              isCommitted(false)
+        {}
+        
+        friend class File;
+        int fd;
+        String name;
+        String tempName;
+        bool isCommitted;
+    };
+    
+    class Reader : public HeapObject
+    {
+    public:
+        typedef OwningPtr<Reader> Ptr;
+        
+        ~Reader();
+        
+        /**
+         * Returns the number of bytes read, 0 at the end of the file.
+         */
+        long read(byte* buffer, long length) const;
+
+        /**
+         * Reads at the given file offset without changing the current 
+         * position. Returns less than length only at the end of the file.
+         */
+        long readAt(byte* buffer, long offset, long length) const;
+        
     private:
         static Ptr create(int fd, const String& name) {
-            return Ptr(new Writer(fd, name));
+            return Ptr(new Reader(fd, name));
         }
-        explicit Writer(int fd, const String& name)
+        explicit Reader(int fd, const String& name)
             : fd(fd),
               name(name)
         {}
@@ -106,6 +180,19 @@ public:
     
     Writer::Ptr openForWriting() const;
     
+    /**
+     * Opens a temporary file in the same directory that replaces
+     * the file on Writer::commit(). Permissions, ownership and extended
+     * attributes like ACLs of the existing file are preserved. Returns 
+     * an invalid pointer if the file cannot be replaced, e.g. because it 
+     * is not a regular file, has multiple hard links, the directory is 
+     * not writable or the ownership or the extended attributes cannot be 
+     * given to the temporary file.
+     */
+    Writer::Ptr openForAtomicWriting() const;
+    
+    Reader::Ptr openForReading() const;
+    
     String getAbsoluteName() const;
     
     String getAbsoluteNameWithResolvedLinks() const;
@@ -120,6 +207,12 @@ public:
 
     void loadInto(RawPtr<ByteBuffer> buffer) const;
     
+    /**
+     * Maps the file read-only into memory instead of reading it. Returns 
+     * an invalid pointer if no more files can be mapped, see MappedMemory.
+     */
+    MappedMemory::Ptr mapForReading() const;
+    
     void storeData(const char* data, int length) const;
 
     void storeData(const char* data) const;
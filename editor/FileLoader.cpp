@@ -0,0 +1,318 @@
+/////////////////////////////////////////////////////////////////////////////////////
+//
+//   LucED - The Lucid Editor
+//
+//   Copyright (C) 2005-2010 Oliver Schmidt, oliver at luced dot de
+//
+//   This program is free software; you can redistribute it and/or modify it
+//   under the terms of the GNU General Public License Version 2 as published
+//   by the Free Software Foundation in June 1991.
+//
+//   This program is distributed in the hope that it will be useful, but WITHOUT
+//   ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+//   FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+//   more details.
+//
+//   You should have received a copy of the GNU General Public License along with
+//   this program; if not, write to the Free Software Foundation, Inc.,
+//   51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+//
+/////////////////////////////////////////////////////////////////////////////////////
+
+#include "FileLoader.hpp"
+#include "EventDispatcher.hpp"
+#include "FileException.hpp"
+#include "Thread.hpp"
+#include "SystemException.hpp"
+
+using namespace LucED;
+
+
+FileLoader::WeakPtr FileLoader::start(TextData::Ptr                  textData, 
+                                      File::Reader::Ptr              reader,
+                                      EncodingConverter::Stream::Ptr converter,
+                                      Callback<const String&>::Ptr   errorCallback)
+{
+    OwningPtr ptr(new FileLoader(textData, reader, converter, errorCallback));
+
+    EventDispatcher::getInstance()->registerRunningComponent(ptr);
+
+#if LUCED_USE_MULTI_THREAD
+    try {
+        Thread::start(ptr->thread);
+    }
+    catch (SystemException& ex) {
+        ptr->readSynchronously();
+    }
+#else
+    ptr->readNextBatch();
+#endif
+    return ptr;
+}
+
+
+void FileLoader::finish(const Nullable<String>& errorMessage)
+{
+    if (!isFinished)
+    {
+        isFinished = true;
+
+        if (textData.isValid())
+        {
+            textData->finishLoading();
+
+            if (errorMessage.isValid())
+            {
+                // the text is incomplete and must not be saved over the file
+
+                textData->setPseudoFileName(textData->getFileName());
+                errorCallback->call(errorMessage.get());
+            }
+        }
+        EventDispatcher::getInstance()->deregisterRunningComponent(this);
+    }
+}
+
+
+/**
+ * Replaces the batch by its conversion to UTF-8. Returns an error message
+ * if bytes could not be converted.
+ */
+Nullable<String> FileLoader::convertBatch(RawPtr<ByteBuffer> batch, bool isEndOfFile)
+{
+    Nullable<String> errorMessage;
+
+    if (converter.isValid())
+    {
+        ByteBuffer convertedBatch;
+        try {
+            converter->convert(batch->getTotalAmount(), batch->getLength(), &convertedBatch);
+            if (isEndOfFile) {
+                converter->finish(&convertedBatch);
+            }
+        }
+        catch (BaseException& ex) {
+            errorMessage = ex.getMessage();
+        }
+        batch->takeOver(&convertedBatch);
+    }
+    return errorMessage;
+}
+
+
+#if LUCED_USE_MULTI_THREAD
+
+class FileLoader::ReadingThread : public Thread
+{
+public:
+    typedef LucED::OwningPtr<ReadingThread> Ptr;
+
+    static Ptr create(FileLoader* loader) {
+        return Ptr(new ReadingThread(loader));
+    }
+
+protected:
+    virtual void main()
+    {
+        ByteBuffer       batch;
+        Nullable<String> errorMessage;
+        bool             isEndOfFile = false;
+
+        while (!isEndOfFile)
+        {
+            {
+                Mutex::Lock lock(loader->mutex);
+
+                while (   !loader->isStopRequested
+                       && loader->stagingBuffer.getLength() >= MAX_STAGING_LENGTH)
+                {
+                    lock.waitForNotify();
+                }
+                if (loader->isStopRequested) {
+                    break;
+                }
+            }
+            batch.clear();
+            try {
+                long n = loader->reader->read(batch.appendAmount(BATCH_LENGTH), BATCH_LENGTH);
+                batch.removeTail(n);
+                isEndOfFile = (n == 0);
+            }
+            catch (FileException& ex) {
+                errorMessage = ex.getMessage();
+                isEndOfFile  = true;
+            }
+            Nullable<String> conversionErrorMessage = loader->convertBatch(&batch, isEndOfFile);
+            
+            if (conversionErrorMessage.isValid())
+            {
+                // stop at the first error as readSynchronously() does, so
+                // that the text is truncated at the same position
+
+                if (!errorMessage.isValid()) {
+                    errorMessage = conversionErrorMessage;
+                }
+                isEndOfFile = true;
+            }
+            if (batch.getLength() > 0)
+            {
+                Mutex::Lock lock(loader->mutex);
+
+                loader->stagingBuffer.append(batch.getPtr(), batch.getLength());
+                notifyLoader();
+            }
+        }
+
+        // After this the loader may be destroyed at any time
+
+        Mutex::Lock lock(loader->mutex);
+
+        loader->threadErrorMessage = errorMessage;
+        loader->isThreadFinished   = true;
+        notifyLoader();
+    }
+
+private:
+    explicit ReadingThread(FileLoader* loader)
+        : loader(loader)
+    {}
+
+    void notifyLoader()
+    {
+        if (!loader->isTaskPending) {
+            loader->isTaskPending = true;
+            EventDispatcher::getInstance()->executeTaskOnMainThread(loader->handleStagedDataCallback);
+        }
+    }
+
+    FileLoader* loader;
+};
+
+
+FileLoader::FileLoader(TextData::Ptr textData, File::Reader::Ptr reader, EncodingConverter::Stream::Ptr converter,
+                       Callback<const String&>::Ptr errorCallback)
+    : textData(textData),
+      reader(reader),
+      converter(converter),
+      errorCallback(errorCallback),
+      isFinished(false),
+      mutex(Mutex::create()),
+      isTaskPending(false),
+      isStopRequested(false),
+      isThreadFinished(false)
+{
+    thread                   = ReadingThread::create(this);
+    handleStagedDataCallback = newCallback(this, &FileLoader::handleStagedData);
+}
+
+
+FileLoader::~FileLoader()
+{
+    {
+        Mutex::Lock lock(mutex);
+        isStopRequested = true;
+        lock.notify();
+    }
+    thread->waitForFinished();
+}
+
+
+void FileLoader::readSynchronously()
+{
+    isThreadFinished = true;
+
+    Nullable<String> errorMessage;
+    ByteBuffer       batch;
+    try
+    {
+        long n;
+        do {
+            batch.clear();
+            n = reader->read(batch.appendAmount(BATCH_LENGTH), BATCH_LENGTH);
+            batch.removeTail(n);
+            errorMessage = convertBatch(&batch, n == 0);
+            if (textData.isValid()) {
+                textData->appendLoadedData(batch.getTotalAmount(), batch.getLength());
+            }
+        } while (n > 0 && !errorMessage.isValid());
+    }
+    catch (FileException& ex) {
+        errorMessage = ex.getMessage();
+    }
+    finish(errorMessage);
+}
+
+
+void FileLoader::handleStagedData()
+{
+    // invoked in the main thread by the EventDispatcher
+
+    ByteBuffer       data;
+    bool             threadFinished;
+    Nullable<String> errorMessage;
+    {
+        Mutex::Lock lock(mutex);
+
+        data.takeOver(&stagingBuffer);
+        threadFinished = isThreadFinished;
+        errorMessage   = threadErrorMessage;
+        isTaskPending  = false;
+
+        if (!textData.isValid()) {
+            isStopRequested = true;
+        }
+        lock.notify();
+    }
+    if (textData.isValid()) {
+        textData->appendLoadedData(data.getPtr(), data.getLength());
+    }
+    if (threadFinished) {
+        finish(errorMessage);
+    }
+}
+
+#else // !LUCED_USE_MULTI_THREAD
+
+FileLoader::FileLoader(TextData::Ptr textData, File::Reader::Ptr reader, EncodingConverter::Stream::Ptr converter,
+                       Callback<const String&>::Ptr errorCallback)
+    : textData(textData),
+      reader(reader),
+      converter(converter),
+      errorCallback(errorCallback),
+      isFinished(false)
+{}
+
+
+FileLoader::~FileLoader()
+{}
+
+
+void FileLoader::readNextBatch()
+{
+    if (!textData.isValid()) {
+        finish(Null);
+        return;
+    }
+    try
+    {
+        batchBuffer.clear();
+        long n = reader->read(batchBuffer.appendAmount(BATCH_LENGTH), BATCH_LENGTH);
+        batchBuffer.removeTail(n);
+
+        Nullable<String> errorMessage = convertBatch(&batchBuffer, n == 0);
+
+        textData->appendLoadedData(batchBuffer.getTotalAmount(), batchBuffer.getLength());
+
+        if (n > 0 && !errorMessage.isValid()) {
+            EventDispatcher::getInstance()->registerTimerCallback(Seconds(0), MicroSeconds(0), 
+                                                                  newCallback(this, &FileLoader::readNextBatch));
+        } else {
+            finish(errorMessage);
+        }
+    }
+    catch (FileException& ex) {
+        finish(ex.getMessage());
+    }
+}
+
+#endif // !LUCED_USE_MULTI_THREAD
@@ -0,0 +1,119 @@
+/////////////////////////////////////////////////////////////////////////////////////
+//
+//   LucED - The Lucid Editor
+//
+//   Copyright (C) 2005-2010 Oliver Schmidt, oliver at luced dot de
+//
+//   This program is free software; you can redistribute it and/or modify it
+//   under the terms of the GNU General Public License Version 2 as published
+//   by the Free Software Foundation in June 1991.
+//
+//   This program is distributed in the hope that it will be useful, but WITHOUT
+//   ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+//   FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+//   more details.
+//
+//   You should have received a copy of the GNU General Public License along with
+//   this program; if not, write to the Free Software Foundation, Inc.,
+//   51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+//
+/////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef FILE_LOADER_HPP
+#define FILE_LOADER_HPP
+
+#include "config.h"
+#include "RunningComponent.hpp"
+#include "OwningPtr.hpp"
+#include "WeakPtr.hpp"
+#include "TextData.hpp"
+#include "File.hpp"
+#include "ByteBuffer.hpp"
+#include "Nullable.hpp"
+#include "Mutex.hpp"
+#include "Callback.hpp"
+#include "EncodingConverter.hpp"
+
+namespace LucED
+{
+
+/**
+ * Loads the rest of a file into a TextData in the background.
+ *
+ * The TextData must have been prepared by TextData::beginLoading().
+ * The file is read in batches by a worker thread, the batches are
+ * appended to the text in the main thread, so that the text is displayed
+ * and updated while it is still being loaded. Without multi threading the
+ * batches are read between the processing of other events.
+ *
+ * If a converter is given, the batches are converted to UTF-8 right after 
+ * reading, i.e. also by the worker thread.
+ *
+ * If reading or converting fails, the incomplete text gets a pseudo file
+ * name, so that it cannot be saved over the file, and the errorCallback
+ * is invoked with the error message in the main thread.
+ */
+class FileLoader : public RunningComponent
+{
+public:
+    typedef LucED::OwningPtr<FileLoader> OwningPtr;
+    typedef LucED::WeakPtr  <FileLoader> WeakPtr;
+
+    static WeakPtr start(TextData::Ptr                  textData, 
+                         File::Reader::Ptr              reader,
+                         EncodingConverter::Stream::Ptr converter,
+                         Callback<const String&>::Ptr   errorCallback);
+
+    ~FileLoader();
+
+private:
+    enum
+    {
+        BATCH_LENGTH       = 1024 * 1024,
+        MAX_STAGING_LENGTH = 8 * BATCH_LENGTH
+    };
+
+    FileLoader(TextData::Ptr textData, File::Reader::Ptr reader, EncodingConverter::Stream::Ptr converter,
+               Callback<const String&>::Ptr errorCallback);
+
+    void finish(const Nullable<String>& errorMessage);
+    
+    Nullable<String> convertBatch(RawPtr<ByteBuffer> batch, bool isEndOfFile);
+
+    LucED::WeakPtr<TextData>       textData;
+    File::Reader::Ptr              reader;
+    EncodingConverter::Stream::Ptr converter;
+    Callback<const String&>::Ptr   errorCallback;
+    bool                           isFinished;
+
+#if LUCED_USE_MULTI_THREAD
+
+    class ReadingThread;
+
+    void handleStagedData();
+    void readSynchronously();
+
+    LucED::OwningPtr<ReadingThread> thread;
+    Callback<>::Ptr                 handleStagedDataCallback;
+
+    // shared with the reading thread
+
+    Mutex::Ptr       mutex;
+    ByteBuffer       stagingBuffer;
+    bool             isTaskPending;
+    bool             isStopRequested;
+    bool             isThreadFinished;
+    Nullable<String> threadErrorMessage;
+
+#else
+
+    void readNextBatch();
+
+    ByteBuffer batchBuffer;
+
+#endif // LUCED_USE_MULTI_THREAD
+};
+
+} // namespace LucED
+
+#endif // FILE_LOADER_HPP
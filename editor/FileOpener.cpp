@@ -23,9 +23,12 @@
 #include <stdio.h>
 
 #include "FileOpener.hpp"
+#include "util.hpp"
 #include "GlobalConfig.hpp"
 #include "FileException.hpp"
 #include "LuaException.hpp"
+#include "FileLoader.hpp"
+#include "EncodingConverter.hpp"
 
 using namespace LucED;
 
@@ -117,10 +120,42 @@ void FileOpener::openFiles()
                 
                 Nullable<String> errorMessage;
 
+                File::Reader::Ptr              loaderReader;
+                EncodingConverter::Stream::Ptr loaderConverter;
+
                 try
                 {
-                    ByteBuffer buffer; 
-                    File(fileName).loadInto(&buffer);
+                    File              file(fileName);
+                    File::Info        fileInfo = file.getInfo();
+                    ByteBuffer        buffer; 
+                    MappedMemory::Ptr mappedMemory;
+                    File::Reader::Ptr reader;
+                    
+                    if (   fileInfo.exists() && fileInfo.isFile() 
+                        && TextData::isFileMappingPreferredForLength(fileInfo.getLength()))
+                    {
+                        mappedMemory = file.mapForReading();
+                    }
+                    else if (   fileInfo.exists() && fileInfo.isFile() 
+                             && TextData::isProgressiveLoadingPreferredForLength(fileInfo.getLength()))
+                    {
+                        // only the beginning is needed for detecting language mode and encoding,
+                        // the rest is loaded by a FileLoader
+                        
+                        reader = file.openForReading();
+                        long n = reader->read(buffer.appendAmount(FIRST_BATCH_LENGTH), FIRST_BATCH_LENGTH);
+                        buffer.removeTail(n);
+                    }
+                    else {
+                        file.loadInto(&buffer);
+                    }
+                    // a mapped file is not read completely here, only its beginning is
+                    // looked at for detecting language mode and encoding
+                    
+                    const byte* content       = mappedMemory.isValid() ? mappedMemory->getPtr()    : buffer.getTotalAmount();
+                    long        contentLength = mappedMemory.isValid() ? mappedMemory->getLength() : buffer.getLength();
+                    
+                    contentLength = util::minimum(contentLength, (long) LanguageModeSelectors::DETECTION_LENGTH);
                     
                     Nullable<GlobalConfig::LanguageModeAndEncoding> result;
                     try
@@ -129,7 +164,8 @@ void FileOpener::openFiles()
                                  ->getLanguageModeAndEncodingForFileNameAndContent
                                  (
                                    fileName, 
-                                   &buffer
+                                   content,
+                                   contentLength
                                  );
                         languageMode = result.get().languageMode;
                         hilitedText  = HilitedText::create(textData, languageMode);
@@ -144,7 +180,40 @@ void FileOpener::openFiles()
                         encoding = result.get().encoding;
                     }
 
-                    textData->takeOverFileBuffer(fileName, encoding, &buffer);
+                    if (mappedMemory.isValid()) {
+                        textData->takeOverMappedFile(fileName, encoding, mappedMemory);
+                    }
+                    else if (reader.isValid())
+                    {
+                        EncodingConverter              converter(encoding, "UTF-8");
+                        EncodingConverter::Stream::Ptr stream;
+                        long                           expectedLength = fileInfo.getLength();
+
+                        if (converter.isConvertingBetweenDifferentCodesets())
+                        {
+                            // the rest of the file is converted batch by batch by the FileLoader
+
+                            ByteBuffer convertedBuffer;
+                            stream = converter.createStream();
+                            stream->convert(buffer.getTotalAmount(), buffer.getLength(), &convertedBuffer);
+                            if (buffer.getLength() > 0) {
+                                expectedLength = (long)(((double) expectedLength * convertedBuffer.getLength()) 
+                                                        / buffer.getLength());
+                            }
+                            buffer.takeOver(&convertedBuffer);
+                        }
+                        textData->beginLoading(fileName, encoding, expectedLength);
+                        textData->appendLoadedData(buffer.getTotalAmount(), buffer.getLength());
+
+                        // the FileLoader is started after the window is created,
+                        // so that loading errors can be shown in the window
+
+                        loaderReader    = reader;
+                        loaderConverter = stream;
+                    }
+                    else {
+                        textData->takeOverFileBuffer(fileName, encoding, &buffer);
+                    }
                 }
                 catch (LuaException& ex)
                 {
@@ -222,6 +291,10 @@ void FileOpener::openFiles()
                     return;
                 }
                 lastTopWin = EditorTopWin::create(hilitedText);
+                if (loaderReader.isValid()) {
+                    FileLoader::start(textData, loaderReader, loaderConverter,
+                                      newCallback(lastTopWin, &EditorTopWin::handleLoadingError));
+                }
                 if (errorMessage.isValid()) {
                     MessageBoxParameter p;
                                         p.setTitle("Error opening file")
@@ -71,6 +71,11 @@ public:
 private:
     friend class EditorServer;
 
+    enum
+    {
+        FIRST_BATCH_LENGTH = 64 * 1024
+    };
+
     FileOpener(ParameterList::Ptr              fileParameterList,
                ConfigException::ErrorList::Ptr errorList)
 
@@ -0,0 +1,207 @@
+/////////////////////////////////////////////////////////////////////////////////////
+//
+//   LucED - The Lucid Editor
+//
+//   Copyright (C) 2005-2010 Oliver Schmidt, oliver at luced dot de
+//
+//   This program is free software; you can redistribute it and/or modify it
+//   under the terms of the GNU General Public License Version 2 as published
+//   by the Free Software Foundation in June 1991.
+//
+//   This program is distributed in the hope that it will be useful, but WITHOUT
+//   ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+//   FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+//   more details.
+//
+//   You should have received a copy of the GNU General Public License along with
+//   this program; if not, write to the Free Software Foundation, Inc.,
+//   51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+//
+/////////////////////////////////////////////////////////////////////////////////////
+
+#include "util.hpp"
+#include "FileSaver.hpp"
+#include "EventDispatcher.hpp"
+#include "EncodingConverter.hpp"
+#include "EncodingException.hpp"
+#include "FileException.hpp"
+#include "SystemException.hpp"
+#include "Thread.hpp"
+
+using namespace LucED;
+
+
+void FileSaver::Result::throwError() const
+{
+    switch (errorType)
+    {
+        case NO_ERROR:       return;
+        case FILE_ERROR:     throw FileException(errnoValue, message);
+        case ENCODING_ERROR: throw EncodingException(message);
+        default:             throw SystemException(message);
+    }
+}
+
+
+#if LUCED_USE_MULTI_THREAD
+
+class FileSaver::SavingThread : public Thread
+{
+public:
+    typedef LucED::OwningPtr<SavingThread> Ptr;
+
+    static Ptr create(FileSaver* saver) {
+        return Ptr(new SavingThread(saver));
+    }
+
+protected:
+    virtual void main()
+    {
+        saver->writeSnapshot();
+
+        EventDispatcher::getInstance()->executeTaskOnMainThread(newCallback(saver, &FileSaver::finish));
+    }
+
+private:
+    explicit SavingThread(FileSaver* saver)
+        : saver(saver)
+    {}
+
+    FileSaver* saver;
+};
+
+#endif // LUCED_USE_MULTI_THREAD
+
+
+FileSaver::FileSaver(TextData::Ptr textData, File::Writer::Ptr writer, Callback<const Result&>::Ptr finishedCallback)
+    : textData(textData),
+      finishedCallback(finishedCallback),
+      writer(writer),
+      wasWritten(false)
+{
+    encoding = textData->getEncoding();
+    snapshot = textData->beginSaving();
+
+#if LUCED_USE_MULTI_THREAD
+    thread = SavingThread::create(this);
+#else
+    writtenLength = 0;
+#endif
+}
+
+
+FileSaver::~FileSaver()
+{
+#if LUCED_USE_MULTI_THREAD
+    thread->waitForFinished();
+#endif
+}
+
+
+void FileSaver::start(TextData::Ptr textData, Callback<const Result&>::Ptr finishedCallback)
+{
+    File::Writer::Ptr writer = textData->openFileForSaving();
+
+    OwningPtr ptr(new FileSaver(textData, writer, finishedCallback));
+
+    EventDispatcher::getInstance()->registerRunningComponent(ptr);
+
+#if LUCED_USE_MULTI_THREAD
+    try {
+        Thread::start(ptr->thread);
+    }
+    catch (SystemException& ex) {
+        ptr->writeSnapshot();
+        ptr->finish();
+    }
+#else
+    EventDispatcher::getInstance()->registerTimerCallback(Seconds(0), MicroSeconds(0), 
+                                                          newCallback(ptr, &FileSaver::writeNextBatch));
+#endif
+}
+
+
+void FileSaver::writeSnapshot()
+{
+    // may be invoked outside of the main thread: only the snapshot and 
+    // the writer are accessed
+
+    try
+    {
+        try {
+            snapshot->writeTo(writer, encoding);
+        }
+        catch (EncodingException& ex) {
+            writer->commit();
+            wasWritten = true;
+            throw;
+        }
+        writer->commit();
+        wasWritten = true;
+    }
+    catch (FileException& ex) {
+        result.errorType  = Result::FILE_ERROR;
+        result.errnoValue = ex.getErrno();
+        result.message    = ex.getMessage();
+    }
+    catch (EncodingException& ex) {
+        result.errorType  = Result::ENCODING_ERROR;
+        result.message    = ex.getMessage();
+    }
+    catch (BaseException& ex) {
+        result.errorType  = Result::OTHER_ERROR;
+        result.message    = ex.getMessage();
+    }
+}
+
+
+#if !LUCED_USE_MULTI_THREAD
+
+void FileSaver::writeNextBatch()
+{
+    EncodingConverter c("UTF-8", encoding);
+
+    if (c.isConvertingBetweenDifferentCodesets()) {
+        writeSnapshot();
+        finish();
+        return;
+    }
+    try
+    {
+        long n = util::minimum((long) BATCH_LENGTH, snapshot->getLength() - writtenLength);
+
+        snapshot->writeTo(writer, writtenLength, n);
+        writtenLength += n;
+
+        if (writtenLength < snapshot->getLength()) {
+            EventDispatcher::getInstance()->registerTimerCallback(Seconds(0), MicroSeconds(0), 
+                                                                  newCallback(this, &FileSaver::writeNextBatch));
+            return;
+        }
+        writer->commit();
+        wasWritten = true;
+    }
+    catch (FileException& ex) {
+        result.errorType  = Result::FILE_ERROR;
+        result.errnoValue = ex.getErrno();
+        result.message    = ex.getMessage();
+    }
+    finish();
+}
+
+#endif // !LUCED_USE_MULTI_THREAD
+
+
+void FileSaver::finish()
+{
+    // the snapshot is released in the main thread
+
+    snapshot.invalidate();
+    writer.invalidate();
+
+    textData->finishSaving(wasWritten);
+
+    finishedCallback->call(result);
+
+    EventDispatcher::getInstance()->deregisterRunningComponent(this);
+}
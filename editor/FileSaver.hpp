@@ -0,0 +1,127 @@
+/////////////////////////////////////////////////////////////////////////////////////
+//
+//   LucED - The Lucid Editor
+//
+//   Copyright (C) 2005-2010 Oliver Schmidt, oliver at luced dot de
+//
+//   This program is free software; you can redistribute it and/or modify it
+//   under the terms of the GNU General Public License Version 2 as published
+//   by the Free Software Foundation in June 1991.
+//
+//   This program is distributed in the hope that it will be useful, but WITHOUT
+//   ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+//   FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+//   more details.
+//
+//   You should have received a copy of the GNU General Public License along with
+//   this program; if not, write to the Free Software Foundation, Inc.,
+//   51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+//
+/////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef FILE_SAVER_HPP
+#define FILE_SAVER_HPP
+
+#include "config.h"
+#include "RunningComponent.hpp"
+#include "OwningPtr.hpp"
+#include "WeakPtr.hpp"
+#include "TextData.hpp"
+#include "TextSnapshot.hpp"
+#include "File.hpp"
+#include "String.hpp"
+#include "Callback.hpp"
+
+namespace LucED
+{
+
+/**
+ * Saves a snapshot of a TextData in the background, so that the text
+ * can be edited while it is being written.
+ *
+ * With multi threading the snapshot is written by a worker thread,
+ * otherwise it is written in batches between the processing of other
+ * events.
+ */
+class FileSaver : public RunningComponent
+{
+public:
+    typedef LucED::OwningPtr<FileSaver> OwningPtr;
+    typedef LucED::WeakPtr  <FileSaver> WeakPtr;
+
+    class Result
+    {
+    public:
+        bool hasError() const {
+            return errorType != NO_ERROR;
+        }
+
+        /**
+         * Throws the exception that occurred while saving.
+         */
+        void throwError() const;
+
+    private:
+        friend class FileSaver;
+
+        enum ErrorType
+        {
+            NO_ERROR,
+            FILE_ERROR,
+            ENCODING_ERROR,
+            OTHER_ERROR
+        };
+
+        Result()
+            : errorType(NO_ERROR),
+              errnoValue(0)
+        {}
+
+        ErrorType errorType;
+        int       errnoValue;
+        String    message;
+    };
+
+    /**
+     * The file is opened and the snapshot is taken before returning,
+     * errors in doing so are thrown. The finishedCallback is invoked
+     * in the main thread after the text has been saved.
+     */
+    static void start(TextData::Ptr textData, Callback<const Result&>::Ptr finishedCallback);
+
+    ~FileSaver();
+
+private:
+    enum { BATCH_LENGTH = 4 * 1024 * 1024 };
+
+    FileSaver(TextData::Ptr textData, File::Writer::Ptr writer, Callback<const Result&>::Ptr finishedCallback);
+
+    void writeSnapshot();
+    void finish();
+
+    TextData::Ptr                 textData;
+    Callback<const Result&>::Ptr  finishedCallback;
+    File::Writer::Ptr             writer;
+    TextSnapshot::Ptr             snapshot;
+    String                        encoding;
+    Result                        result;
+    bool                          wasWritten;
+
+#if LUCED_USE_MULTI_THREAD
+
+    class SavingThread;
+
+    LucED::OwningPtr<SavingThread> thread;
+
+#else
+
+    void writeNextBatch();
+
+    long writtenLength;
+
+#endif // LUCED_USE_MULTI_THREAD
+};
+
+} // namespace LucED
+
+#endif // FILE_SAVER_HPP
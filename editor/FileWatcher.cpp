@@ -0,0 +1,315 @@
+/////////////////////////////////////////////////////////////////////////////////////
+//
+//   LucED - The Lucid Editor
+//
+//   Copyright (C) 2005-2010 Oliver Schmidt, oliver at luced dot de
+//
+//   This program is free software; you can redistribute it and/or modify it
+//   under the terms of the GNU General Public License Version 2 as published
+//   by the Free Software Foundation in June 1991.
+//
+//   This program is distributed in the hope that it will be useful, but WITHOUT
+//   ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+//   FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+//   more details.
+//
+//   You should have received a copy of the GNU General Public License along with
+//   this program; if not, write to the Free Software Foundation, Inc.,
+//   51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+//
+/////////////////////////////////////////////////////////////////////////////////////
+
+#include "config.h"
+
+#if LUCED_USE_INOTIFY
+#  include <sys/inotify.h>
+#endif
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <string.h>
+
+#include "FileWatcher.hpp"
+#include "EventDispatcher.hpp"
+#include "SystemException.hpp"
+#include "File.hpp"
+
+using namespace LucED;
+
+SingletonInstance<FileWatcher> FileWatcher::instance;
+
+#if LUCED_USE_INOTIFY
+static const uint32_t WATCH_MASK = IN_MODIFY | IN_ATTRIB | IN_CLOSE_WRITE
+                                 | IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO
+                                 | IN_DELETE_SELF | IN_MOVE_SELF;
+#endif
+
+FileWatcher* FileWatcher::getInstance()
+{
+    return instance.getPtr();
+}
+
+FileWatcher::FileWatcher()
+    : isTimerPending(false)
+{
+#if LUCED_USE_INOTIFY
+    int fd = inotify_init();
+    if (fd != -1)
+    {
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+        fcntl(fd, F_SETFD, FD_CLOEXEC);
+
+        inotifyListener = FileDescriptorListener::create(fd,
+                                                         newCallback(this, &FileWatcher::handleEvents),
+                                                         Callback<int>::Ptr());
+        EventDispatcher::getInstance()->registerFileDescriptorListener(inotifyListener);
+    }
+#endif
+}
+
+FileWatcher::~FileWatcher()
+{
+    if (inotifyListener.isValid()) {
+        inotifyListener->close();
+    }
+}
+
+bool FileWatcher::watchFile(const String& fileName, Callback<const String&>::Ptr callback)
+{
+    // watch the directory of the real file, changes to the symbolic link itself are not noticed
+
+    File realFile(File(fileName).getAbsoluteNameWithResolvedLinks());
+
+    Listener listener;
+             listener.baseName = realFile.getBaseName();
+             listener.fileName = fileName;
+             listener.callback = callback;
+
+    return addListener(realFile.getDirName(), listener);
+}
+
+bool FileWatcher::watchDirectory(const String& dirName, Callback<const String&>::Ptr callback)
+{
+    Listener listener;
+             listener.fileName = dirName;
+             listener.callback = callback;
+
+    return addListener(File(dirName).getAbsoluteNameWithResolvedLinks(), listener);
+}
+
+bool FileWatcher::addListener(const String& dirName, const Listener& listener)
+{
+#if LUCED_USE_INOTIFY
+    if (!inotifyListener.isValid()) {
+        return false;
+    }
+    removeDisabledListeners();
+
+    Directory::Ptr directory;
+
+    Nullable<int> foundWd = watchDescriptors.get(dirName);
+
+    if (foundWd.isValid()) {
+        directory = directories.get(foundWd.get()).get();
+    }
+    else
+    {
+        int wd = inotify_add_watch(inotifyListener->getFileDescriptor(), dirName.toCString(), WATCH_MASK);
+        if (wd == -1) {
+            return false;
+        }
+        // different names of the same directory get the same watch descriptor
+
+        Nullable<Directory::Ptr> foundDirectory = directories.get(wd);
+        if (foundDirectory.isValid()) {
+            directory = foundDirectory.get();
+        } else {
+            directory = Directory::create(wd, dirName);
+            directories.set(wd, directory);
+        }
+        watchDescriptors.set(dirName, wd);
+    }
+    directory->listeners.append(listener);
+    return true;
+#else
+    return false;
+#endif
+}
+
+void FileWatcher::removeWatchesFor(HeapObject* callbackObject)
+{
+    for (HashMap<int,Directory::Ptr>::Iterator i = directories.getIterator(); !i.isAtEnd(); i.gotoNext())
+    {
+        ObjectArray<Listener>& listeners = i.getValue()->listeners;
+
+        for (int j = 0; j < listeners.getLength(); ++j) {
+            if (listeners[j].callback->getObjectPtr() == callbackObject) {
+                listeners[j].callback->disable();
+            }
+        }
+    }
+    removeDisabledListeners();
+}
+
+void FileWatcher::removeDisabledListeners()
+{
+    ObjectArray<Directory::Ptr> unusedDirectories;
+
+    for (HashMap<int,Directory::Ptr>::Iterator i = directories.getIterator(); !i.isAtEnd(); i.gotoNext())
+    {
+        Directory::Ptr         directory = i.getValue();
+        ObjectArray<Listener>& listeners = directory->listeners;
+
+        for (int j = 0; j < listeners.getLength();) {
+            if (!listeners[j].callback->isEnabled()) {
+                listeners.remove(j);
+            } else {
+                ++j;
+            }
+        }
+        if (listeners.getLength() == 0) {
+            unusedDirectories.append(directory);
+        }
+    }
+    for (int i = 0; i < unusedDirectories.getLength(); ++i)
+    {
+#if LUCED_USE_INOTIFY
+        inotify_rm_watch(inotifyListener->getFileDescriptor(), unusedDirectories[i]->watchDescriptor);
+#endif
+        removeDirectory(unusedDirectories[i]);
+    }
+}
+
+void FileWatcher::removeDirectory(Directory::Ptr directory)
+{
+    ObjectArray<String> names;
+
+    for (HashMap<String,int>::Iterator i = watchDescriptors.getIterator(); !i.isAtEnd(); i.gotoNext()) {
+        if (i.getValue() == directory->watchDescriptor) {
+            names.append(i.getKey());
+        }
+    }
+    for (int i = 0; i < names.getLength(); ++i) {
+        watchDescriptors.remove(names[i]);
+    }
+    directories.remove(directory->watchDescriptor);
+}
+
+void FileWatcher::handleEvents(int fileDescriptor)
+{
+#if LUCED_USE_INOTIFY
+    union
+    {
+        struct inotify_event event;
+        char                 bytes[16 * 1024];
+    } buffer;
+
+    for (;;)
+    {
+        long readLength = ::read(fileDescriptor, buffer.bytes, sizeof(buffer.bytes));
+
+        if (readLength <= 0) {
+            if (readLength == -1 && errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+        for (long p = 0; p < readLength;)
+        {
+            const struct inotify_event* event = (const struct inotify_event*) (buffer.bytes + p);
+            p += sizeof(struct inotify_event) + event->len;
+
+            if (event->mask & IN_Q_OVERFLOW)
+            {
+                // events were lost: everybody has to check
+
+                for (HashMap<int,Directory::Ptr>::Iterator i = directories.getIterator(); !i.isAtEnd(); i.gotoNext()) {
+                    notifyListeners(i.getValue(), NULL);
+                }
+                continue;
+            }
+            Nullable<Directory::Ptr> foundDirectory = directories.get(event->wd);
+
+            if (!foundDirectory.isValid()) {
+                continue;
+            }
+            Directory::Ptr directory = foundDirectory.get();
+
+            if (event->mask & (IN_IGNORED|IN_DELETE_SELF|IN_MOVE_SELF))
+            {
+                // the directory is gone, a new watch is added by the next watchFile()
+
+                notifyListeners(directory, NULL);
+                if (event->mask & IN_IGNORED) {
+                    removeDirectory(directory);
+                }
+            }
+            else {
+                notifyListeners(directory, event->len > 0 ? event->name : NULL);
+            }
+        }
+    }
+    if (pendingNotifications.getLength() > 0 && !isTimerPending)
+    {
+        EventDispatcher::getInstance()->registerTimerCallback(Seconds(0), MicroSeconds(DEBOUNCE_MICROSECS),
+                                                              newCallback(this, &FileWatcher::handleDebounceTimer));
+        isTimerPending = true;
+    }
+#endif
+}
+
+/**
+ * changedName == NULL notifies all listeners of the directory.
+ */
+void FileWatcher::notifyListeners(Directory::Ptr directory, const char* changedName)
+{
+    ObjectArray<Listener>& listeners = directory->listeners;
+
+    for (int i = 0; i < listeners.getLength(); ++i)
+    {
+        const Listener& listener = listeners[i];
+
+        if (listener.baseName.getLength() == 0)
+        {
+            if (changedName != NULL) {
+                addNotification(String() << listener.fileName << "/" << changedName, listener.callback);
+            } else {
+                addNotification(listener.fileName, listener.callback);
+            }
+        }
+        else if (changedName == NULL || listener.baseName == changedName)
+        {
+            addNotification(listener.fileName, listener.callback);
+        }
+    }
+}
+
+void FileWatcher::addNotification(const String& fileName, Callback<const String&>::Ptr callback)
+{
+    for (int i = 0; i < pendingNotifications.getLength(); ++i) {
+        if (   pendingNotifications[i].callback->getObjectPtr() == callback->getObjectPtr()
+            && pendingNotifications[i].fileName == fileName)
+        {
+            return;
+        }
+    }
+    Notification notification;
+                 notification.fileName = fileName;
+                 notification.callback = callback;
+
+    pendingNotifications.append(notification);
+}
+
+void FileWatcher::handleDebounceTimer()
+{
+    isTimerPending = false;
+
+    ObjectArray<Notification> notifications = pendingNotifications;
+    pendingNotifications.clear();
+
+    for (int i = 0; i < notifications.getLength(); ++i) {
+        notifications[i].callback->call(notifications[i].fileName);
+    }
+    removeDisabledListeners();
+}
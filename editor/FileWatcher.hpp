@@ -0,0 +1,141 @@
+/////////////////////////////////////////////////////////////////////////////////////
+//
+//   LucED - The Lucid Editor
+//
+//   Copyright (C) 2005-2010 Oliver Schmidt, oliver at luced dot de
+//
+//   This program is free software; you can redistribute it and/or modify it
+//   under the terms of the GNU General Public License Version 2 as published
+//   by the Free Software Foundation in June 1991.
+//
+//   This program is distributed in the hope that it will be useful, but WITHOUT
+//   ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+//   FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+//   more details.
+//
+//   You should have received a copy of the GNU General Public License along with
+//   this program; if not, write to the Free Software Foundation, Inc.,
+//   51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+//
+/////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef FILE_WATCHER_HPP
+#define FILE_WATCHER_HPP
+
+#include "String.hpp"
+#include "HeapObject.hpp"
+#include "OwningPtr.hpp"
+#include "ObjectArray.hpp"
+#include "HashMap.hpp"
+#include "Callback.hpp"
+#include "SingletonInstance.hpp"
+#include "FileDescriptorListener.hpp"
+
+namespace LucED
+{
+
+/**
+ * Watches files and directories for changes by other processes.
+ *
+ * Uses inotify where available. The inotify file descriptor is served by the
+ * EventDispatcher, so no polling is needed regardless of the number of
+ * watched files. Files are watched through their directory, so that files
+ * which are replaced by renaming or which do not exist yet are noticed too.
+ *
+ * Notifications are coalesced: a callback is invoked once for all changes
+ * of a file within DEBOUNCE_MICROSECS after the first change.
+ */
+class FileWatcher : public HeapObject
+{
+public:
+    static FileWatcher* getInstance();
+
+    /**
+     * If false, callers must check their files themselves.
+     */
+    bool isAvailable() const {
+        return inotifyListener.isValid();
+    }
+
+    /**
+     * The callback is invoked with the given fileName if the file is
+     * modified, replaced or removed.
+     *
+     * @return false if the file cannot be watched.
+     */
+    bool watchFile(const String& fileName, Callback<const String&>::Ptr callback);
+
+    /**
+     * The callback is invoked with the name of the changed file for
+     * changes of files directly within the directory.
+     *
+     * @return false if the directory cannot be watched.
+     */
+    bool watchDirectory(const String& dirName, Callback<const String&>::Ptr callback);
+
+    /**
+     * Removes all watches whose callbacks refer to callbackObject.
+     */
+    void removeWatchesFor(HeapObject* callbackObject);
+
+private:
+    friend class SingletonInstance<FileWatcher>;
+    static SingletonInstance<FileWatcher> instance;
+
+    enum { DEBOUNCE_MICROSECS = 100 * 1000 };
+
+    FileWatcher();
+    ~FileWatcher();
+
+    struct Listener
+    {
+        String                       baseName; // empty for directory listeners
+        String                       fileName;
+        Callback<const String&>::Ptr callback;
+    };
+
+    class Directory : public HeapObject
+    {
+    public:
+        typedef OwningPtr<Directory> Ptr;
+
+        static Ptr create(int watchDescriptor, const String& dirName) {
+            return Ptr(new Directory(watchDescriptor, dirName));
+        }
+        int                   watchDescriptor;
+        String                dirName;
+        ObjectArray<Listener> listeners;
+    private:
+        Directory(int watchDescriptor, const String& dirName)
+            : watchDescriptor(watchDescriptor),
+              dirName(dirName)
+        {}
+    };
+
+    struct Notification
+    {
+        String                       fileName;
+        Callback<const String&>::Ptr callback;
+    };
+
+    bool addListener(const String& dirName, const Listener& listener);
+    void removeDisabledListeners();
+    void removeDirectory(Directory::Ptr directory);
+
+    void handleEvents(int fileDescriptor);
+    void notifyListeners(Directory::Ptr directory, const char* changedName);
+    void addNotification(const String& fileName, Callback<const String&>::Ptr callback);
+    void handleDebounceTimer();
+
+    FileDescriptorListener::Ptr inotifyListener;
+
+    HashMap<int,    Directory::Ptr> directories;
+    HashMap<String, int>            watchDescriptors;
+
+    ObjectArray<Notification> pendingNotifications;
+    bool isTimerPending;
+};
+
+} // namespace LucED
+
+#endif // FILE_WATCHER_HPP
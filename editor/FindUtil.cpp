@@ -24,6 +24,7 @@
 #include "GlobalLuaInterpreter.hpp"
 #include "RegexException.hpp"
 #include "GlobalConfig.hpp"
+#include "util.hpp"
 
 using namespace LucED;
 
@@ -287,7 +288,8 @@ void FindUtil::initialize()
         return;
     }
 
-    BasicRegex::CreateOptions opts = BasicRegex::MULTILINE;
+    BasicRegex::CreateOptions opts = BasicRegex::CreateOptions() | BasicRegex::MULTILINE 
+                                                                 | BasicRegex::STUDY;
     if (p.hasIgnoreCaseFlag()) {
         opts |= BasicRegex::IGNORE_CASE;
     }
@@ -382,16 +384,22 @@ bool FindUtil::doesMatch()
             initialize();
         }
 
-        int   textLength     = textData->getLength();
-        byte* textStart      = textData->getAmount(0, textLength);
+        long textLength = textData->getLength();
 
         if (textPosition < 0 || textPosition > textLength) {
             wasFoundFlag = false;
             return false;
         }
-
-        if (regex.findMatch(this, &FindUtil::pcreCalloutFunction,
-                            (char*)textStart, textLength, textPosition, BasicRegex::ANCHORED, ovector)) {
+        long blockStartPos = textData->getBeginOfWChar
+                             (
+                                   (textPosition - maxBackwardAssertionLength > 0)
+                                 ? (textPosition - maxBackwardAssertionLength) 
+                                 : 0
+                             );
+
+        if (regex.findMatchInSegments(this, &FindUtil::pcreCalloutFunction,
+                                      textData, blockStartPos, textPosition, textLength,
+                                      BasicRegex::ANCHORED, ovector, &windowBuffer)) {
             wasFoundFlag = true;
         } else {
             wasFoundFlag = false;
@@ -406,6 +414,42 @@ bool FindUtil::doesMatch()
     }
 }
 
+bool FindUtil::findLastMatchBetween(long firstStartPos, long lastStartPos, 
+                                    long maxEndPos, long subjectEndPos)
+{
+    bool wasFound = false;
+    long startPos = firstStartPos;
+    
+    while (startPos <= lastStartPos)
+    {
+        long lookBehindPos = textData->getBeginOfWChar
+                             (
+                                   (startPos - maxBackwardAssertionLength > 0)
+                                 ? (startPos - maxBackwardAssertionLength) 
+                                 : 0
+                             );
+        if (!regex.findMatchInSegments(this, &FindUtil::pcreCalloutFunction,
+                                       textData, lookBehindPos, startPos, subjectEndPos,
+                                       BasicRegex::MatchOptions(), ovector, &windowBuffer,
+                                       lastStartPos))
+        {
+            break;
+        }
+        if (ovector[1] <= maxEndPos) {
+            lastMatchOvector.clear();
+            lastMatchOvector.append(ovector);
+            wasFound = true;
+        }
+        startPos = getNextPos(ovector[0]);
+    }
+    if (wasFound) {
+        ovector.clear();
+        ovector.append(lastMatchOvector);
+    }
+    return wasFound;
+}
+
+
 void FindUtil::findNext()
 {
     try
@@ -442,23 +486,17 @@ void FindUtil::findNext()
                                      ? (textPosition - maxBackwardAssertionLength) 
                                      : 0
                                  );
-            long blockLength   = textData->getNextBeginOfWChar
+            long blockEndPos   = textData->getNextBeginOfWChar
                                  (
                                        (epos + maxForwardAssertionLength < textData->getLength()) 
                                      ? (epos + maxForwardAssertionLength) 
                                      : (textData->getLength())
-                                 ) 
-                                 - blockStartPos;
-                                 
-            byte* blockStartPtr = textData->getAmount(blockStartPos, blockLength);
-
-            if (regex.findMatch(this, &FindUtil::pcreCalloutFunction,
-                                (char*)blockStartPtr, blockLength, textPosition - blockStartPos,
-                                BasicRegex::MatchOptions(), ovector))
+                                 );
+
+            if (regex.findMatchInSegments(this, &FindUtil::pcreCalloutFunction,
+                                          textData, blockStartPos, textPosition, blockEndPos,
+                                          BasicRegex::MatchOptions(), ovector, &windowBuffer))
             {
-                for (int i = 0, n = ovector.getLength(); i < n; ++i) {
-                    ovector[i] += blockStartPos;
-                }
                 if (ovector[1] <= epos)
                 {
                     if (p.hasAllowMatchAtStartOfSearchFlag() || doItCounter > 1 || startingTextPosition < ovector[1])
@@ -474,8 +512,11 @@ void FindUtil::findNext()
                 }
             }
         } else {
-            int   textLength     = textData->getLength();
-            byte* textStart      = textData->getAmount(0, textLength);
+            // The text is scanned backwards in blocks, within each block 
+            // matches are searched forward and the last one is taken.
+            // Blocks are small at first, because most matches are near.
+
+            long textLength = textData->getLength();
             
             long epos;
             if (maximalEndOfMatchPosition == -1) {
@@ -487,28 +528,32 @@ void FindUtil::findNext()
             if (noMatchBeforePosition != -1) {
                 zpos = noMatchBeforePosition;
             }
-            while (!wasFoundFlag && textPosition >= zpos) {
-                if (regex.findMatch(this, &FindUtil::pcreCalloutFunction,
-                                    (char*)textStart, textLength, textPosition, BasicRegex::ANCHORED, ovector))
-                {
-                    if (ovector[1] <= epos) 
-                    {
-                        if (p.hasAllowMatchAtStartOfSearchFlag() || doItCounter > 1 || ovector[0] < startingTextPosition)
-                        {
-                            wasFoundFlag = true;
-                        }
-                        else if (doItCounter == 1 && 0 < textPosition)
-                        {
-                            textPosition = getPrevPos(textPosition);
-                            goto doItAgain;
-                        }
-                        else {
-                            textPosition = getPrevPos(textPosition);
-                        }
-                    }
+            long subjectEndPos = textData->getNextBeginOfWChar
+                                 (
+                                       (epos + maxForwardAssertionLength < textLength) 
+                                     ? (epos + maxForwardAssertionLength) 
+                                     : (textLength)
+                                 );
+            long lastStartPos = textPosition;
+            
+            if (!p.hasAllowMatchAtStartOfSearchFlag()) {
+                lastStartPos = getPrevPos(lastStartPos);
+            }
+            long blockLength = MIN_BACKWARD_BLOCK_LENGTH;
+
+            while (!wasFoundFlag && lastStartPos >= zpos)
+            {
+                long firstStartPos = textData->getBeginOfWChar(util::maximum(zpos, lastStartPos - blockLength));
+                
+                if (firstStartPos < zpos) {
+                    firstStartPos = zpos;
                 }
-                else {
-                    textPosition = getPrevPos(textPosition);
+                if (findLastMatchBetween(firstStartPos, lastStartPos, epos, subjectEndPos)) {
+                    wasFoundFlag = true;
+                    textPosition = ovector[0];
+                } else {
+                    lastStartPos = getPrevPos(firstStartPos);
+                    blockLength  = util::minimum(2 * blockLength, (long) MAX_BACKWARD_BLOCK_LENGTH);
                 }
             }
         }
@@ -308,7 +308,15 @@ private:
     long maximalEndOfMatchPosition;
     RawPtr<TextData> textData;
     
+    enum { MIN_BACKWARD_BLOCK_LENGTH =      1024,
+           MAX_BACKWARD_BLOCK_LENGTH = 64 * 1024 };
+
+    bool findLastMatchBetween(long firstStartPos, long lastStartPos, 
+                              long maxEndPos, long subjectEndPos);
+
     MemArray<int> ovector;
+    MemArray<int> lastMatchOvector;
+    ByteArray     windowBuffer;
     
     ObjectArray<CalloutObject::Ptr> calloutObjects;
     bool wasError;
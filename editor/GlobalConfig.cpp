@@ -32,6 +32,10 @@
 #include "ActionIdRegistry.hpp"
 #include "QualifiedName.hpp"
 #include "DefaultConfig.hpp"
+#include "FileWatcher.hpp"
+#include "FileException.hpp"
+#include "LuaException.hpp"
+#include "ConfigErrorHandler.hpp"
                             
 using namespace LucED;
 
@@ -54,6 +58,7 @@ ConfigData::Ptr GlobalConfig::getConfigData()
 
 GlobalConfig::GlobalConfig()
         : syntaxPatternsConfig(SyntaxPatternsConfig::create()),
+          configReadTime(TimeStamp::now()),
           textStyleDefinitions(TextStyleDefinitions::create())
 {}
 
@@ -80,7 +85,14 @@ LanguageMode::Ptr GlobalConfig::getLanguageModeForFileName(const String& fileNam
 GlobalConfig::LanguageModeAndEncoding GlobalConfig::getLanguageModeAndEncodingForFileNameAndContent(const String& fileName, 
                                                                                                     RawPtr<const ByteBuffer> fileContent) const
 {
-    LanguageModeSelectors::Result result = languageModeSelectors->getResultForFileNameAndContent(fileName, fileContent);
+    return getLanguageModeAndEncodingForFileNameAndContent(fileName, fileContent->getTotalAmount(), fileContent->getLength());
+}
+
+GlobalConfig::LanguageModeAndEncoding GlobalConfig::getLanguageModeAndEncodingForFileNameAndContent(const String& fileName, 
+                                                                                                    const byte*   fileContent,
+                                                                                                    long          contentLength) const
+{
+    LanguageModeSelectors::Result result = languageModeSelectors->getResultForFileNameAndContent(fileName, fileContent, contentLength);
 
     LanguageMode::Ptr languageMode = languageModes->getLanguageMode(result.languageModeName);
     if (!languageMode.isValid()) {
@@ -305,8 +317,12 @@ void GlobalConfig::readConfig()
 {
     packagesMap.clear();
     
+    configReadTime  = TimeStamp::now();
     configDirectory = DefaultConfig::getCreatedConfigDirectory().getAbsoluteNameWithResolvedLinks();
 
+    FileWatcher::getInstance()->removeWatchesFor(this);
+    watchConfigDirectory(configDirectory, 0);
+
     ConfigException::ErrorList::Ptr errorList = ConfigException::ErrorList::create();
 
     RawPtr<GlobalLuaInterpreter> luaInterpreter = GlobalLuaInterpreter::getInstance();
@@ -526,6 +542,59 @@ void GlobalConfig::notifyAboutNewFileContent(String fileName)
     }
 }
 
+void GlobalConfig::watchConfigDirectory(const String& dirName, int depth)
+{
+    // depth guards against cycles of symbolic links
+
+    if (depth <= MAX_WATCHED_DIRECTORY_DEPTH && FileWatcher::getInstance()->watchDirectory(dirName, newCallback(this, &GlobalConfig::handleChangedConfigFile)))
+    {
+        DirectoryReader dirReader(dirName);
+        
+        while (dirReader.next())
+        {
+            String name = dirReader.getName();
+            
+            if (!name.startsWith(".")) {
+                try {
+                    if (dirReader.isDirectory()) {
+                        watchConfigDirectory(String() << dirName << "/" << name, depth + 1);
+                    }
+                } catch (FileException& ex) {
+                    // e.g. dangling symbolic link
+                }
+            }
+        }
+    }
+}
+
+/**
+ * Called by the FileWatcher. Files that were saved by this editor have already
+ * been read by notifyAboutNewFileContent().
+ */
+void GlobalConfig::handleChangedConfigFile(const String& fileName)
+{
+    File::Info fileInfo = File(fileName).getInfo();
+    
+    bool isRelevant = fileName.endsWith(luaFileExtension)
+                   || (fileInfo.exists() && fileInfo.isDirectory());
+
+    if (isRelevant && (!fileInfo.exists() || fileInfo.getLastModifiedTime() >= configReadTime))
+    {
+        try
+        {
+            GlobalLuaInterpreter::getInstance()->resetModules();
+        
+            readConfig();
+        }
+        catch (LuaException& ex) {
+            ConfigErrorHandler::startWithCatchedException();
+        }
+        catch (ConfigException& ex) {
+            ConfigErrorHandler::startWithCatchedException();
+        }
+    }
+}
+
 bool GlobalConfig::dependsOnPackage(const String& packageName) const
 {
     Nullable<bool> flag = packagesMap.get(packageName);
@@ -34,6 +34,7 @@
 #include "Callback.hpp"
 #include "CallbackContainer.hpp"
 #include "MicroSeconds.hpp"
+#include "TimeStamp.hpp"
 #include "SyntaxPatternsConfig.hpp"
 #include "ActionKeyConfig.hpp"
 #include "LuaVar.hpp"
@@ -78,6 +79,7 @@ public:
     };
 
     LanguageModeAndEncoding getLanguageModeAndEncodingForFileNameAndContent(const String& fileName, RawPtr<const ByteBuffer> fileContent) const;
+    LanguageModeAndEncoding getLanguageModeAndEncodingForFileNameAndContent(const String& fileName, const byte* fileContent, long contentLength) const;
     LanguageMode::Ptr       getDefaultLanguageMode() const;
 
     void notifyAboutNewFileContent(String fileName);
@@ -121,6 +123,11 @@ private:
 
     ActionKeyConfig::Ptr buildActionKeyConfig();
 
+    enum { MAX_WATCHED_DIRECTORY_DEPTH = 8 };
+
+    void watchConfigDirectory(const String& dirName, int depth);
+    void handleChangedConfigFile(const String& fileName);
+
     static void appendFontTo(ConfigDataFont::Ptr      font,
                              ConfigDataFontList::Ptr  fonts, 
                              const String&            thisPackageName);
@@ -162,6 +169,8 @@ private:
     
     String configDirectory;
     
+    TimeStamp configReadTime;
+    
     HashMap<String,bool> packagesMap;
     
     TextStyleDefinitions::Ptr textStyleDefinitions;
@@ -85,7 +85,7 @@ void GotoLinePanel::handleButtonPressed(Button* button, Button::ActivationVarian
             int textLength = editField->getTextData()->getLength();
             if (textLength > 0)
             {
-                byte* ptr = editField->getTextData()->getAmount(0, textLength);
+                const byte* ptr = editField->getTextData()->getAmount(0, textLength);
                 int newLineNumber = 0;
                 for (int i = 0; i < textLength; ++i) {
                     switch (ptr[i]) {
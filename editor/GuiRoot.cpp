@@ -120,6 +120,8 @@ GuiRoot::GuiRoot()
     if (display == NULL) {
         throw SystemException(String() << "Cannot open display \"" << XDisplayName(NULL) << "\"");
     }
+    System::setCloseOnExecFlag(ConnectionNumber(display));
+
 #ifdef ABORT_ON_X11_ERRORS
     XSynchronize(display, True);
 #endif
@@ -19,10 +19,16 @@
 //
 /////////////////////////////////////////////////////////////////////////////////////
 
+#include <string.h>
+#include <unistd.h>
+
 #include "util.hpp"
 #include "HilitedText.hpp"
 #include "EventDispatcher.hpp"
 #include "GlobalConfig.hpp"
+#include "HilitingScheduler.hpp"
+#include "Thread.hpp"
+#include "SystemException.hpp"
 
 //#define processAmountUnit (10 * breakPointDistance)  // TODO: muss grer sein als das grte vorkommende Pattern
 //#define processAmountUnit 500  // TODO: muss grer sein als das grte vorkommende Pattern
@@ -39,8 +45,25 @@ HilitedText::HilitedText(TextData::Ptr textData, LanguageMode::Ptr languageMode)
           rememberedLastProcessingRestartedIterator(createNewIterator()),
           languageMode(languageMode),
           startNextProcessIterator(createNewIterator()),
-          tryToBeLastBreakIterator(createNewIterator()),
-          processHandler(ProcessHandler::create(this, &HilitedText::process, &HilitedText::needsProcessing))
+          tryToBeLastBreakIterator(createNewIterator())
+#if LUCED_USE_MULTI_THREAD
+        , isParsingThreadUsable(true),
+          isJobRunning(false),
+          hasStagedBreaks(false),
+          canMergeBeStopped(false),
+          mergeIndex(0),
+          mutex(Mutex::create()),
+          isJobRequested(false),
+          jobId(0),
+          parsingJobId(0),
+          isStopRequested(false),
+          isJobFinished(false),
+          isTaskPending(false),
+          jobStartPos(0),
+          jobText(NULL),
+          jobSyntaxPatterns(NULL),
+          jobBreakPointDistance(0)
+#endif
 {
     textData                      ->registerUpdateListener(newCallback(this, &HilitedText::treatTextDataUpdate));
     EventDispatcher::getInstance()->registerUpdateSource  (newCallback(this, &HilitedText::flushPendingUpdates));
@@ -61,13 +84,14 @@ HilitedText::HilitedText(TextData::Ptr textData, LanguageMode::Ptr languageMode)
 
     ASSERT(syntaxPatterns.isValid());
     
-    if (syntaxPatterns->hasPatterns()) {
-        this->ovector.increaseTo(syntaxPatterns->getMaxOvecSize());
-    }
-    EventDispatcher::getInstance()->registerProcess(processHandler);
+#if LUCED_USE_MULTI_THREAD
+    this->handleStagedBreaksCallback = newCallback(this, &HilitedText::handleStagedBreaks);
+#endif
+    HilitingScheduler::getInstance()->registerHilitedText(this);
 }
 
 
+
 void HilitedText::setLanguageMode(LanguageMode::Ptr languageMode)
 {
     if (languageMode != this->languageMode)
@@ -90,10 +114,10 @@ void HilitedText::treatSyntaxPatternsUpdate(SyntaxPatterns::Ptr newSyntaxPattern
 {
     if (this->syntaxPatterns != newSyntaxPatterns)
     {
+#if LUCED_USE_MULTI_THREAD
+        cancelParsingThreadJob();
+#endif
         this->syntaxPatterns = newSyntaxPatterns;
-        if (syntaxPatterns->hasPatterns()) {
-            this->ovector.increaseTo(syntaxPatterns->getMaxOvecSize());
-        }
         HilitingBase::clear();
     
         this->beginChangedPos = 0;
@@ -148,33 +172,6 @@ bool HilitedText::setBreak(IteratorHandle iterator,
 }
 
 
-bool HilitedText::fillWithBreaks(IteratorHandle iterator, 
-        long fillStart, long fillEnd,
-        long *lastFillEnd, PatternStack& patternStack)
-{
-    long p;
-    long p1 = fillStart;
-    bool canBeStopped = false;
-
-    if (*lastFillEnd + breakPointDistance <= fillEnd) {
-        p = *lastFillEnd + breakPointDistance;
-        util::maximize(&p, p1);
-        do {
-            ASSERT(!isEndOfBreaks(iterator));
-            incIterator(iterator);
-            canBeStopped = setBreak(iterator, p1, p, p, 
-                    Break_INTER, patternStack) || canBeStopped;
-            ASSERT(!isEndOfBreaks(iterator));
-                    
-            *lastFillEnd = getBreakEndPos(iterator); // p;
-            p1  = p;
-            p  += breakPointDistance;
-        } while (p < fillEnd);
-    }
-    return canBeStopped;
-}
-
-
 inline int HilitedText::getReparseDistance(IteratorHandle iterator)
 {
     BreakType type = getBreakType(iterator);
@@ -219,14 +216,35 @@ void HilitedText::gotoReparseStart(long textPos, IteratorHandle iterator)
 
 bool HilitedText::needsProcessing()
 {
+#if LUCED_USE_MULTI_THREAD
+    if (isJobRunning) {
+        return hasStagedBreaks || mergeIndex < mergedBreaks.getLength();
+    }
+#endif
     return needsProcessingFlag;
 }
 
+long HilitedText::getProcessedEndPos()
+{
+    if (needsProcessingFlag) {
+        return getBreakEndPos(startNextProcessIterator);
+    } else {
+        return textData->getLength();
+    }
+}
+
 void HilitedText::treatTextDataUpdate(TextData::UpdateInfo u)
 {
     if (!syntaxPatterns->hasPatterns()) {
         return;
     }
+#if LUCED_USE_MULTI_THREAD
+    // the breaks of the parsing thread refer to the unmodified text, 
+    // parsing is restarted at startNextProcessIterator
+
+    cancelParsingThreadJob();
+    jobSnapshot.invalidate();
+#endif
     HilitingBase::treatTextDataUpdate(rememberedLastProcessingRestartedIterator, 
             u.beginChangedPos, u.oldEndChangedPos, u.changedAmount);
 
@@ -292,26 +310,35 @@ void HilitedText::flushPendingUpdates()
     this->endChangedPos   = 0;
 }
 
-int HilitedText::pcreCalloutFunction(void* voidPtr, pcre_callout_block* calloutBlock)
-{
-    HilitedText* self = static_cast<HilitedText*>(voidPtr);
 
-    ASSERT(calloutBlock->callout_number == 1);
 
-    bool didMatch = false;
+/**
+ * Sets the breaks found by a HilitingParser immediately.
+ */
+class HilitedText::BreakSetter
+{
+public:
+    BreakSetter(HilitedText* hilitedText, TimeStamp endTime)
+        : hilitedText(hilitedText),
+          endTime(endTime)
+    {}
 
-    if (   calloutBlock->capture_last != -1 
-        && self->ovector[calloutBlock->capture_last * 2 + 1] == calloutBlock->current_position)
+    bool setBreak(long startPos1, long startPos, long endPos, BreakType type, 
+                  const PatternStack& stack, bool isStopPoint)
     {
-        int i1 = self->ovector[calloutBlock->capture_last * 2 + 0];
-        int i2 = self->ovector[calloutBlock->capture_last * 2 + 1];
-        
-        didMatch = self->pushedSubstr.equals(calloutBlock->subject + i1, i2 - i1);
+        hilitedText->incIterator(hilitedText->startNextProcessIterator);
+        return hilitedText->setBreak(hilitedText->startNextProcessIterator, 
+                                     startPos1, startPos, endPos, type, stack);
     }
 
-    return didMatch ? 0 : 1;
-}
+    bool isInterrupted() const {
+        return TimeStamp::now() >= endTime;
+    }
 
+private:
+    HilitedText* hilitedText;
+    TimeStamp    endTime;
+};
 
 
 int HilitedText::process(TimeStamp endTime)
@@ -320,240 +347,836 @@ int HilitedText::process(TimeStamp endTime)
         needsProcessingFlag =  false;
         return 0;
     }
+#if LUCED_USE_MULTI_THREAD
+    if (isJobRunning) {
+        return mergeParsedBreaks(endTime);
+    }
+    // the parsing thread cannot be used if the HilitingBase does not
+    // match the current text, short texts are parsed here in a few steps
+
+    const bool useParsingThread =    isParsingThreadUsable 
+                                  && !textData->hasPendingUpdates()
+                                  &&   textData->getLength() - getBreakEndPos(startNextProcessIterator) 
+                                     >= THREAD_MIN_LENGTH;
+
+    if (useParsingThread) {
+        TimeStamp latest = TimeStamp::now() + MicroSeconds(MAX_MAIN_THREAD_MICRO_SECS);
+        if (latest < endTime) {
+            endTime = latest;
+        }
+    }
+#endif
     ASSERT(!isEndOfBreaks(startNextProcessIterator));
-    long pos = getBreakEndPos(startNextProcessIterator);
+    long wasStartPos = getBreakEndPos(startNextProcessIterator);
 
-    long wasStartPos = pos;
-    long lastSetBreakEnd = pos;
-    SyntaxPattern* sp = syntaxPatterns->get(getLastBreakStackByte(startNextProcessIterator));
+    util::minimize(&this->beginChangedPos, wasStartPos);
+    copyBreakStackTo(startNextProcessIterator, patternStack);
 
-    long processAmountUnit = 10 * breakPointDistance;
+    HilitingParser<TextData> parser(textData.getRawPtr(), syntaxPatterns.getRawPtr(), breakPointDistance);
+    BreakSetter              breakSetter(this, endTime);
 
-    util::maximize(&processAmountUnit, (long)3000);
+    HilitingParserTypes::Result result = parser.parse(wasStartPos, patternStack, &breakSetter);
 
-    long searchEndPos = pos + processAmountUnit;
+    handleParsingResult(result);
 
-#if 0
-TimeStamp startTime = TimeStamp::now();
-printf("------HilitedText::process start = %ld / %ld .. %ld --> %d\n", getBreakStartPos(startNextProcessIterator),
-                                                                pos, searchEndPos, 
-                                                                getLastBreakStackByte(startNextProcessIterator));
+#if LUCED_USE_MULTI_THREAD
+    if (result == HilitingParserTypes::INTERRUPTED && useParsingThread) {
+        startParsingThreadJob();
+    }
+    else if (!needsProcessingFlag) {
+        // a kept snapshot lets the next modification copy the chunk
+        jobSnapshot.invalidate();
+    }
 #endif
+    return parser.getPos() - wasStartPos;
+}
 
-    long oldBreakPos = pos;
-    long foundStartPos = pos;
-    long foundEndPos = pos;
-    BreakType foundType = Break_INTER;
-    util::minimize(&this->beginChangedPos, pos);
-    bool canBeStopped = false;
-    copyBreakStackTo(startNextProcessIterator, patternStack);
-    pushedSubstr = patternStack.getAdditionalDataAsString();
-    
-    bool wasZeroLengthMatch = false;
-    bool loopFinished = false;
+
+void HilitedText::handleParsingResult(HilitingParserTypes::Result result)
+{
     const long textDataLength = textData->getLength();
-    do
+
+    util::maximize(&this->endChangedPos, getBreakEndPos(startNextProcessIterator));
+
+    ASSERT(!isEndOfBreaks(startNextProcessIterator));
+
+    if (result == HilitingParserTypes::CAN_BE_STOPPED)
+    {
+        this->processingEndBeforeRestartFlag = false;
+        while (!isEndOfBreaks(tryToBeLastBreakIterator)) {
+            incIterator(tryToBeLastBreakIterator);
+        }
+        if (textDataLength - getBreakStartPos(tryToBeLastBreakIterator) < 2 * breakPointDistance) { 
+            this->needsProcessingFlag = false;
+            this->endChangedPos = textDataLength;
+        } else {
+            this->needsProcessingFlag = true;
+
+            incIterator(startNextProcessIterator);
+            util::maximize(&this->endChangedPos, getBreakStartPos(startNextProcessIterator));
+
+            copyToIteratorFromIterator(startNextProcessIterator, tryToBeLastBreakIterator);
+            decIterator(startNextProcessIterator);
+        }
+    }
+    else if (result == HilitingParserTypes::END_OF_TEXT)
     {
-        util::minimize(&searchEndPos, textDataLength);
+        this->processingEndBeforeRestartFlag = false;
+        this->needsProcessingFlag = false;
         
-        while (!canBeStopped && pos < searchEndPos)
+        if (!isLastBreak(startNextProcessIterator))
         {
-            ASSERT(sp == syntaxPatterns->get(patternStack.getLast()));
-            long extendedSearchEndPos = searchEndPos + sp->maxREBytesExtend;
-            BasicRegex::MatchOptions additionalOptions;
-            
-            util::minimize(&extendedSearchEndPos, textDataLength);
-            if (!textData->isBeginOfLine(pos)) {
-                additionalOptions |= BasicRegex::NOTBOL;
+            // delete trailing Breaks
+
+            incIterator(startNextProcessIterator);
+            Iterator tempIterator = createNewIterator();
+            copyToIteratorFromIterator(tempIterator, startNextProcessIterator);
+            while (!isEndOfBreaks(tempIterator)) {
+                incIterator(tempIterator);
             }
-            if (!textData->isEndOfLine(extendedSearchEndPos)) {
-                additionalOptions |= BasicRegex::NOTEOL;
+            deleteBreaks(startNextProcessIterator, tempIterator);
+        }
+        util::maximize(&this->endChangedPos, textDataLength);
+    }
+    ASSERT(!needsProcessingFlag || !isEndOfBreaks(startNextProcessIterator));
+}
+
+
+#if LUCED_USE_MULTI_THREAD
+
+namespace
+{
+    /**
+     * Returns the begin of the first line starting at or after pos.
+     */
+    long getLineBeginAfter(const TextSnapshot* text, long pos)
+    {
+        if (pos == 0) {
+            return 0;
+        }
+        long length = text->getLength();
+        --pos;
+
+        while (pos < length)
+        {
+            const byte* ptr;
+            long n = text->getContiguousAmount(pos, length - pos, &ptr);
+            const byte* p = (const byte*) memchr(ptr, '\n', n);
+            if (p != NULL) {
+                return pos + (p - ptr) + 1;
             }
-            
-            bool matched = sp->re.findMatch(this, &HilitedText::pcreCalloutFunction,
-                                            (const char*) textData->getAmount(pos, extendedSearchEndPos - pos), 
-                        extendedSearchEndPos - pos, 0,
-                        additionalOptions /*| BasicRegex::NOTEMPTY*/, ovector);
-            
-            if (matched)
+            pos += n;
+        }
+        return length;
+    }
+}
+
+
+/**
+ * Parses a chunk of a TextSnapshot speculatively from the root pattern stack.
+ *
+ * Parsing is continued until a break ends at or after the end of the chunk,
+ * so that the ParsingThread can continue after the last break of the chunk
+ * if it takes over the breaks.
+ */
+class HilitedText::ChunkParsingThread : public Thread
+{
+public:
+    typedef LucED::OwningPtr<ChunkParsingThread> Ptr;
+
+    static Ptr create(HilitedText* hilitedText, long beginPos, long endPos) {
+        return Ptr(new ChunkParsingThread(hilitedText, beginPos, endPos));
+    }
+
+    bool setBreak(long startPos1, long startPos, long endPos, BreakType type, 
+                  const PatternStack& stack, bool isStopPoint)
+    {
+        ParsedBreak b;
+                    b.startPos1   = startPos1;
+                    b.startPos    = startPos;
+                    b.endPos      = endPos;
+                    b.type        = type;
+                    b.isStopPoint = isStopPoint;
+                    b.stackBegin  = stacks.getLength();
+                    b.stackLength = stack.getLength();
+        breaks.append(b);
+        stacks.append(stack.getPtr(0), stack.getLength());
+        return false;
+    }
+
+    bool isInterrupted()
+    {
+        if (breaks.getLength() > 0 && breaks.getLast().endPos >= endPos) {
+            return true;
+        }
+        Mutex::Lock lock(hilitedText->mutex);
+        return hilitedText->isJobCancelled(jobId);
+    }
+
+    long getBeginPos() const {
+        return beginPos;
+    }
+
+    /**
+     * Must be called with locked mutex, the breaks may only be
+     * accessed after the chunk is finished.
+     */
+    bool isFinished() const {
+        return isFinishedFlag;
+    }
+
+    const MemArray<ParsedBreak>& getBreaks() const {
+        return breaks;
+    }
+
+    const byte* getStack(const ParsedBreak& b) const {
+        return stacks.getPtr(b.stackBegin);
+    }
+
+protected:
+    virtual void main()
+    {
+        PatternStack rootStack;
+                     rootStack.append(0);
+
+        HilitingParser<TextSnapshot> parser(text, syntaxPatterns, breakPointDistance);
+
+        parser.parse(beginPos, rootStack, this);
+
+        Mutex::Lock lock(hilitedText->mutex);
+        isFinishedFlag = true;
+
+        if (hilitedText->isJobCancelled(jobId) && !hilitedText->isStopRequested) {
+            // the main thread can release the cancelled job
+            hilitedText->notifyMainThread();
+        }
+        lock.notifyAll();
+    }
+
+private:
+    ChunkParsingThread(HilitedText* hilitedText, long beginPos, long endPos)
+        : hilitedText(hilitedText),
+          text(hilitedText->jobSnapshot.getRawPtr()),
+          syntaxPatterns(hilitedText->syntaxPatterns.getRawPtr()),
+          breakPointDistance(hilitedText->breakPointDistance),
+          jobId(hilitedText->jobId),
+          beginPos(beginPos),
+          endPos(endPos),
+          isFinishedFlag(false)
+    {}
+
+    HilitedText*          hilitedText;
+    const TextSnapshot*   text;
+    SyntaxPatterns*       syntaxPatterns;
+    long                  breakPointDistance;
+    long                  jobId;
+    long                  beginPos;
+    long                  endPos;
+    bool                  isFinishedFlag;
+    MemArray<ParsedBreak> breaks;
+    ByteArray             stacks;
+};
+
+
+/**
+ * Parses a TextSnapshot and stages the breaks found for the HilitedText.
+ *
+ * The thread only accesses objects that are kept alive by the main thread 
+ * while a job is running, i.e. the TextSnapshot and the SyntaxPatterns,
+ * and after it was cancelled by a CancelledJob.
+ */
+class HilitedText::ParsingThread : public Thread
+{
+public:
+    typedef LucED::OwningPtr<ParsingThread> Ptr;
+
+    static Ptr create(HilitedText* hilitedText) {
+        return Ptr(new ParsingThread(hilitedText));
+    }
+
+    bool setBreak(long startPos1, long startPos, long endPos, BreakType type, 
+                  const PatternStack& stack, bool isStopPoint)
+    {
+        ParsedBreak b;
+                    b.startPos1   = startPos1;
+                    b.startPos    = startPos;
+                    b.endPos      = endPos;
+                    b.type        = type;
+                    b.isStopPoint = isStopPoint;
+                    b.stackLength = stack.getLength();
+
+        if (wasChunkTakenOver) {
+            return true;
+        }
+        if (!appendBreak(b, stack.getPtr(0))) {
+            return true;
+        }
+        if (nextChunkIndex < chunks.getLength() && startPos >= chunks[nextChunkIndex]->getBeginPos()) {
+            return takeOverConvergedChunk(b, stack);
+        }
+        return false;
+    }
+
+    bool isInterrupted()
+    {
+        Mutex::Lock lock(hilitedText->mutex);
+        return hilitedText->isJobCancelled(jobId);
+    }
+
+protected:
+    virtual void main()
+    {
+        PatternStack startStack;
+
+        for (;;)
+        {
+            const TextSnapshot* text;
+            SyntaxPatterns*     syntaxPatterns;
+            long                breakPointDistance;
+            long                startPos;
             {
-                // something matched
-    
-                if (ovector[1] == 0)
-                {
-                    if (wasZeroLengthMatch) {
-                        ovector[1] = 1; // prevent endless loop for second zero length match
-                        wasZeroLengthMatch = false;
-                    }
-                    else {
-                        wasZeroLengthMatch = true;
-                    }
+                Mutex::Lock lock(hilitedText->mutex);
+
+                while (!hilitedText->isStopRequested && !hilitedText->isJobRequested) {
+                    lock.waitForNotify();
                 }
-                else {
-                    wasZeroLengthMatch = false;
+                if (hilitedText->isStopRequested) {
+                    break;
                 }
-    
-                canBeStopped = fillWithBreaks(startNextProcessIterator, pos, pos + ovector[0], &lastSetBreakEnd, patternStack);
-                if (canBeStopped) break;
-                
-                int cid = sp->getMatchedChild(ovector);
-                if (cid == -1)
-                {
-                    // EndPattern matched
-     
-                    foundStartPos = pos + ovector[0];
-                    foundEndPos = pos + ovector[1];
-                    foundType = Break_END;
-    
-                    //memset(hb->buffer + pos + ovector[0], sp->style, ovector[1] - ovector[0]);
-                    pos += ovector[1];
-                    patternStack.removeLast();
-                    sp = syntaxPatterns->get(patternStack.getLast());
-                    pushedSubstr = patternStack.getAdditionalDataAsString();
+                hilitedText->isJobRequested    = false;
+                hilitedText->parsingJobId      = hilitedText->jobId;
+
+                jobId              = hilitedText->jobId;
+
+                text               = hilitedText->jobText;
+                syntaxPatterns     = hilitedText->jobSyntaxPatterns;
+                breakPointDistance = hilitedText->jobBreakPointDistance;
+                startPos           = hilitedText->jobStartPos;
+                startStack         = hilitedText->jobStartStack;
+
+                chunks.clear();
+                for (long i = 0, n = hilitedText->chunkThreads.getLength(); i < n; ++i) {
+                    chunks.append(hilitedText->chunkThreads[i].getRawPtr());
                 }
-                else
-                {
-                    // normal Child matched
-                    
-                    SyntaxPattern* cpat = syntaxPatterns->getChildPattern(sp, cid);
-                        
-                    if (patternStack.getLength() >= STACK_SIZE
-                            && cpat->hasEndPattern) {
-    
-                        // New Begin-Child, but Stack is too big
-    
-                        foundStartPos = pos + ovector[1];
-                        foundEndPos   = foundStartPos;
-                        pos += ovector[1];
-                        foundType = Break_INTER;
-                        
-                    } else {
-                        
-                        // Stack is ok or doesn't need to grow
-    
-                        foundStartPos = pos + ovector[0];
-                        foundEndPos   = pos + ovector[1];
-    
-                        if (cpat->hasEndPattern) {
-                            if (!cpat->hasPushedSubstr) {
-                                pushedSubstr = String();
-                                patternStack.append(syntaxPatterns->getChildPatternId(sp, cid));
-                            } else {
-                                
-                                int pushedSubstrNo = syntaxPatterns->getPushedSubstrNo(sp, cid);
-                            
-                                pushedSubstr = textData->getSubstring(Pos(pos + ovector[pushedSubstrNo * 2 + 0]),
-                                                                      Pos(pos + ovector[pushedSubstrNo * 2 + 1]));
-    
-                                patternStack.append(syntaxPatterns->getChildPatternId(sp, cid),
-                                                    pushedSubstr);
-                            }
-                            sp = cpat;
-                            foundType = Break_BEGIN;
-                        } else {
-                            foundType = Break_INTER;
-                        }
-    
-                        pos += ovector[1];
-                    }
+            }
+            batchBreaks.clear();
+            batchStacks.clear();
+            nextChunkIndex  = 0;
+            chunkBreakIndex = 0;
+
+            HilitingParser<TextSnapshot> parser(text, syntaxPatterns, breakPointDistance);
+
+            HilitingParserTypes::Result result;
+            do {
+                wasChunkTakenOver = false;
+                result = parser.parse(startPos, startStack, this);
+                
+                startPos   = restartPos;
+                startStack = restartStack;
+            }
+            while (result == HilitingParserTypes::CAN_BE_STOPPED && wasChunkTakenOver);
+
+            if (result == HilitingParserTypes::END_OF_TEXT) {
+                stageBatch();
+            }
+            Mutex::Lock lock(hilitedText->mutex);
+
+            if (!hilitedText->isJobCancelled(jobId)) {
+                if (result == HilitingParserTypes::END_OF_TEXT) {
+                    hilitedText->isJobFinished = true;
+                    hilitedText->notifyMainThread();
                 }
             }
-            else
-            {
-                // nothing matched
-    
-                canBeStopped = fillWithBreaks(startNextProcessIterator, pos, searchEndPos, &lastSetBreakEnd, patternStack);
-                if (canBeStopped) break;
-                //memset(hb->buffer + pos, sp->style, searchEndPos - pos);
-                pos = searchEndPos;
-                foundStartPos = foundEndPos = pos;
-                foundType = Break_INTER;
+            else if (!hilitedText->isStopRequested) {
+                // the main thread can release the cancelled job
+                hilitedText->notifyMainThread();
             }
-            if (foundEndPos >= getBreakEndPos(startNextProcessIterator) + breakPointDistance)
+            hilitedText->parsingJobId = 0;
+            lock.notifyAll();
+        }
+    }
+
+private:
+    explicit ParsingThread(HilitedText* hilitedText)
+        : hilitedText(hilitedText),
+          jobId(0),
+          nextChunkIndex(0),
+          chunkBreakIndex(0),
+          wasChunkTakenOver(false),
+          restartPos(0)
+    {}
+
+    /**
+     * Returns false if the job was cancelled.
+     */
+    bool appendBreak(const ParsedBreak& b, const byte* stack)
+    {
+        ParsedBreak* appended = batchBreaks.appendAmount(1);
+                    *appended = b;
+                     appended->stackBegin = batchStacks.getLength();
+        batchStacks.append(stack, b.stackLength);
+
+        if (batchBreaks.getLength() >= BATCH_LENGTH) {
+            return stageBatch();
+        } else {
+            return true;
+        }
+    }
+
+    /**
+     * Compares the break with the breaks of the speculatively parsed 
+     * chunk it lies in. If the chunk contains the same break, the following
+     * breaks of the chunk are taken over and true is returned, so that 
+     * parsing is restarted after the last break of the chunk.
+     * Also returns true if the job was cancelled.
+     */
+    bool takeOverConvergedChunk(const ParsedBreak& b, const PatternStack& stack)
+    {
+        while (   nextChunkIndex + 1 < chunks.getLength() 
+               && b.startPos >= chunks[nextChunkIndex + 1]->getBeginPos())
+        {
+            // the chunk was parsed without convergence
+
+            ++nextChunkIndex;
+            chunkBreakIndex = 0;
+        }
+        ChunkParsingThread* chunk = chunks[nextChunkIndex];
+        {
+            Mutex::Lock lock(hilitedText->mutex);
+
+            while (!hilitedText->isJobCancelled(jobId) && !chunk->isFinished()) {
+                lock.waitForNotify();
+            }
+            if (hilitedText->isJobCancelled(jobId)) {
+                return true;
+            }
+        }
+        const MemArray<ParsedBreak>& breaks = chunk->getBreaks();
+        const long                   n      = breaks.getLength();
+
+        while (   chunkBreakIndex < n 
+               && (   breaks[chunkBreakIndex].startPos < b.startPos
+                   || (   breaks[chunkBreakIndex].startPos == b.startPos
+                       && breaks[chunkBreakIndex].endPos   <  b.endPos)))
+        {
+            ++chunkBreakIndex;
+        }
+        if (chunkBreakIndex < n)
+        {
+            const ParsedBreak& c = breaks[chunkBreakIndex];
+            
+            if (   c.startPos    == b.startPos 
+                && c.endPos      == b.endPos
+                && c.type        == b.type 
+                && c.stackLength == b.stackLength
+                && memcmp(chunk->getStack(c), stack.getPtr(0), c.stackLength) == 0)
             {
-                incIterator(startNextProcessIterator);
-                canBeStopped = setBreak(startNextProcessIterator, foundStartPos, foundStartPos, foundEndPos, 
-                        foundType, patternStack);
-                lastSetBreakEnd = getBreakEndPos(startNextProcessIterator);
-                if (canBeStopped) break;
+                for (long i = chunkBreakIndex + 1; i < n; ++i) {
+                    if (!appendBreak(breaks[i], chunk->getStack(breaks[i]))) {
+                        return true;
+                    }
+                }
+                const ParsedBreak& last = breaks[n - 1];
+                
+                restartPos = last.endPos;
+                restartStack.clear();
+                restartStack.appendAmount(last.stackLength);
+                memcpy(restartStack.getPtr(0), chunk->getStack(last), last.stackLength);
+
+                wasChunkTakenOver = true;
+                ++nextChunkIndex;
+                chunkBreakIndex = 0;
+                return true;
             }
         }
-        if (canBeStopped || pos >= textDataLength || TimeStamp::now() >= endTime) {
-            loopFinished = true;
+        return false;
+    }
+
+    /**
+     * Returns false if the job was cancelled.
+     */
+    bool stageBatch()
+    {
+        Mutex::Lock lock(hilitedText->mutex);
+
+        while (   !hilitedText->isJobCancelled(jobId)
+               && hilitedText->stagedBreaks.getLength() >= MAX_STAGED_BREAKS)
+        {
+            lock.waitForNotify();
+        }
+        if (hilitedText->isJobCancelled(jobId)) {
+            return false;
         }
-        else
+        if (batchBreaks.getLength() > 0)
         {
-            searchEndPos = pos + processAmountUnit;
+            long stackOffset = hilitedText->stagedStacks.getLength();
+
+            for (long i = 0, n = batchBreaks.getLength(); i < n; ++i) {
+                batchBreaks[i].stackBegin += stackOffset;
+            }
+            hilitedText->stagedBreaks.append(batchBreaks.getPtr(0), batchBreaks.getLength());
+            hilitedText->stagedStacks.append(batchStacks.getPtr(0), batchStacks.getLength());
+            hilitedText->notifyMainThread();
         }
-    } while (!loopFinished);
-    
-    int processedAmount = (pos - wasStartPos);
-    
-    util::maximize(&this->endChangedPos, getBreakEndPos(startNextProcessIterator));
-    util::maximize(&this->endChangedPos, lastSetBreakEnd);
 
-    ASSERT(!isEndOfBreaks(startNextProcessIterator));
+        batchBreaks.clear();
+        batchStacks.clear();
+        return true;
+    }
+
+    HilitedText*                  hilitedText;
+    long                          jobId;
+    MemArray<ParsedBreak>         batchBreaks;
+    ByteArray                     batchStacks;
+    MemArray<ChunkParsingThread*> chunks;
+    long                          nextChunkIndex;
+    long                          chunkBreakIndex;
+    bool                          wasChunkTakenOver;
+    long                          restartPos;
+    PatternStack                  restartStack;
+};
+
+
+/**
+ * Keeps the objects of a cancelled job alive until its threads do not
+ * access them any more.
+ */
+class HilitedText::CancelledJob : public HeapObject
+{
+public:
+    typedef LucED::OwningPtr<CancelledJob> Ptr;
 
-    if (canBeStopped)
+    static Ptr create(long jobId, TextSnapshot::Ptr snapshot, SyntaxPatterns::Ptr syntaxPatterns,
+                      const ObjectArray<ChunkParsingThread::Ptr>& chunkThreads)
     {
-        this->processingEndBeforeRestartFlag = false;
-        while (!isEndOfBreaks(tryToBeLastBreakIterator)) {
-            incIterator(tryToBeLastBreakIterator);
+        return Ptr(new CancelledJob(jobId, snapshot, syntaxPatterns, chunkThreads));
+    }
+
+    /**
+     * Must be called with locked mutex.
+     */
+    bool isFinished(long parsingJobId) const
+    {
+        if (parsingJobId == jobId) {
+            return false;
         }
-        if (textDataLength - getBreakStartPos(tryToBeLastBreakIterator) < 2 * breakPointDistance) { 
-            this->needsProcessingFlag = false;
-            this->endChangedPos = textDataLength;
-        } else {
-            this->needsProcessingFlag = true;
+        for (long i = 0, n = chunkThreads.getLength(); i < n; ++i) {
+            if (!chunkThreads[i]->isFinished()) {
+                return false;
+            }
+        }
+        return true;
+    }
 
-            incIterator(startNextProcessIterator);
-            util::maximize(&this->endChangedPos, getBreakStartPos(startNextProcessIterator));
+    void waitForChunkThreads()
+    {
+        for (long i = 0, n = chunkThreads.getLength(); i < n; ++i) {
+            chunkThreads[i]->waitForFinished();
+        }
+    }
 
-            copyToIteratorFromIterator(startNextProcessIterator, tryToBeLastBreakIterator);
-            decIterator(startNextProcessIterator);
+private:
+    CancelledJob(long jobId, TextSnapshot::Ptr snapshot, SyntaxPatterns::Ptr syntaxPatterns,
+                 const ObjectArray<ChunkParsingThread::Ptr>& chunkThreads)
+        : jobId(jobId),
+          snapshot(snapshot),
+          syntaxPatterns(syntaxPatterns),
+          chunkThreads(chunkThreads)
+    {}
+
+    long                                 jobId;
+    TextSnapshot::Ptr                    snapshot;
+    SyntaxPatterns::Ptr                  syntaxPatterns;
+    ObjectArray<ChunkParsingThread::Ptr> chunkThreads;
+};
+
+
+/**
+ * Must be called with locked mutex.
+ */
+bool HilitedText::isJobCancelled(long jobId) const
+{
+    return jobId != this->jobId || isStopRequested;
+}
+
+
+/**
+ * Lets handleStagedBreaks() be invoked in the main thread, 
+ * must be called with locked mutex.
+ */
+void HilitedText::notifyMainThread()
+{
+    if (!isTaskPending) {
+        isTaskPending = true;
+        EventDispatcher::getInstance()->executeTaskOnMainThread(handleStagedBreaksCallback);
+    }
+}
+
+
+void HilitedText::startParsingThreadJob()
+{
+    ASSERT(!isJobRunning);
+
+    if (!parsingThread.isValid())
+    {
+        parsingThread = ParsingThread::create(this);
+        try {
+            Thread::start(parsingThread);
         }
-#if 0
-printf("------HilitedText::process can be stoppend = %ld / %ld (%d) --> %d  <%ld>\n", getBreakStartPos(startNextProcessIterator),
-                                                                   getBreakEndPos(startNextProcessIterator), processedAmount, 
-                                                                   getLastBreakStackByte(startNextProcessIterator),
-                                                                   (long)startTime.getMicroSecsBefore(TimeStamp::now())/1000);
-#endif
+        catch (SystemException& ex) {
+            parsingThread.invalidate();
+            isParsingThreadUsable = false;
+            return;
+        }
+    }
+    releaseCancelledJobs();
+
+    if (!jobSnapshot.isValid() || jobSnapshot->getVersion() != textData->getVersion()) {
+        jobSnapshot = textData->createSnapshot();
+    }
+    const long startPos = getBreakEndPos(startNextProcessIterator);
+    {
+        Mutex::Lock lock(mutex);
+        ++jobId;
+    }
+    if (isLastBreak(startNextProcessIterator)) {
+        // there is no hiliting yet behind startPos
+        startChunkParsingThreads(startPos);
+    }
+
+    copyBreakStackTo(startNextProcessIterator, patternStack);
+    {
+        Mutex::Lock lock(mutex);
+
+        jobStartPos           = startPos;
+        jobStartStack         = patternStack;
+        jobText               = jobSnapshot.getRawPtr();
+        jobSyntaxPatterns     = syntaxPatterns.getRawPtr();
+        jobBreakPointDistance = breakPointDistance;
+        isJobRequested        = true;
+        isJobFinished         = false;
+
+        lock.notifyAll();
+    }
+    isJobRunning      = true;
+    canMergeBeStopped = false;
+}
+
+
+void HilitedText::startChunkParsingThreads(long startPos)
+{
+    ASSERT(chunkThreads.getLength() == 0);
+
+    const long length = util::minimum(jobSnapshot->getLength() - startPos, 
+                                      (long) SPECULATIVE_MAX_LENGTH);
+    if (length < SPECULATIVE_MIN_LENGTH) {
+        return;
+    }
+    long numberOfChunks = sysconf(_SC_NPROCESSORS_ONLN);
+    
+    util::minimize(&numberOfChunks, (long) SPECULATIVE_MAX_THREADS);
+    util::minimize(&numberOfChunks, length / SPECULATIVE_MIN_CHUNK_LENGTH);
+
+    if (numberOfChunks <= 1) {
+        return;
+    }
+    const TextSnapshot* text        = jobSnapshot.getRawPtr();
+    const long          chunkLength = length / numberOfChunks;
+
+    // the first chunk is parsed by the ParsingThread
+
+    long beginPos = getLineBeginAfter(text, startPos + chunkLength);
+
+    for (long i = 1; i < numberOfChunks; ++i)
+    {
+        long endPos = (i + 1 < numberOfChunks) ? getLineBeginAfter(text, startPos + (i + 1) * chunkLength)
+                                               : startPos + length;
+        if (endPos <= beginPos) {
+            continue;
+        }
+        ChunkParsingThread::Ptr thread = ChunkParsingThread::create(this, beginPos, endPos);
+        try {
+            Thread::start(thread);
+        }
+        catch (SystemException& ex) {
+            break;
+        }
+        chunkThreads.append(thread);
+        beginPos = endPos;
+    }
+}
+
+
+void HilitedText::finishChunkParsingThreads()
+{
+    // the chunk threads stop because cancel or stop was requested
+
+    for (long i = 0, n = chunkThreads.getLength(); i < n; ++i) {
+        chunkThreads[i]->waitForFinished();
     }
-    else
+    chunkThreads.clear();
+}
+
+
+/**
+ * Does not wait for the threads, they stop at their next check of the
+ * job id.
+ */
+void HilitedText::cancelParsingThreadJob()
+{
+    if (isJobRunning)
     {
-        if (searchEndPos >= textDataLength)
+        CancelledJob::Ptr job = CancelledJob::create(jobId, jobSnapshot, syntaxPatterns, chunkThreads);
         {
-            this->processingEndBeforeRestartFlag = false;
-            this->needsProcessingFlag = false;
-            
-            if (!isLastBreak(startNextProcessIterator))
-            {
-                // delete trailing Breaks
+            Mutex::Lock lock(mutex);
 
-                incIterator(startNextProcessIterator);
-                Iterator tempIterator = createNewIterator();
-                copyToIteratorFromIterator(tempIterator, startNextProcessIterator);
-                while (!isEndOfBreaks(tempIterator)) {
-                    incIterator(tempIterator);
-                }
-                deleteBreaks(startNextProcessIterator, tempIterator);
+            ++jobId;
+            isJobRequested = false;
+            stagedBreaks.clear();
+            stagedStacks.clear();
+            isJobFinished = false;
+            isTaskPending = false;
+            lock.notifyAll();
+        }
+        chunkThreads.clear();
+        cancelledJobs.append(job);
+
+        mergedBreaks.clear();
+        mergedStacks.clear();
+        mergeIndex        = 0;
+        hasStagedBreaks   = false;
+        canMergeBeStopped = false;
+        isJobRunning      = false;
+
+        releaseCancelledJobs();
+    }
+}
+
+
+void HilitedText::releaseCancelledJobs()
+{
+    ObjectArray<CancelledJob::Ptr> finishedJobs;
+    {
+        Mutex::Lock lock(mutex);
+
+        for (long i = 0; i < cancelledJobs.getLength();)
+        {
+            if (cancelledJobs[i]->isFinished(parsingJobId)) {
+                finishedJobs.append(cancelledJobs[i]);
+                cancelledJobs.remove(i);
+            } else {
+                ++i;
             }
-            util::maximize(&this->endChangedPos, searchEndPos);
         }
-#if 0
-long overTime = 0;
-if (TimeStamp::now() > endTime) {
-    overTime = (long)endTime.getMicroSecsBefore(TimeStamp::now())/1000;
+    }
+    for (long i = 0, n = finishedJobs.getLength(); i < n; ++i) {
+        finishedJobs[i]->waitForChunkThreads();
+    }
 }
-printf("------HilitedText::process cannot be stoppend = %ld / %ld  (%d) --> %d  <%ld,  %ld>\n", getBreakStartPos(startNextProcessIterator),
-                                                                   getBreakEndPos(startNextProcessIterator), processedAmount, 
-                                                                   getLastBreakStackByte(startNextProcessIterator),
-                                                                   (long)startTime.getMicroSecsBefore(TimeStamp::now())/1000,
-                                                                   overTime);
-#endif
+
+
+void HilitedText::handleStagedBreaks()
+{
+    // invoked in the main thread by the EventDispatcher
+
+    if (isJobRunning) {
+        hasStagedBreaks = true;
+    } else {
+        Mutex::Lock lock(mutex);
+        isTaskPending = false;
     }
+    releaseCancelledJobs();
+}
 
-    ASSERT(!needsProcessingFlag || !isEndOfBreaks(startNextProcessIterator));
-    return processedAmount;
+
+int HilitedText::mergeParsedBreaks(TimeStamp endTime)
+{
+    if (jobSnapshot->getVersion() != textData->getVersion()) {
+        cancelParsingThreadJob();
+        return 0;
+    }
+    TimeStamp latest = TimeStamp::now() + MicroSeconds(MAX_MAIN_THREAD_MICRO_SECS);
+    if (latest < endTime) {
+        endTime = latest;
+    }
+    const long wasStartPos = getBreakEndPos(startNextProcessIterator);
+
+    util::minimize(&this->beginChangedPos, wasStartPos);
+
+    bool canBeStopped = false;
+    bool isFinished   = false;
+
+    for (long counter = 1; !canBeStopped; ++counter)
+    {
+        if (mergeIndex >= mergedBreaks.getLength())
+        {
+            Mutex::Lock lock(mutex);
+
+            mergedBreaks.takeOver(&stagedBreaks);
+            mergedStacks.takeOver(&stagedStacks);
+            mergeIndex      = 0;
+            isTaskPending   = false;
+            hasStagedBreaks = false;
+            lock.notifyAll();
+
+            if (mergedBreaks.getLength() == 0) {
+                isFinished = isJobFinished;
+                break;
+            }
+        }
+        const ParsedBreak& b = mergedBreaks[mergeIndex++];
+
+        patternStack.clear();
+        patternStack.appendAmount(b.stackLength);
+        memcpy(patternStack.getPtr(0), mergedStacks.getPtr(b.stackBegin), b.stackLength);
+        
+        incIterator(startNextProcessIterator);
+        canMergeBeStopped = setBreak(startNextProcessIterator, b.startPos1, b.startPos, b.endPos, b.type, patternStack)
+                            || canMergeBeStopped;
+        canBeStopped = canMergeBeStopped && b.isStopPoint;
+
+        if (counter % 64 == 0 && TimeStamp::now() >= endTime) {
+            break;
+        }
+    }
+    int mergedAmount = getBreakEndPos(startNextProcessIterator) - wasStartPos;
+
+    if (canBeStopped) {
+        cancelParsingThreadJob();
+        handleParsingResult(HilitingParserTypes::CAN_BE_STOPPED);
+    }
+    else if (isFinished) {
+        cancelParsingThreadJob();
+        handleParsingResult(HilitingParserTypes::END_OF_TEXT);
+    }
+    else {
+        util::maximize(&this->endChangedPos, getBreakEndPos(startNextProcessIterator));
+    }
+    if (!needsProcessingFlag) {
+        jobSnapshot.invalidate();
+    }
+    return mergedAmount;
 }
 
+#endif // LUCED_USE_MULTI_THREAD
+
+
+HilitedText::~HilitedText()
+{
+#if LUCED_USE_MULTI_THREAD
+    if (parsingThread.isValid())
+    {
+        {
+            Mutex::Lock lock(mutex);
+            isStopRequested = true;
+            lock.notifyAll();
+        }
+        parsingThread->waitForFinished();
+    }
+    finishChunkParsingThreads();
+
+    for (long i = 0, n = cancelledJobs.getLength(); i < n; ++i) {
+        cancelledJobs[i]->waitForChunkThreads();
+    }
+#endif
+}
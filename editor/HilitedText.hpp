@@ -22,23 +22,42 @@
 #ifndef HILITED_TEXT_HPP
 #define HILITED_TEXT_HPP
 
+#include "config.h"
 #include "HilitingBase.hpp"
+#include "HilitingParser.hpp"
 #include "TextData.hpp"
 #include "SyntaxPatterns.hpp"
 #include "CallbackContainer.hpp"
-#include "ProcessHandler.hpp"
 #include "MemArray.hpp"
+#include "ObjectArray.hpp"
 #include "LanguageModes.hpp"
 #include "OwningPtr.hpp"
 #include "RawPtr.hpp"
 #include "TimeStamp.hpp"
-
-// TODO: Konstanten
-//
-#define STACK_SIZE 100
+#include "TextSnapshot.hpp"
+#include "Mutex.hpp"
 
 namespace LucED {
 
+/**
+ * Hiliting breaks of a TextData.
+ *
+ * Parsing is done in the main thread between the processing of other
+ * events. With multi threading the main thread only parses for a short
+ * time after a modification, which is mostly enough to reach a break
+ * that matches the existing hiliting. Longer parsing is done by a worker
+ * thread on a TextSnapshot, the breaks found are merged in the main thread
+ * in small portions. Short remaining texts are parsed in the main thread
+ * only. A modification cancels the worker thread without waiting for it,
+ * the job is restarted from the last merged break and the snapshot is
+ * reused as long as the text is not modified.
+ *
+ * For large texts further chunks starting at line boundaries are parsed 
+ * speculatively by additional threads with the root pattern stack. When the 
+ * worker thread finds a break that is equal to a break of such a chunk, the
+ * remaining breaks of the chunk are taken over. Otherwise the chunk is 
+ * parsed again by the worker thread.
+ */
 class HilitedText : public HilitingBase
 {
 public:
@@ -57,6 +76,11 @@ public:
 
     int process(TimeStamp endTime);
     bool needsProcessing();
+
+    /**
+     * Position up to which the hiliting is up to date.
+     */
+    long getProcessedEndPos();
     
     void registerUpdateListener(Callback<UpdateInfo>::Ptr updateCallback);
 
@@ -85,11 +109,15 @@ public:
         return textData;
     }
 
+    ~HilitedText();
+
 private:
     
     HilitedText(TextData::Ptr textData, LanguageMode::Ptr languageMode);
 
-    static int pcreCalloutFunction(void*, pcre_callout_block*);
+    class BreakSetter;
+
+    void handleParsingResult(HilitingParserTypes::Result result);
 
     bool setBreak(IteratorHandle iterator, 
             long startPos1, long startPos, long endPos, BreakType type, 
@@ -102,10 +130,7 @@ private:
     int getReparseDistance(IteratorHandle iterator);
 
     void gotoReparseStart(long textPos, IteratorHandle iterator);
-    bool fillWithBreaks(IteratorHandle iterator, 
-            long fillStart, long fillEnd,
-            long *lastFillEnd, PatternStack& patternStack);
-            
+
     void flushPendingUpdates();
     
     Iterator rememberedLastProcessingRestartedIterator;
@@ -126,21 +151,87 @@ private:
     PatternStack patternStack;
     CallbackContainer<UpdateInfo> updateListeners;
     
-    ProcessHandler::Ptr processHandler;
-    
-    MemArray<int> ovector;
-    
     int breakPointDistance;
 
     CallbackContainer<HilitedText*> hilitingChangedCallbacks;    
 
     Callback<SyntaxPatterns::Ptr>::Ptr syntaxPatternUpdateCallback;
 
-    String pushedSubstr;
-    
     CallbackContainer<SyntaxPatterns::Ptr> syntaxPatternsChangedCallbacks;
     
     CallbackContainer<LanguageMode::Ptr> languageModeChangedCallbacks;
+
+#if LUCED_USE_MULTI_THREAD
+
+    enum
+    {
+        MAX_MAIN_THREAD_MICRO_SECS = 300,
+        BATCH_LENGTH               = 256,
+        MAX_STAGED_BREAKS          = 64 * BATCH_LENGTH,
+        THREAD_MIN_LENGTH          = 256 * 1024,
+
+        SPECULATIVE_MIN_LENGTH       =      1024 * 1024,
+        SPECULATIVE_MIN_CHUNK_LENGTH =       256 * 1024,
+        SPECULATIVE_MAX_LENGTH       = 32 * 1024 * 1024,
+        SPECULATIVE_MAX_THREADS      = 8
+    };
+
+    class ParsingThread;
+    class ChunkParsingThread;
+    class CancelledJob;
+
+    struct ParsedBreak
+    {
+        long      startPos1;
+        long      startPos;
+        long      endPos;
+        BreakType type;
+        bool      isStopPoint;
+        long      stackBegin;
+        long      stackLength;
+    };
+
+    void startParsingThreadJob();
+    void cancelParsingThreadJob();
+    int  mergeParsedBreaks(TimeStamp endTime);
+    void handleStagedBreaks();
+    void startChunkParsingThreads(long startPos);
+    void finishChunkParsingThreads();
+    void releaseCancelledJobs();
+    bool isJobCancelled(long jobId) const;
+    void notifyMainThread();
+
+    OwningPtr<ParsingThread> parsingThread;
+    bool                     isParsingThreadUsable;
+    bool                     isJobRunning;
+    TextSnapshot::Ptr        jobSnapshot;
+    bool                     hasStagedBreaks;
+    bool                     canMergeBeStopped;
+    MemArray<ParsedBreak>    mergedBreaks;
+    ByteArray                mergedStacks;
+    long                     mergeIndex;
+    Callback<>::Ptr          handleStagedBreaksCallback;
+    ObjectArray< OwningPtr<ChunkParsingThread> > chunkThreads;
+    ObjectArray< OwningPtr<CancelledJob> >       cancelledJobs;
+
+    // shared with the parsing thread
+
+    Mutex::Ptr               mutex;
+    bool                     isJobRequested;
+    long                     jobId;
+    long                     parsingJobId;
+    bool                     isStopRequested;
+    bool                     isJobFinished;
+    bool                     isTaskPending;
+    long                     jobStartPos;
+    PatternStack             jobStartStack;
+    const TextSnapshot*      jobText;
+    SyntaxPatterns*          jobSyntaxPatterns;
+    long                     jobBreakPointDistance;
+    MemArray<ParsedBreak>    stagedBreaks;
+    ByteArray                stagedStacks;
+
+#endif // LUCED_USE_MULTI_THREAD
 };
 
 } // namespace LucED
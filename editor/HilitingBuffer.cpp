@@ -21,6 +21,7 @@
 
 #include "util.hpp"
 #include "HilitingBuffer.hpp"
+#include "HilitingScheduler.hpp"
 
 using namespace LucED;
 
@@ -41,8 +42,11 @@ HilitingBuffer::HilitingBuffer(HilitedText::Ptr hilitedText)
     syntaxPatterns(hilitedText->getSyntaxPatterns()),
     languageMode(hilitedText->getLanguageMode()),
     iterator(hilitedText->createNewIterator()),
-    maxDistance(calculateMaxDistance(hilitedText))
-    
+    maxDistance(calculateMaxDistance(hilitedText)),
+    isVisibleFlag(false),
+    isFocusedFlag(false),
+    visibleBeginPos(0),
+    visibleEndPos(0)
 {
     hilitedText->registerHilitingChangedCallback(newCallback(this, &HilitingBuffer::treatChangedHiliting));
 
@@ -56,6 +60,23 @@ HilitingBuffer::HilitingBuffer(HilitedText::Ptr hilitedText)
     textData->registerUpdateListener(newCallback(this, &HilitingBuffer::treatTextDataUpdate));
 
     syntaxPatterns->registerTextStylesChangedCallback(newCallback(this, &HilitingBuffer::treatTextStylesChanged));
+
+    HilitingScheduler::getInstance()->registerView(this);
+}
+
+
+void HilitingBuffer::setVisibleRange(long beginPos, long endPos, bool isFocused)
+{
+    const bool isJump = !isVisibleFlag || beginPos >= visibleEndPos || endPos <= visibleBeginPos;
+
+    isVisibleFlag   = true;
+    isFocusedFlag   = isFocused;
+    visibleBeginPos = beginPos;
+    visibleEndPos   = endPos;
+
+    if (isJump) {
+        HilitingScheduler::getInstance()->treatViewJump(this);
+    }
 }
 
 void HilitingBuffer::treatLanguageModeChange(LanguageMode::Ptr newLanguageMode)
@@ -258,9 +279,9 @@ byte* HilitingBuffer::getNonBufferedTextStyles(long pos, long numberStyles)
         
         this->rememberedSearchRestartPos = searchStartPos;
         
-        bool matched = sp->re.findMatch(this, &HilitingBuffer::pcreCalloutFunction,
-                                        (const char*) textData->getAmount(searchStartPos, extendedSearchEndPos - searchStartPos), 
-                extendedSearchEndPos - searchStartPos, 0,
+        bool matched = sp->findMatch(this, &HilitingBuffer::pcreCalloutFunction,
+                                     (const char*) textData->getAmount(searchStartPos, extendedSearchEndPos - searchStartPos, &scratchBuffer), 
+                extendedSearchEndPos - searchStartPos,
                 additionalOptions /*| BasicRegex::NOTEMPTY*/, ovector);
 
         if (matched)
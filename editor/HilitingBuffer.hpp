@@ -87,6 +87,30 @@ public:
         return hilitedText;
     }
 
+    /**
+     * Must be invoked by the view of this HilitingBuffer, so that the
+     * HilitingScheduler can process the visible range first.
+     */
+    void setVisibleRange(long beginPos, long endPos, bool isFocused);
+
+    void setInvisible() {
+        isVisibleFlag = false;
+        isFocusedFlag = false;
+    }
+
+    bool isVisible() const {
+        return isVisibleFlag;
+    }
+    bool isFocused() const {
+        return isFocusedFlag;
+    }
+    long getVisibleBeginPos() const {
+        return visibleBeginPos;
+    }
+    long getVisibleEndPos() const {
+        return visibleEndPos;
+    }
+
 private:
     
     HilitingBuffer(HilitedText::Ptr hilitedText);
@@ -117,12 +141,18 @@ private:
     CallbackContainer<UpdateInfo> updateListeners;
     CallbackContainer<const ObjectArray<TextStyle::Ptr>&> textStylesChangedListeners;
     MemArray<int> ovector;
+    ByteArray     scratchBuffer;
 
     int maxDistance;
 
     String pushedSubstr;
 
     CallbackContainer<LanguageMode::Ptr> languageModeChangedCallbacks;
+
+    bool isVisibleFlag;
+    bool isFocusedFlag;
+    long visibleBeginPos;
+    long visibleEndPos;
 };
 
 } // namespace LucED
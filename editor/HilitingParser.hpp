@@ -0,0 +1,361 @@
+/////////////////////////////////////////////////////////////////////////////////////
+//
+//   LucED - The Lucid Editor
+//
+//   Copyright (C) 2005-2010 Oliver Schmidt, oliver at luced dot de
+//
+//   This program is free software; you can redistribute it and/or modify it
+//   under the terms of the GNU General Public License Version 2 as published
+//   by the Free Software Foundation in June 1991.
+//
+//   This program is distributed in the hope that it will be useful, but WITHOUT
+//   ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+//   FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+//   more details.
+//
+//   You should have received a copy of the GNU General Public License along with
+//   this program; if not, write to the Free Software Foundation, Inc.,
+//   51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+//
+/////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef HILITING_PARSER_HPP
+#define HILITING_PARSER_HPP
+
+#include <pcre.h>
+
+#include "debug.hpp"
+#include "util.hpp"
+#include "types.hpp"
+#include "NonCopyable.hpp"
+#include "HilitingBase.hpp"
+#include "SyntaxPatterns.hpp"
+#include "PatternStack.hpp"
+#include "MemArray.hpp"
+#include "ByteArray.hpp"
+#include "String.hpp"
+
+// TODO: Konstanten
+//
+#define STACK_SIZE 100
+
+namespace LucED
+{
+
+class HilitingParserTypes
+{
+public:
+    enum Result
+    {
+        CAN_BE_STOPPED,
+        END_OF_TEXT,
+        INTERRUPTED
+    };
+};
+
+/**
+ * Parses a text with SyntaxPatterns and reports the breaks that
+ * HilitedText has to set.
+ *
+ * The parser does not access the HilitingBase, it only needs the position 
+ * and the stack of the break where parsing starts. Therefore it can also 
+ * be used by a worker thread on a TextSnapshot. The Text must provide
+ * getLength(), getContiguousAmount(pos, maxAmount, const byte**), 
+ * copyTo(byte*, pos, amount) and operator[].
+ *
+ * The breaks are reported to a Sink providing 
+ *
+ *   bool setBreak(long startPos1, long startPos, long endPos, 
+ *                 HilitingBase::BreakType type, const PatternStack& stack, 
+ *                 bool isStopPoint)
+ *
+ * which returns true if the break matches the already existing hiliting, 
+ * and bool isInterrupted(), which is asked after each processAmountUnit
+ * and after each break that is not a fill break.
+ * Parsing is only stopped at breaks marked as stop point, so that
+ * a sink that records the breaks can later stop at the same break
+ * as a sink that sets the breaks immediately.
+ */
+template<class Text
+        > class HilitingParser : public  HilitingParserTypes,
+                                 private NonCopyable
+{
+public:
+    HilitingParser(const Text* text, SyntaxPatterns* syntaxPatterns, long breakPointDistance)
+        : text(text),
+          syntaxPatterns(syntaxPatterns),
+          breakPointDistance(breakPointDistance),
+          pos(0)
+    {
+        this->processAmountUnit = 10 * breakPointDistance;
+        util::maximize(&processAmountUnit, (long)3000);
+
+        if (syntaxPatterns->hasPatterns()) {
+            this->ovector.increaseTo(syntaxPatterns->getMaxOvecSize());
+        }
+    }
+
+    /**
+     * Parses from startPos, which must be the end of a break with the
+     * given stack.
+     */
+    template<class Sink
+            > Result parse(long startPos, const PatternStack& startStack, Sink* sink);
+
+    /**
+     * Position up to which the text was parsed.
+     */
+    long getPos() const {
+        return pos;
+    }
+
+private:
+    typedef HilitingBase::BreakType BreakType;
+
+    static int pcreCalloutFunction(void*, pcre_callout_block*);
+
+    template<class Sink
+            > bool fillWithBreaks(Sink* sink, long fillStart, long fillEnd);
+
+    const byte* getAmount(long p, long amount)
+    {
+        const byte* rslt;
+        if (text->getContiguousAmount(p, amount, &rslt) < amount) {
+            scratchBuffer.clear();
+            text->copyTo(scratchBuffer.appendAmount(amount), p, amount);
+            rslt = scratchBuffer.getPtr();
+        }
+        return rslt;
+    }
+    bool isBeginOfLine(long p) const {
+        return p == 0 || (*text)[p - 1] == '\n';
+    }
+    bool isEndOfLine(long p) const {
+        return p == text->getLength() || (*text)[p] == '\n';
+    }
+
+    const Text*     text;
+    SyntaxPatterns* syntaxPatterns;
+    long            breakPointDistance;
+    long            processAmountUnit;
+
+    long            pos;
+    long            lastBreakEnd;
+    PatternStack    patternStack;
+    String          pushedSubstr;
+    MemArray<int>   ovector;
+    ByteArray       scratchBuffer;
+};
+
+
+template<class Text
+        > int HilitingParser<Text>::pcreCalloutFunction(void* voidPtr, pcre_callout_block* calloutBlock)
+{
+    HilitingParser* self = static_cast<HilitingParser*>(voidPtr);
+
+    ASSERT(calloutBlock->callout_number == 1);
+
+    bool didMatch = false;
+
+    if (   calloutBlock->capture_last != -1 
+        && self->ovector[calloutBlock->capture_last * 2 + 1] == calloutBlock->current_position)
+    {
+        int i1 = self->ovector[calloutBlock->capture_last * 2 + 0];
+        int i2 = self->ovector[calloutBlock->capture_last * 2 + 1];
+        
+        didMatch = self->pushedSubstr.equals(calloutBlock->subject + i1, i2 - i1);
+    }
+
+    return didMatch ? 0 : 1;
+}
+
+
+template<class Text
+        > template<class Sink
+                  > bool HilitingParser<Text>::fillWithBreaks(Sink* sink, long fillStart, long fillEnd)
+{
+    long p;
+    long p1 = fillStart;
+    bool canBeStopped = false;
+
+    if (lastBreakEnd + breakPointDistance <= fillEnd) {
+        p = lastBreakEnd + breakPointDistance;
+        util::maximize(&p, p1);
+        do {
+            bool isLast = (p + breakPointDistance >= fillEnd);
+
+            canBeStopped = sink->setBreak(p1, p, p, HilitingBase::Break_INTER, patternStack, isLast) 
+                           || canBeStopped;
+            lastBreakEnd = p;
+            p1  = p;
+            p  += breakPointDistance;
+        } while (p < fillEnd);
+    }
+    return canBeStopped;
+}
+
+
+template<class Text
+        > template<class Sink
+                  > HilitingParserTypes::Result HilitingParser<Text>::parse(long startPos, 
+                                                                        const PatternStack& startStack, 
+                                                                        Sink* sink)
+{
+    pos          = startPos;
+    lastBreakEnd = startPos;
+    patternStack = startStack;
+    pushedSubstr = patternStack.getAdditionalDataAsString();
+
+    SyntaxPattern* sp = syntaxPatterns->get(patternStack.getLast());
+
+    long searchEndPos = pos + processAmountUnit;
+
+    long foundStartPos = pos;
+    long foundEndPos   = pos;
+    BreakType foundType = HilitingBase::Break_INTER;
+    
+    bool wasZeroLengthMatch = false;
+    const long textLength = text->getLength();
+    for (;;)
+    {
+        util::minimize(&searchEndPos, textLength);
+        
+        while (pos < searchEndPos)
+        {
+            ASSERT(sp == syntaxPatterns->get(patternStack.getLast()));
+            long extendedSearchEndPos = searchEndPos + sp->maxREBytesExtend;
+            BasicRegex::MatchOptions additionalOptions;
+            
+            util::minimize(&extendedSearchEndPos, textLength);
+            if (!isBeginOfLine(pos)) {
+                additionalOptions |= BasicRegex::NOTBOL;
+            }
+            if (!isEndOfLine(extendedSearchEndPos)) {
+                additionalOptions |= BasicRegex::NOTEOL;
+            }
+            
+            bool matched = sp->findMatch(this, &HilitingParser::pcreCalloutFunction,
+                                         (const char*) getAmount(pos, extendedSearchEndPos - pos), 
+                        extendedSearchEndPos - pos,
+                        additionalOptions /*| BasicRegex::NOTEMPTY*/, ovector);
+            
+            if (matched)
+            {
+                // something matched
+    
+                if (ovector[1] == 0)
+                {
+                    if (wasZeroLengthMatch) {
+                        ovector[1] = 1; // prevent endless loop for second zero length match
+                        wasZeroLengthMatch = false;
+                    }
+                    else {
+                        wasZeroLengthMatch = true;
+                    }
+                }
+                else {
+                    wasZeroLengthMatch = false;
+                }
+    
+                if (fillWithBreaks(sink, pos, pos + ovector[0])) {
+                    return CAN_BE_STOPPED;
+                }
+                int cid = sp->getMatchedChild(ovector);
+                if (cid == -1)
+                {
+                    // EndPattern matched
+     
+                    foundStartPos = pos + ovector[0];
+                    foundEndPos = pos + ovector[1];
+                    foundType = HilitingBase::Break_END;
+    
+                    pos += ovector[1];
+                    patternStack.removeLast();
+                    sp = syntaxPatterns->get(patternStack.getLast());
+                    pushedSubstr = patternStack.getAdditionalDataAsString();
+                }
+                else
+                {
+                    // normal Child matched
+                    
+                    SyntaxPattern* cpat = syntaxPatterns->getChildPattern(sp, cid);
+                        
+                    if (patternStack.getLength() >= STACK_SIZE
+                            && cpat->hasEndPattern) {
+    
+                        // New Begin-Child, but Stack is too big
+    
+                        foundStartPos = pos + ovector[1];
+                        foundEndPos   = foundStartPos;
+                        pos += ovector[1];
+                        foundType = HilitingBase::Break_INTER;
+                        
+                    } else {
+                        
+                        // Stack is ok or doesn't need to grow
+    
+                        foundStartPos = pos + ovector[0];
+                        foundEndPos   = pos + ovector[1];
+    
+                        if (cpat->hasEndPattern) {
+                            if (!cpat->hasPushedSubstr) {
+                                pushedSubstr = String();
+                                patternStack.append(syntaxPatterns->getChildPatternId(sp, cid));
+                            } else {
+                                
+                                int pushedSubstrNo = syntaxPatterns->getPushedSubstrNo(sp, cid);
+                                long p1 = pos + ovector[pushedSubstrNo * 2 + 0];
+                                long p2 = pos + ovector[pushedSubstrNo * 2 + 1];
+
+                                pushedSubstr = String((const char*) getAmount(p1, p2 - p1), p2 - p1);
+    
+                                patternStack.append(syntaxPatterns->getChildPatternId(sp, cid),
+                                                    pushedSubstr);
+                            }
+                            sp = cpat;
+                            foundType = HilitingBase::Break_BEGIN;
+                        } else {
+                            foundType = HilitingBase::Break_INTER;
+                        }
+    
+                        pos += ovector[1];
+                    }
+                }
+            }
+            else
+            {
+                // nothing matched
+    
+                if (fillWithBreaks(sink, pos, searchEndPos)) {
+                    return CAN_BE_STOPPED;
+                }
+                pos = searchEndPos;
+                foundStartPos = foundEndPos = pos;
+                foundType = HilitingBase::Break_INTER;
+            }
+            if (foundEndPos >= lastBreakEnd + breakPointDistance)
+            {
+                bool canBeStopped = sink->setBreak(foundStartPos, foundStartPos, foundEndPos, 
+                                                   foundType, patternStack, true);
+                lastBreakEnd = foundEndPos;
+                if (canBeStopped) {
+                    return CAN_BE_STOPPED;
+                }
+                if (sink->isInterrupted()) {
+                    return INTERRUPTED;
+                }
+            }
+        }
+        if (pos >= textLength) {
+            return END_OF_TEXT;
+        }
+        if (sink->isInterrupted()) {
+            return INTERRUPTED;
+        }
+        searchEndPos = pos + processAmountUnit;
+    }
+}
+
+} // namespace LucED
+
+#endif // HILITING_PARSER_HPP
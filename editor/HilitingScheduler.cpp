@@ -0,0 +1,192 @@
+/////////////////////////////////////////////////////////////////////////////////////
+//
+//   LucED - The Lucid Editor
+//
+//   Copyright (C) 2005-2010 Oliver Schmidt, oliver at luced dot de
+//
+//   This program is free software; you can redistribute it and/or modify it
+//   under the terms of the GNU General Public License Version 2 as published
+//   by the Free Software Foundation in June 1991.
+//
+//   This program is distributed in the hope that it will be useful, but WITHOUT
+//   ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+//   FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+//   more details.
+//
+//   You should have received a copy of the GNU General Public License along with
+//   this program; if not, write to the Free Software Foundation, Inc.,
+//   51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+//
+/////////////////////////////////////////////////////////////////////////////////////
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "util.hpp"
+#include "HilitingScheduler.hpp"
+#include "EventDispatcher.hpp"
+
+using namespace LucED;
+
+SingletonInstance<HilitingScheduler> HilitingScheduler::instance;
+
+
+HilitingScheduler* HilitingScheduler::getInstance()
+{
+    return instance.getPtr();
+}
+
+
+HilitingScheduler::HilitingScheduler()
+    : processHandler(ProcessHandler::create(this, &HilitingScheduler::process, 
+                                                  &HilitingScheduler::needsProcessing)),
+      nextTextIndex(0),
+      isStatisticsEnabled(getenv("LUCED_HILITING_STATISTICS") != NULL),
+      numberOfJumps(0),
+      totalJumpMilliSecs(0),
+      maxJumpMilliSecs(0)
+{
+    EventDispatcher::getInstance()->registerProcess(processHandler);
+}
+
+
+void HilitingScheduler::registerHilitedText(HilitedText* hilitedText)
+{
+    hilitedTexts.append(hilitedText);
+}
+
+
+void HilitingScheduler::registerView(HilitingBuffer* view)
+{
+    views.append(view);
+}
+
+
+bool HilitingScheduler::needsProcessing()
+{
+    for (long i = 0; i < hilitedTexts.getLength();)
+    {
+        if (!hilitedTexts[i].isValid()) {
+            hilitedTexts.remove(i);
+            if (nextTextIndex > i) {
+                --nextTextIndex;
+            }
+        } else {
+            ++i;
+        }
+    }
+    for (long i = 0; i < views.getLength();)
+    {
+        if (!views[i].isValid()) {
+            views.remove(i);
+        } else {
+            ++i;
+        }
+    }
+    return getNextHilitedText(false) != NULL;
+}
+
+
+HilitedText* HilitingScheduler::getNextHilitedText(bool isTurnTaken)
+{
+    // First the visible range of the focused view, then the visible 
+    // ranges of the other views. If the text of such a view is processed 
+    // by its parsing thread and has no parsed breaks to merge yet, the 
+    // next view or text is taken meanwhile.
+
+    for (int pass = 0; pass < 2; ++pass)
+    {
+        for (long i = 0, n = views.getLength(); i < n; ++i)
+        {
+            HilitingBuffer* view = views[i];
+
+            if (view != NULL && view->isVisible() && (pass == 1 || view->isFocused()))
+            {
+                HilitedText* hilitedText = view->getHilitedText().getRawPtr();
+
+                if (   hilitedText->getProcessedEndPos() < view->getVisibleEndPos()
+                    && hilitedText->needsProcessing())
+                {
+                    return hilitedText;
+                }
+            }
+        }
+    }
+
+    // then all texts in turn
+
+    const long n = hilitedTexts.getLength();
+
+    for (long i = 0; i < n; ++i)
+    {
+        long j = (nextTextIndex + i) % n;
+        
+        if (hilitedTexts[j].isValid() && hilitedTexts[j]->needsProcessing()) {
+            if (isTurnTaken) {
+                nextTextIndex = j + 1;
+            }
+            return hilitedTexts[j].getRawPtr();
+        }
+    }
+    return NULL;
+}
+
+
+int HilitingScheduler::process(TimeStamp endTime)
+{
+    int rslt = 0;
+    
+    HilitedText* hilitedText = getNextHilitedText(true);
+    
+    if (hilitedText != NULL) {
+        rslt = hilitedText->process(endTime);
+    }
+    if (jumpedViews.getLength() > 0) {
+        checkJumpedViews();
+    }
+    return rslt;
+}
+
+
+void HilitingScheduler::treatViewJump(HilitingBuffer* view)
+{
+    if (!isStatisticsEnabled || view->getHilitedText()->getProcessedEndPos() >= view->getVisibleEndPos()) {
+        return;
+    }
+    for (long i = 0; i < jumpedViews.getLength(); ++i) {
+        if (jumpedViews[i].view == view) {
+            jumpedViews[i].jumpTime = TimeStamp::now();
+            return;
+        }
+    }
+    jumpedViews.append(JumpedView(view, TimeStamp::now()));
+}
+
+
+void HilitingScheduler::checkJumpedViews()
+{
+    for (long i = 0; i < jumpedViews.getLength();)
+    {
+        HilitingBuffer* view = jumpedViews[i].view;
+
+        if (view == NULL || !view->isVisible()) {
+            jumpedViews.remove(i);
+        }
+        else if (view->getHilitedText()->getProcessedEndPos() >= view->getVisibleEndPos())
+        {
+            TimePeriod t  = TimeStamp::now() - jumpedViews[i].jumpTime;
+            long       ms = t.getSeconds() * 1000 + t.getMicroSeconds() / 1000;
+
+            numberOfJumps      += 1;
+            totalJumpMilliSecs += ms;
+            util::maximize(&maxJumpMilliSecs, ms);
+
+            fprintf(stderr, "luced: hiliting correct %ld ms after jump (jumps: %ld, average: %ld ms, max: %ld ms)\n",
+                            ms, numberOfJumps, totalJumpMilliSecs / numberOfJumps, maxJumpMilliSecs);
+            jumpedViews.remove(i);
+        }
+        else {
+            ++i;
+        }
+    }
+}
@@ -0,0 +1,100 @@
+/////////////////////////////////////////////////////////////////////////////////////
+//
+//   LucED - The Lucid Editor
+//
+//   Copyright (C) 2005-2010 Oliver Schmidt, oliver at luced dot de
+//
+//   This program is free software; you can redistribute it and/or modify it
+//   under the terms of the GNU General Public License Version 2 as published
+//   by the Free Software Foundation in June 1991.
+//
+//   This program is distributed in the hope that it will be useful, but WITHOUT
+//   ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+//   FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+//   more details.
+//
+//   You should have received a copy of the GNU General Public License along with
+//   this program; if not, write to the Free Software Foundation, Inc.,
+//   51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+//
+/////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef HILITING_SCHEDULER_HPP
+#define HILITING_SCHEDULER_HPP
+
+#include "HeapObject.hpp"
+#include "SingletonInstance.hpp"
+#include "ObjectArray.hpp"
+#include "WeakPtr.hpp"
+#include "TimeStamp.hpp"
+#include "ProcessHandler.hpp"
+#include "HilitedText.hpp"
+#include "HilitingBuffer.hpp"
+
+namespace LucED
+{
+
+/**
+ * Distributes the processing time for hiliting among all HilitedText objects.
+ *
+ * Each view reports its visible range through its HilitingBuffer. A HilitedText
+ * that is not processed up to the end of the visible range of the focused view
+ * is processed first, then texts that are not processed up to the end of the
+ * other visible views, then all other texts in turn. While the parsing thread 
+ * of a text with such a view is running, other texts are not processed.
+ *
+ * If the environment variable LUCED_HILITING_STATISTICS is set, the time from
+ * a view jumping into a range that is not processed yet until the hiliting
+ * of this range is correct is printed to stderr.
+ */
+class HilitingScheduler : public HeapObject
+{
+public:
+    static HilitingScheduler* getInstance();
+
+    void registerHilitedText(HilitedText* hilitedText);
+
+    void registerView(HilitingBuffer* view);
+
+    /**
+     * Invoked by a HilitingBuffer if the visible range of its view jumped.
+     */
+    void treatViewJump(HilitingBuffer* view);
+
+private:
+    friend class SingletonInstance<HilitingScheduler>;
+    static SingletonInstance<HilitingScheduler> instance;
+
+    HilitingScheduler();
+
+    int  process(TimeStamp endTime);
+    bool needsProcessing();
+
+    HilitedText* getNextHilitedText(bool isTurnTaken);
+
+    void checkJumpedViews();
+
+    struct JumpedView
+    {
+        JumpedView(HilitingBuffer* view, TimeStamp jumpTime)
+            : view(view),
+              jumpTime(jumpTime)
+        {}
+        WeakPtr<HilitingBuffer> view;
+        TimeStamp               jumpTime;
+    };
+
+    ProcessHandler::Ptr                    processHandler;
+    ObjectArray< WeakPtr<HilitedText> >    hilitedTexts;
+    ObjectArray< WeakPtr<HilitingBuffer> > views;
+    long                                   nextTextIndex;
+    bool                                   isStatisticsEnabled;
+    ObjectArray<JumpedView>                jumpedViews;
+    long                                   numberOfJumps;
+    long                                   totalJumpMilliSecs;
+    long                                   maxJumpMilliSecs;
+};
+
+} // namespace LucED
+
+#endif // HILITING_SCHEDULER_HPP
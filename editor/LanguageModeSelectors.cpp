@@ -21,6 +21,8 @@
 
 #include "LanguageModeSelectors.hpp"
 #include "RegexException.hpp"
+#include "CharUtil.hpp"
+#include "util.hpp"
 
 using namespace LucED;
 
@@ -58,6 +60,18 @@ String LanguageModeSelectors::getLanguageModeNameForFileName(const String& fileN
 
 LanguageModeSelectors::Result LanguageModeSelectors::getResultForFileNameAndContent(const String& fileName, RawPtr<const ByteBuffer> fileContent)
 {
+    return getResultForFileNameAndContent(fileName, fileContent->getTotalAmount(), fileContent->getLength());
+}
+
+LanguageModeSelectors::Result LanguageModeSelectors::getResultForFileNameAndContent(const String& fileName, const byte* fileContent, long contentLength)
+{
+    // The content is not converted yet, but the regular expressions are 
+    // matched without UTF-8 check, so they only get to see the valid part
+    // of the beginning.
+
+    contentLength = util::minimum(contentLength, (long) DETECTION_LENGTH);
+    contentLength = CharUtil::getValidUtf8PrefixLength(fileContent, contentLength);
+    
     for (int i = 0; i < selectors.getLength(); ++i)
     {
         LanguageModeSelector::Ptr selector = selectors[i];
@@ -76,7 +90,7 @@ LanguageModeSelectors::Result LanguageModeSelectors::getResultForFileNameAndCont
             }
         }
         if (contentRegex.isValid()) {
-            bool matched = contentRegex.get().findMatch((const char*)fileContent->getTotalAmount(), fileContent->getLength(), 0, BasicRegex::MatchOptions(), ovector);
+            bool matched = contentRegex.get().findMatch((const char*)fileContent, contentLength, 0, BasicRegex::MatchOptions(), ovector);
             if (matched) {
                 contentMatched = true;
                 try
@@ -86,7 +100,7 @@ LanguageModeSelectors::Result LanguageModeSelectors::getResultForFileNameAndCont
                         int p1 = ovector[2*i];
                         int p2 = ovector[2*i + 1];
                         if (p1 >= 0 && p2 > p1) {
-                            encoding = String((const char*)fileContent->getAmount(p1, p2 - p1), p2 - p1);
+                            encoding = String((const char*)fileContent + p1, p2 - p1);
                         }
                     }
                 }
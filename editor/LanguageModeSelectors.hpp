@@ -44,6 +44,12 @@ class LanguageModeSelectors : public HeapObject
 {
 public:
     typedef OwningPtr<LanguageModeSelectors> Ptr;
+
+    /**
+     * Length of the beginning of a text that is enough for
+     * detecting language mode and encoding.
+     */
+    enum { DETECTION_LENGTH = 1024 * 1024 };
     
     static Ptr create() {
         return Ptr(new LanguageModeSelectors());
@@ -73,6 +79,7 @@ public:
     
     String getLanguageModeNameForFileName(const String& fileName);
     Result getResultForFileNameAndContent(const String& fileName, RawPtr<const ByteBuffer> fileContent);
+    Result getResultForFileNameAndContent(const String& fileName, const byte* fileContent, long contentLength);
 
 private:
     LanguageModeSelectors()
@@ -0,0 +1,399 @@
+/////////////////////////////////////////////////////////////////////////////////////
+//
+//   LucED - The Lucid Editor
+//
+//   Copyright (C) 2005-2010 Oliver Schmidt, oliver at luced dot de
+//
+//   This program is free software; you can redistribute it and/or modify it
+//   under the terms of the GNU General Public License Version 2 as published
+//   by the Free Software Foundation in June 1991.
+//
+//   This program is distributed in the hope that it will be useful, but WITHOUT
+//   ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+//   FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+//   more details.
+//
+//   You should have received a copy of the GNU General Public License along with
+//   this program; if not, write to the Free Software Foundation, Inc.,
+//   51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+//
+/////////////////////////////////////////////////////////////////////////////////////
+
+#include <string.h>
+#include <unistd.h>
+
+#include "config.h"
+#include "util.hpp"
+#include "LineIndex.hpp"
+#include "ObjectArray.hpp"
+#include "NewlineCounter.hpp"
+#include "Thread.hpp"
+#include "SystemException.hpp"
+
+using namespace LucED;
+
+
+namespace
+{
+    enum
+    {
+        PARALLEL_MIN_LENGTH        = 4 * 1024 * 1024,
+        PARALLEL_MIN_THREAD_LENGTH =     1024 * 1024,
+        PARALLEL_MAX_THREADS       = 8
+    };
+
+    struct Segment
+    {
+        const byte* data;
+        long        begin;
+        long        length;
+    };
+
+    /**
+     * Counts the newlines of the blocks [firstBlock, endBlock) into counts.
+     * Only reads the segments, so that several ranges can be counted
+     * concurrently.
+     */
+    void countNewlinesOfBlocks(const MemArray<Segment>& segments, long length, long blockLength,
+                               long firstBlock, long endBlock, long* counts)
+    {
+        long pos = firstBlock * blockLength;
+        long s   = 0;
+        long e   = segments.getLength();
+
+        while (s + 1 < e) {
+            long m = (s + e) / 2;
+            if (segments[m].begin <= pos) {
+                s = m;
+            } else {
+                e = m;
+            }
+        }
+        for (long b = firstBlock; b < endBlock; ++b)
+        {
+            long end   = util::minimum(pos + blockLength, length);
+            long count = 0;
+
+            while (pos < end)
+            {
+                const Segment& segment    = segments[s];
+                long           segmentEnd = segment.begin + segment.length;
+                long           n          = util::minimum(end, segmentEnd) - pos;
+
+                count += NewlineCounter::count(segment.data + (pos - segment.begin), n);
+                pos   += n;
+
+                if (pos == segmentEnd) {
+                    ++s;
+                }
+            }
+            counts[b] = count;
+        }
+    }
+
+#if LUCED_USE_MULTI_THREAD
+
+    class CountingThread : public Thread
+    {
+    public:
+        typedef OwningPtr<CountingThread> Ptr;
+
+        static Ptr create(const MemArray<Segment>* segments, long length, long blockLength,
+                          long firstBlock, long endBlock, long* counts)
+        {
+            return Ptr(new CountingThread(segments, length, blockLength, firstBlock, endBlock, counts));
+        }
+
+    protected:
+        virtual void main() {
+            countNewlinesOfBlocks(*segments, length, blockLength, firstBlock, endBlock, counts);
+        }
+
+    private:
+        CountingThread(const MemArray<Segment>* segments, long length, long blockLength,
+                       long firstBlock, long endBlock, long* counts)
+            : segments(segments),
+              length(length),
+              blockLength(blockLength),
+              firstBlock(firstBlock),
+              endBlock(endBlock),
+              counts(counts)
+        {}
+
+        const MemArray<Segment>* segments;
+        long  length;
+        long  blockLength;
+        long  firstBlock;
+        long  endBlock;
+        long* counts;
+    };
+
+    long getNumberOfCountingThreads(long length)
+    {
+        if (length < PARALLEL_MIN_LENGTH) {
+            return 1;
+        }
+        long n = sysconf(_SC_NPROCESSORS_ONLN);
+
+        return util::maximum(1L, util::minimum(util::minimum(n, (long) PARALLEL_MAX_THREADS),
+                                               length / PARALLEL_MIN_THREAD_LENGTH));
+    }
+
+#else
+
+    long getNumberOfCountingThreads(long length)
+    {
+        return 1;
+    }
+
+#endif // LUCED_USE_MULTI_THREAD
+
+} // anonymous namespace
+
+
+long LineIndex::countNewlines(long pos, long amount) const
+{
+    long rslt = 0;
+
+    while (amount > 0)
+    {
+        const byte* ptr;
+        long n = text->getContiguousAmount(pos, amount, &ptr);
+
+        rslt   += NewlineCounter::count(ptr, n);
+        pos    += n;
+        amount -= n;
+    }
+    return rslt;
+}
+
+
+long LineIndex::getPosAfterNewline(long pos, long newlineIndex) const
+{
+    long length = text->getLength();
+
+    while (pos < length)
+    {
+        const byte* ptr;
+        long n = text->getContiguousAmount(pos, length - pos, &ptr);
+
+        const byte* end = ptr + n;
+        const byte* p   = ptr;
+
+        while ((p = (const byte*) memchr(p, '\n', end - p)) != NULL)
+        {
+            if (newlineIndex == 0) {
+                return pos + (p - ptr) + 1;
+            }
+            --newlineIndex;
+            ++p;
+        }
+        pos += n;
+    }
+    ASSERT(false);
+    return length;
+}
+
+
+long LineIndex::getBlockIndexForPos(long pos) const
+{
+    long i = blockLengths.getIndexForSum(pos);
+    if (i == blockLengths.getLength() && i > 0) {
+        i -= 1; // end of text belongs to the last block
+    }
+    return i;
+}
+
+
+void LineIndex::rebuild()
+{
+    long length         = text->getLength();
+    long numberOfBlocks = util::roundedUpDiv(length, (long) TARGET_BLOCK_LENGTH);
+
+    MemArray<long>    lengths(numberOfBlocks);
+    MemArray<long>    counts (numberOfBlocks);
+    MemArray<Segment> segments;
+
+    for (long b = 0; b < numberOfBlocks; ++b) {
+        lengths[b] = util::minimum(length - b * TARGET_BLOCK_LENGTH, (long) TARGET_BLOCK_LENGTH);
+    }
+    for (long p = 0; p < length;)
+    {
+        Segment segment;
+        segment.begin  = p;
+        segment.length = text->getContiguousAmount(p, length - p, &segment.data);
+        segments.append(segment);
+        p += segment.length;
+    }
+
+    long numberOfThreads = getNumberOfCountingThreads(length);
+    long blocksPerThread = util::roundedUpDiv(numberOfBlocks, numberOfThreads);
+
+#if LUCED_USE_MULTI_THREAD
+    // the first range is counted in this thread, the others in worker threads
+
+    ObjectArray<CountingThread::Ptr> threads;
+
+    for (long t = 1; t < numberOfThreads; ++t)
+    {
+        long firstBlock = util::minimum(t * blocksPerThread, numberOfBlocks);
+        long endBlock   = util::minimum(firstBlock + blocksPerThread, numberOfBlocks);
+
+        CountingThread::Ptr thread = CountingThread::create(&segments, length, TARGET_BLOCK_LENGTH,
+                                                            firstBlock, endBlock, counts.getPtr());
+        try {
+            Thread::start(thread);
+            threads.append(thread);
+        }
+        catch (SystemException& ex) {
+            countNewlinesOfBlocks(segments, length, TARGET_BLOCK_LENGTH, firstBlock, endBlock, counts.getPtr());
+        }
+    }
+#endif
+    countNewlinesOfBlocks(segments, length, TARGET_BLOCK_LENGTH,
+                          0, util::minimum(blocksPerThread, numberOfBlocks), counts.getPtr());
+#if LUCED_USE_MULTI_THREAD
+    for (long t = 0; t < threads.getLength(); ++t) {
+        threads[t]->waitForFinished();
+    }
+#endif
+    blockLengths .replace(0, blockLengths .getLength(), lengths.getPtr(), lengths.getLength());
+    newlineCounts.replace(0, newlineCounts.getLength(), counts .getPtr(), counts .getLength());
+}
+
+
+long LineIndex::getBeginOfLine(long line) const
+{
+    ASSERT(0 <= line && line < getNumberOfLines());
+
+    if (line == 0) {
+        return 0;
+    }
+    long k = line - 1;
+    long i = newlineCounts.getIndexForSum(k);
+
+    return getPosAfterNewline(blockLengths.getSumBefore(i), k - newlineCounts.getSumBefore(i));
+}
+
+
+long LineIndex::getLineOfPos(long pos) const
+{
+    ASSERT(0 <= pos && pos <= text->getLength());
+
+    if (blockLengths.getLength() == 0) {
+        return 0;
+    }
+    long i          = getBlockIndexForPos(pos);
+    long blockBegin = blockLengths.getSumBefore(i);
+
+    return newlineCounts.getSumBefore(i) + countNewlines(blockBegin, pos - blockBegin);
+}
+
+
+void LineIndex::splitBlock(long i)
+{
+    long begin  = blockLengths.getSumBefore(i);
+    long length = blockLengths.get(i);
+
+    long numberOfParts = util::roundedUpDiv(length, (long) TARGET_BLOCK_LENGTH);
+
+    MemArray<long> lengths;
+    MemArray<long> counts;
+
+    for (long k = 0, p = begin; k < numberOfParts; ++k)
+    {
+        long n = length / numberOfParts + (k < length % numberOfParts ? 1 : 0);
+        lengths.append(n);
+        counts .append(countNewlines(p, n));
+        p += n;
+    }
+    blockLengths .replace(i, 1, lengths.getPtr(), lengths.getLength());
+    newlineCounts.replace(i, 1, counts .getPtr(), counts .getLength());
+}
+
+
+void LineIndex::mergeSmallBlock(long i)
+{
+    long n = blockLengths.getLength();
+
+    if (0 <= i && i < n && blockLengths.get(i) < MIN_BLOCK_LENGTH)
+    {
+        if (blockLengths.get(i) == 0) {
+            blockLengths .remove(i);
+            newlineCounts.remove(i);
+            return;
+        }
+        long k;
+        if (i + 1 < n && blockLengths.get(i) + blockLengths.get(i + 1) <= MAX_BLOCK_LENGTH) {
+            k = i;
+        } else if (i > 0 && blockLengths.get(i - 1) + blockLengths.get(i) <= MAX_BLOCK_LENGTH) {
+            k = i - 1;
+        } else {
+            return;
+        }
+        long length = blockLengths .get(k) + blockLengths .get(k + 1);
+        long count  = newlineCounts.get(k) + newlineCounts.get(k + 1);
+
+        blockLengths .replace(k, 2, &length, 1);
+        newlineCounts.replace(k, 2, &count,  1);
+    }
+}
+
+
+void LineIndex::insertAmount(long pos, long amount, long numberOfNewlines)
+{
+    if (amount > 0)
+    {
+        long i;
+
+        if (blockLengths.getLength() == 0) {
+            i = 0;
+            blockLengths .append(amount);
+            newlineCounts.append(numberOfNewlines);
+        } else {
+            i = getBlockIndexForPos(pos);
+            blockLengths .add(i, amount);
+            newlineCounts.add(i, numberOfNewlines);
+        }
+        if (blockLengths.get(i) > MAX_BLOCK_LENGTH) {
+            splitBlock(i);
+        }
+    }
+}
+
+
+void LineIndex::removeAmount(long pos, long amount)
+{
+    ASSERT(0 <= pos && 0 <= amount && pos + amount <= text->getLength());
+
+    if (amount > 0)
+    {
+        long end = pos + amount;
+        long i   = blockLengths.getIndexForSum(pos);
+        long j   = blockLengths.getIndexForSum(end - 1);
+
+        if (i == j)
+        {
+            blockLengths .add(i, -amount);
+            newlineCounts.add(i, -countNewlines(pos, amount));
+        }
+        else
+        {
+            long iBegin = blockLengths.getSumBefore(i);
+            long iEnd   = iBegin + blockLengths.get(i);
+            long jBegin = blockLengths.getSumBefore(j);
+            long jEnd   = jBegin + blockLengths.get(j);
+
+            long lengths[2] = { pos - iBegin,
+                                jEnd - end };
+            long counts[2]  = { newlineCounts.get(i) - countNewlines(pos, iEnd - pos),
+                                newlineCounts.get(j) - countNewlines(jBegin, end - jBegin) };
+
+            blockLengths .replace(i, j - i + 1, lengths, 2);
+            newlineCounts.replace(i, j - i + 1, counts,  2);
+
+            mergeSmallBlock(i + 1);
+        }
+        mergeSmallBlock(i);
+    }
+}
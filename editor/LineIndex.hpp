@@ -0,0 +1,91 @@
+/////////////////////////////////////////////////////////////////////////////////////
+//
+//   LucED - The Lucid Editor
+//
+//   Copyright (C) 2005-2010 Oliver Schmidt, oliver at luced dot de
+//
+//   This program is free software; you can redistribute it and/or modify it
+//   under the terms of the GNU General Public License Version 2 as published
+//   by the Free Software Foundation in June 1991.
+//
+//   This program is distributed in the hope that it will be useful, but WITHOUT
+//   ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+//   FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+//   more details.
+//
+//   You should have received a copy of the GNU General Public License along with
+//   this program; if not, write to the Free Software Foundation, Inc.,
+//   51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+//
+/////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef LINE_INDEX_HPP
+#define LINE_INDEX_HPP
+
+#include "debug.hpp"
+#include "NonCopyable.hpp"
+#include "RawPtr.hpp"
+#include "PrefixSumArray.hpp"
+#include "TextStorage.hpp"
+
+namespace LucED
+{
+
+/**
+ * Index of the line beginnings in a TextStorage.
+ *
+ * The text is divided into blocks of limited size. For each block the
+ * length and the number of newlines is kept in a PrefixSumArray, so that
+ * the block containing a position or a line is found in O(log n) and
+ * only one block has to be scanned.
+ *
+ * The index must be informed about every modification of the text:
+ * insertAmount() after the bytes were inserted, removeAmount() before
+ * the bytes are removed.
+ */
+class LineIndex : private NonCopyable
+{
+public:
+    explicit LineIndex(RawPtr<const TextStorage> text)
+        : text(text)
+    {}
+
+    /**
+     * Builds the index from scratch for the whole text.
+     */
+    void rebuild();
+
+    long getNumberOfLines() const {
+        return newlineCounts.getTotalSum() + 1;
+    }
+
+    long getBeginOfLine(long line) const;
+    long getLineOfPos(long pos) const;
+
+    void insertAmount(long pos, long amount, long numberOfNewlines);
+    void removeAmount(long pos, long amount);
+
+    long countNewlines(long pos, long amount) const;
+
+private:
+    enum
+    {
+        TARGET_BLOCK_LENGTH =  8 * 1024,
+        MAX_BLOCK_LENGTH    = 16 * 1024,
+        MIN_BLOCK_LENGTH    =  2 * 1024
+    };
+
+    long getPosAfterNewline(long pos, long newlineIndex) const;
+    long getBlockIndexForPos(long pos) const;
+
+    void splitBlock(long i);
+    void mergeSmallBlock(long i);
+
+    RawPtr<const TextStorage> text;
+    PrefixSumArray            blockLengths;
+    PrefixSumArray            newlineCounts;
+};
+
+} // namespace LucED
+
+#endif // LINE_INDEX_HPP
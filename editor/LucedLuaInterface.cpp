@@ -27,6 +27,7 @@
 #include "GlobalConfig.hpp"
 #include "LuaIterator.hpp"
 #include "FileOpener.hpp"
+#include "EditingHistory.hpp"
 
 using namespace LucED;
 
@@ -166,3 +167,12 @@ LuaCFunctionResult LucedLuaInterface::bindActionKey(const LuaCFunctionArguments&
                                                                     action);
     return LuaCFunctionResult(luaAccess);
 }
+
+
+LuaCFunctionResult LucedLuaInterface::getHistoryMemoryUsage(const LuaCFunctionArguments& args)
+{
+    LuaAccess luaAccess = args.getLuaAccess();
+
+    return LuaCFunctionResult(luaAccess) << EditingHistory::getTotalMemoryUsage()
+                                         << EditingHistory::getTotalSpilledLength();
+}
@@ -0,0 +1,162 @@
+/////////////////////////////////////////////////////////////////////////////////////
+//
+//   LucED - The Lucid Editor
+//
+//   Copyright (C) 2005-2010 Oliver Schmidt, oliver at luced dot de
+//
+//   This program is free software; you can redistribute it and/or modify it
+//   under the terms of the GNU General Public License Version 2 as published
+//   by the Free Software Foundation in June 1991.
+//
+//   This program is distributed in the hope that it will be useful, but WITHOUT
+//   ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+//   FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+//   more details.
+//
+//   You should have received a copy of the GNU General Public License along with
+//   this program; if not, write to the Free Software Foundation, Inc.,
+//   51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+//
+/////////////////////////////////////////////////////////////////////////////////////
+
+#include <sys/mman.h>
+#include <signal.h>
+#include <unistd.h>
+#include <string.h>
+
+#include "MappedMemory.hpp"
+
+#ifndef MAP_ANONYMOUS
+#  define MAP_ANONYMOUS MAP_ANON
+#endif
+
+using namespace LucED;
+
+namespace
+{
+
+/**
+ * The address ranges of all mappings for the SIGBUS handler. Slots are
+ * claimed and released with atomic operations, because the handler may
+ * run in any thread at any time. An unused slot has begin == end == 0, 
+ * a slot being claimed or released has begin == BUSY_SLOT. Both never 
+ * match an address.
+ */
+struct MappingSlot
+{
+    volatile unsigned long begin;
+    volatile unsigned long end;
+    volatile sig_atomic_t  wasTruncated;
+};
+
+enum { MAX_MAPPINGS = 64 };
+
+const unsigned long BUSY_SLOT = ~0UL;
+
+MappingSlot mappingSlots[MAX_MAPPINGS];
+
+volatile sig_atomic_t isHandlerInstalled = false;
+
+long pageSize = 0;
+
+void handleBusError(int signalNumber, siginfo_t* info, void* context)
+{
+    unsigned long address = (unsigned long) info->si_addr;
+    
+    for (int i = 0; i < MAX_MAPPINGS; ++i)
+    {
+        MappingSlot& slot = mappingSlots[i];
+        
+        if (slot.begin <= address && address < slot.end)
+        {
+            // The file was truncated: all pages from here on are behind the 
+            // end of the file. They are replaced by zero filled pages and the 
+            // faulting access is repeated after returning.
+
+            unsigned long pageBegin = address & ~(pageSize - 1);
+
+            if (mmap((void*) pageBegin, slot.end - pageBegin, PROT_READ, 
+                     MAP_PRIVATE|MAP_ANONYMOUS|MAP_FIXED, -1, 0) != MAP_FAILED)
+            {
+                slot.wasTruncated = true;
+                return;
+            }
+        }
+    }
+    // not caused by a mapped file: repeating the access 
+    // with the default action terminates the program
+
+    signal(SIGBUS, SIG_DFL);
+}
+
+void installHandler()
+{
+    if (!isHandlerInstalled)
+    {
+        pageSize = sysconf(_SC_PAGESIZE);
+
+        struct sigaction action;
+        memset(&action, 0, sizeof(action));
+        action.sa_sigaction = &handleBusError;
+        action.sa_flags     = SA_SIGINFO;
+        sigemptyset(&action.sa_mask);
+        
+        sigaction(SIGBUS, &action, NULL);
+        
+        isHandlerInstalled = true;
+    }
+}
+
+} // anonymous namespace
+
+
+MappedMemory::Ptr MappedMemory::create(void* data, long length)
+{
+    if (length == 0) {
+        return Ptr(new MappedMemory(data, length, -1));
+    }
+    installHandler();
+    
+    for (int i = 0; i < MAX_MAPPINGS; ++i)
+    {
+        MappingSlot& slot = mappingSlots[i];
+
+        if (__sync_bool_compare_and_swap(&slot.begin, 0, BUSY_SLOT))
+        {
+            unsigned long begin = (unsigned long) data;
+            unsigned long end   = (begin + length + pageSize - 1) & ~(pageSize - 1);
+            
+            slot.wasTruncated = false;
+            slot.end          = end;
+            __sync_synchronize();
+            slot.begin        = begin;
+            
+            return Ptr(new MappedMemory(data, length, i));
+        }
+    }
+    return Ptr();
+}
+
+
+MappedMemory::~MappedMemory()
+{
+    if (slotIndex >= 0)
+    {
+        MappingSlot& slot = mappingSlots[slotIndex];
+        
+        slot.begin = BUSY_SLOT;
+        __sync_synchronize();
+        slot.end   = 0;
+        __sync_synchronize();
+        slot.begin = 0;
+    }
+    if (length > 0) {
+        munmap((void*) data, length);
+    }
+}
+
+
+bool MappedMemory::wasTruncated() const
+{
+    return slotIndex >= 0 && mappingSlots[slotIndex].wasTruncated;
+}
@@ -0,0 +1,85 @@
+/////////////////////////////////////////////////////////////////////////////////////
+//
+//   LucED - The Lucid Editor
+//
+//   Copyright (C) 2005-2010 Oliver Schmidt, oliver at luced dot de
+//
+//   This program is free software; you can redistribute it and/or modify it
+//   under the terms of the GNU General Public License Version 2 as published
+//   by the Free Software Foundation in June 1991.
+//
+//   This program is distributed in the hope that it will be useful, but WITHOUT
+//   ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+//   FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+//   more details.
+//
+//   You should have received a copy of the GNU General Public License along with
+//   this program; if not, write to the Free Software Foundation, Inc.,
+//   51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+//
+/////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef MAPPED_MEMORY_HPP
+#define MAPPED_MEMORY_HPP
+
+#include "debug.hpp"
+#include "types.hpp"
+#include "HeapObject.hpp"
+#include "OwningPtr.hpp"
+
+namespace LucED
+{
+
+/**
+ * Read-only memory mapping of a file.
+ *
+ * The content is paged in from the page cache on demand, so that
+ * mapping a large file costs neither reading time nor private memory.
+ * If the file is truncated while it is mapped, accessing pages behind 
+ * the new end of the file raises SIGBUS. The SIGBUS handler installed
+ * for mappings replaces these pages by zero filled pages, so that they 
+ * read as null bytes, and remembers the truncation for wasTruncated().
+ */
+class MappedMemory : public HeapObject
+{
+public:
+    typedef OwningPtr<MappedMemory> Ptr;
+
+    ~MappedMemory();
+
+    const byte* getPtr() const {
+        return data;
+    }
+    long getLength() const {
+        return length;
+    }
+    
+    /**
+     * True if pages behind the end of the truncated file were accessed. 
+     * Their content is lost.
+     */
+    bool wasTruncated() const;
+
+private:
+    friend class File;
+
+    /**
+     * Returns an invalid pointer if the SIGBUS handler cannot take
+     * more mappings.
+     */
+    static Ptr create(void* data, long length);
+
+    MappedMemory(void* data, long length, int slotIndex)
+        : data((const byte*) data),
+          length(length),
+          slotIndex(slotIndex)
+    {}
+
+    const byte* data;
+    long        length;
+    int         slotIndex;
+};
+
+} // namespace LucED
+
+#endif // MAPPED_MEMORY_HPP
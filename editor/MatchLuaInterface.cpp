@@ -264,7 +264,8 @@ LuaCFunctionResult MatchLuaInterface::getMatchedBytes(const LuaCFunctionArgument
     
     if (amount > 0)
     {
-        rslt = luaAccess.toLua((const char*)(textData->getAmount(beginPos, amount)),
+        ByteArray scratchBuffer;
+        rslt = luaAccess.toLua((const char*)(textData->getAmount(beginPos, amount, &scratchBuffer)),
                                amount);
     }
     else {
@@ -118,6 +118,32 @@ public:
             return posToPtr(startPos);
         }
     }
+    /**
+     * Returns the number of elements that can be read contiguously
+     * at startPos, but not more than maxAmount. Does not move the gap.
+     */
+    long getContiguousAmount(long startPos, long maxAmount, const T** rslt) const {
+        ASSERT(0 <= startPos && 0 <= maxAmount && startPos + maxAmount <= getLength());
+        *rslt = posToPtr(startPos);
+        if (startPos < gapPos && gapPos - startPos < maxAmount) {
+            return gapPos - startPos;
+        } else {
+            return maxAmount;
+        }
+    }
+    /**
+     * Copies without moving the gap.
+     */
+    void copyTo(T* dest, long startPos, long amount) const {
+        while (amount > 0) {
+            const T* src;
+            long n = getContiguousAmount(startPos, amount, &src);
+            memcpy(dest, src, n * sizeof(T));
+            dest     += n;
+            startPos += n;
+            amount   -= n;
+        }
+    }
     T* getPtr(long pos = 0) {
         return getAmount(pos, getLength() - pos);
     }
@@ -234,6 +234,8 @@ void MultiLineEditActions::shiftBlockLeft()
         long               endPos = e->getEndSelectionPos();
 
         textData->rememberChangeAreaInHistory(mark.getPos(), endPos);
+
+        TextData::CompoundChange::Ptr compoundChange = textData->createCompoundChange(mark.getPos(), endPos);
         
         if (!mark.isAtBeginOfLine()) {
             mark.moveToNextLineBegin();
@@ -274,6 +276,8 @@ void MultiLineEditActions::shiftBlockRight()
         
         textData->rememberChangeAreaInHistory(mark.getPos(), endPos);
 
+        TextData::CompoundChange::Ptr compoundChange = textData->createCompoundChange(mark.getPos(), endPos);
+
         if (!mark.isAtBeginOfLine()) {
             mark.moveToNextLineBegin();
         }
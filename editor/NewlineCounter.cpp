@@ -0,0 +1,133 @@
+/////////////////////////////////////////////////////////////////////////////////////
+//
+//   LucED - The Lucid Editor
+//
+//   Copyright (C) 2005-2010 Oliver Schmidt, oliver at luced dot de
+//
+//   This program is free software; you can redistribute it and/or modify it
+//   under the terms of the GNU General Public License Version 2 as published
+//   by the Free Software Foundation in June 1991.
+//
+//   This program is distributed in the hope that it will be useful, but WITHOUT
+//   ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+//   FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+//   more details.
+//
+//   You should have received a copy of the GNU General Public License along with
+//   this program; if not, write to the Free Software Foundation, Inc.,
+//   51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+//
+/////////////////////////////////////////////////////////////////////////////////////
+
+#include "config.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__)) && defined(__SSE2__)
+#  define USE_SSE2 1
+#  include <emmintrin.h>
+#  if __GNUC__ >= 5 || defined(__clang__)
+#    define USE_AVX2 1
+#    include <immintrin.h>
+#  endif
+#endif
+
+#include "NewlineCounter.hpp"
+
+using namespace LucED;
+
+namespace
+{
+
+long countBytewise(const byte* ptr, long length)
+{
+    long rslt = 0;
+    for (long i = 0; i < length; ++i) {
+        if (ptr[i] == '\n') {
+            ++rslt;
+        }
+    }
+    return rslt;
+}
+
+#if USE_SSE2
+
+long countSse2(const byte* ptr, long length)
+{
+    const __m128i newline = _mm_set1_epi8('\n');
+    const __m128i zero    = _mm_setzero_si128();
+
+    long rslt = 0;
+
+    while (length >= 16)
+    {
+        // byte counters must not overflow: at most 255 steps
+
+        long    steps    = length / 16 < 255 ? length / 16 : 255;
+        __m128i counters = zero;
+
+        for (long i = 0; i < steps; ++i, ptr += 16) {
+            __m128i bytes = _mm_loadu_si128((const __m128i*) ptr);
+            counters = _mm_sub_epi8(counters, _mm_cmpeq_epi8(bytes, newline));
+        }
+        __m128i sums = _mm_sad_epu8(counters, zero);
+
+        rslt   += _mm_cvtsi128_si32(sums) + _mm_extract_epi16(sums, 4);
+        length -= steps * 16;
+    }
+    return rslt + countBytewise(ptr, length);
+}
+
+#endif // USE_SSE2
+
+#if USE_AVX2
+
+__attribute__((target("avx2")))
+long countAvx2(const byte* ptr, long length)
+{
+    const __m256i newline = _mm256_set1_epi8('\n');
+    const __m256i zero    = _mm256_setzero_si256();
+
+    long rslt = 0;
+
+    while (length >= 32)
+    {
+        long    steps    = length / 32 < 255 ? length / 32 : 255;
+        __m256i counters = zero;
+
+        for (long i = 0; i < steps; ++i, ptr += 32) {
+            __m256i bytes = _mm256_loadu_si256((const __m256i*) ptr);
+            counters = _mm256_sub_epi8(counters, _mm256_cmpeq_epi8(bytes, newline));
+        }
+        __m256i sums = _mm256_sad_epu8(counters, zero);
+        __m128i sum2 = _mm_add_epi64(_mm256_castsi256_si128(sums), 
+                                     _mm256_extracti128_si256(sums, 1));
+
+        rslt   += _mm_cvtsi128_si32(sum2) + _mm_extract_epi16(sum2, 4);
+        length -= steps * 32;
+    }
+    return rslt + countSse2(ptr, length);
+}
+
+#endif // USE_AVX2
+
+} // anonymous namespace
+
+
+NewlineCounter::CountFunction* NewlineCounter::selectCountFunction()
+{
+#if USE_AVX2
+    __builtin_cpu_init();
+
+    if (__builtin_cpu_supports("avx2")) {
+        return &countAvx2;
+    } else {
+        return &countSse2;
+    }
+#elif USE_SSE2
+    return &countSse2;
+#else
+    return &countBytewise;
+#endif
+}
+
+
+NewlineCounter::CountFunction* NewlineCounter::countFunction = NewlineCounter::selectCountFunction();
@@ -0,0 +1,53 @@
+/////////////////////////////////////////////////////////////////////////////////////
+//
+//   LucED - The Lucid Editor
+//
+//   Copyright (C) 2005-2010 Oliver Schmidt, oliver at luced dot de
+//
+//   This program is free software; you can redistribute it and/or modify it
+//   under the terms of the GNU General Public License Version 2 as published
+//   by the Free Software Foundation in June 1991.
+//
+//   This program is distributed in the hope that it will be useful, but WITHOUT
+//   ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+//   FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+//   more details.
+//
+//   You should have received a copy of the GNU General Public License along with
+//   this program; if not, write to the Free Software Foundation, Inc.,
+//   51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+//
+/////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef NEWLINE_COUNTER_HPP
+#define NEWLINE_COUNTER_HPP
+
+#include "types.hpp"
+
+namespace LucED
+{
+
+/**
+ * Counts newline characters in memory.
+ *
+ * On x86 processors 16 or 32 bytes are compared at once using SSE2 or
+ * AVX2 instructions, the best variant is selected at runtime.
+ */
+class NewlineCounter
+{
+public:
+    static long count(const byte* ptr, long length) {
+        return countFunction(ptr, length);
+    }
+
+private:
+    typedef long CountFunction(const byte* ptr, long length);
+
+    static CountFunction* countFunction;
+
+    static CountFunction* selectCountFunction();
+};
+
+} // namespace LucED
+
+#endif // NEWLINE_COUNTER_HPP
@@ -0,0 +1,166 @@
+/////////////////////////////////////////////////////////////////////////////////////
+//
+//   LucED - The Lucid Editor
+//
+//   Copyright (C) 2005-2010 Oliver Schmidt, oliver at luced dot de
+//
+//   This program is free software; you can redistribute it and/or modify it
+//   under the terms of the GNU General Public License Version 2 as published
+//   by the Free Software Foundation in June 1991.
+//
+//   This program is distributed in the hope that it will be useful, but WITHOUT
+//   ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+//   FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+//   more details.
+//
+//   You should have received a copy of the GNU General Public License along with
+//   this program; if not, write to the Free Software Foundation, Inc.,
+//   51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+//
+/////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef PREFIX_SUM_ARRAY_HPP
+#define PREFIX_SUM_ARRAY_HPP
+
+#include "debug.hpp"
+#include "MemArray.hpp"
+#include "NonCopyable.hpp"
+
+namespace LucED
+{
+
+/**
+ * Array of non-negative numbers with prefix sums in O(log n).
+ *
+ * Changing the value of an element and computing the sum of all elements
+ * before an index are done in a Fenwick tree. Inserting or removing
+ * elements rebuilds the tree in O(n), so callers should change the number
+ * of elements in bulk and not for every single modification.
+ */
+class PrefixSumArray : private NonCopyable
+{
+public:
+    PrefixSumArray()
+        : highestBit(0)
+    {
+        tree.append(0);
+    }
+
+    long getLength() const {
+        return values.getLength();
+    }
+
+    long get(long i) const {
+        return values[i];
+    }
+
+    long getTotalSum() const {
+        return getSumBefore(values.getLength());
+    }
+
+    long getSumBefore(long i) const {
+        ASSERT(0 <= i && i <= values.getLength());
+        long rslt = 0;
+        for (long j = i; j > 0; j -= (j & -j)) {
+            rslt += tree[j];
+        }
+        return rslt;
+    }
+
+    void add(long i, long delta) {
+        ASSERT(0 <= i && i < values.getLength());
+        values[i] += delta;
+        ASSERT(values[i] >= 0);
+        for (long j = i + 1, n = values.getLength(); j <= n; j += (j & -j)) {
+            tree[j] += delta;
+        }
+    }
+
+    void set(long i, long value) {
+        add(i, value - values[i]);
+    }
+
+    /**
+     * Returns the index i of the element with getSumBefore(i) <= sum < getSumBefore(i + 1),
+     * or getLength() if sum >= getTotalSum().
+     */
+    long getIndexForSum(long sum) const {
+        long i = 0;
+        for (long step = highestBit; step > 0; step >>= 1) {
+            long j = i + step;
+            if (j <= values.getLength() && tree[j] <= sum) {
+                i    = j;
+                sum -= tree[j];
+            }
+        }
+        return i;
+    }
+
+    void insert(long i, const long* newValues, long amount) {
+        values.insert(i, newValues, amount);
+        rebuild();
+    }
+
+    void insert(long i, long value) {
+        insert(i, &value, 1);
+    }
+
+    void append(long value) {
+        insert(values.getLength(), &value, 1);
+    }
+
+    void removeAmount(long i, long amount) {
+        values.removeAmount(i, amount);
+        rebuild();
+    }
+
+    void remove(long i) {
+        removeAmount(i, 1);
+    }
+
+    void clear() {
+        values.clear();
+        rebuild();
+    }
+
+    /**
+     * Replaces the elements [i, i + amount) by newAmount new elements.
+     */
+    void replace(long i, long amount, const long* newValues, long newAmount) {
+        values.removeAmount(i, amount);
+        values.insert(i, newValues, newAmount);
+        rebuild();
+    }
+
+private:
+    void rebuild() {
+        long n = values.getLength();
+        tree.clear();
+        tree.appendAmount(n + 1);
+        tree[0] = 0;
+        for (long j = 1; j <= n; ++j) {
+            tree[j] = values[j - 1];
+        }
+        for (long j = 1; j <= n; ++j) {
+            long p = j + (j & -j);
+            if (p <= n) {
+                tree[p] += tree[j];
+            }
+        }
+        highestBit = 1;
+        while (highestBit * 2 <= n) {
+            highestBit *= 2;
+        }
+        if (n == 0) {
+            highestBit = 0;
+        }
+    }
+
+    MemArray<long> values;
+    MemArray<long> tree;
+    long           highestBit;
+};
+
+} // namespace LucED
+
+#endif // PREFIX_SUM_ARRAY_HPP
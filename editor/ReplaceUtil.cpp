@@ -166,6 +166,12 @@ String ReplaceUtil::getSubstitutedString()
     }
 }
 
+/**
+ * The region is scanned once: all matches are searched in the unmodified 
+ * text and the result is collected in a separate buffer. The changed part 
+ * of the region is then replaced at once, so that there is only one 
+ * modification of the text and only one history record.
+ */
 bool ReplaceUtil::replaceAllBetween(long spos, long epos)
 {
     if (!FindUtil::wasInitialized()) {
@@ -173,54 +179,45 @@ bool ReplaceUtil::replaceAllBetween(long spos, long epos)
     }
 
     RawPtr<TextData> textData = getTextData();
-    TextData::TextMark textMark = textData->createNewMark();
-    textMark.moveToPos(spos);
 
-    FindUtil::setTextPosition(textMark.getPos());
+    FindUtil::setTextPosition(spos);
     FindUtil::setMaximalEndOfMatchPosition(epos);
     
-    bool wasAnythingReplaced = false;
+    long       changedBegin = -1;
+    long       changedEnd   = -1;   // bytes up to here are in newContent
+    ByteBuffer newContent;
 
     try
     {
         FindUtil::setAllowMatchAtStartOfSearchFlag(true);
         
-        while (textMark.getPos() < epos)
+        long pos = spos;
+        
+        while (pos < epos)
         {
             FindUtil::findNext();
-            if (FindUtil::wasFound())
-            {
-                textMark.moveForwardToPos(FindUtil::getTextPosition());
-                
-    
-                if (FindUtil::getTextPosition() < epos)
-                {
-                    if (!wasAnythingReplaced) {
-                        textData->rememberChangeAreaInHistory(spos, epos);
-                        wasAnythingReplaced = true;
-                    }
-
-                    String substitutedString = getSubstitutedString();
-                    textData->insertAtMark(textMark, substitutedString);
-
-                    textMark.moveForwardToPos(textMark.getPos() + substitutedString.getLength());
-
-                    textData->removeAtMark(textMark, FindUtil::getMatchLength());
+            
+            if (!FindUtil::wasFound() || FindUtil::getTextPosition() >= epos) {
+                break;
+            }
+            long matchBegin  = FindUtil::getTextPosition();
+            long matchLength = FindUtil::getMatchLength();
 
-                    if (FindUtil::getMatchLength() == 0) {
-                        textMark.inc();
-                    }
+            if (changedBegin < 0) {
+                changedBegin = matchBegin;
+                changedEnd   = matchBegin;
+            }
+            textData->copyTo(newContent.appendAmount(matchBegin - changedEnd), changedEnd, matchBegin - changedEnd);
+            
+            newContent.appendString(getSubstitutedString());
 
-                    epos += substitutedString.getLength() - FindUtil::getMatchLength();
+            changedEnd = matchBegin + matchLength;
+            pos        = changedEnd;
 
-                    FindUtil::setTextPosition(textMark.getPos());
-                    FindUtil::setMaximalEndOfMatchPosition(epos);
-                }
-            }
-            else
-            {
-                break;
+            if (matchLength == 0) {
+                pos += 1;
             }
+            FindUtil::setTextPosition(pos);
         }
 
         FindUtil::setMaximalEndOfMatchPosition(-1);
@@ -229,6 +226,23 @@ bool ReplaceUtil::replaceAllBetween(long spos, long epos)
         throw;
     }
     
+    bool wasAnythingReplaced = (changedBegin >= 0);
+    
+    if (wasAnythingReplaced)
+    {
+        textData->rememberChangeAreaInHistory(spos, epos);
+
+        TextData::CompoundChange::Ptr compoundChange = textData->createCompoundChange(changedBegin, changedEnd);
+        
+        TextData::TextMark textMark = textData->createNewMark();
+        textMark.moveToPos(changedBegin);
+        
+        long insertedLength = textData->insertAtMark(textMark, &newContent);
+        
+        textMark.moveForwardToPos(changedBegin + insertedLength);
+        
+        textData->removeAtMark(textMark, changedEnd - changedBegin);
+    }
     return wasAnythingReplaced;
 }
 
@@ -0,0 +1,876 @@
+/////////////////////////////////////////////////////////////////////////////////////
+//
+//   LucED - The Lucid Editor
+//
+//   Copyright (C) 2005-2010 Oliver Schmidt, oliver at luced dot de
+//
+//   This program is free software; you can redistribute it and/or modify it
+//   under the terms of the GNU General Public License Version 2 as published
+//   by the Free Software Foundation in June 1991.
+//
+//   This program is distributed in the hope that it will be useful, but WITHOUT
+//   ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+//   FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+//   more details.
+//
+//   You should have received a copy of the GNU General Public License along with
+//   this program; if not, write to the Free Software Foundation, Inc.,
+//   51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+//
+/////////////////////////////////////////////////////////////////////////////////////
+
+#include "config.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__)) && defined(__SSE2__)
+#  define USE_SSE2 1
+#  include <emmintrin.h>
+#endif
+
+#include <string.h>
+
+#include "StartByteFilter.hpp"
+
+using namespace LucED;
+
+namespace
+{
+
+/**
+ * Where a match of a part of a regex may start.
+ */
+class Start
+{
+public:
+    Start()
+        : isLineStart(false),
+          canBeEmpty(false)
+    {
+        memset(bytes, 0, sizeof(bytes));
+    }
+
+    bool isEmpty() const
+    {
+        if (isLineStart || prefixes.getLength() > 0) {
+            return false;
+        }
+        for (int i = 0; i < 256; ++i) {
+            if (bytes[i]) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    void addRange(int b1, int b2) {
+        for (int i = b1; i <= b2; ++i) {
+            bytes[i] = true;
+        }
+    }
+    void addAll() {
+        addRange(0, 255);
+    }
+    void addPrefix(const String& prefix)
+    {
+        if (prefix.getLength() == 1) {
+            bytes[(byte) prefix[0]] = true;
+        } else {
+            prefixes.append(prefix);
+        }
+    }
+    void unite(const Start& rhs)
+    {
+        for (int i = 0; i < 256; ++i) {
+            bytes[i] = bytes[i] || rhs.bytes[i];
+        }
+        for (long i = 0; i < rhs.prefixes.getLength(); ++i) {
+            prefixes.append(rhs.prefixes[i]);
+        }
+        isLineStart = isLineStart || rhs.isLineStart;
+    }
+
+    bool bytes[256];
+    ObjectArray<String> prefixes;
+    bool isLineStart;
+    bool canBeEmpty;
+};
+
+
+/**
+ * Derives the Start of a pcre pattern compiled with EXTENDED and MULTILINE.
+ *
+ * Only as much of the pattern syntax is understood as is needed to skip 
+ * over it. Everything else, as well as back references and recursions that
+ * may be reached at the beginning of a match, makes the result inconclusive.
+ */
+class Analyzer
+{
+public:
+    Analyzer(const String& pattern)
+        : p(pattern.toCString()),
+          end(pattern.toCString() + pattern.getLength()),
+          isInconclusive(false)
+    {}
+
+    bool analyze(Start* rslt)
+    {
+        parseAlternation(rslt);
+        if (p < end) {
+            isInconclusive = true; // unbalanced ')'
+        }
+        return !isInconclusive && !rslt->canBeEmpty;
+    }
+
+private:
+    enum ItemType
+    {
+        LITERAL,
+        CONSUMING,
+        ZERO_WIDTH,
+        LINE_START,
+        LOOKAHEAD
+    };
+
+    struct Item
+    {
+        Item() : type(CONSUMING) {}
+
+        ItemType type;
+        String   literal;
+        Start    start;
+    };
+
+    static bool isSpace(char c) {
+        return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\f' || c == '\v';
+    }
+    static bool isDigit(char c) {
+        return '0' <= c && c <= '9';
+    }
+    static bool isAlnum(char c) {
+        return isDigit(c) || ('a' <= c && c <= 'z') || ('A' <= c && c <= 'Z');
+    }
+    static int getHexValue(char c)
+    {
+        if      (isDigit(c))           return c - '0';
+        else if ('a' <= c && c <= 'f') return c - 'a' + 10;
+        else if ('A' <= c && c <= 'F') return c - 'A' + 10;
+        else                           return -1;
+    }
+
+    static void addWordBytes(bool* bytes)
+    {
+        for (int i = 0; i < 128; ++i) {
+            if (isAlnum((char) i) || i == '_') {
+                bytes[i] = true;
+            }
+        }
+    }
+    static void addSpaceBytes(bool* bytes)
+    {
+        for (int i = 0; i < 128; ++i) {
+            if (isSpace((char) i)) {
+                bytes[i] = true;
+            }
+        }
+    }
+    static void addDigitBytes(bool* bytes)
+    {
+        for (int i = '0'; i <= '9'; ++i) {
+            bytes[i] = true;
+        }
+    }
+
+    /**
+     * In UTF-8 mode characters beyond ASCII never match \d, \s or \w,
+     * so the negated types match all of their bytes.
+     */
+    static void addNegated(bool* bytes, void (*addFunction)(bool*))
+    {
+        bool b[256];
+        memset(b, 0, sizeof(b));
+        addFunction(b);
+        for (int i = 0; i < 256; ++i) {
+            if (!b[i]) {
+                bytes[i] = true;
+            }
+        }
+    }
+
+    void skipSpaceAndComments()
+    {
+        while (p < end)
+        {
+            if (isSpace(*p)) {
+                ++p;
+            } else if (*p == '#') {
+                while (p < end && *p != '\n') {
+                    ++p;
+                }
+            } else {
+                break;
+            }
+        }
+    }
+
+    /**
+     * Copies a complete UTF-8 encoded character.
+     */
+    void appendChar(String* rslt)
+    {
+        byte c = *p++;
+        rslt->append(c);
+        if (c >= 0x80) {
+            while (p < end && (((byte) *p) & 0xC0) == 0x80) {
+                rslt->append(*p++);
+            }
+        }
+    }
+
+    /**
+     * Handles a character type escape like \d, returns false if it is none.
+     */
+    bool parseTypeEscape(char c, bool* bytes)
+    {
+        switch (c) {
+            case 'd': addDigitBytes(bytes);                 return true;
+            case 'D': addNegated(bytes, &addDigitBytes);    return true;
+            case 's': addSpaceBytes(bytes);                 return true;
+            case 'S': addNegated(bytes, &addSpaceBytes);    return true;
+            case 'w': addWordBytes(bytes);                  return true;
+            case 'W': addNegated(bytes, &addWordBytes);     return true;
+            default:                                        return false;
+        }
+    }
+
+    /**
+     * Returns the byte value of a single byte escape like \n or \*, 
+     * or -1.
+     */
+    int parseSimpleEscape(char c)
+    {
+        switch (c) {
+            case 'n': return '\n';
+            case 't': return '\t';
+            case 'r': return '\r';
+            case 'f': return '\f';
+            case 'e': return 0x1B;
+            case 'a': return 0x07;
+            case 'x': {
+                if (p + 1 < end && getHexValue(p[0]) >= 0 && getHexValue(p[1]) >= 0) {
+                    int v = 16 * getHexValue(p[0]) + getHexValue(p[1]);
+                    if (v < 0x80) {
+                        p += 2;
+                        return v;
+                    }
+                }
+                return -1;
+            }
+            default: {
+                if (!isAlnum(c) && ((byte) c) < 0x80) {
+                    return (byte) c;
+                }
+                return -1;
+            }
+        }
+    }
+
+    /**
+     * Parses one character of a character class, returns its byte value 
+     * or -1 if it was added to bytes as a character type or as character
+     * beyond ASCII.
+     */
+    int parseClassChar(bool* bytes)
+    {
+        char c = *p++;
+
+        if (c == '\\')
+        {
+            if (p >= end) {
+                isInconclusive = true;
+                return -1;
+            }
+            char e = *p++;
+            if (e == 'b') {
+                return 0x08;
+            }
+            if (parseTypeEscape(e, bytes)) {
+                return -1;
+            }
+            int v = parseSimpleEscape(e);
+            if (v < 0) {
+                isInconclusive = true;
+            }
+            return v;
+        }
+        else if (((byte) c) >= 0x80)
+        {
+            while (p < end && (((byte) *p) & 0xC0) == 0x80) {
+                ++p;
+            }
+            for (int i = 0x80; i < 256; ++i) {
+                bytes[i] = true;
+            }
+            return -1;
+        }
+        else {
+            return (byte) c;
+        }
+    }
+
+    void parseClass(Start* rslt)
+    {
+        bool bytes[256];
+        memset(bytes, 0, sizeof(bytes));
+
+        bool isNegated = false;
+        if (p < end && *p == '^') {
+            isNegated = true;
+            ++p;
+        }
+        bool isFirst = true;
+        for (;;)
+        {
+            if (p >= end || isInconclusive) {
+                isInconclusive = true;
+                return;
+            }
+            if (*p == ']' && !isFirst) {
+                ++p;
+                break;
+            }
+            isFirst = false;
+
+            if (*p == '[' && p + 1 < end && (p[1] == ':' || p[1] == '.' || p[1] == '=')) {
+                isInconclusive = true; // POSIX classes
+                return;
+            }
+            int c1 = parseClassChar(bytes);
+
+            if (c1 >= 0 && p + 1 < end && *p == '-' && p[1] != ']')
+            {
+                ++p;
+                int c2 = parseClassChar(bytes);
+                if (c2 < c1) {
+                    isInconclusive = true;
+                    return;
+                }
+                for (int i = c1; i <= c2; ++i) {
+                    bytes[i] = true;
+                }
+            }
+            else if (c1 >= 0) {
+                bytes[c1] = true;
+            }
+        }
+        for (int i = 0; i < 256; ++i) {
+            if (isNegated ? (!bytes[i] || i >= 0x80) : bytes[i]) {
+                rslt->bytes[i] = true;
+            }
+        }
+    }
+
+    /**
+     * Parses a group after the opening parenthesis.
+     */
+    void parseGroup(Item* item)
+    {
+        if (p < end && *p == '*') {
+            isInconclusive = true; // (*VERB)
+            return;
+        }
+        if (p >= end || *p != '?') {
+            parseAlternation(&item->start);
+        }
+        else
+        {
+            ++p;
+            if (p >= end) {
+                isInconclusive = true;
+                return;
+            }
+            char c = *p;
+
+            if (c == ':' || c == '>' || c == '|') {
+                ++p;
+                parseAlternation(&item->start);
+            }
+            else if (c == 'P' && p + 1 < end && p[1] == '<') {
+                p += 2;
+                skipName('>');
+                parseAlternation(&item->start);
+            }
+            else if (c == '<' && p + 1 < end && p[1] != '=' && p[1] != '!') {
+                ++p;
+                skipName('>');
+                parseAlternation(&item->start);
+            }
+            else if (c == '\'') {
+                ++p;
+                skipName('\'');
+                parseAlternation(&item->start);
+            }
+            else if (c == '=') {
+                ++p;
+                parseAlternation(&item->start);
+                item->type = LOOKAHEAD;
+            }
+            else if (c == '!' || (c == '<' && p + 1 < end && (p[1] == '=' || p[1] == '!'))) {
+                p += (c == '!') ? 1 : 2;
+                Start ignored;
+                parseAlternation(&ignored);
+                item->type = ZERO_WIDTH;
+            }
+            else if (c == 'C') {
+                while (p < end && *p != ')') {
+                    ++p;
+                }
+                item->type = ZERO_WIDTH;
+            }
+            else if (c == '#') {
+                while (p < end && *p != ')') {
+                    ++p;
+                }
+                item->type = ZERO_WIDTH;
+            }
+            else if (   isDigit(c) || c == 'R' || c == '&' 
+                     || ((c == '+' || c == '-') && p + 1 < end && isDigit(p[1]))
+                     || (c == 'P' && p + 1 < end && (p[1] == '>' || p[1] == '=')))
+            {
+                // recursions and back references
+
+                while (p < end && *p != ')') {
+                    ++p;
+                }
+                setUnknown(item);
+            }
+            else {
+                // option settings and conditions
+
+                isInconclusive = true;
+                return;
+            }
+        }
+        if (p >= end || *p != ')') {
+            isInconclusive = true;
+            return;
+        }
+        ++p;
+    }
+
+    static void setUnknown(Item* item)
+    {
+        item->type = CONSUMING;
+        item->start.addAll();
+        item->start.canBeEmpty = true;
+    }
+
+    void skipBraces()
+    {
+        if (p < end && *p == '{') {
+            skipName('}');
+        }
+    }
+
+    void skipName(char terminator)
+    {
+        while (p < end && *p != terminator) {
+            ++p;
+        }
+        if (p < end) {
+            ++p;
+        }
+    }
+
+    void parseEscape(Item* item)
+    {
+        if (p >= end) {
+            isInconclusive = true;
+            return;
+        }
+        char c = *p++;
+
+        if (parseTypeEscape(c, item->start.bytes)) {
+            return;
+        }
+        int v = parseSimpleEscape(c);
+        if (v >= 0) {
+            item->type = LITERAL;
+            item->literal.append((char) v);
+            return;
+        }
+        switch (c)
+        {
+            case 'b': case 'B': case 'A': case 'G': case 'z': case 'Z': case 'K': {
+                item->type = ZERO_WIDTH;
+                break;
+            }
+            case 'g': case 'k': {
+                // back references
+
+                if (p < end && (*p == '{' || *p == '<' || *p == '\'')) {
+                    char opening = *p++;
+                    skipName(opening == '{' ? '}' : (opening == '<' ? '>' : '\''));
+                } else {
+                    if (p < end && *p == '-') {
+                        ++p;
+                    }
+                    while (p < end && isDigit(*p)) {
+                        ++p;
+                    }
+                }
+                setUnknown(item);
+                break;
+            }
+            case 'p': case 'P': case 'x': {
+                if (p < end && *p == '{') {
+                    skipBraces();
+                } else if (c == 'x') {
+                    for (int i = 0; i < 2 && p < end && getHexValue(*p) >= 0; ++i) {
+                        ++p;
+                    }
+                } else if (p < end) {
+                    ++p;
+                }
+                item->start.addAll();
+                break;
+            }
+            case 'c': {
+                if (p < end) {
+                    ++p;
+                }
+                item->start.addAll();
+                break;
+            }
+            case 'Q': case 'E': {
+                isInconclusive = true;
+                break;
+            }
+            default: {
+                if (isDigit(c)) {
+                    // back references and octal characters
+
+                    while (p < end && isDigit(*p)) {
+                        ++p;
+                    }
+                    setUnknown(item);
+                } else {
+                    item->start.addAll(); // \C, \R, \X, \h...
+                }
+                break;
+            }
+        }
+    }
+
+    void parseItem(Item* item)
+    {
+        char c = *p++;
+
+        switch (c)
+        {
+            case '(':  parseGroup(item);                                          break;
+            case '[':  parseClass(&item->start);                                  break;
+            case '\\': parseEscape(item);                                         break;
+            case '.':  item->start.addAll();                                      break;
+            case '^':  item->type = LINE_START;                                   break;
+            case '$':  item->start.bytes['\n'] = true;                            break;
+            case '*': 
+            case '+': 
+            case '?':  isInconclusive = true;                                     break;
+            default:   item->type = LITERAL; --p; appendChar(&item->literal);     break;
+        }
+        if (item->type == LITERAL) {
+            item->start.addPrefix(String(item->literal.toCString(), 1));
+        }
+    }
+
+    bool parseNumber(int* rslt)
+    {
+        if (p >= end || !isDigit(*p)) {
+            return false;
+        }
+        *rslt = 0;
+        while (p < end && isDigit(*p)) {
+            *rslt = 10 * *rslt + (*p++ - '0');
+        }
+        return true;
+    }
+
+    /**
+     * Parses an optional quantifier, maxCount -1 means unlimited.
+     */
+    void parseQuantifier(int* minCount, int* maxCount)
+    {
+        *minCount = 1;
+        *maxCount = 1;
+
+        skipSpaceAndComments();
+
+        if (p >= end) {
+            return;
+        }
+        switch (*p)
+        {
+            case '?': *minCount = 0; ++p; break;
+            case '*': *minCount = 0; *maxCount = -1; ++p; break;
+            case '+': *maxCount = -1; ++p; break;
+            case '{': {
+                const char* start = p++;
+                int n1, n2 = -1;
+                if (parseNumber(&n1)) {
+                    if (p < end && *p == '}') {
+                        n2 = n1;
+                    } else if (p < end && *p == ',') {
+                        ++p;
+                        parseNumber(&n2);
+                    }
+                    if (p < end && *p == '}') {
+                        ++p;
+                        *minCount = n1;
+                        *maxCount = n2;
+                        break;
+                    }
+                }
+                p = start; // '{' is a literal
+                return;
+            }
+            default: return;
+        }
+        if (p < end && (*p == '?' || *p == '+')) {
+            ++p;
+        }
+    }
+
+    void parseAlternation(Start* rslt)
+    {
+        parseSequence(rslt);
+
+        while (p < end && *p == '|' && !isInconclusive) {
+            ++p;
+            Start s;
+            parseSequence(&s);
+            rslt->unite(s);
+            rslt->canBeEmpty = rslt->canBeEmpty || s.canBeEmpty;
+        }
+    }
+
+    void parseSequence(Start* rslt)
+    {
+        enum { SCANNING, LITERAL_PREFIX, DONE } state = SCANNING;
+        String prefix;
+
+        for (;;)
+        {
+            skipSpaceAndComments();
+
+            if (p >= end || *p == '|' || *p == ')' || isInconclusive) {
+                break;
+            }
+            Item item;
+            parseItem(&item);
+            if (isInconclusive) {
+                break;
+            }
+            int minCount, maxCount;
+            parseQuantifier(&minCount, &maxCount);
+
+            bool canBeEmpty = (minCount == 0) || item.type == ZERO_WIDTH 
+                                              || item.type == LINE_START
+                                              || item.type == LOOKAHEAD
+                                              || item.start.canBeEmpty;
+            switch (state)
+            {
+                case SCANNING:
+                {
+                    if ((item.type == LINE_START || item.type == LOOKAHEAD) && rslt->isEmpty())
+                    {
+                        // everything before was zero width, so the
+                        // assertion restricts the start of the match
+
+                        if (item.type == LINE_START) {
+                            rslt->isLineStart = true;
+                            state = DONE;
+                        }
+                        else if (!item.start.canBeEmpty) {
+                            rslt->unite(item.start);
+                            state = DONE;
+                        }
+                    }
+                    else if (canBeEmpty) {
+                        rslt->unite(item.start);
+                    }
+                    else if (item.type == LITERAL) {
+                        prefix = item.literal;
+                        state = (maxCount == 1) ? LITERAL_PREFIX : DONE;
+                    }
+                    else {
+                        rslt->unite(item.start);
+                        state = DONE;
+                    }
+                    break;
+                }
+                case LITERAL_PREFIX:
+                {
+                    if (item.type == LITERAL && minCount >= 1) {
+                        prefix.append(item.literal);
+                        if (maxCount != 1) {
+                            state = DONE;
+                        }
+                    } else {
+                        state = DONE;
+                    }
+                    break;
+                }
+                case DONE:
+                {
+                    break;
+                }
+            }
+        }
+        if (prefix.getLength() > 0) {
+            rslt->addPrefix(prefix);
+        }
+        if (state == SCANNING) {
+            rslt->canBeEmpty = true;
+        }
+    }
+
+    const char* p;
+    const char* end;
+    bool        isInconclusive;
+};
+
+} // anonymous namespace
+
+
+void StartByteFilter::clear()
+{
+    hasAlternatives = false;
+    isInconclusive  = false;
+    hasLineStart    = false;
+    memset(startBytes, 0, sizeof(startBytes));
+    prefixes.clear();
+    updateFlags();
+}
+
+
+void StartByteFilter::addAlternative(const String& pattern)
+{
+    hasAlternatives = true;
+
+    Start start;
+    if (!Analyzer(pattern).analyze(&start)) {
+        isInconclusive = true;
+    }
+    if (!isInconclusive)
+    {
+        for (int i = 0; i < 256; ++i) {
+            startBytes[i] = startBytes[i] || start.bytes[i];
+        }
+        for (long i = 0; i < start.prefixes.getLength(); ++i) {
+            prefixes.append(start.prefixes[i]);
+        }
+        hasLineStart = hasLineStart || start.isLineStart;
+    }
+    updateFlags();
+}
+
+
+void StartByteFilter::updateFlags()
+{
+    int numberOfCandidates = 0;
+
+    for (int i = 0; i < 256; ++i) {
+        byteFlags[i] = startBytes[i] ? CANDIDATE : 0;
+        if (startBytes[i]) {
+            ++numberOfCandidates;
+        }
+    }
+    for (long i = 0; i < prefixes.getLength(); ++i) {
+        byteFlags[(byte) prefixes[i][0]] |= PREFIX;
+    }
+    if (hasLineStart) {
+        byteFlags['\n'] |= LINE_END;
+    }
+    if (numberOfCandidates == 256) {
+        isInconclusive = true;
+    }
+
+    numberOfScanBytes = 0;
+#if USE_SSE2
+    for (int i = 0; i < 256; ++i) {
+        if (byteFlags[i] != 0) {
+            if (numberOfScanBytes < MAX_SCAN_BYTES) {
+                scanBytes[numberOfScanBytes] = i;
+            }
+            ++numberOfScanBytes;
+        }
+    }
+    if (numberOfScanBytes > MAX_SCAN_BYTES) {
+        numberOfScanBytes = 0;
+    }
+#endif
+}
+
+
+bool StartByteFilter::hasPrefixAt(const byte* subject, long pos, long endPos) const
+{
+    for (long i = 0; i < prefixes.getLength(); ++i)
+    {
+        const String& prefix = prefixes[i];
+        long          length = prefix.getLength();
+
+        if (   (byte) prefix[0] == subject[pos] && pos + length <= endPos
+            && memcmp(subject + pos, prefix.toCString(), length) == 0)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+
+long StartByteFilter::findCandidateBytewise(const byte* subject, long pos, long endPos) const
+{
+    for (; pos < endPos; ++pos) {
+        if (byteFlags[subject[pos]] != 0) {
+            long rslt = checkCandidate(subject, pos, endPos);
+            if (rslt >= 0) {
+                return rslt;
+            }
+        }
+    }
+    return endPos;
+}
+
+
+long StartByteFilter::findCandidateWithScanBytes(const byte* subject, long pos, long endPos) const
+{
+#if USE_SSE2
+    __m128i bytes[MAX_SCAN_BYTES];
+
+    for (int i = 0; i < numberOfScanBytes; ++i) {
+        bytes[i] = _mm_set1_epi8(scanBytes[i]);
+    }
+    while (pos + 16 <= endPos)
+    {
+        __m128i chunk = _mm_loadu_si128((const __m128i*) (subject + pos));
+        __m128i found = _mm_cmpeq_epi8(chunk, bytes[0]);
+
+        for (int i = 1; i < numberOfScanBytes; ++i) {
+            found = _mm_or_si128(found, _mm_cmpeq_epi8(chunk, bytes[i]));
+        }
+        int mask = _mm_movemask_epi8(found);
+
+        while (mask != 0)
+        {
+            long p = pos + __builtin_ctz(mask);
+            long rslt = checkCandidate(subject, p, endPos);
+            if (rslt >= 0) {
+                return rslt;
+            }
+            mask &= mask - 1;
+        }
+        pos += 16;
+    }
+#endif
+    return findCandidateBytewise(subject, pos, endPos);
+}
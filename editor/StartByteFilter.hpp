@@ -0,0 +1,122 @@
+/////////////////////////////////////////////////////////////////////////////////////
+//
+//   LucED - The Lucid Editor
+//
+//   Copyright (C) 2005-2010 Oliver Schmidt, oliver at luced dot de
+//
+//   This program is free software; you can redistribute it and/or modify it
+//   under the terms of the GNU General Public License Version 2 as published
+//   by the Free Software Foundation in June 1991.
+//
+//   This program is distributed in the hope that it will be useful, but WITHOUT
+//   ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+//   FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+//   more details.
+//
+//   You should have received a copy of the GNU General Public License along with
+//   this program; if not, write to the Free Software Foundation, Inc.,
+//   51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+//
+/////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef START_BYTE_FILTER_HPP
+#define START_BYTE_FILTER_HPP
+
+#include "types.hpp"
+#include "String.hpp"
+#include "ObjectArray.hpp"
+
+namespace LucED
+{
+
+/**
+ * Skips positions at which none of the alternatives of a combined
+ * regex can start a match.
+ *
+ * The alternatives are analysed in the syntax of pcre patterns compiled
+ * with EXTENDED and MULTILINE. For each alternative the bytes it may
+ * start with are derived, together with its literal prefix (e.g. "template")
+ * and whether it only matches at the beginning of a line.
+ * If the start of any alternative cannot be determined, e.g. because it
+ * can match the empty string or uses back references or option settings,
+ * the filter is not active and every position must be tried.
+ */
+class StartByteFilter
+{
+public:
+    StartByteFilter() {
+        clear();
+    }
+
+    void clear();
+
+    void addAlternative(const String& pattern);
+
+    bool isActive() const {
+        return hasAlternatives && !isInconclusive;
+    }
+
+    /**
+     * Returns the first position in [pos, endPos) at which a match may
+     * start or endPos, if there is none. isBeginOfLine tells whether pos 
+     * is at the beginning of a line, for pos > 0 subject[pos - 1] must be
+     * accessible.
+     */
+    long findCandidate(const byte* subject, long pos, long endPos, bool isBeginOfLine) const
+    {
+        if (isBeginOfLine && hasLineStart) {
+            return pos;
+        }
+        if (numberOfScanBytes > 0) {
+            return findCandidateWithScanBytes(subject, pos, endPos);
+        } else {
+            return findCandidateBytewise(subject, pos, endPos);
+        }
+    }
+
+private:
+    enum Flag
+    {
+        CANDIDATE = 1,
+        PREFIX    = 2,
+        LINE_END  = 4
+    };
+    enum { MAX_SCAN_BYTES = 6 };
+
+    void updateFlags();
+
+    bool hasPrefixAt(const byte* subject, long pos, long endPos) const;
+
+    long checkCandidate(const byte* subject, long pos, long endPos) const
+    {
+        byte flags = byteFlags[subject[pos]];
+
+        if (flags & CANDIDATE) {
+            return pos;
+        }
+        if ((flags & PREFIX) && hasPrefixAt(subject, pos, endPos)) {
+            return pos;
+        }
+        if (flags & LINE_END) {
+            return pos + 1;
+        }
+        return -1;
+    }
+
+    long findCandidateBytewise(const byte* subject, long pos, long endPos) const;
+    long findCandidateWithScanBytes(const byte* subject, long pos, long endPos) const;
+
+    bool hasAlternatives;
+    bool isInconclusive;
+    bool hasLineStart;
+    bool startBytes[256];
+    ObjectArray<String> prefixes;
+
+    byte byteFlags[256];
+    int  numberOfScanBytes;
+    byte scanBytes[MAX_SCAN_BYTES];
+};
+
+} // namespace LucED
+
+#endif // START_BYTE_FILTER_HPP
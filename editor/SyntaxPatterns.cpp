@@ -375,6 +375,7 @@ void SyntaxPatterns::compile(int i)
     SyntaxPattern* sp = get(i);
     
     sp->maxREBytesExtend = 0;
+    sp->startFilter.clear();
     
     for (int i = 0; i < sp->childList.getLength(); ++i) {
         ChildPatternDescriptor* cdescr = sp->childList.getPtr(i);
@@ -387,6 +388,8 @@ void SyntaxPatterns::compile(int i)
                   .append(cpat->beginPattern)
               .append(")");
 
+        sp->startFilter.addAlternative(cpat->beginPattern);
+
         maximize(&sp->maxREBytesExtend, cpat->maxBeginBytesExtend);
 
         first = false;
@@ -398,6 +401,8 @@ void SyntaxPatterns::compile(int i)
         patStr.append("(")
               .append("?P<").append(sp->name).append("_END>");
 
+        long endPatternBegin = patStr.getLength();
+
         if (sp->pushedSubPatternName.getLength() > 0)
         {
             sp->hasPushedSubstr = true;
@@ -451,6 +456,7 @@ void SyntaxPatterns::compile(int i)
         {
             patStr.append(sp->endPattern);
         }
+        sp->startFilter.addAlternative(patStr.getTail(endPatternBegin));
         patStr.append(")");
         
         maximize(&sp->maxREBytesExtend, sp->maxEndBytesExtend);
@@ -460,7 +466,8 @@ void SyntaxPatterns::compile(int i)
     }
     if (!first) {
         sp->re = BasicRegex(patStr, BasicRegex::CreateOptions() | BasicRegex::MULTILINE 
-                                                                | BasicRegex::EXTENDED);
+                                                                | BasicRegex::EXTENDED
+                                                                | BasicRegex::STUDY);
         util::maximize(&maxOvecSize, sp->re.getOvecSize());
 
         for (int ci = 0; ci < sp->childList.getLength(); ++ci)
@@ -26,6 +26,7 @@
 #include "HeapObject.hpp"
 #include "HeapHashMap.hpp"
 #include "BasicRegex.hpp"
+#include "StartByteFilter.hpp"
 #include "MemArray.hpp"
 #include "OwningPtr.hpp"
 #include "TextStyleDefinition.hpp"
@@ -76,6 +77,37 @@ struct SyntaxPattern
 
     int getMatchedChild(const MemArray<int>& ovector);
 
+    /**
+     * Finds the first match of re in subject. Positions at which no match 
+     * can start according to startFilter are skipped without invoking pcre,
+     * the remaining positions are tried with anchored matches.
+     */
+    bool findMatch(void* object, BasicRegex::CalloutFunction* calloutFunction,
+                   const char* subject, int length,
+                   BasicRegex::MatchOptions matchOptions, MemArray<int>& ovector) const
+    {
+        if (!startFilter.isActive()) {
+            return re.findMatch(object, calloutFunction, subject, length, 0, matchOptions, ovector);
+        }
+        const byte* s = (const byte*) subject;
+        
+        BasicRegex::MatchOptions anchoredOptions = matchOptions;
+        anchoredOptions |= BasicRegex::ANCHORED;
+        
+        long p = startFilter.findCandidate(s, 0, length, !matchOptions.isSet(BasicRegex::NOTBOL));
+
+        while (p < length)
+        {
+            if (re.findMatch(object, calloutFunction, subject, length, p, anchoredOptions, ovector)) {
+                return true;
+            }
+            p = startFilter.findCandidate(s, p + 1, length, s[p] == '\n');
+        }
+        // empty matches at the end, e.g. for '$'
+
+        return re.findMatch(object, calloutFunction, subject, length, length, anchoredOptions, ovector);
+    }
+
     String name;
     int style;
     String beginPattern;
@@ -92,6 +124,7 @@ struct SyntaxPattern
     int  maxREBytesExtend;
     
     BasicRegex re;
+    StartByteFilter startFilter;
     ObjectArray<CombinedSubPatternStyle> combinedSubs;
     bool hasPushedSubstr;
 };
@@ -24,6 +24,7 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <sys/types.h>
+#include <sys/stat.h>
 #include <sys/utsname.h>
 #include <pwd.h>
 #include <locale.h>
@@ -104,6 +105,9 @@ System::System()
     if (defaultEncoding == cEncoding) {
         defaultEncoding = "ISO-8859-1";
     }
+    
+    fileCreationMask = umask(0);
+    umask(fileCreationMask);
 }
 
 
@@ -22,6 +22,8 @@
 #ifndef SYSTEM_HPP
 #define SYSTEM_HPP
 
+#include <sys/types.h>
+
 #include "HeapObject.hpp"
 #include "SingletonInstance.hpp"
 #include "String.hpp"
@@ -85,6 +87,15 @@ public:
     String getDefaultLocale() const {
         return defaultLocale;
     }
+    
+    /**
+     * The umask of the process. It is read only once at startup, because
+     * reading the umask means setting it, which would race with threads 
+     * creating files.
+     */
+    mode_t getFileCreationMask() const {
+        return fileCreationMask;
+    }
 
 private:
     friend class SingletonInstance<System>;
@@ -98,6 +109,7 @@ private:
     String defaultLocale;
     String defaultEncoding;
     String cEncoding;
+    mode_t fileCreationMask;
 };
 
 
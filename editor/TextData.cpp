@@ -20,6 +20,8 @@
 /////////////////////////////////////////////////////////////////////////////////////
 
 #include <limits.h>
+#include <errno.h>
+#include <string.h>
 
 #include "util.hpp"
 #include "TextData.hpp"
@@ -30,22 +32,52 @@
 #include "System.hpp"
 #include "FileException.hpp"
 #include "Nullable.hpp"
+#include "GlobalConfig.hpp"
+#include "NewlineCounter.hpp"
+#include "TextDiff.hpp"
 
 using namespace std;
 using namespace LucED;
 
+namespace
+{
+    // Marks are moved by scanning the text if the target is near,
+    // otherwise the position is looked up in the line index.
+
+    const long MAX_LINES_TO_SCAN = 100;
+    const long MAX_BYTES_TO_SCAN = 16 * 1024;
+
+    // Marks are kept in blocks of limited length, so that inserting
+    // or removing a mark only has to move the entries of one block.
+
+    const long MAX_MARK_BLOCK_LENGTH = 128;
+}
+
 TextData::TextData() 
         : buffer(),
           utf8Parser(&buffer),
+          lineIndex(&buffer),
+          wcharColumnCache(&utf8Parser),
           modifiedFlag(false),
           viewCounter(0),
           hasHistoryFlag(false),
+          isCompoundChangeActive(false),
           isReadOnlyFlag(false),
           modifiedOnDiskFlag(false),
           ignoreModifiedOnDiskFlag(false),
-          fileNamePseudoFlag(false)
+          fileNamePseudoFlag(false),
+          loadingFlag(false),
+          expectedLoadingLength(0),
+          loadingProgress(-1),
+          version(0),
+          firstRecordedVersion(0),
+          savingFlag(false),
+          savingVersion(0),
+          savingActionIndex(-1)
 {
     numberLines = 1;
+    markBlockSplitIndex = 0;
+    markSplitPos = 0;
     beginChangedPos = 0;
     changedAmount = 0;
     oldEndChangedPos = 0;
@@ -56,28 +88,96 @@ TextData::TextData()
 
 void TextData::loadFile(const String& filename, const String& encoding)
 {
-    ByteBuffer buffer;
-    File(filename).loadInto(&buffer);
+    File file(filename);
+    File::Info info = file.getInfo();
+
+    MappedMemory::Ptr mappedMemory;
 
-    this->takeOverFileBuffer(filename, encoding, &buffer);
+    if (info.exists() && info.isFile() && isFileMappingPreferredForLength(info.getLength()))
+    {
+        mappedMemory = file.mapForReading();
+    }
+    if (mappedMemory.isValid())
+    {
+        this->takeOverMappedFile(filename, encoding, mappedMemory);
+    }
+    else
+    {
+        ByteBuffer buffer;
+        file.loadInto(&buffer);
+
+        this->takeOverFileBuffer(filename, encoding, &buffer);
+    }
 }    
 
 
+bool TextData::isFileMappingPreferredForLength(long length)
+{
+    long minLength = GlobalConfig::getConfigData()->getGeneralConfig()->getMappedFileMinLength();
+
+    return minLength > 0 && length >= minLength;
+}
+
+
+bool TextData::isProgressiveLoadingPreferredForLength(long length)
+{
+    long minLength = GlobalConfig::getConfigData()->getGeneralConfig()->getProgressiveLoadingMinLength();
+
+    return minLength > 0 && length >= minLength;
+}
+
+
+TextStorage::Backend TextData::getStorageBackendForLength(long length)
+{
+    long minLength = GlobalConfig::getConfigData()->getGeneralConfig()->getChunkedStorageMinLength();
+
+    if (minLength > 0 && length >= minLength) {
+        return TextStorage::CHUNKED_BUFFER;
+    } else {
+        return TextStorage::GAP_BUFFER;
+    }
+}
+
+
 void TextData::internalTakeOverBuffer(RawPtr<ByteBuffer> bufferPtr)
 {
+    long oldLength = buffer.getLength();
+    long len       = bufferPtr->getLength();
+
+    moveMarkSplitTo(getLength());
+
+    this->buffer.clear();
+    this->buffer.setBackend(getStorageBackendForLength(len));
     this->buffer.takeOver(bufferPtr);
 
-    long len = buffer.getLength();
-    byte* ptr = buffer.getTotalAmount();
+    afterInternalTakeOver(oldLength);
+}
+
+
+void TextData::internalTakeOverMappedMemory(MappedMemory::Ptr memory)
+{
+    long oldLength = buffer.getLength();
+
+    moveMarkSplitTo(getLength());
+
+    this->buffer.clear();
+    this->buffer.setBackend(TextStorage::CHUNKED_BUFFER);
+    this->buffer.takeOver(memory);
+
+    afterInternalTakeOver(oldLength);
+}
+
+
+void TextData::afterInternalTakeOver(long oldLength)
+{
+    this->lineIndex.rebuild();
+    this->numberLines = lineIndex.getNumberOfLines();
 
-    for (long i = 0; i < len; ++i) {
-        if (ptr[i] == '\n') {
-            ++this->numberLines;
-        }
-    }
     this->beginChangedPos = 0;
-    this->changedAmount = len;
+    this->changedAmount = buffer.getLength();
     this->oldEndChangedPos = 0;
+
+    recordChange(0, oldLength, buffer.getLength() - oldLength);
 }
 
 
@@ -85,8 +185,10 @@ void TextData::takeOverUtf8Buffer(RawPtr<ByteBuffer> newBufferPtr)
 {
     long oldLen = buffer.getLength();
     
+    endCompoundChange();
+
     if (hasHistory() && oldLen > 0) {
-        history->rememberDeleteAction(0, oldLen, buffer.getTotalAmount());
+        history->rememberDeleteAction(0, oldLen, buffer.getAmount(0, oldLen));
     }
 
     internalTakeOverBuffer(newBufferPtr);
@@ -126,6 +228,101 @@ void TextData::takeOverFileBuffer(const String& filename,
     }
     internalTakeOverBuffer(bufferPtr);
 
+    setFileAfterLoading(filename);
+}
+
+
+void TextData::takeOverMappedFile(const String& filename, 
+                                  const String& encoding,
+                                  MappedMemory::Ptr memory)
+{
+    fileContentEncoding = encoding;
+    EncodingConverter c(fileContentEncoding, "UTF-8");
+    if (c.isConvertingBetweenDifferentCodesets())
+    {
+        // convert directly out of the mapping, without copying the raw bytes before
+        
+        ByteBuffer                     convertedBuffer;
+        EncodingConverter::Stream::Ptr stream = c.createStream();
+        stream->convert(memory->getPtr(), memory->getLength(), &convertedBuffer);
+        memory.invalidate();
+        stream->finish(&convertedBuffer);
+        internalTakeOverBuffer(&convertedBuffer);
+    }
+    else {
+        internalTakeOverMappedMemory(memory);
+    }
+    setFileAfterLoading(filename);
+
+    this->mappedFileInfo = fileInfo;
+}
+
+
+void TextData::beginLoading(const String& filename, 
+                            const String& encoding,
+                            long          expectedLength)
+{
+    ASSERT(getLength() == 0 && !loadingFlag);
+
+    fileContentEncoding = encoding;
+    buffer.setBackend(getStorageBackendForLength(expectedLength));
+
+    setFileAfterLoading(filename);
+
+    this->loadingFlag           = true;
+    this->expectedLoadingLength = expectedLength;
+    this->loadingProgress       = 0;
+
+    if (!isReadOnlyFlag) {
+        isReadOnlyFlag = true;
+        readOnlyListeners.invokeAllCallbacks(isReadOnlyFlag);
+    }
+    loadingProgressListeners.invokeAllCallbacks(loadingProgress);
+}
+
+
+void TextData::appendLoadedData(const byte* data, long length)
+{
+    ASSERT(loadingFlag);
+
+    if (length > 0)
+    {
+        internalInsertAtPos(getLength(), numberLines - 1, data, length);
+
+        if (expectedLoadingLength > 0)
+        {
+            int progress = (int) util::minimum((long) 99, (long)((100.0 * getLength()) / expectedLoadingLength));
+
+            if (progress != loadingProgress) {
+                loadingProgress = progress;
+                loadingProgressListeners.invokeAllCallbacks(loadingProgress);
+            }
+        }
+    }
+}
+
+
+void TextData::finishLoading()
+{
+    ASSERT(loadingFlag);
+
+    this->loadingFlag     = false;
+    this->loadingProgress = -1;
+
+    bool readOnlyFlag = fileInfo.exists() && !fileInfo.isWritable();
+    
+    if (isReadOnlyFlag != readOnlyFlag) {
+        isReadOnlyFlag = readOnlyFlag;
+        readOnlyListeners.invokeAllCallbacks(isReadOnlyFlag);
+    }
+    setModifiedFlag(false);
+    
+    loadingProgressListeners.invokeAllCallbacks(loadingProgress);
+}
+
+
+void TextData::setFileAfterLoading(const String& filename)
+{
     File file(filename);
     
     this->fileName               = file.getAbsoluteName();
@@ -147,16 +344,21 @@ void TextData::takeOverFileBuffer(const String& filename,
 void TextData::setToData(const char* buffer, int length, const String& encoding)
 {
     clear();
-    insertAtMark(createNewMark(), (const byte*) buffer, length);
 
     fileContentEncoding = encoding;
     EncodingConverter c(fileContentEncoding, "UTF-8");
 
     if (c.isConvertingBetweenDifferentCodesets())
     {
-        c.convertInPlace(&this->buffer);
+        ByteBuffer                     convertedBuffer;
+        EncodingConverter::Stream::Ptr stream = c.createStream();
+        stream->convert((const byte*) buffer, length, &convertedBuffer);
+        stream->finish(&convertedBuffer);
+        insertAtMark(createNewMark(), convertedBuffer.getTotalAmount(), convertedBuffer.getLength());
+    }
+    else {
+        insertAtMark(createNewMark(), (const byte*) buffer, length);
     }
-    
 }
 
 namespace
@@ -178,23 +380,11 @@ void TextData::reloadFile()
 {
     File file(this->fileName);
 
-    long oldLength = getLength();
-    long oldNumberLines = this->numberLines;
-
-    ObjectArray<LineAndColumn> oldMarkPositions;
+    ByteBuffer newBuffer;
 
-    for (long i = 0; i < marks.getLength(); ++i) {
-        if (marks[i].inUseCounter > 0) {
-            oldMarkPositions.append(LineAndColumn(marks[i].line,
-                                                  getWCharColumn(marks[i])));
-        } else {
-            oldMarkPositions.append(LineAndColumn(0, 0));
-        }
-    }
-    
     Nullable<FileException> fileException;
     try {
-        file.loadInto(&buffer);
+        file.loadInto(&newBuffer);
     } catch (FileException& ex) {
         fileException = ex;
     }
@@ -203,30 +393,23 @@ void TextData::reloadFile()
     
     if (c.isConvertingBetweenDifferentCodesets())
     {
-        c.convertInPlace(&buffer);
+        c.convertInPlace(&newBuffer);
     }
 
-    long len = buffer.getLength();
-    byte* ptr = buffer.getTotalAmount();
+    // A mapped file that was modified in place does not contain
+    // the old text anymore, so it cannot be compared to the new text.
 
-    this->numberLines = 1;
-    for (long i = 0; i < len; ++i) {
-        if (ptr[i] == '\n') {
-            ++this->numberLines;
-        }
-    }
-    this->beginChangedPos = 0;
-    this->changedAmount = len - oldLength;
-    this->oldEndChangedPos = oldLength;
-    
-    updateMarks(0, oldLength, len - oldLength,           // long beginChangedPos, long oldEndChangedPos, long changedAmount,
-                0, this->numberLines - oldNumberLines);  // long beginLineNumber, long changedLineNumberAmount)
+    bool canApplyDifferences = !buffer.hasMappedMemory() 
+                            || !file.getInfo().isSameFileAs(mappedFileInfo);
 
-    for (long i = 0; i < marks.getLength(); ++i) {
-        if (marks[i].inUseCounter > 0) {
-            moveMarkToLineAndWCharColumn(MarkHandle(i), oldMarkPositions[i].line,
-                                                        oldMarkPositions[i].wcharColumn);
-        }
+    if (canApplyDifferences) {
+        applyDifferencesTo(newBuffer);
+    } else {
+        replaceByReloadedBuffer(&newBuffer);
+    }
+    if (hasHistory() && canApplyDifferences) {
+        setHistorySeparator();
+        history->setPreviousActionToSavedState();
     }
     setModifiedFlag(false);
 
@@ -239,16 +422,115 @@ void TextData::reloadFile()
             isReadOnlyFlag = !fileInfo.isWritable();
             readOnlyListeners.invokeAllCallbacks(isReadOnlyFlag);
         }
-        clearHistory();
+        if (!canApplyDifferences) {
+            clearHistory();
+        }
     }
     if (fileException.isValid()) {
         throw fileException.get();
     }
 }
 
+
+/**
+ * Applies only the differing regions as ordinary modifications, so that
+ * marks, hiliting and the history are kept for the unchanged text.
+ * The hunks are applied from the end, so that the positions of the
+ * remaining hunks stay valid.
+ */
+void TextData::applyDifferencesTo(const ByteBuffer& newBuffer)
+{
+    TextDiff diff(buffer, newBuffer.getTotalAmount(), newBuffer.getLength());
+    
+    if (diff.getNumberOfHunks() > 0 && hasHistory()) {
+        setHistorySeparator();
+    }
+    TextMark m = createNewMark();
+
+    for (long i = diff.getNumberOfHunks() - 1; i >= 0; --i)
+    {
+        const TextDiff::Hunk& h = diff.getHunk(i);
+        
+        long oldAmount = h.oldEnd - h.oldBegin;
+        long newAmount = h.newEnd - h.newBegin;
+
+        m.moveToPos(h.oldBegin);
+        
+        if (oldAmount > 0)
+        {
+            if (hasHistory()) {
+                history->rememberDeleteAction(h.oldBegin, oldAmount, buffer.getAmount(h.oldBegin, oldAmount));
+            }
+            internalRemoveAtPos(h.oldBegin, m.getLine(), oldAmount);
+        }
+        if (newAmount > 0)
+        {
+            if (hasHistory()) {
+                history->rememberInsertAction(h.oldBegin, newAmount);
+            }
+            internalInsertAtPos(h.oldBegin, m.getLine(), newBuffer.getAmount(h.newBegin, newAmount), newAmount);
+        }
+    }
+}
+
+
+void TextData::replaceByReloadedBuffer(RawPtr<ByteBuffer> newBuffer)
+{
+    long oldLength = getLength();
+    long oldNumberLines = this->numberLines;
+
+    ObjectArray<LineAndColumn> oldMarkPositions;
+
+    for (long i = 0; i < marks.getLength(); ++i) {
+        if (marks[i].inUseCounter > 0) {
+            oldMarkPositions.append(LineAndColumn(getMarkLine(marks[i]),
+                                                  getWCharColumn(marks[i])));
+        } else {
+            oldMarkPositions.append(LineAndColumn(0, 0));
+        }
+    }
+
+    long len = newBuffer->getLength();
+
+    moveMarkSplitTo(0);
+    buffer.clear();
+    buffer.setBackend(getStorageBackendForLength(len));
+    buffer.takeOver(newBuffer);
+
+    lineIndex.rebuild();
+    this->numberLines = lineIndex.getNumberOfLines();
+    this->beginChangedPos = 0;
+    this->changedAmount = len - oldLength;
+    this->oldEndChangedPos = oldLength;
+
+    recordChange(0, oldLength, len - oldLength);
+    
+    updateMarks(0, oldLength, len - oldLength,           // long beginChangedPos, long oldEndChangedPos, long changedAmount,
+                0, this->numberLines - oldNumberLines);  // long beginLineNumber, long changedLineNumberAmount)
+
+    for (long i = 0; i < marks.getLength(); ++i) {
+        if (marks[i].inUseCounter > 0) {
+            moveMarkToLineAndWCharColumn(MarkHandle(i), oldMarkPositions[i].line,
+                                                        oldMarkPositions[i].wcharColumn);
+        }
+    }
+}
+
+void TextData::checkMappedFile()
+{
+    if (buffer.wasMappedFileTruncated())
+    {
+        buffer.releaseMappedMemory();
+        setPseudoFileName(fileName);
+        
+        throw FileException(EIO, String() << "file '" << fileName << "' was truncated while it was mapped into memory, "
+                                          << "the text behind the new end of the file is lost");
+    }
+}
+
 void TextData::checkFileInfo()
 {
-    if (fileNamePseudoFlag == false)
+    if (fileNamePseudoFlag == false && !loadingFlag && !savingFlag)
     {
         Nullable<TimeStamp> oldLastModifiedTime;
         bool fileExisted = false;
@@ -258,7 +540,9 @@ void TextData::checkFileInfo()
             fileExisted = true;
             oldLastModifiedTime = fileInfo.getLastModifiedTime();
         }
-    
+        if (!modifiedOnDiskFlag) {
+            this->syncedFileInfo = fileInfo;
+        }
         this->fileInfo = File(this->fileName).getInfo();
         
         if (fileInfo.exists())
@@ -278,6 +562,62 @@ void TextData::checkFileInfo()
     }
 }
 
+bool TextData::appendFileGrowth()
+{
+    if (fileNamePseudoFlag || loadingFlag || savingFlag || modifiedFlag) {
+        return false;
+    }
+    EncodingConverter c(fileContentEncoding, "UTF-8");
+    
+    if (c.isConvertingBetweenDifferentCodesets()) {
+        return false;
+    }
+    File              file(fileName);
+    File::Info        info       = file.getInfo();
+    const File::Info& syncedInfo = modifiedOnDiskFlag ? syncedFileInfo : fileInfo;
+    long              oldLength  = getLength();
+
+    if (!info.isSameFileAs(syncedInfo) || info.getLength() < oldLength) {
+        return false;
+    }
+    if (info.getLength() == oldLength) {
+        return info.getLastModifiedTime() == syncedInfo.getLastModifiedTime();
+    }
+    File::Reader::Ptr reader = file.openForReading();
+    
+    // the end of the text must still be found in the file
+
+    long       tailLength = util::minimum(oldLength, (long) FOLLOW_TAIL_LENGTH);
+    ByteBuffer tail;
+    byte*      fileTail   = tail.appendAmount(2 * tailLength);
+    byte*      textTail   = fileTail + tailLength;
+
+    buffer.copyTo(textTail, oldLength - tailLength, tailLength);
+
+    if (   reader->readAt(fileTail, oldLength - tailLength, tailLength) < tailLength
+        || memcmp(fileTail, textTail, tailLength) != 0)
+    {
+        return false;
+    }
+    long       amount = util::minimum(info.getLength() - oldLength, (long) FOLLOW_BATCH_LENGTH);
+    ByteBuffer newData;
+
+    amount = reader->readAt(newData.appendAmount(amount), oldLength, amount);
+
+    if (amount > 0)
+    {
+        internalInsertAtPos(oldLength, numberLines - 1, newData.getPtr(0), amount);
+    }
+    if (oldLength + amount == info.getLength())
+    {
+        this->fileInfo                 = info;
+        this->modifiedOnDiskFlag       = false;
+        this->ignoreModifiedOnDiskFlag = false;
+    }
+    return true;
+}
+
+
 void TextData::setRealFileName(const String& filename)
 {
     this->fileNamePseudoFlag = false;
@@ -302,81 +642,423 @@ void TextData::setToSavedState()
         setHistorySeparator();
         history->setPreviousActionToSavedState();
     }
-    setModifiedFlag(false);
+    setModifiedFlag(false);
+
+    this->modifiedOnDiskFlag = false;
+    this->ignoreModifiedOnDiskFlag = false;
+    this->fileInfo = File(fileName).getInfo();
+}
+
+
+File::Writer::Ptr TextData::openFileForSaving()
+{
+    checkMappedFile();
+
+    if (loadingFlag) {
+        throw FileException(EBUSY, String() << "file '" << fileName << "' cannot be saved while it is being loaded");
+    }
+    if (savingFlag) {
+        throw FileException(EBUSY, String() << "file '" << fileName << "' is already being saved");
+    }
+    ASSERT(!fileNamePseudoFlag);
+
+    File              file(fileName);
+    File::Writer::Ptr writer;
+    
+    if (GlobalConfig::getConfigData()->getGeneralConfig()->getUseAtomicSaving()) {
+        writer = file.openForAtomicWriting();
+    }
+    if (!writer.isValid()) {
+        buffer.releaseMappedMemory(); // the mapped file is overwritten in place
+        writer = file.openForWriting();
+    }
+    return writer;
+}
+
+
+void TextData::save()
+{
+    try
+    {
+        File::Writer::Ptr writer = openFileForSaving();
+
+        EncodingConverter c("UTF-8", fileContentEncoding);
+        
+        if (c.isConvertingBetweenDifferentCodesets())
+        {
+            try {
+                c.convertToWriter(buffer, writer);
+            }
+            catch (EncodingException& ex) {
+                writer->commit();
+                throw;
+            }
+        }
+        else {
+            buffer.writeTo(writer);
+        }
+        writer->commit();
+
+        setToSavedState();
+    }
+    catch (EncodingException& ex)
+    {
+        setToSavedState();
+
+        throw;
+    }
+    catch (BaseException& ex)
+    {
+        this->ignoreModifiedOnDiskFlag = true;
+        
+        throw;
+    }
+}
+
+
+TextSnapshot::Ptr TextData::beginSaving()
+{
+    ASSERT(!savingFlag && !loadingFlag);
+
+    if (hasHistory()) {
+        setHistorySeparator();
+        savingActionIndex = history->getPreviousActionIndex();
+    }
+    savingFlag     = true;
+    savingVersion  = version;
+    savingFileName = fileName;
+
+    return createSnapshot();
+}
+
+
+void TextData::finishSaving(bool wasWritten)
+{
+    ASSERT(savingFlag);
+
+    savingFlag = false;
+
+    if (!wasWritten) {
+        this->ignoreModifiedOnDiskFlag = true;
+    }
+    else if (version == savingVersion && fileName == savingFileName) {
+        setToSavedState();
+    }
+    else if (fileName == savingFileName)
+    {
+        // the text was modified while it was being saved
+
+        if (hasHistory()) {
+            history->setSavedActionIndex(savingActionIndex);
+            setModifiedFlag(!history->isPreviousActionSavedState());
+        }
+        this->modifiedOnDiskFlag       = false;
+        this->ignoreModifiedOnDiskFlag = false;
+        this->fileInfo                 = File(fileName).getInfo();
+    }
+}
+
+
+TextData::TextMark TextData::createNewMark() {
+    long i;
+    if (freeMarks.getLength() > 0) {
+        i = freeMarks.getAndRemoveLast();
+    } else {
+        i = marks.getLength();
+        marks.appendAmount(1);
+    }
+    marks[i].inUseCounter  = 0;
+    marks[i].pos           = 0;
+    marks[i].line          = 0;
+    marks[i].byteColumn    = 0;
+    marks[i].wcharColumn   = 0;
+    marks[i].block         = NULL;
+    return TextMark(this, i);
+}
+
+TextData::TextMark TextData::createNewMark(MarkHandle src)
+{
+    ASSERT(marks[src.index].inUseCounter > 0);
+
+    TextMark rslt = createNewMark();
+    TextMarkData& srcMark  = marks[src.index];
+    TextMarkData& rsltMark = marks[rslt.index];
+    rsltMark.pos         = getMarkPos(srcMark);
+    rsltMark.line        = getMarkLine(srcMark);
+    rsltMark.byteColumn  = srcMark.byteColumn;
+    rsltMark.wcharColumn = srcMark.wcharColumn;
+    attachMark(rslt);
+    return rslt;
+}
+
+
+/**
+ * Returns the index of the first block in [beginIndex, endIndex)
+ * whose last mark has a position >= pos, or endIndex.
+ */
+long TextData::getMarkBlockIndexForPos(long pos, long beginIndex, long endIndex) const
+{
+    long lo = beginIndex;
+    long hi = endIndex;
+
+    while (lo < hi) {
+        long mid = (lo + hi) / 2;
+        if (getLastMarkPos(markBlocks[mid].getRawPtr()) < pos) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+
+/**
+ * Returns the index of the first mark in the block with a position >= pos.
+ */
+long TextData::getIndexInMarkBlockForPos(const MarkBlock* block, long pos) const
+{
+    long relativePos = pos - getBlockPos(block);
+    long lo = 0;
+    long hi = block->markIndices.getLength();
+
+    while (lo < hi) {
+        long mid = (lo + hi) / 2;
+        if (marks[block->markIndices[mid]].pos < relativePos) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+
+/**
+ * Moves the marks from splitIndex on into a new block behind the given block.
+ * The new block gets the same base, so the marks keep their relative positions.
+ */
+void TextData::splitMarkBlock(long blockIndex, long splitIndex)
+{
+    MarkBlock* block = markBlocks[blockIndex].getRawPtr();
+    MarkBlock::Ptr newBlock = MarkBlock::create();
+
+    newBlock->pos           = block->pos;
+    newBlock->line          = block->line;
+    newBlock->isEndRelative = block->isEndRelative;
+
+    long amount = block->markIndices.getLength() - splitIndex;
+    newBlock->markIndices.append(block->markIndices.getPtr(splitIndex), amount);
+    block->markIndices.removeTail(splitIndex);
+
+    for (long i = 0; i < amount; ++i) {
+        marks[newBlock->markIndices[i]].block = newBlock.getRawPtr();
+    }
+    markBlocks.insert(blockIndex + 1, newBlock);
+
+    if (blockIndex < markBlockSplitIndex) {
+        ++markBlockSplitIndex;
+    }
+}
+
+
+/**
+ * Merges the block with the following block, if both are on the same
+ * side of the split point and are small enough together.
+ */
+void TextData::mergeMarkBlocksIfSmall(long blockIndex)
+{
+    if (   blockIndex < 0 
+        || blockIndex + 1 >= markBlocks.getLength()
+        || blockIndex + 1 == markBlockSplitIndex)
+    {
+        return;
+    }
+    MarkBlock* block     = markBlocks[blockIndex    ].getRawPtr();
+    MarkBlock* nextBlock = markBlocks[blockIndex + 1].getRawPtr();
+
+    long length     = block    ->markIndices.getLength();
+    long nextLength = nextBlock->markIndices.getLength();
+
+    if (length + nextLength <= MAX_MARK_BLOCK_LENGTH)
+    {
+        ASSERT(block->isEndRelative == nextBlock->isEndRelative);
+
+        long posOffset  = nextBlock->pos  - block->pos;
+        long lineOffset = nextBlock->line - block->line;
+
+        for (long i = 0; i < nextLength; ++i) {
+            TextMarkData& mark = marks[nextBlock->markIndices[i]];
+            mark.pos   += posOffset;
+            mark.line  += lineOffset;
+            mark.block  = block;
+        }
+        block->markIndices.append(nextBlock->markIndices);
+        removeMarkBlock(blockIndex + 1);
+    }
+}
+
+
+void TextData::removeMarkBlock(long blockIndex)
+{
+    markBlocks.remove(blockIndex);
+
+    if (blockIndex < markBlockSplitIndex) {
+        --markBlockSplitIndex;
+    }
+}
+
+
+/**
+ * Removes the mark from markBlocks, so that its position
+ * can be changed directly. attachMark() must be called afterwards.
+ */
+TextData::TextMarkData& TextData::detachMark(MarkHandle m)
+{
+    TextMarkData& mark = marks[m.index];
+
+    if (mark.block != NULL)
+    {
+        MarkBlock* block = mark.block;
+        long       pos   = getMarkPos(mark);
+
+        long b = getMarkBlockIndexForPos(pos, 0, markBlocks.getLength());
+        while (markBlocks[b].getRawPtr() != block) {
+            ++b;
+        }
+        long i = getIndexInMarkBlockForPos(block, pos);
+        while (block->markIndices[i] != m.index) {
+            ++i;
+        }
+        block->markIndices.remove(i);
+
+        mark.pos   = pos;
+        mark.line += getBlockLine(block);
+        mark.block = NULL;
+
+        if (block->markIndices.getLength() == 0) {
+            removeMarkBlock(b);
+        } 
+        else if (block->markIndices.getLength() < MAX_MARK_BLOCK_LENGTH / 4) {
+            mergeMarkBlocksIfSmall(b);
+            mergeMarkBlocksIfSmall(b - 1);
+        }
+    }
+    return mark;
+}
+
+
+void TextData::attachMark(MarkHandle m)
+{
+    TextMarkData& mark = marks[m.index];
+
+    ASSERT(mark.block == NULL);
+    ASSERT(0 <= mark.pos && mark.pos <= getLength());
+
+    if (mark.pos > 0)
+    {
+        long beginIndex;
+        long endIndex;
+        bool isEndRelative = (mark.pos > markSplitPos);
+
+        if (isEndRelative) {
+            beginIndex = markBlockSplitIndex;
+            endIndex   = markBlocks.getLength();
+        } else {
+            beginIndex = 0;
+            endIndex   = markBlockSplitIndex;
+        }
+        long b = getMarkBlockIndexForPos(mark.pos + 1, beginIndex, endIndex);
+
+        if (b == endIndex)
+        {
+            if (b > beginIndex) {
+                --b;
+            } else {
+                MarkBlock::Ptr newBlock = MarkBlock::create();
+                setBlockEndRelative(newBlock.getRawPtr(), isEndRelative);
+                markBlocks.insert(b, newBlock);
+                if (!isEndRelative) {
+                    ++markBlockSplitIndex;
+                }
+            }
+        }
+        MarkBlock* block = markBlocks[b].getRawPtr();
+        long       i     = getIndexInMarkBlockForPos(block, mark.pos + 1);
+
+        block->markIndices.insert(i, &m.index, 1);
+        mark.pos   -= getBlockPos(block);
+        mark.line  -= getBlockLine(block);
+        mark.block  = block;
+
+        if (block->markIndices.getLength() > MAX_MARK_BLOCK_LENGTH) {
+            splitMarkBlock(b, MAX_MARK_BLOCK_LENGTH / 2);
+        }
+    }
+}
 
-    this->modifiedOnDiskFlag = false;
-    this->ignoreModifiedOnDiskFlag = false;
-    this->fileInfo = File(fileName).getInfo();
+
+void TextData::freeMark(long index)
+{
+    detachMark(MarkHandle(index));
+    freeMarks.append(index);
 }
 
 
-void TextData::save()
+void TextData::moveMarkSplitTo(long pos)
 {
-    try
+    while (markBlockSplitIndex > 0)
     {
-        ASSERT(!fileNamePseudoFlag);
-    
-        File file(fileName);
-        
-        EncodingConverter c("UTF-8", fileContentEncoding);
-        
-        if (c.isConvertingBetweenDifferentCodesets())
-        {
-            c.convertToFile(buffer, file);
+        long       b     = markBlockSplitIndex - 1;
+        MarkBlock* block = markBlocks[b].getRawPtr();
+
+        if (getLastMarkPos(block) <= pos) {
+            break;
         }
-        else {
-            file.storeData(&buffer);
+        long i = getIndexInMarkBlockForPos(block, pos + 1);
+        if (i > 0) {
+            splitMarkBlock(b, i);
+            b += 1;
         }
+        setBlockEndRelative(markBlocks[b].getRawPtr(), true);
+        markBlockSplitIndex = b;
+        mergeMarkBlocksIfSmall(b);
 
-        setToSavedState();
+        if (i > 0) {
+            break;
+        }
     }
-    catch (EncodingException& ex)
+    while (markBlockSplitIndex < markBlocks.getLength())
     {
-        setToSavedState();
+        long       b     = markBlockSplitIndex;
+        MarkBlock* block = markBlocks[b].getRawPtr();
 
-        throw;
-    }
-    catch (BaseException& ex)
-    {
-        this->ignoreModifiedOnDiskFlag = true;
-        
-        throw;
-    }
-}
+        if (getFirstMarkPos(block) > pos) {
+            break;
+        }
+        long i = getIndexInMarkBlockForPos(block, pos + 1);
+        bool isSplitted = (i < block->markIndices.getLength());
+        if (isSplitted) {
+            splitMarkBlock(b, i);
+        }
+        setBlockEndRelative(block, false);
+        markBlockSplitIndex = b + 1;
+        mergeMarkBlocksIfSmall(b - 1);
 
-TextData::TextMark TextData::createNewMark() {
-    long i = 0;
-    for (; i < marks.getLength(); ++i) {
-        if (!marks[i].inUseCounter > 0) {
+        if (isSplitted) {
             break;
         }
     }
-    if (i == marks.getLength()) {
-        marks.appendAmount(1);
-    }
-    marks[i].inUseCounter = 0;
-    marks[i].pos          = 0;
-    marks[i].line         = 0;
-    marks[i].byteColumn   = 0;
-    marks[i].wcharColumn  = 0;
-    return TextMark(this, i);
-}
-
-TextData::TextMark TextData::createNewMark(MarkHandle src)
-{
-    TextMarkData& srcMark = marks[src.index];
-    ASSERT(srcMark.inUseCounter > 0);
-
-    TextMark rslt = createNewMark();
-    TextMarkData& rsltMark = marks[rslt.index];
-    rsltMark.pos         = srcMark.pos;
-    rsltMark.line        = srcMark.line;
-    rsltMark.byteColumn  = srcMark.byteColumn;
-    rsltMark.wcharColumn = srcMark.wcharColumn;
-    return rslt;
+    markSplitPos = pos;
 }
 
 
+/**
+ * Must be called after the text was modified. Before the modification
+ * moveMarkSplitTo(beginChangedPos) must have been called, so that
+ * the marks behind the modification are already shifted and only the
+ * marks near the modification have to be adjusted here.
+ */
 void TextData::updateMarks(
         long beginChangedPos, long oldEndChangedPos, long changedAmount,
         long beginLineNumber, long changedLineNumberAmount)
@@ -386,56 +1068,78 @@ void TextData::updateMarks(
     bool beginColCalculated = false;
     long beginByteColumns = 0;
     long endByteColumns = 0;
+    bool finished = false;
     
     ASSERT(beginChangedPos <= oldEndChangedPos);
     ASSERT(beginChangedPos <= oldEndChangedPos + changedAmount);
+    ASSERT(markSplitPos == beginChangedPos);
 
-    for (long i = 0; i < marks.getLength(); ++i) {
-        if (marks[i].inUseCounter > 0) {
-            if (marks[i].pos <= beginChangedPos) {
-                goto next;
+    for (long b = markBlockSplitIndex; b < markBlocks.getLength() && !finished; ++b)
+    {
+        MarkBlock* block     = markBlocks[b].getRawPtr();
+        long       blockPos  = getBlockPos(block);
+        long       blockLine = getBlockLine(block);
+
+        for (long i = 0; i < block->markIndices.getLength(); ++i)
+        {
+            TextMarkData& mark = marks[block->markIndices[i]];
+            long          pos  = mark.pos + blockPos;
+
+            if (pos < newEndChangedPos)
+            {
+                if (!beginColCalculated) {
+                    long bol = getThisLineBegin(beginChangedPos);
+                    beginColCalculated = true;
+                    beginByteColumns = beginChangedPos - bol;
+                }
+                mark.pos         = beginChangedPos - blockPos;
+                mark.line        = beginLineNumber - blockLine;
+                mark.byteColumn  = beginByteColumns;
+                mark.wcharColumn = -1;
             }
-            if (marks[i].pos >= oldEndChangedPos) {
-                if (marks[i].pos   - oldEndChangedPos > marks[i].byteColumn) {
-                    marks[i].pos  += changedAmount;
-                    marks[i].line += changedLineNumberAmount;
-                } else {
-                    if (!endColCalculated) {
-                        endColCalculated = true;
-                        endByteColumns = newEndChangedPos - getThisLineBegin(newEndChangedPos);
-                    }
-                    marks[i].byteColumn  = marks[i].pos - oldEndChangedPos + endByteColumns;
-                    marks[i].pos        += changedAmount;
-                    marks[i].line       += changedLineNumberAmount;
-                    marks[i].wcharColumn = -1;
+            else if (pos - newEndChangedPos <= mark.byteColumn)
+            {
+                if (!endColCalculated) {
+                    endColCalculated = true;
+                    endByteColumns = newEndChangedPos - getThisLineBegin(newEndChangedPos);
                 }
-                goto next;
+                mark.byteColumn  = pos - newEndChangedPos + endByteColumns;
+                mark.wcharColumn = -1;
             }
-            if (!beginColCalculated) {
-                long bol = getThisLineBegin(beginChangedPos);
-                beginColCalculated = true;
-                beginByteColumns = beginChangedPos - bol;
+            else {
+                finished = true;
+                break;
+            }
+        }
+    }
+    finished = false;
+
+    for (long b = markBlockSplitIndex; b < markBlocks.getLength() && !finished; ++b)
+    {
+        MarkBlock* block    = markBlocks[b].getRawPtr();
+        long       blockPos = getBlockPos(block);
+
+        for (long i = 0; i < block->markIndices.getLength(); ++i)
+        {
+            TextMarkData& mark = marks[block->markIndices[i]];
+            long          p    = mark.pos + blockPos;
+
+            if (p > newEndChangedPos + 3) {
+                finished = true;
+                break;
             }
-            marks[i].pos         = beginChangedPos;
-            marks[i].line        = beginLineNumber;
-            marks[i].byteColumn  = beginByteColumns;
-            marks[i].wcharColumn = -1;
-            ASSERT(marks[i].pos <= this->getLength());
-        next:
+            long wcharBegin = getBeginOfWChar(p);
+            if (p != wcharBegin)
             {
-                long p = marks[i].pos;
-                long wcharBegin = getBeginOfWChar(p);
-                if (p != wcharBegin)
+                if (p >= beginChangedPos && wcharBegin <= newEndChangedPos)
                 {
-                    if (p >= beginChangedPos && wcharBegin <= newEndChangedPos)
-                    {
-                        marks[i].pos         = wcharBegin;
-                        marks[i].byteColumn -= (p - wcharBegin);
-                    }
+                    mark.pos        -= (p - wcharBegin);
+                    mark.byteColumn -= (p - wcharBegin);
                 }
             }
         }
     }
+    moveMarkSplitTo(beginChangedPos);
 }
 
 void TextData::setInsertFilterCallback(Callback<const byte**, long*>::Ptr filterCallback)
@@ -444,36 +1148,43 @@ void TextData::setInsertFilterCallback(Callback<const byte**, long*>::Ptr filter
 }
 
 
+inline void TextData::internalInsertAtPos(long pos, long lineNumber, const byte* insertBuffer, long length)
+{
+    long lineCounter = NewlineCounter::count(insertBuffer, length);
+
+    moveMarkSplitTo(getBeginOfWChar(pos));
+
+    if (   buffer.getBackend() == TextStorage::GAP_BUFFER
+        && getStorageBackendForLength(buffer.getLength() + length) == TextStorage::CHUNKED_BUFFER)
+    {
+        buffer.setBackend(TextStorage::CHUNKED_BUFFER);
+    }
+    buffer.insert(pos, insertBuffer, length);
+    lineIndex.insertAmount(pos, length, lineCounter);
+
+    this->numberLines += lineCounter;
+    ASSERT(numberLines == lineIndex.getNumberOfLines());
+
+    // Affected positions for wchar handling
+    long b2    = getBeginOfWChar(pos);
+    long n2    = getEndOfWChar(pos + length); 
+    long o2    = n2 - length;
+    long a2    = n2 - o2;
+    
+    recalculateChangeMarker(b2, o2, a2);
+
+    updateMarks(b2, o2, a2, lineNumber, lineCounter);
+}
+
 inline long TextData::internalInsertAtMark(MarkHandle m, const byte* insertBuffer, long length)
 {
     if (!isReadOnlyFlag)
     {
         if (length > 0)
         {
-            int lineCounter = 0;
-            for (int i = 0; i < length; ++i) {
-                if (insertBuffer[i] == '\n') {
-                    ++lineCounter;
-                }
-            }
-    
             TextMarkData& mark = marks[m.index];
-            long lineNumber = mark.line;
-            long pos = mark.pos;
-    
-            buffer.insert(pos, insertBuffer, length);
 
-            this->numberLines += lineCounter;
-
-            // Affected positions for wchar handling
-            long b2    = getBeginOfWChar(pos);
-            long n2    = getEndOfWChar(pos + length); 
-            long o2    = n2 - length;
-            long a2    = n2 - o2;
-            
-            recalculateChangeMarker(b2, o2, a2);
-
-            updateMarks(b2, o2, a2, lineNumber, lineCounter);
+            internalInsertAtPos(getMarkPos(mark), getMarkLine(mark), insertBuffer, length);
         }
         return length;
     }
@@ -495,6 +1206,83 @@ inline void TextData::recalculateChangeMarker(long b2, long o2, long a2)
     this->beginChangedPos  = b3;
     this->oldEndChangedPos = o3;
     this->changedAmount    = a3;
+
+    recordChange(b2, o2, a2);
+}
+
+
+void TextData::recordChange(long beginPos, long oldEndPos, long changedAmount)
+{
+    ASSERT(firstRecordedVersion + changeRecords.getLength() == version);
+
+    wcharColumnCache.applyChange(beginPos, oldEndPos, changedAmount);
+
+    long oldestVersion = version;
+    
+    for (long i = 0; i < snapshots.getLength();)
+    {
+        if (snapshots[i].isValid()) {
+            oldestVersion = util::minimum(oldestVersion, snapshots[i]->getVersion());
+            ++i;
+        } else {
+            snapshots.remove(i);
+        }
+    }
+    this->version += 1;
+
+    if (snapshots.getLength() == 0)
+    {
+        changeRecords.clear();
+        firstRecordedVersion = version;
+    }
+    else
+    {
+        if (oldestVersion > firstRecordedVersion) {
+            changeRecords.removeAmount(0, oldestVersion - firstRecordedVersion);
+            firstRecordedVersion = oldestVersion;
+        }
+        ChangeRecord r;
+                     r.beginPos      = beginPos;
+                     r.oldEndPos     = oldEndPos;
+                     r.changedAmount = changedAmount;
+        changeRecords.append(r);
+    }
+}
+
+
+TextSnapshot::Ptr TextData::createSnapshot()
+{
+    TextSnapshot::Ptr rslt = buffer.createSnapshot();
+
+    rslt->version = version;
+    snapshots.append(rslt);
+
+    return rslt;
+}
+
+
+long TextData::getCurrentPosForSnapshotPos(RawPtr<const TextSnapshot> snapshot, long pos) const
+{
+    long i = snapshot->getVersion() - firstRecordedVersion;
+
+    ASSERT(0 <= i && i <= changeRecords.getLength());
+    ASSERT(0 <= pos && pos <= snapshot->getLength());
+
+    for (; i < changeRecords.getLength(); ++i)
+    {
+        const ChangeRecord& r = changeRecords[i];
+
+        if (pos <= r.beginPos) {
+            continue;
+        }
+        else if (pos >= r.oldEndPos) {
+            pos += r.changedAmount;
+        }
+        else {
+            pos = r.beginPos;
+        }
+    }
+    return pos;
 }
 
 
@@ -505,6 +1293,8 @@ long TextData::undo(MarkHandle m)
         long spos = LONG_MAX;
         long epos = 0;
         
+        endCompoundChange();
+
         if (hasHistory())
         {
             bool first = true;
@@ -546,6 +1336,30 @@ long TextData::undo(MarkHandle m)
                         }
                         break;
                     }
+                    case EditingHistory::ACTION_REPLACE: {
+                        long pos               = history->getPreviousActionTextPos();
+                        long length            = history->getPreviousActionLength();
+                        long oldLength         = history->getPreviousActionOldLength();
+                        
+                        // insert behind the replacing text, so that it can be
+                        // handed over to the history before it is removed
+                        
+                        moveMarkToPos(m, pos + length);
+                        internalInsertAtMark(m, history->getContentForUndoReplaceAction(), oldLength);
+                        moveMarkToPos(m, pos);
+                        history->undoReplaceAction(buffer.getAmount(pos, length));
+                        internalRemoveAtMark(m, length);
+                        
+                        if (spos > pos) {
+                            spos = pos;
+                        }
+                        if (epos < pos + length) {
+                            epos = pos + oldLength;
+                        } else {
+                            epos += oldLength - length;
+                        }
+                        break;
+                    }
                     case EditingHistory::ACTION_NONE: {
                         break;
                     }
@@ -590,6 +1404,8 @@ long TextData::redo(MarkHandle m)
         long spos = LONG_MAX;
         long epos = 0;
             
+        endCompoundChange();
+
         if (hasHistory())
         {
             do
@@ -630,6 +1446,27 @@ long TextData::redo(MarkHandle m)
                         }
                         break;
                     }
+                    case EditingHistory::ACTION_REPLACE: {
+                        long pos               = history->getNextActionTextPos();
+                        long length            = history->getNextActionLength();
+                        long oldLength         = history->getNextActionOldLength();
+
+                        moveMarkToPos(m, pos + oldLength);
+                        internalInsertAtMark(m, history->getContentForRedoReplaceAction(), length);
+                        moveMarkToPos(m, pos);
+                        history->redoReplaceAction(buffer.getAmount(pos, oldLength));
+                        internalRemoveAtMark(m, oldLength);
+                        
+                        if (spos > pos) {
+                            spos = pos;
+                        }
+                        if (epos < pos + oldLength) {
+                            epos = pos + length;
+                        } else {
+                            epos += length - oldLength;
+                        }
+                        break;
+                    }
                     case EditingHistory::ACTION_NONE: {
                         break;
                     }
@@ -676,9 +1513,13 @@ long TextData::insertAtMark(MarkHandle m, const byte* insertBuffer, long length)
         if (length > 0)
         {
             if (hasHistory()) {
-                TextMarkData& mark = marks[m.index];
-                long pos = mark.pos;
-                history->rememberInsertAction(pos, length);
+                long pos = getMarkPos(marks[m.index]);
+                if (isInCompoundChange(pos, 0)) {
+                    rememberCompoundInsert(pos, length);
+                } else {
+                    endCompoundChange();
+                    history->rememberInsertAction(pos, length);
+                }
             }
             internalInsertAtMark(m, insertBuffer, length);
     
@@ -694,34 +1535,36 @@ long TextData::insertAtMark(MarkHandle m, const byte* insertBuffer, long length)
 
 
 
+inline void TextData::internalRemoveAtPos(long pos, long lineNumber, long amount)
+{
+    long lineCounter = lineIndex.countNewlines(pos, amount);
+
+    moveMarkSplitTo(getBeginOfWChar(pos));
+
+    lineIndex.removeAmount(pos, amount);
+    buffer.removeAmount(pos, amount);
+
+    // Affected positions for wchar handling
+    long b2   = getBeginOfWChar(pos);
+    long n2   = getEndOfWChar(pos); 
+    long o2   = n2 + amount;
+    long a2   = n2 - o2;
+
+    this->numberLines -= lineCounter;
+    ASSERT(numberLines == lineIndex.getNumberOfLines());
+
+    recalculateChangeMarker(b2, o2, a2);
+
+    updateMarks(b2, o2, a2, lineNumber, -lineCounter);
+}
+
 inline void TextData::internalRemoveAtMark(MarkHandle m, long amount)
 {
     if (!isReadOnlyFlag)
     {
         TextMarkData& mark = marks[m.index];
-        long lineNumber = mark.line;
-        long pos = mark.pos;
-        
-        int lineCounter = 0;
-        for (int p = mark.pos, i = 0; i < amount; ++i) {
-            if (buffer[p + i] == '\n') {
-                ++lineCounter;
-            }
-        }
-    
-        buffer.removeAmount(mark.pos, amount);
-
-        // Affected positions for wchar handling
-        long b2   = getBeginOfWChar(pos);
-        long n2   = getEndOfWChar(pos); 
-        long o2   = n2 + amount;
-        long a2   = n2 - o2;
-
-        this->numberLines -= lineCounter;
 
-        recalculateChangeMarker(b2, o2, a2);
-
-        updateMarks(b2, o2, a2, lineNumber, -lineCounter);
+        internalRemoveAtPos(getMarkPos(mark), getMarkLine(mark), amount);
     }
 }
 
@@ -740,12 +1583,17 @@ void TextData::removeAtMark(MarkHandle m, long amount)
     {
         if (amount > 0)
         {
-            TextMarkData& mark = marks[m.index];
+            long pos = getMarkPos(marks[m.index]);
     
             if (hasHistory()) {
-                history->rememberDeleteAction(mark.pos, 
-                                              amount, 
-                                              buffer.getAmount(mark.pos, amount));
+                if (isInCompoundChange(pos, amount)) {
+                    rememberCompoundRemove(pos, amount);
+                } else {
+                    endCompoundChange();
+                    history->rememberDeleteAction(pos, 
+                                                  amount, 
+                                                  buffer.getAmount(pos, amount));
+                }
             }
             internalRemoveAtMark(m, amount);
     
@@ -761,8 +1609,84 @@ void TextData::clear()
 }
 
 
+TextData::CompoundChange::Ptr TextData::createCompoundChange(long spos, long epos)
+{
+    if (hasHistory() && !isCompoundChangeActive)
+    {
+        ASSERT(0 <= spos && spos <= epos && epos <= getLength());
+
+        long length = epos - spos;
+
+        compoundOldData.clear();
+        buffer.copyTo(compoundOldData.appendAmount(length), spos, length);
+
+        isCompoundChangeActive  = true;
+        compoundBeginPos        = spos;
+        compoundChangedAmount   = 0;
+        compoundFirstChangedPos = epos;
+        compoundLastChangedPos  = -1;
+
+        return CompoundChange::create(this);
+    } else {
+        return CompoundChange::Ptr();
+    }
+}
+
+
+void TextData::rememberCompoundInsert(long pos, long length)
+{
+    compoundFirstChangedPos = util::minimum(compoundFirstChangedPos, pos);
+    
+    if (compoundLastChangedPos >= pos) {
+        compoundLastChangedPos += length;
+    } else {
+        compoundLastChangedPos = pos + length;
+    }
+    compoundChangedAmount += length;
+}
+
+
+void TextData::rememberCompoundRemove(long pos, long amount)
+{
+    compoundFirstChangedPos = util::minimum(compoundFirstChangedPos, pos);
+
+    if (compoundLastChangedPos >= pos + amount) {
+        compoundLastChangedPos -= amount;
+    } else {
+        compoundLastChangedPos = pos;
+    }
+    compoundChangedAmount -= amount;
+}
+
+
+void TextData::endCompoundChange()
+{
+    if (isCompoundChangeActive)
+    {
+        isCompoundChangeActive = false;
+        
+        if (compoundLastChangedPos >= 0)
+        {
+            // only the changed area is remembered
+
+            long oldBegin = compoundFirstChangedPos - compoundBeginPos;
+            long oldEnd   = compoundLastChangedPos - compoundChangedAmount - compoundBeginPos;
+            
+            history->rememberReplaceAction(compoundFirstChangedPos,
+                                           oldEnd - oldBegin,
+                                           compoundLastChangedPos - compoundFirstChangedPos,
+                                           compoundOldData.getAmount(oldBegin, oldEnd - oldBegin));
+        }
+        ByteBuffer emptyBuffer;
+        compoundOldData.takeOver(&emptyBuffer);
+    }
+}
+
+
 void TextData::clearHistory()
 {
+    endCompoundChange();
+
     if (hasHistory()) {
         history->clear();
     }
@@ -773,11 +1697,15 @@ void TextData::reset()
     int oldLength = getLength();
     if (oldLength > 0) {
         int oldNumberLines = numberLines;
+        moveMarkSplitTo(0);
         this->buffer.clear();
+        this->buffer.setBackend(TextStorage::GAP_BUFFER);
+        this->lineIndex.rebuild();
         this->numberLines = 1;
         this->changedAmount -= oldLength;
         this->oldEndChangedPos = oldLength;
         this->beginChangedPos = 0;
+        recordChange(0, oldLength, -oldLength);
         updateMarks(0, oldLength, -oldLength, 0, -(oldNumberLines - 1));
     }
 
@@ -795,33 +1723,22 @@ void TextData::moveMarkToBeginOfLine(MarkHandle m, long newLine)
         newLine = numberLines - 1;
     }
 
-    TextMarkData& mark = marks[m.index];
+    TextMarkData& mark = detachMark(m);
 
-    if (newLine < mark.line) {
-        if (newLine - 0 <= mark.line - newLine) {
-            mark.pos = 0;
-            mark.line = 0;
-            for (int i = 0, count = newLine - mark.line; i < count; ++i) {
-                mark.pos = getNextLineBegin(mark.pos);
-            }
-        } else {
-            mark.pos = getThisLineBegin(mark.pos);
-            for (int i = 0, count = mark.line - newLine; i < count; ++i) {
-                mark.pos = getPrevLineBegin(mark.pos);
-            }
+    if (   newLine < mark.line - MAX_LINES_TO_SCAN
+        || newLine > mark.line + MAX_LINES_TO_SCAN)
+    {
+        mark.pos = lineIndex.getBeginOfLine(newLine);
+    }
+    else if (newLine < mark.line) {
+        mark.pos = getThisLineBegin(mark.pos);
+        for (int i = 0, count = mark.line - newLine; i < count; ++i) {
+            mark.pos = getPrevLineBegin(mark.pos);
         }
     } else if (newLine > mark.line) {
-        if (getNumberOfLines() - newLine <= newLine - mark.line) {
-            mark.pos = getThisLineBegin(getLength());
-            mark.line = getNumberOfLines() - 1;
-            for (int i = 0, count = mark.line - newLine; i < count; ++i) {
-                mark.pos = getPrevLineBegin(mark.pos);
-            }
-        } else {
-            mark.pos = getThisLineBegin(mark.pos);
-            for (int i = 0, count = newLine - mark.line; i < count; ++i) {
-                mark.pos = getNextLineBegin(mark.pos);
-            }
+        mark.pos = getThisLineBegin(mark.pos);
+        for (int i = 0, count = newLine - mark.line; i < count; ++i) {
+            mark.pos = getNextLineBegin(mark.pos);
         }
     } else {
         mark.pos = getThisLineBegin(mark.pos);
@@ -829,128 +1746,112 @@ void TextData::moveMarkToBeginOfLine(MarkHandle m, long newLine)
     mark.line   = newLine;
 
     ASSERT(isBeginOfLine(mark.pos));
+    attachMark(m);
 }
 
 void TextData::moveMarkToLineAndWCharColumn(MarkHandle m, long newLine, long newWCharColumn)
 {
     moveMarkToBeginOfLine(m, newLine);
 
-    TextMarkData& mark = marks[m.index];
+    TextMarkData& mark = detachMark(m);
+
+    long i = utf8Parser.getPosAfterWChars(mark.pos, getThisLineEnding(mark.pos), newWCharColumn);
 
-    long c = 0;
-    long i = mark.pos;
-    while (!isEndOfLine(i) && c < newWCharColumn) {
-        ++c;
-        i = getNextWCharPos(i);
-    }
     mark.byteColumn  = i - mark.pos;
     mark.pos         = i;
     mark.wcharColumn = newWCharColumn;
+    attachMark(m);
 }
 
 
 void TextData::moveMarkToBeginOfLine(MarkHandle m)
 {
-    TextMarkData& mark = marks[m.index];
+    TextMarkData& mark = detachMark(m);
     long pos           = getThisLineBegin(mark.pos);
     mark.pos           = pos;
     mark.byteColumn    = 0;
     mark.wcharColumn   = 0;
+    attachMark(m);
 }
 
 void TextData::moveMarkToEndOfLine(MarkHandle m)
 {
-    TextMarkData& mark = marks[m.index];
+    long wcharColumn = getWCharColumn(m);
+
+    TextMarkData& mark = detachMark(m);
 
     long p1          = mark.pos;
-    long p           = p1;
-    long wcharColumn = getWCharColumn(m);
+    long p           = getThisLineEnding(p1);
 
-    while (!isEndOfLine(p)) {
-        p = getNextWCharPos(p);
-        ++wcharColumn;
-    }
+    wcharColumn     += utf8Parser.getNumberOfWChars(p1, p);
     mark.byteColumn += p - p1;
     mark.pos         = p;
     mark.wcharColumn = wcharColumn;
+    attachMark(m);
 }
 
 void TextData::moveMarkToNextLineBegin(MarkHandle m)
 {
-    TextMarkData& mark = marks[m.index];
+    TextMarkData& mark = detachMark(m);
     long pos           = getNextLineBegin(mark.pos);
     mark.line         += 1;
     mark.pos           = pos;
     mark.byteColumn    = 0;
     mark.wcharColumn   = 0;
+    attachMark(m);
 }
 
 void TextData::moveMarkToPrevLineBegin(MarkHandle m)
 {
-    TextMarkData& mark = marks[m.index];
+    TextMarkData& mark = detachMark(m);
     long pos         = getPrevLineBegin(mark.pos);
     mark.line       -= 1;
     mark.pos         = pos;
     mark.byteColumn  = 0;
     mark.wcharColumn = 0;
+    attachMark(m);
 }
 
 void TextData::moveMarkToPos(MarkHandle m, long pos)
 {
-    TextMarkData& mark = marks[m.index];
+    TextMarkData& mark = detachMark(m);
     
-    if (pos < mark.pos)
+    if (   pos < mark.pos - MAX_BYTES_TO_SCAN
+        || pos > mark.pos + MAX_BYTES_TO_SCAN)
     {
-        if (pos - 0 <= mark.pos - pos) {
-            mark.pos = 0;
-            mark.line = 0;
-            while (mark.pos < pos) {
-                if (isEndOfLine(mark.pos)) {
-                    mark.pos += getLengthOfLineEnding(mark.pos);
-                    mark.line += 1;
-                } else {
-                    mark.pos += 1;
-                }
+        mark.pos  = pos;
+        mark.line = lineIndex.getLineOfPos(pos);
+        fillInColumns(mark);
+    }
+    else if (pos < mark.pos)
+    {
+        long oldPos  = mark.pos;
+        long oldLine = mark.line;
+        do {
+            if (isBeginOfLine(mark.pos)) {
+                mark.line -= 1;
+                mark.pos -= getLengthOfPrevLineEnding(mark.pos);
+            } else {
+                mark.pos -= 1;
             }
-            fillInColumns(mark);
-        } else {
-            do {
-                if (isBeginOfLine(mark.pos)) {
-                    mark.line -= 1;
-                    mark.pos -= getLengthOfPrevLineEnding(mark.pos);
-                } else {
-                    mark.pos -= 1;
-                }
-            } while (pos < mark.pos);
-            fillInColumns(mark);
-        }
+        } while (pos < mark.pos);
+        fillInColumnsAfterMove(mark, oldPos, oldLine);
     } 
     else if (mark.pos < pos)
     {
-        if (getLength() - pos <= pos - mark.pos) {
-            mark.pos = getLength();
-            mark.line = getNumberOfLines() - 1;
-            while (pos < mark.pos) {
-                if (isBeginOfLine(mark.pos)) {
-                    mark.line -= 1;
-                    mark.pos -= getLengthOfPrevLineEnding(mark.pos);
-                } else {
-                    mark.pos -= 1;
-                }
+        long oldPos  = mark.pos;
+        long oldLine = mark.line;
+        do {
+            if (isEndOfLine(mark.pos)) {
+                mark.pos += getLengthOfLineEnding(mark.pos);
+                mark.line += 1;
+            } else {
+                mark.pos += 1;
             }
-            fillInColumns(mark);
-        } else {
-            do {
-                if (isEndOfLine(mark.pos)) {
-                    mark.pos += getLengthOfLineEnding(mark.pos);
-                    mark.line += 1;
-                } else {
-                    mark.pos += 1;
-                }
-            } while (mark.pos < pos);
-            fillInColumns(mark);
-        }
+        } while (mark.pos < pos);
+        fillInColumnsAfterMove(mark, oldPos, oldLine);
     }
+    attachMark(m);
 }
 
 void TextData::moveMarkToPosOfMark(MarkHandle m, MarkHandle toMark)
@@ -959,12 +1860,13 @@ void TextData::moveMarkToPosOfMark(MarkHandle m, MarkHandle toMark)
     {
         ASSERT(marks[     m.index].inUseCounter > 0);
         ASSERT(marks[toMark.index].inUseCounter > 0);
-        TextMarkData& mark = marks[     m.index];
+        TextMarkData& mark = detachMark(m);
         TextMarkData& to   = marks[toMark.index];
-        mark.pos           = to.pos;
-        mark.line          = to.line;
+        mark.pos           = getMarkPos(to);
+        mark.line          = getMarkLine(to);
         mark.byteColumn    = to.byteColumn;
         mark.wcharColumn   = to.wcharColumn;
+        attachMark(m);
     }
 }
 
@@ -972,6 +1874,8 @@ void TextData::flushPendingUpdatesIntern()
 {
     ASSERT(changedAmount != 0 || oldEndChangedPos != 0);
     
+    endCompoundChange();
+
     if (hasHistory()) {
         history->setSectionMarkOnHistoryTop();
     }
@@ -1018,8 +1922,16 @@ void TextData::registerModifiedFlagListener(Callback<bool>::Ptr modifiedFlagCall
     modifiedFlagCallback->call(modifiedFlag);
 }
 
+void TextData::registerLoadingProgressListener(Callback<int>::Ptr loadingProgressCallback)
+{
+    loadingProgressListeners.registerCallback(loadingProgressCallback);
+    loadingProgressCallback->call(loadingProgress);
+}
+
 void TextData::setHistorySeparator()
 {
+    endCompoundChange();
+
     if (hasHistory()) {
         history->setSectionMarkOnPreviousAction();
         history->setMergeStopMarkOnPreviousAction(true);
@@ -1028,6 +1940,8 @@ void TextData::setHistorySeparator()
 
 void TextData::setMergableHistorySeparator()
 {
+    endCompoundChange();
+
     if (hasHistory()) {
         history->setSectionMarkOnPreviousAction();
     }
@@ -22,6 +22,8 @@
 #ifndef TEXT_DATA_HPP
 #define TEXT_DATA_HPP
 
+#include <string.h>
+
 #include "String.hpp"
 #include "HeapObject.hpp"
 #include "MemBuffer.hpp"
@@ -29,12 +31,16 @@
 #include "ObjectArray.hpp"
 #include "CallbackContainer.hpp"
 #include "OwningPtr.hpp"
+#include "WeakPtr.hpp"
 #include "EditingHistory.hpp"
 #include "TimeStamp.hpp"
 #include "File.hpp"
 #include "RawPtr.hpp"
 #include "Utf8Parser.hpp"
 #include "Nullable.hpp"
+#include "TextStorage.hpp"
+#include "LineIndex.hpp"
+#include "WCharColumnCache.hpp"
 
 
 namespace LucED
@@ -74,23 +80,23 @@ public:
         TextMark() {}
         ~TextMark() {
             if (textData.isValid()) {
-                textData->getTextMarkData(index)->inUseCounter -= 1;
+                textData->releaseMark(index);
             }
         }
         TextMark(const TextMark& src) {
             index = src.index;
             textData = src.textData;
             if (textData.isValid()) {
-                textData->getTextMarkData(index)->inUseCounter += 1;
+                textData->retainMark(index);
             }
         }
         TextMark& operator=(const TextMark& src) {
             ASSERT(!textData.isValid() || !src.textData.isValid() || textData == src.textData);
             if (src.textData.isValid()) {
-                src.textData->getTextMarkData(src.index)->inUseCounter += 1;
+                src.textData->retainMark(src.index);
             }
             if (textData.isValid()) {
-                textData->getTextMarkData(index)->inUseCounter -= 1;
+                textData->releaseMark(index);
             }
             index = src.index;
             textData = src.textData;
@@ -155,12 +161,16 @@ public:
         TextMark(RawPtr<TextData> textData, long index) {
             this->index = index;
             this->textData = textData;
-            textData->getTextMarkData(index)->inUseCounter += 1;
+            textData->retainMark(index);
         }
         
         RawPtr<TextData> textData;
     };
     
+private:
+    class MarkBlock;
+
+public:
     class TextMarkData
     {
     private:
@@ -168,10 +178,11 @@ public:
         friend class TextMark;
         
         int inUseCounter;
-        long pos;
-        long line;
+        long pos;           // pos and line are relative to the base of
+        long line;          // the block containing the mark
         long byteColumn;
         long wcharColumn;
+        MarkBlock* block;   // block in markBlocks containing the mark or NULL
     };
     
     static Ptr create() {
@@ -183,24 +194,103 @@ public:
     void setEncoding(const String& encodingName) {
         this->fileContentEncoding = encodingName;
     }
+    String getEncoding() const {
+        return fileContentEncoding;
+    }
 
     void takeOverFileBuffer(const String& filename, 
                             const String& encoding,
                             RawPtr<ByteBuffer> buffer);
 
+    /**
+     * The mapped file content is referred to until it is modified,
+     * unmodified parts of the text remain in the page cache.
+     */
+    void takeOverMappedFile(const String& filename, 
+                            const String& encoding,
+                            MappedMemory::Ptr memory);
+
+    static bool isFileMappingPreferredForLength(long length);
+
+    static bool isProgressiveLoadingPreferredForLength(long length);
+
+    /**
+     * Prepares the empty text for being filled by appendLoadedData(),
+     * e.g. by a FileLoader. The text is read-only until finishLoading()
+     * is called.
+     */
+    void beginLoading(const String& filename, 
+                      const String& encoding,
+                      long          expectedLength);
+
+    void appendLoadedData(const byte* data, long length);
+
+    void finishLoading();
+
+    bool isLoading() const {
+        return loadingFlag;
+    }
+
     void takeOverBuffer(const String& encoding,
                         RawPtr<ByteBuffer> bufferPtr);
 
     void takeOverUtf8Buffer(RawPtr<ByteBuffer> bufferPtr);
-                        
-    RawPtr<const ByteBuffer> getByteBuffer() const {
-        return &buffer;
-    }                            
+
+    TextStorage::Backend getStorageBackend() const {
+        return buffer.getBackend();
+    }
+    void setStorageBackend(TextStorage::Backend backend) {
+        buffer.setBackend(backend);
+    }
+
     void reloadFile();
     void setRealFileName(const String& filename);
     void setPseudoFileName(const String& filename);
     void save();
 
+    /**
+     * Opens the file for save() or for saving a snapshot outside of
+     * the main thread.
+     */
+    File::Writer::Ptr openFileForSaving();
+
+    /**
+     * Starts saving the snapshot that is returned. After the snapshot has been 
+     * written, e.g. by a FileSaver, finishSaving() must be invoked. Edits 
+     * made meanwhile keep the text modified.
+     */
+    TextSnapshot::Ptr beginSaving();
+
+    void finishSaving(bool wasWritten);
+
+    bool isSaving() const {
+        return savingFlag;
+    }
+
+    /**
+     * The version is incremented by every modification of the text.
+     */
+    long getVersion() const {
+        return version;
+    }
+
+    /**
+     * Returns a read-only view of the current content that is tagged with
+     * the current version. While the snapshot exists, the modifications 
+     * made after its creation are recorded, so that its positions can be
+     * mapped by getCurrentPosForSnapshotPos().
+     */
+    TextSnapshot::Ptr createSnapshot();
+
+    /**
+     * Maps a position of a snapshot of this text to the corresponding 
+     * position in the current text in the same way as the positions of
+     * marks are adjusted: positions within removed text are mapped to
+     * the begin of the removal, positions at an insertion point stay in
+     * front of the inserted text.
+     */
+    long getCurrentPosForSnapshotPos(RawPtr<const TextSnapshot> snapshot, long snapshotPos) const;
+
     long getLength() const {
         return buffer.getLength();
     }
@@ -211,24 +301,68 @@ public:
 
     TextMark createNewMark();
     TextMark createNewMark(MarkHandle src);
-    TextMarkData* getTextMarkData(long index) {
-        return &(marks[index]);
+    void retainMark(long index) {
+        marks[index].inUseCounter += 1;
+    }
+    void releaseMark(long index) {
+        TextMarkData& mark = marks[index];
+        mark.inUseCounter -= 1;
+        if (mark.inUseCounter == 0) {
+            freeMark(index);
+        }
     }
 
-    byte* getAmount(long pos, long amount) {
+    /**
+     * The returned pointer is valid until the next modification or
+     * until the next call of getAmount().
+     */
+    const byte* getAmount(long pos, long amount) const {
         return buffer.getAmount(pos, amount);
     }
-    String getSubstring(Pos pos, Len amount) {
-        return String((const char*) getAmount(pos, amount), amount);
-    }
-    String getSubstring(Pos pos1, Pos pos2) {
-        long amount = pos2 - pos1;
-        return String((const char*) getAmount(pos1, amount), amount);
-    }
-    String getSubstring(const MarkHandle& beginMark, const MarkHandle& endMark) {
+    /**
+     * Returns the number of bytes that can be read contiguously at pos,
+     * but not more than maxAmount. Reading a range segment by segment
+     * never changes the layout of the buffer, so it does not slow down
+     * the next modification as getAmount() may do.
+     */
+    long getContiguousAmount(long pos, long maxAmount, const byte** rslt) const {
+        return buffer.getContiguousAmount(pos, maxAmount, rslt);
+    }
+    void copyTo(byte* dest, long pos, long amount) const {
+        buffer.copyTo(dest, pos, amount);
+    }
+    /**
+     * Same as getAmount(), but the buffer layout is not changed:
+     * if the range is not stored contiguously, it is copied into
+     * scratchBuffer.
+     */
+    const byte* getAmount(long pos, long amount, RawPtr<ByteArray> scratchBuffer) const {
+        const byte* rslt;
+        if (getContiguousAmount(pos, amount, &rslt) < amount) {
+            scratchBuffer->clear();
+            copyTo(scratchBuffer->appendAmount(amount), pos, amount);
+            rslt = scratchBuffer->getPtr();
+        }
+        return rslt;
+    }
+    String getSubstring(Pos pos, Len amount) const {
+        String rslt;
+        for (long p = pos, n = amount; n > 0;) {
+            const byte* ptr;
+            long len = getContiguousAmount(p, n, &ptr);
+            rslt.append(ptr, len);
+            p += len;
+            n -= len;
+        }
+        return rslt;
+    }
+    String getSubstring(Pos pos1, Pos pos2) const {
+        return getSubstring(pos1, Len(pos2 - pos1));
+    }
+    String getSubstring(const MarkHandle& beginMark, const MarkHandle& endMark) const {
         long amount = getTextPositionOfMark(endMark) - getTextPositionOfMark(beginMark);
         ASSERT(0 <= amount);
-        return String((const char*) getAmount(getTextPositionOfMark(beginMark), amount), amount);
+        return getSubstring(Pos(getTextPositionOfMark(beginMark)), Len(amount));
     }
     String getHead(int length) {
         return getSubstring(Pos(0), Len(length));
@@ -244,14 +378,14 @@ public:
 
     void setToData(const char* buffer, int length, const String& encoding = "");
 
-    const byte& operator[](long pos) const {
+    byte operator[](long pos) const {
         return buffer[pos];
     }
     byte getByte(long pos) const {
         return buffer[pos];
     }
     byte getByte(MarkHandle m) const {
-        return buffer[marks[m.index].pos];
+        return buffer[getMarkPos(marks[m.index])];
     }
     
     int getWCharAndIncrementPos(long* pos) const
@@ -262,7 +396,7 @@ public:
         return utf8Parser.getWChar(pos);
     }
     int getWChar(MarkHandle m) const {
-        long pos = marks[m.index].pos;
+        long pos = getMarkPos(marks[m.index]);
         return getWChar(pos);
     }
     bool hasWCharAtPos(int wchar, long pos) const {
@@ -319,9 +453,7 @@ public:
         return pos == 0 ? 0 : 1;
     }
     long getLengthToEndOfLine(long pos) const {
-        long epos = pos;
-        for (; epos < buffer.getLength() && buffer[epos] != '\n'; ++epos);
-        return epos - pos;
+        return getThisLineEnding(pos) - pos;
     }
     long getNextLineBegin(long pos) const {
         pos += getLengthToEndOfLine(pos);
@@ -338,8 +470,15 @@ public:
         return pos;
     }
     long getThisLineEnding(long pos) const {
-        while (!isEndOfLine(pos)) {
-            pos += 1;
+        const long len = buffer.getLength();
+        while (pos < len) {
+            const byte* ptr;
+            long        n  = buffer.getContiguousAmount(pos, len - pos, &ptr);
+            const void* nl = memchr(ptr, '\n', n);
+            if (nl != NULL) {
+                return pos + ((const byte*) nl - ptr);
+            }
+            pos += n;
         }
         return pos;
     }
@@ -354,9 +493,12 @@ public:
     }
 
 private:
+    void internalInsertAtPos(long pos, long lineNumber, const byte* buffer, long length);
     long internalInsertAtMark(MarkHandle m, const byte* buffer, long length);
+    void internalRemoveAtPos(long pos, long lineNumber, long amount);
     void internalRemoveAtMark(MarkHandle m, long amount);
     void recalculateChangeMarker(long b2, long o2, long a2);
+    void recordChange(long beginPos, long oldEndPos, long changedAmount);
 
 public:
     long insertAtMark(MarkHandle m, const byte* buffer, long length);
@@ -394,22 +536,30 @@ public:
 
 private:
     void fillInColumns(long pos, long* byteColumn, long* wcharColumn) {
-        long p = pos;
-        long w = 0;
-        while (!isBeginOfLine(p)) {
-            p = getPrevBeginOfWChar(p);
-            ++w;
-        }
-        *wcharColumn = w;
+        long p = getThisLineBegin(pos);
+        *wcharColumn = wcharColumnCache.getWCharColumn(p, getBeginOfWChar(pos));
         *byteColumn  = pos - p;
     }
     void fillInColumns(TextMarkData& mark) {
-        fillInColumns(mark.pos, &mark.byteColumn, 
-                                &mark.wcharColumn);
+        fillInColumns(getMarkPos(mark), &mark.byteColumn, 
+                                        &mark.wcharColumn);
+    }
+    /**
+     * Within the same line the wchar column is computed when needed.
+     */
+    void fillInColumnsAfterMove(TextMarkData& mark, long oldPos, long oldLine) {
+        if (mark.line == oldLine) {
+            mark.byteColumn += mark.pos - oldPos;
+            mark.wcharColumn = -1;
+        } else {
+            fillInColumns(mark);
+        }
     }
     long getWCharColumn(TextMarkData& mark) {
         if (mark.wcharColumn == -1) {
-            fillInColumns(mark);
+            // byteColumn is always valid
+            long pos = getMarkPos(mark);
+            mark.wcharColumn = wcharColumnCache.getWCharColumn(pos - mark.byteColumn, getBeginOfWChar(pos));
         }
         return mark.wcharColumn;
     }
@@ -419,7 +569,7 @@ public:
     }
     
     void moveMarkForwardToPos(MarkHandle m, long pos) {
-        TextMarkData& mark = marks[m.index];
+        TextMarkData& mark = detachMark(m);
         ASSERT(mark.pos <= pos);
         long markPos  = mark.pos;
         long markLine = mark.line;
@@ -431,19 +581,21 @@ public:
                 markPos += 1;
             }
         }
-        mark.pos        = markPos;
-        mark.line       = markLine;
-        mark.byteColumn = pos - getThisLineBegin(pos);
+        mark.pos         = markPos;
+        mark.line        = markLine;
+        mark.byteColumn  = pos - getThisLineBegin(pos);
+        mark.wcharColumn = -1;
+        attachMark(m);
     }
     
     void incMark(MarkHandle m) {
-        moveMarkToPos(m, marks[m.index].pos + 1);
+        moveMarkToPos(m, getMarkPos(marks[m.index]) + 1);
     }
     bool isEndOfText(MarkHandle m) {
-        return marks[m.index].pos == buffer.getLength();
+        return getMarkPos(marks[m.index]) == buffer.getLength();
     }
     bool isEndOfLine(MarkHandle m) {
-        return isEndOfLine(marks[m.index].pos);
+        return isEndOfLine(getMarkPos(marks[m.index]));
     }
     void setInsertFilterCallback(Callback<const byte**, long*>::Ptr filterCallback);
     void registerUpdateListener(Callback<UpdateInfo>::Ptr updateCallback);
@@ -451,18 +603,27 @@ public:
     void registerReadOnlyListener(Callback<bool>::Ptr readOnlyCallback);
     void registerLengthListener(Callback<long>::Ptr lengthCallback);
     void registerModifiedFlagListener(Callback<bool>::Ptr modifiedFlagCallback);
+
+    /**
+     * The callback gets the loaded percentage while the text is
+     * being loaded and -1 after loading has finished.
+     */
+    void registerLoadingProgressListener(Callback<int>::Ptr loadingProgressCallback);
     
     void flushPendingUpdatesIntern();
     void flushPendingUpdates() {
-        if (changedAmount != 0 || oldEndChangedPos != 0) {
+        if (hasPendingUpdates()) {
             flushPendingUpdatesIntern();
         }
     }
+    bool hasPendingUpdates() const {
+        return changedAmount != 0 || oldEndChangedPos != 0;
+    }
     
     long getBeginChangedPos() {return beginChangedPos;}
     long getChangedAmount()   {return changedAmount;}
     long getTextPositionOfMark(MarkHandle mark) const {
-        return marks[mark.index].pos;
+        return getMarkPos(marks[mark.index]);
     }
     long getByteColumnNumberOfMark(MarkHandle mark) const {
         return marks[mark.index].byteColumn;
@@ -471,7 +632,7 @@ public:
         return marks[mark.index].byteColumn;
     }
     long getLineNumberOfMark(MarkHandle mark) const {
-        return marks[mark.index].line;
+        return getMarkLine(marks[mark.index]);
     }
     
     String getFileName() const {
@@ -493,6 +654,13 @@ public:
     
     void clearHistory();
     
+    long getHistoryMemoryUsage() const {
+        return hasHistory() ? history->getMemoryUsage() : 0;
+    }
+    long getHistorySpilledLength() const {
+        return hasHistory() ? history->getSpilledLength() : 0;
+    }
+    
     void activateHistory() {
         if (!hasHistory()) {
           history = EditingHistory::create();
@@ -560,6 +728,43 @@ public:
         }
     }
     
+    /**
+     * While a CompoundChange object exists, all modifications within
+     * its region are remembered in the history as one replace action,
+     * so that bulk operations are undone by one splice. Modifications
+     * outside the region end the compound change.
+     */
+    class CompoundChange : public HeapObject
+    {
+    public:
+        typedef OwningPtr<CompoundChange> Ptr;
+        
+        ~CompoundChange() {
+            if (textData.isValid()) {
+                textData->endCompoundChange();
+            }
+        }
+        
+    private:
+        friend class TextData;
+        
+        static Ptr create(TextData* textData) {
+            return Ptr(new CompoundChange(textData));
+        }
+        
+        CompoundChange(TextData* textData)
+            : textData(textData)
+        {}
+        
+        WeakPtr<TextData> textData;
+    };
+    
+    /**
+     * Returns an invalid pointer if there is no history or if a 
+     * compound change is already active.
+     */
+    CompoundChange::Ptr createCompoundChange(long spos, long epos);
+    
     HistorySection::Ptr getHistorySectionHolder() {
         if (hasHistory()) {
             return HistorySection::create(this, 
@@ -602,23 +807,136 @@ public:
     
     void checkFileInfo();
     
+    /**
+     * Throws a FileException if the mapped file was truncated by another
+     * process and text behind the new end of the file was lost. The text
+     * then becomes a pseudo file, so that it is not saved over the file.
+     */
+    void checkMappedFile();
+
+    /**
+     * Appends the bytes that were appended to the file since it was
+     * last loaded, saved or followed. This is only possible if the text
+     * is unmodified, if the file is the same inode and if the end of the
+     * text is still found in the file.
+     *
+     * Returns false if the file was changed in another way. At most
+     * FOLLOW_BATCH_LENGTH bytes are appended per call, the remaining 
+     * bytes are appended by the next call.
+     */
+    bool appendFileGrowth();
+    
 private:
+    enum { FOLLOW_BATCH_LENGTH = 16 * 1024 * 1024,
+           FOLLOW_TAIL_LENGTH  = 4096 };
 
     friend class ViewCounterTextDataAccess;
 
     TextData();
 
     void internalTakeOverBuffer(RawPtr<ByteBuffer> bufferPtr);
+    void internalTakeOverMappedMemory(MappedMemory::Ptr memory);
+    void afterInternalTakeOver(long oldLength);
+    void setFileAfterLoading(const String& filename);
+    void applyDifferencesTo(const ByteBuffer& newBuffer);
+    void replaceByReloadedBuffer(RawPtr<ByteBuffer> newBuffer);
     void setToSavedState();
+    static TextStorage::Backend getStorageBackendForLength(long length);
     
-    ByteBuffer             buffer;
-    Utf8Parser<ByteBuffer> utf8Parser;
+    bool isInCompoundChange(long pos, long amount) const {
+        return isCompoundChangeActive
+            && compoundBeginPos <= pos
+            && pos + amount <= compoundBeginPos + compoundOldData.getLength() + compoundChangedAmount;
+    }
+    void rememberCompoundInsert(long pos, long length);
+    void rememberCompoundRemove(long pos, long amount);
+    void endCompoundChange();
+    
+    TextStorage             buffer;
+    Utf8Parser<TextStorage> utf8Parser;
+    LineIndex               lineIndex;
+    WCharColumnCache        wcharColumnCache;
     
     long numberLines;
     long beginChangedPos;
     long changedAmount;
     long oldEndChangedPos;
     ObjectArray<TextMarkData> marks;
+    MemArray<long>            freeMarks;
+
+    // Marks with pos > 0 are kept ordered by position in markBlocks.
+    // Position and line of a mark are relative to the base of its block.
+    // The blocks before markBlockSplitIndex contain the marks with 
+    // positions <= markSplitPos, the blocks after it have a base relative
+    // to the end of the text, so that they are shifted implicitly by
+    // modifications at markSplitPos. Moving the split point only has
+    // to touch the blocks in between, not every single mark.
+
+    class MarkBlock : public HeapObject
+    {
+    public:
+        typedef OwningPtr<MarkBlock> Ptr;
+
+        static Ptr create() {
+            return Ptr(new MarkBlock());
+        }
+        long pos;
+        long line;
+        bool isEndRelative; // pos and line are relative to the end of the text
+        MemArray<long> markIndices;
+
+    private:
+        MarkBlock()
+            : pos(0),
+              line(0),
+              isEndRelative(false)
+        {}
+    };
+
+    ObjectArray<MarkBlock::Ptr> markBlocks;
+    long                        markBlockSplitIndex;
+    long                        markSplitPos;
+
+    long getBlockPos(const MarkBlock* block) const {
+        return block->isEndRelative ? block->pos + buffer.getLength() : block->pos;
+    }
+    long getBlockLine(const MarkBlock* block) const {
+        return block->isEndRelative ? block->line + numberLines : block->line;
+    }
+    long getMarkPos(const TextMarkData& mark) const {
+        return mark.block != NULL ? mark.pos + getBlockPos(mark.block) : mark.pos;
+    }
+    long getMarkLine(const TextMarkData& mark) const {
+        return mark.block != NULL ? mark.line + getBlockLine(mark.block) : mark.line;
+    }
+    long getFirstMarkPos(const MarkBlock* block) const {
+        return getMarkPos(marks[block->markIndices[0]]);
+    }
+    long getLastMarkPos(const MarkBlock* block) const {
+        return getMarkPos(marks[block->markIndices.getLast()]);
+    }
+    void setBlockEndRelative(MarkBlock* block, bool endRelativeFlag) {
+        if (block->isEndRelative != endRelativeFlag) {
+            long length = buffer.getLength();
+            if (endRelativeFlag) {
+                block->pos  -= length;
+                block->line -= numberLines;
+            } else {
+                block->pos  += length;
+                block->line += numberLines;
+            }
+            block->isEndRelative = endRelativeFlag;
+        }
+    }
+    long getMarkBlockIndexForPos(long pos, long beginIndex, long endIndex) const;
+    long getIndexInMarkBlockForPos(const MarkBlock* block, long pos) const;
+    void splitMarkBlock(long blockIndex, long splitIndex);
+    void mergeMarkBlocksIfSmall(long blockIndex);
+    void removeMarkBlock(long blockIndex);
+    TextMarkData& detachMark(MarkHandle m);
+    void attachMark(MarkHandle m);
+    void freeMark(long index);
+    void moveMarkSplitTo(long pos);
 
     void updateMarks(
         long beginChangedPos, long oldEndChangedPos, long changedAmount,
@@ -629,6 +947,7 @@ private:
     CallbackContainer<bool> readOnlyListeners;
     CallbackContainer<long> lengthListeners;
     CallbackContainer<bool> changedModifiedFlagListeners;
+    CallbackContainer<int> loadingProgressListeners;
     
     Callback<const byte**, long*>::Ptr filterCallback;
     
@@ -639,14 +958,44 @@ private:
     int viewCounter;
     bool hasHistoryFlag;
     EditingHistory::Ptr history;
+    
+    bool       isCompoundChangeActive;
+    long       compoundBeginPos;
+    long       compoundChangedAmount;
+    long       compoundFirstChangedPos;   // changed area in current positions
+    long       compoundLastChangedPos;    // or -1 if nothing was changed
+    ByteBuffer compoundOldData;
     bool isReadOnlyFlag;
     bool modifiedOnDiskFlag;
     bool ignoreModifiedOnDiskFlag;
     Nullable<TimeStamp> ignoreModifiedOnDiskTime;
     File::Info fileInfo;
+    File::Info mappedFileInfo;
+    File::Info syncedFileInfo;
     
     bool fileNamePseudoFlag;
     
+    bool loadingFlag;
+    long expectedLoadingLength;
+    int  loadingProgress;
+    
+    long   version;
+
+    struct ChangeRecord
+    {
+        long beginPos;
+        long oldEndPos;
+        long changedAmount;
+    };
+    ObjectArray< WeakPtr<TextSnapshot> > snapshots;
+    MemArray<ChangeRecord>               changeRecords;
+    long                                 firstRecordedVersion;
+
+    bool   savingFlag;
+    long   savingVersion;
+    long   savingActionIndex;
+    String savingFileName;
+    
     String fileContentEncoding;
 };
 
@@ -0,0 +1,374 @@
+/////////////////////////////////////////////////////////////////////////////////////
+//
+//   LucED - The Lucid Editor
+//
+//   Copyright (C) 2005-2010 Oliver Schmidt, oliver at luced dot de
+//
+//   This program is free software; you can redistribute it and/or modify it
+//   under the terms of the GNU General Public License Version 2 as published
+//   by the Free Software Foundation in June 1991.
+//
+//   This program is distributed in the hope that it will be useful, but WITHOUT
+//   ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+//   FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+//   more details.
+//
+//   You should have received a copy of the GNU General Public License along with
+//   this program; if not, write to the Free Software Foundation, Inc.,
+//   51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+//
+/////////////////////////////////////////////////////////////////////////////////////
+
+#include <string.h>
+
+#include "util.hpp"
+#include "TextDiff.hpp"
+
+using namespace LucED;
+
+
+namespace // anonymous namespace
+{
+
+enum { COMPARE_BLOCK_LENGTH = 4096 };
+
+inline bool isLineBegin(const byte* text, long pos, long minPos)
+{
+    return pos <= minPos || text[pos - 1] == '\n';
+}
+
+inline bool isLineBegin(const TextStorage& text, long pos, long minPos)
+{
+    return pos <= minPos || text[pos - 1] == '\n';
+}
+
+} // anonymous namespace
+
+
+TextDiff::TextDiff(const TextStorage& oldText, const byte* newText, long newLength)
+    : oldText(oldText),
+      newText(newText),
+      newLength(newLength)
+{
+    const long oldLength = oldText.getLength();
+    const long minLength = util::minimum(oldLength, newLength);
+    
+    // skip common lines at the begin
+
+    long prefix = 0;
+    
+    while (prefix < minLength)
+    {
+        const byte* ptr;
+        long        n = oldText.getContiguousAmount(prefix, minLength - prefix, &ptr);
+
+        if (memcmp(ptr, newText + prefix, n) == 0) {
+            prefix += n;
+        } else {
+            long i = 0;
+            while (ptr[i] == newText[prefix + i]) {
+                ++i;
+            }
+            prefix += i;
+            break;
+        }
+    }
+    if (prefix == oldLength && prefix == newLength) {
+        return;
+    }
+    while (prefix > 0 && newText[prefix - 1] != '\n') {
+        --prefix;
+    }
+
+    // skip common lines at the end
+
+    long suffix    = 0;
+    long maxSuffix = minLength - prefix;
+    
+    while (suffix < maxSuffix)
+    {
+        byte        block[COMPARE_BLOCK_LENGTH];
+        long        n   = util::minimum((long) COMPARE_BLOCK_LENGTH, maxSuffix - suffix);
+        const byte* ptr = newText + newLength - suffix - n;
+
+        oldText.copyTo(block, oldLength - suffix - n, n);
+
+        if (memcmp(block, ptr, n) == 0) {
+            suffix += n;
+        } else {
+            long i = n;
+            while (block[i - 1] == ptr[i - 1]) {
+                --i;
+            }
+            suffix += n - i;
+            break;
+        }
+    }
+    while (suffix > 0 && !(   isLineBegin(newText, newLength - suffix, prefix)
+                           && isLineBegin(oldText, oldLength - suffix, prefix)))
+    {
+        --suffix;
+    }
+
+    // compare the remaining lines
+
+    splitOldLines(prefix, oldLength - suffix);
+    splitNewLines(prefix, newLength - suffix);
+
+    if (compareLines() && areUnchangedLinesEqual())
+    {
+        for (long i = 0; i < lineHunks.getLength(); ++i)
+        {
+            const Hunk& h = lineHunks[i];
+
+            long oldBegin = (h.oldBegin < oldLines.getLength()) ? oldLines[h.oldBegin].begin : oldLength - suffix;
+            long newBegin = (h.newBegin < newLines.getLength()) ? newLines[h.newBegin].begin : newLength - suffix;
+            long oldEnd   = (h.oldEnd   < oldLines.getLength()) ? oldLines[h.oldEnd  ].begin : oldLength - suffix;
+            long newEnd   = (h.newEnd   < newLines.getLength()) ? newLines[h.newEnd  ].begin : newLength - suffix;
+
+            appendHunk(oldBegin, oldEnd, newBegin, newEnd);
+        }
+    }
+    else
+    {
+        appendHunk(prefix, oldLength - suffix, prefix, newLength - suffix);
+    }
+}
+
+
+void TextDiff::scanSegment(const byte* ptr, long pos, long length, Line* line, MemArray<Line>* lines)
+{
+    unsigned long hash = line->hash;
+
+    for (long i = 0; i < length; ++i)
+    {
+        hash = ((hash << 5) + hash) + ptr[i];
+
+        if (ptr[i] == '\n') {
+            line->length = pos + i + 1 - line->begin;
+            line->hash   = hash;
+            lines->append(*line);
+            line->begin  = pos + i + 1;
+            hash         = INITIAL_HASH;
+        }
+    }
+    line->hash = hash;
+}
+
+
+void TextDiff::splitOldLines(long begin, long end)
+{
+    Line line;
+         line.begin = begin;
+         line.hash  = INITIAL_HASH;
+    
+    for (long pos = begin; pos < end;)
+    {
+        const byte* ptr;
+        long        n = oldText.getContiguousAmount(pos, end - pos, &ptr);
+
+        scanSegment(ptr, pos, n, &line, &oldLines);
+        pos += n;
+    }
+    if (line.begin < end) {
+        line.length = end - line.begin;
+        oldLines.append(line);
+    }
+}
+
+
+void TextDiff::splitNewLines(long begin, long end)
+{
+    Line line;
+         line.begin = begin;
+         line.hash  = INITIAL_HASH;
+
+    scanSegment(newText + begin, begin, end - begin, &line, &newLines);
+    
+    if (line.begin < end) {
+        line.length = end - line.begin;
+        newLines.append(line);
+    }
+}
+
+
+/**
+ * Myers' algorithm: the furthest reaching path for each diagonal k = x - y
+ * is extended with d differences until the end of both texts is reached.
+ * The row of furthest reaching x values after each step is kept for
+ * tracing the edit script back.
+ *
+ * Each step may compare all lines again, so the comparison is also given
+ * up if the diagonals and line comparisons of all steps together exceed
+ * MAX_COMPARE_STEPS.
+ */
+bool TextDiff::compareLines()
+{
+    const long n      = oldLines.getLength();
+    const long m      = newLines.getLength();
+    const long maxD   = util::minimum(n + m, (long) MAX_EDIT_SCRIPT_LENGTH);
+    const long offset = maxD + 1;
+    
+    MemArray<long> v(2 * maxD + 3);
+    MemArray<long> trace;           // row d begins at index d * d
+    long           compareSteps = 0;
+    
+    v[offset + 1] = 0;
+
+    for (long d = 0; d <= maxD; ++d)
+    {
+        for (long k = -d; k <= d; k += 2)
+        {
+            long x;
+            if (k == -d || (k != d && v[offset + k - 1] < v[offset + k + 1])) {
+                x = v[offset + k + 1];
+            } else {
+                x = v[offset + k - 1] + 1;
+            }
+            long y  = x - k;
+            long x0 = x;
+
+            while (x < n && y < m && oldLines[x] == newLines[y]) {
+                ++x;
+                ++y;
+            }
+            v[offset + k] = x;
+
+            compareSteps += 1 + (x - x0);
+
+            if (x >= n && y >= m)
+            {
+                // trace back from (n, m)
+
+                for (; d > 0; --d)
+                {
+                    const long* prev = trace.getPtr((d - 1) * (d - 1) + d - 1); // prev[k] for -(d-1) <= k <= d-1
+
+                    long diagonal = x - y;
+                    long prevK;
+                    
+                    if (diagonal == -d || (diagonal != d && prev[diagonal - 1] < prev[diagonal + 1])) {
+                        prevK = diagonal + 1;
+                    } else {
+                        prevK = diagonal - 1;
+                    }
+                    long prevX = prev[prevK];
+                    long prevY = prevX - prevK;
+                    
+                    Hunk h;
+                    if (prevK == diagonal + 1) {
+                        h.oldBegin = prevX; h.oldEnd = prevX;
+                        h.newBegin = prevY; h.newEnd = prevY + 1;
+                    } else {
+                        h.oldBegin = prevX; h.oldEnd = prevX + 1;
+                        h.newBegin = prevY; h.newEnd = prevY;
+                    }
+                    if (   lineHunks.getLength() > 0 
+                        && lineHunks.getLast().oldBegin == h.oldEnd
+                        && lineHunks.getLast().newBegin == h.newEnd)
+                    {
+                        lineHunks.getLast().oldBegin = h.oldBegin;
+                        lineHunks.getLast().newBegin = h.newBegin;
+                    }
+                    else {
+                        lineHunks.append(h);
+                    }
+                    x = prevX;
+                    y = prevY;
+                }
+                for (long i = 0, j = lineHunks.getLength() - 1; i < j; ++i, --j) {
+                    Hunk h = lineHunks[i];
+                    lineHunks[i] = lineHunks[j];
+                    lineHunks[j] = h;
+                }
+                return true;
+            }
+            if (compareSteps > MAX_COMPARE_STEPS) {
+                return false;
+            }
+        }
+        trace.append(v.getPtr(offset - d), 2 * d + 1);
+    }
+    return false;
+}
+
+
+/**
+ * Lines are compared by their hash values, so the lines outside of the 
+ * hunks have to be verified.
+ */
+bool TextDiff::areUnchangedLinesEqual() const
+{
+    long x = 0;
+    long y = 0;
+
+    for (long i = 0; i <= lineHunks.getLength(); ++i)
+    {
+        long xEnd = (i < lineHunks.getLength()) ? lineHunks[i].oldBegin : oldLines.getLength();
+        
+        for (; x < xEnd; ++x, ++y)
+        {
+            const Line& oldLine = oldLines[x];
+            const byte* newPtr  = newText + newLines[y].begin;
+
+            for (long pos = oldLine.begin, end = oldLine.begin + oldLine.length; pos < end;)
+            {
+                const byte* ptr;
+                long        n = oldText.getContiguousAmount(pos, end - pos, &ptr);
+
+                if (memcmp(ptr, newPtr, n) != 0) {
+                    return false;
+                }
+                pos    += n;
+                newPtr += n;
+            }
+        }
+        if (i < lineHunks.getLength()) {
+            x = lineHunks[i].oldEnd;
+            y = lineHunks[i].newEnd;
+        }
+    }
+    return true;
+}
+
+
+void TextDiff::appendHunk(long oldBegin, long oldEnd, long newBegin, long newEnd)
+{
+    long p = 0;
+
+    while (   oldBegin + p < oldEnd && newBegin + p < newEnd 
+           && oldText[oldBegin + p] == newText[newBegin + p])
+    {
+        ++p;
+    }
+    while (p > 0 && (   (oldBegin + p < oldEnd && isUtf8FollowerByte(oldText[oldBegin + p]))
+                     || (newBegin + p < newEnd && isUtf8FollowerByte(newText[newBegin + p]))))
+    {
+        --p;
+    }
+    oldBegin += p;
+    newBegin += p;
+    
+    long s = 0;
+
+    while (   oldEnd - s > oldBegin && newEnd - s > newBegin
+           && oldText[oldEnd - s - 1] == newText[newEnd - s - 1])
+    {
+        ++s;
+    }
+    while (s > 0 && isUtf8FollowerByte(newText[newEnd - s])) {
+        --s;
+    }
+    oldEnd -= s;
+    newEnd -= s;
+    
+    if (oldBegin < oldEnd || newBegin < newEnd)
+    {
+        Hunk h;
+             h.oldBegin = oldBegin;
+             h.oldEnd   = oldEnd;
+             h.newBegin = newBegin;
+             h.newEnd   = newEnd;
+        hunks.append(h);
+    }
+}
@@ -0,0 +1,106 @@
+/////////////////////////////////////////////////////////////////////////////////////
+//
+//   LucED - The Lucid Editor
+//
+//   Copyright (C) 2005-2010 Oliver Schmidt, oliver at luced dot de
+//
+//   This program is free software; you can redistribute it and/or modify it
+//   under the terms of the GNU General Public License Version 2 as published
+//   by the Free Software Foundation in June 1991.
+//
+//   This program is distributed in the hope that it will be useful, but WITHOUT
+//   ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+//   FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+//   more details.
+//
+//   You should have received a copy of the GNU General Public License along with
+//   this program; if not, write to the Free Software Foundation, Inc.,
+//   51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+//
+/////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef TEXT_DIFF_HPP
+#define TEXT_DIFF_HPP
+
+#include "debug.hpp"
+#include "types.hpp"
+#include "NonCopyable.hpp"
+#include "MemArray.hpp"
+#include "TextStorage.hpp"
+
+namespace LucED
+{
+
+/**
+ * Computes the regions in which an old text differs from a new text.
+ *
+ * Common lines at the begin and at the end are skipped bytewise, the
+ * remaining lines are compared by their hash values with the algorithm
+ * of Myers. If the lines differ too much or the comparison takes too
+ * many steps, the remaining region is taken as one hunk. Each hunk is
+ * narrowed down to the differing bytes without splitting UTF-8 sequences.
+ */
+class TextDiff : private NonCopyable
+{
+public:
+    struct Hunk
+    {
+        long oldBegin;
+        long oldEnd;
+        long newBegin;
+        long newEnd;
+    };
+
+    TextDiff(const TextStorage& oldText, const byte* newText, long newLength);
+
+    /**
+     * Hunks are sorted by position and do not overlap.
+     */
+    long getNumberOfHunks() const {
+        return hunks.getLength();
+    }
+    const Hunk& getHunk(long i) const {
+        return hunks[i];
+    }
+
+private:
+    enum { MAX_EDIT_SCRIPT_LENGTH = 1000,
+           MAX_COMPARE_STEPS      = 20 * 1000 * 1000,
+           INITIAL_HASH           = 5381 };
+
+    struct Line
+    {
+        long          begin;
+        long          length;
+        unsigned long hash;
+
+        bool operator==(const Line& rhs) const {
+            return hash == rhs.hash && length == rhs.length;
+        }
+    };
+
+    static bool isUtf8FollowerByte(byte b) {
+        return (b & 0xC0) == 0x80;
+    }
+
+    static void scanSegment(const byte* ptr, long pos, long length, Line* line, MemArray<Line>* lines);
+
+    void splitOldLines(long begin, long end);
+    void splitNewLines(long begin, long end);
+    bool compareLines();
+    bool areUnchangedLinesEqual() const;
+    void appendHunk(long oldBegin, long oldEnd, long newBegin, long newEnd);
+
+    const TextStorage& oldText;
+    const byte*        newText;
+    long               newLength;
+
+    MemArray<Line>     oldLines;
+    MemArray<Line>     newLines;
+    MemArray<Hunk>     lineHunks;
+    MemArray<Hunk>     hunks;
+};
+
+} // namespace LucED
+
+#endif // TEXT_DIFF_HPP
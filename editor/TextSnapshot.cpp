@@ -0,0 +1,129 @@
+/////////////////////////////////////////////////////////////////////////////////////
+//
+//   LucED - The Lucid Editor
+//
+//   Copyright (C) 2005-2010 Oliver Schmidt, oliver at luced dot de
+//
+//   This program is free software; you can redistribute it and/or modify it
+//   under the terms of the GNU General Public License Version 2 as published
+//   by the Free Software Foundation in June 1991.
+//
+//   This program is distributed in the hope that it will be useful, but WITHOUT
+//   ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+//   FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+//   more details.
+//
+//   You should have received a copy of the GNU General Public License along with
+//   this program; if not, write to the Free Software Foundation, Inc.,
+//   51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+//
+/////////////////////////////////////////////////////////////////////////////////////
+
+#include <sys/uio.h>
+#include <string.h>
+
+#include "util.hpp"
+#include "TextSnapshot.hpp"
+#include "EncodingConverter.hpp"
+
+using namespace LucED;
+
+
+TextSnapshot::~TextSnapshot()
+{
+    for (long i = 0; i < sharedBlocks.getLength(); ++i) {
+        ChunkedByteBuffer::releaseBlock(sharedBlocks[i]);
+    }
+}
+
+
+void TextSnapshot::appendSegment(const byte* data, long length)
+{
+    if (length > 0) {
+        this->length += length;
+        segmentData.append(data);
+        segmentEnds.append(this->length);
+    }
+}
+
+
+long TextSnapshot::getSegmentIndexForPos(long pos) const
+{
+    ASSERT(0 <= pos && pos < length);
+
+    long i = 0;
+    long j = segmentEnds.getLength() - 1;
+
+    while (i < j)
+    {
+        long m = (i + j) / 2;
+        if (segmentEnds[m] <= pos) {
+            i = m + 1;
+        } else {
+            j = m;
+        }
+    }
+    return i;
+}
+
+
+long TextSnapshot::getContiguousAmount(long pos, long maxAmount, const byte** rslt) const
+{
+    ASSERT(0 <= pos && 0 <= maxAmount && pos + maxAmount <= length);
+
+    if (maxAmount == 0) {
+        *rslt = NULL;
+        return 0;
+    }
+    long i = getSegmentIndexForPos(pos);
+
+    *rslt = segmentData[i] + (pos - getSegmentBegin(i));
+
+    return util::minimum(maxAmount, segmentEnds[i] - pos);
+}
+
+
+void TextSnapshot::copyTo(byte* dest, long pos, long amount) const
+{
+    while (amount > 0)
+    {
+        const byte* src;
+        long n = getContiguousAmount(pos, amount, &src);
+        memcpy(dest, src, n);
+        dest   += n;
+        pos    += n;
+        amount -= n;
+    }
+}
+
+
+void TextSnapshot::writeTo(File::Writer::Ptr writer, long pos, long amount) const
+{
+    MemArray<struct iovec> buffers;
+
+    while (amount > 0)
+    {
+        const byte* ptr;
+        long n = getContiguousAmount(pos, amount, &ptr);
+
+        struct iovec b;
+                     b.iov_base = (void*) ptr;
+                     b.iov_len  = n;
+        buffers.append(b);
+        pos    += n;
+        amount -= n;
+    }
+    writer->writev(buffers.getPtr(0), buffers.getLength());
+}
+
+
+void TextSnapshot::writeTo(File::Writer::Ptr writer, const String& encoding) const
+{
+    EncodingConverter c("UTF-8", encoding);
+
+    if (c.isConvertingBetweenDifferentCodesets()) {
+        c.convertToWriter(*this, writer);
+    } else {
+        writeTo(writer, 0, length);
+    }
+}
@@ -0,0 +1,120 @@
+/////////////////////////////////////////////////////////////////////////////////////
+//
+//   LucED - The Lucid Editor
+//
+//   Copyright (C) 2005-2010 Oliver Schmidt, oliver at luced dot de
+//
+//   This program is free software; you can redistribute it and/or modify it
+//   under the terms of the GNU General Public License Version 2 as published
+//   by the Free Software Foundation in June 1991.
+//
+//   This program is distributed in the hope that it will be useful, but WITHOUT
+//   ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+//   FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+//   more details.
+//
+//   You should have received a copy of the GNU General Public License along with
+//   this program; if not, write to the Free Software Foundation, Inc.,
+//   51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+//
+/////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef TEXT_SNAPSHOT_HPP
+#define TEXT_SNAPSHOT_HPP
+
+#include "debug.hpp"
+#include "types.hpp"
+#include "HeapObject.hpp"
+#include "OwningPtr.hpp"
+#include "MemArray.hpp"
+#include "ObjectArray.hpp"
+#include "ByteBuffer.hpp"
+#include "String.hpp"
+#include "File.hpp"
+#include "ChunkedByteBuffer.hpp"
+
+namespace LucED
+{
+
+/**
+ * Read-only copy of the content of a TextStorage.
+ *
+ * The content of a ChunkedByteBuffer is not copied, its chunks are shared
+ * until they are modified. Snapshots must be created and released in the
+ * main thread, but they can be read by other threads.
+ */
+class TextSnapshot : public HeapObject
+{
+public:
+    typedef OwningPtr<TextSnapshot> Ptr;
+
+    /**
+     * Version of the TextData at the creation of the snapshot,
+     * see TextData::createSnapshot().
+     */
+    long getVersion() const {
+        return version;
+    }
+
+    ~TextSnapshot();
+
+    long getLength() const {
+        return length;
+    }
+
+    byte operator[](long pos) const {
+        ASSERT(0 <= pos && pos < length);
+        long i = getSegmentIndexForPos(pos);
+        return segmentData[i][pos - getSegmentBegin(i)];
+    }
+
+    long getContiguousAmount(long pos, long maxAmount, const byte** rslt) const;
+
+    void copyTo(byte* dest, long pos, long amount) const;
+
+    /**
+     * Writes the bytes without conversion.
+     */
+    void writeTo(File::Writer::Ptr writer, long pos, long amount) const;
+
+    /**
+     * Writes the whole text converted from UTF-8 into the given encoding.
+     * Throws EncodingException after writing if the text could not be
+     * converted without errors.
+     */
+    void writeTo(File::Writer::Ptr writer, const String& encoding) const;
+
+private:
+    friend class TextStorage;
+    friend class TextData;
+    friend class ChunkedByteBuffer;
+
+    static Ptr create() {
+        return Ptr(new TextSnapshot());
+    }
+
+    TextSnapshot()
+        : length(0),
+          version(0)
+    {}
+
+    void appendSegment(const byte* data, long length);
+
+    long getSegmentIndexForPos(long pos) const;
+
+    long getSegmentBegin(long i) const {
+        return (i == 0) ? 0 : segmentEnds[i - 1];
+    }
+
+    long                                  length;
+    long                                  version;
+    MemArray<const byte*>                 segmentData;
+    MemArray<long>                        segmentEnds;
+    ByteBuffer                            copiedContent;
+    ObjectArray< OwningPtr<HeapObject> >  sharedObjects;
+    MemArray<ChunkedByteBuffer::SharedBlock*> sharedBlocks;
+};
+
+} // namespace LucED
+
+#endif // TEXT_SNAPSHOT_HPP
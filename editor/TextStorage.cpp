@@ -0,0 +1,84 @@
+/////////////////////////////////////////////////////////////////////////////////////
+//
+//   LucED - The Lucid Editor
+//
+//   Copyright (C) 2005-2010 Oliver Schmidt, oliver at luced dot de
+//
+//   This program is free software; you can redistribute it and/or modify it
+//   under the terms of the GNU General Public License Version 2 as published
+//   by the Free Software Foundation in June 1991.
+//
+//   This program is distributed in the hope that it will be useful, but WITHOUT
+//   ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+//   FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+//   more details.
+//
+//   You should have received a copy of the GNU General Public License along with
+//   this program; if not, write to the Free Software Foundation, Inc.,
+//   51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+//
+/////////////////////////////////////////////////////////////////////////////////////
+
+#include <sys/uio.h>
+
+#include "TextStorage.hpp"
+#include "MemBuffer.hpp"
+
+using namespace LucED;
+
+void TextStorage::setBackend(Backend newBackend)
+{
+    if (newBackend != backend)
+    {
+        ByteBuffer content;
+
+        if (backend == GAP_BUFFER) {
+            content.takeOver(&gapBuffer);
+        } else {
+            long length = chunkedBuffer.getLength();
+            chunkedBuffer.copyTo(content.appendAmount(length), 0, length);
+            chunkedBuffer.clear();
+        }
+        backend = newBackend;
+        takeOver(&content);
+    }
+}
+
+
+void TextStorage::writeTo(File::Writer::Ptr writer) const
+{
+    MemBuffer<struct iovec> buffers;
+
+    const long length = getLength();
+    long       pos    = 0;
+
+    while (pos < length)
+    {
+        const byte* ptr;
+        long n = getContiguousAmount(pos, length - pos, &ptr);
+
+        struct iovec* b = buffers.appendAmount(1);
+                      b->iov_base = (void*) ptr;
+                      b->iov_len  = n;
+        pos += n;
+    }
+    writer->writev(buffers.getPtr(0), buffers.getLength());
+}
+
+
+TextSnapshot::Ptr TextStorage::createSnapshot()
+{
+    if (backend == GAP_BUFFER)
+    {
+        TextSnapshot::Ptr rslt   = TextSnapshot::create();
+        long              length = gapBuffer.getLength();
+
+        gapBuffer.copyTo(rslt->copiedContent.appendAmount(length), 0, length);
+        rslt->appendSegment(rslt->copiedContent.getPtr(0), length);
+
+        return rslt;
+    }
+    else {
+        return chunkedBuffer.createSnapshot();
+    }
+}
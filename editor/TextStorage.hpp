@@ -0,0 +1,190 @@
+/////////////////////////////////////////////////////////////////////////////////////
+//
+//   LucED - The Lucid Editor
+//
+//   Copyright (C) 2005-2010 Oliver Schmidt, oliver at luced dot de
+//
+//   This program is free software; you can redistribute it and/or modify it
+//   under the terms of the GNU General Public License Version 2 as published
+//   by the Free Software Foundation in June 1991.
+//
+//   This program is distributed in the hope that it will be useful, but WITHOUT
+//   ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+//   FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+//   more details.
+//
+//   You should have received a copy of the GNU General Public License along with
+//   this program; if not, write to the Free Software Foundation, Inc.,
+//   51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+//
+/////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef TEXT_STORAGE_HPP
+#define TEXT_STORAGE_HPP
+
+#include "debug.hpp"
+#include "types.hpp"
+#include "NonCopyable.hpp"
+#include "RawPointable.hpp"
+#include "RawPtr.hpp"
+#include "ByteBuffer.hpp"
+#include "ChunkedByteBuffer.hpp"
+#include "File.hpp"
+#include "TextSnapshot.hpp"
+
+namespace LucED
+{
+
+/**
+ * Storage for the bytes of a TextData object.
+ *
+ * Small texts are kept in a gap buffer, large texts in a ChunkedByteBuffer.
+ * Both backends are accessed through the same inline methods, so that
+ * the selection of the backend can be done per text.
+ */
+class TextStorage : public RawPointable,
+                    private NonCopyable
+{
+public:
+    enum Backend
+    {
+        GAP_BUFFER,
+        CHUNKED_BUFFER
+    };
+
+    TextStorage()
+        : backend(GAP_BUFFER)
+    {}
+
+    Backend getBackend() const {
+        return backend;
+    }
+
+    /**
+     * Moves the content into the other backend.
+     */
+    void setBackend(Backend newBackend);
+
+    long getLength() const {
+        if (backend == GAP_BUFFER) {
+            return gapBuffer.getLength();
+        } else {
+            return chunkedBuffer.getLength();
+        }
+    }
+
+    byte operator[](long pos) const {
+        if (backend == GAP_BUFFER) {
+            return gapBuffer[pos];
+        } else {
+            return chunkedBuffer[pos];
+        }
+    }
+
+    /**
+     * The returned pointer is valid until the next modification or
+     * until the next call of getAmount().
+     */
+    const byte* getAmount(long pos, long amount) const {
+        if (backend == GAP_BUFFER) {
+            return gapBuffer.getAmount(pos, amount);
+        } else {
+            return chunkedBuffer.getAmount(pos, amount);
+        }
+    }
+
+    /**
+     * Returns the number of bytes that can be read contiguously
+     * at pos, but not more than maxAmount. In contrast to getAmount()
+     * this never changes the layout of the storage.
+     */
+    long getContiguousAmount(long pos, long maxAmount, const byte** rslt) const {
+        if (backend == GAP_BUFFER) {
+            return gapBuffer.getContiguousAmount(pos, maxAmount, rslt);
+        } else {
+            return chunkedBuffer.getContiguousAmount(pos, maxAmount, rslt);
+        }
+    }
+
+    void copyTo(byte* dest, long pos, long amount) const {
+        if (backend == GAP_BUFFER) {
+            gapBuffer.copyTo(dest, pos, amount);
+        } else {
+            chunkedBuffer.copyTo(dest, pos, amount);
+        }
+    }
+
+    void insert(long pos, const byte* source, long amount) {
+        if (backend == GAP_BUFFER) {
+            gapBuffer.insert(pos, source, amount);
+        } else {
+            chunkedBuffer.insert(pos, source, amount);
+        }
+    }
+
+    void removeAmount(long pos, long amount) {
+        if (backend == GAP_BUFFER) {
+            gapBuffer.removeAmount(pos, amount);
+        } else {
+            chunkedBuffer.removeAmount(pos, amount);
+        }
+    }
+
+    void clear() {
+        if (backend == GAP_BUFFER) {
+            gapBuffer.clear();
+        } else {
+            chunkedBuffer.clear();
+        }
+    }
+
+    void takeOver(RawPtr<ByteBuffer> buffer) {
+        if (backend == GAP_BUFFER) {
+            gapBuffer.takeOver(buffer);
+        } else {
+            chunkedBuffer.takeOver(buffer);
+        }
+    }
+
+    /**
+     * Mapped memory can only be referred to by the CHUNKED_BUFFER backend.
+     */
+    void takeOver(MappedMemory::Ptr memory) {
+        ASSERT(backend == CHUNKED_BUFFER);
+        chunkedBuffer.takeOver(memory);
+    }
+
+    bool hasMappedMemory() const {
+        return backend == CHUNKED_BUFFER && chunkedBuffer.hasMappedMemory();
+    }
+
+    bool wasMappedFileTruncated() const {
+        return backend == CHUNKED_BUFFER && chunkedBuffer.wasMappedFileTruncated();
+    }
+
+    void releaseMappedMemory() {
+        if (backend == CHUNKED_BUFFER) {
+            chunkedBuffer.releaseMappedMemory();
+        }
+    }
+
+    /**
+     * Writes the content segment by segment without copying it
+     * or changing the layout of the storage.
+     */
+    void writeTo(File::Writer::Ptr writer) const;
+
+    /**
+     * Texts in the GAP_BUFFER backend are copied, because they are small.
+     */
+    TextSnapshot::Ptr createSnapshot();
+
+private:
+    Backend           backend;
+    ByteBuffer        gapBuffer;
+    ChunkedByteBuffer chunkedBuffer;
+};
+
+} // namespace LucED
+
+#endif // TEXT_STORAGE_HPP
@@ -2629,6 +2629,13 @@ void TextWidget::flushPendingUpdates()
                     getWidth(), leftPix);
         updateHorizontalScrollBar = false;
     }
+    if (isMapped()) {
+        hilitingBuffer->setVisibleRange(getTopLeftTextPosition(), 
+                                        util::maximum(endPos, getTopLeftTextPosition()), 
+                                        hasFocus());
+    } else {
+        hilitingBuffer->setInvisible();
+    }
     long newLine = getCursorLineNumber();
     long newColumn = getOpticalCursorColumn();
     long newPos    = getCursorTextPosition();
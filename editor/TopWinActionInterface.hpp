@@ -35,6 +35,7 @@ public:
     virtual void handleSaveAsKey()          = 0;
     virtual void createEmptyWindow()        = 0;
     virtual void createCloneWindow()        = 0;
+    virtual void toggleFollowMode()         = 0;
 
 protected:
     TopWinActionInterface()
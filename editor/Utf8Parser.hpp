@@ -149,7 +149,58 @@ public:
         return rslt;
     }
 
+    /**
+     * Returns the number of wide characters beginning within 
+     * [beginPos, endPos). The ByteContainer must provide 
+     * getContiguousAmount() for this.
+     */
+    long getNumberOfWChars(long beginPos, long endPos) const
+    {
+        long rslt = 0;
+        bool isAfterAsciiChar = isAfterAsciiCharOrBegin(beginPos);
+        
+        while (beginPos < endPos)
+        {
+            const byte* ptr;
+            long        n = buffer->getContiguousAmount(beginPos, endPos - beginPos, &ptr);
+            
+            rslt            += CharUtil::getNumberOfWCharBegins(ptr, n, isAfterAsciiChar);
+            isAfterAsciiChar = CharUtil::isAsciiChar(ptr[n - 1]);
+            beginPos        += n;
+        }
+        return rslt;
+    }
+    
+    /**
+     * Returns the position that is reached by skipping numberOfWChars 
+     * wide characters from beginPos on, but not beyond endPos. The 
+     * ByteContainer must provide getContiguousAmount() for this.
+     */
+    long getPosAfterWChars(long beginPos, long endPos, long numberOfWChars) const
+    {
+        ASSERT(isBeginOfWChar(beginPos));
+
+        bool isAfterAsciiChar = isAfterAsciiCharOrBegin(beginPos);
+        
+        while (beginPos < endPos)
+        {
+            const byte* ptr;
+            long        n = buffer->getContiguousAmount(beginPos, endPos - beginPos, &ptr);
+            long        offset = CharUtil::getOffsetOfWCharBegin(ptr, n, &numberOfWChars, isAfterAsciiChar);
+            
+            if (offset < n) {
+                return beginPos + offset;
+            }
+            isAfterAsciiChar = CharUtil::isAsciiChar(ptr[n - 1]);
+            beginPos        += n;
+        }
+        return endPos;
+    }
+
 private:
+    bool isAfterAsciiCharOrBegin(long pos) const {
+        return pos == 0 || CharUtil::isAsciiChar((*buffer)[pos - 1]);
+    }
     bool isEndOfBuffer(long pos) const {
         return buffer->getLength() == pos;
     }
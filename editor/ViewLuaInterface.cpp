@@ -182,7 +182,8 @@ LuaCFunctionResult ViewLuaInterface::getCharAtCursor(const LuaCFunctionArguments
         long epos = textData->getNextBeginOfWChar(spos);
         long len  = epos - spos;
         
-        rslt = luaAccess.toLua((const char*)(textData->getAmount(spos, len)), len);
+        ByteArray scratchBuffer;
+        rslt = luaAccess.toLua((const char*)(textData->getAmount(spos, len, &scratchBuffer)), len);
     }
     else {
         rslt = "";
@@ -200,7 +201,8 @@ LuaCFunctionResult ViewLuaInterface::getByteAtCursor(const LuaCFunctionArguments
     
     if (0 <= pos && pos < textData->getLength())
     {
-        rslt = luaAccess.toLua((const char*)(textData->getAmount(pos, 1)), 1);
+        byte b = textData->getByte(pos);
+        rslt = luaAccess.toLua((const char*)(&b), 1);
     }
     else {
         rslt = "";
@@ -228,7 +230,8 @@ LuaCFunctionResult ViewLuaInterface::getBytesAtCursor(const LuaCFunctionArgument
     
     if (amount > 0)
     {
-        rslt = luaAccess.toLua((const char*)(textData->getAmount(pos, amount)),
+        ByteArray scratchBuffer;
+        rslt = luaAccess.toLua((const char*)(textData->getAmount(pos, amount, &scratchBuffer)),
                                amount);
     }
     else {
@@ -258,7 +261,8 @@ LuaCFunctionResult ViewLuaInterface::getBytes(const LuaCFunctionArguments& args)
     
     if (pos >= 0 && amount > 0)
     {
-        rslt = luaAccess.toLua((const char*)(textData->getAmount(pos, amount)),
+        ByteArray scratchBuffer;
+        rslt = luaAccess.toLua((const char*)(textData->getAmount(pos, amount, &scratchBuffer)),
                                amount);
     }
     else {
@@ -551,3 +555,14 @@ LuaCFunctionResult ViewLuaInterface::setCurrentActionCategory(const LuaCFunction
     return LuaCFunctionResult(luaAccess);
  
 }
+
+
+LuaCFunctionResult ViewLuaInterface::getHistoryMemoryUsage(const LuaCFunctionArguments& args)
+{
+    LuaAccess luaAccess = args.getLuaAccess();
+
+    TextData::Ptr textData = e->getTextData();
+
+    return LuaCFunctionResult(luaAccess) << textData->getHistoryMemoryUsage()
+                                         << textData->getHistorySpilledLength();
+}
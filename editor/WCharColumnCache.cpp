@@ -0,0 +1,104 @@
+/////////////////////////////////////////////////////////////////////////////////////
+//
+//   LucED - The Lucid Editor
+//
+//   Copyright (C) 2005-2010 Oliver Schmidt, oliver at luced dot de
+//
+//   This program is free software; you can redistribute it and/or modify it
+//   under the terms of the GNU General Public License Version 2 as published
+//   by the Free Software Foundation in June 1991.
+//
+//   This program is distributed in the hope that it will be useful, but WITHOUT
+//   ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+//   FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+//   more details.
+//
+//   You should have received a copy of the GNU General Public License along with
+//   this program; if not, write to the Free Software Foundation, Inc.,
+//   51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+//
+/////////////////////////////////////////////////////////////////////////////////////
+
+#include "WCharColumnCache.hpp"
+
+using namespace LucED;
+
+
+WCharColumnCache::Line& WCharColumnCache::getLine(long lineBegin)
+{
+    Line* rslt = &lines[0];
+    
+    for (int i = 0; i < NUMBER_OF_LINES; ++i)
+    {
+        if (lines[i].lineBegin == lineBegin) {
+            rslt = &lines[i];
+            break;
+        }
+        if (lines[i].lastUse < rslt->lastUse) {
+            rslt = &lines[i];
+        }
+    }
+    if (rslt->lineBegin != lineBegin)
+    {
+        rslt->lineBegin = lineBegin;
+        rslt->checkpoints.clear();
+        rslt->checkpoints.append(0);
+    }
+    rslt->lastUse = ++useCounter;
+    return *rslt;
+}
+
+
+long WCharColumnCache::getWCharColumn(long lineBegin, long pos)
+{
+    ASSERT(lineBegin <= pos);
+
+    if (pos - lineBegin < MIN_LINE_LENGTH) {
+        return utf8Parser->getNumberOfWChars(lineBegin, pos);
+    }
+    Line& line = getLine(lineBegin);
+    
+    const long index = (pos - lineBegin) / CHECKPOINT_DISTANCE;
+
+    for (long i = line.checkpoints.getLength(); i <= index; ++i)
+    {
+        long p = lineBegin + (i - 1) * CHECKPOINT_DISTANCE;
+
+        line.checkpoints.append(line.checkpoints[i - 1] 
+                                + utf8Parser->getNumberOfWChars(p, p + CHECKPOINT_DISTANCE));
+    }
+    return line.checkpoints[index]
+           + utf8Parser->getNumberOfWChars(lineBegin + index * CHECKPOINT_DISTANCE, pos);
+}
+
+
+void WCharColumnCache::applyChange(long beginPos, long oldEndPos, long changedAmount)
+{
+    for (int i = 0; i < NUMBER_OF_LINES; ++i)
+    {
+        Line& line = lines[i];
+
+        if (line.lineBegin < 0) {
+            continue;
+        }
+        if (oldEndPos < line.lineBegin)
+        {
+            // the newline before the line is not affected
+
+            line.lineBegin += changedAmount;
+        }
+        else if (beginPos < line.lineBegin)
+        {
+            line.lineBegin = -1;
+            line.lastUse   =  0;
+        }
+        else
+        {
+            long numberOfValidCheckpoints = (beginPos - line.lineBegin) / CHECKPOINT_DISTANCE + 1;
+            
+            if (numberOfValidCheckpoints < line.checkpoints.getLength()) {
+                line.checkpoints.removeTail(numberOfValidCheckpoints);
+            }
+        }
+    }
+}
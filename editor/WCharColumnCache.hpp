@@ -0,0 +1,89 @@
+/////////////////////////////////////////////////////////////////////////////////////
+//
+//   LucED - The Lucid Editor
+//
+//   Copyright (C) 2005-2010 Oliver Schmidt, oliver at luced dot de
+//
+//   This program is free software; you can redistribute it and/or modify it
+//   under the terms of the GNU General Public License Version 2 as published
+//   by the Free Software Foundation in June 1991.
+//
+//   This program is distributed in the hope that it will be useful, but WITHOUT
+//   ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+//   FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+//   more details.
+//
+//   You should have received a copy of the GNU General Public License along with
+//   this program; if not, write to the Free Software Foundation, Inc.,
+//   51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+//
+/////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef WCHAR_COLUMN_CACHE_HPP
+#define WCHAR_COLUMN_CACHE_HPP
+
+#include "debug.hpp"
+#include "NonCopyable.hpp"
+#include "RawPtr.hpp"
+#include "MemBuffer.hpp"
+#include "TextStorage.hpp"
+#include "Utf8Parser.hpp"
+
+namespace LucED
+{
+
+/**
+ * Checkpoints for the wchar columns within recently queried long lines.
+ *
+ * For every cached line the wchar column is kept at each multiple of
+ * CHECKPOINT_DISTANCE bytes from the line begin, so that a column is
+ * found by counting at most CHECKPOINT_DISTANCE bytes. Checkpoints are
+ * computed on demand and only the ones behind a modification are dropped.
+ *
+ * The cache must be informed about every modification of the text by
+ * applyChange().
+ */
+class WCharColumnCache : private NonCopyable
+{
+public:
+    explicit WCharColumnCache(RawPtr<const Utf8Parser<TextStorage> > utf8Parser)
+        : utf8Parser(utf8Parser),
+          useCounter(0)
+    {}
+    
+    /**
+     * Returns the number of wide characters in [lineBegin, pos).
+     */
+    long getWCharColumn(long lineBegin, long pos);
+
+    void applyChange(long beginPos, long oldEndPos, long changedAmount);
+
+private:
+    enum
+    {
+        CHECKPOINT_DISTANCE = 1024,
+        MIN_LINE_LENGTH     = 4 * CHECKPOINT_DISTANCE,
+        NUMBER_OF_LINES     = 4
+    };
+
+    struct Line
+    {
+        Line()
+            : lineBegin(-1),
+              lastUse(0)
+        {}
+        long            lineBegin;
+        long            lastUse;
+        MemBuffer<long> checkpoints; // checkpoints[i] is the column at lineBegin + i * CHECKPOINT_DISTANCE
+    };
+    
+    Line& getLine(long lineBegin);
+
+    RawPtr<const Utf8Parser<TextStorage> > utf8Parser;
+    Line                                   lines[NUMBER_OF_LINES];
+    long                                   useCounter;
+};
+
+} // namespace LucED
+
+#endif // WCHAR_COLUMN_CACHE_HPP
@@ -0,0 +1,896 @@
+/////////////////////////////////////////////////////////////////////////////////////
+//
+//   LucED - The Lucid Editor
+//
+//   Copyright (C) 2005-2010 Oliver Schmidt, oliver at luced dot de
+//
+//   This program is free software; you can redistribute it and/or modify it
+//   under the terms of the GNU General Public License Version 2 as published
+//   by the Free Software Foundation in June 1991.
+//
+//   This program is distributed in the hope that it will be useful, but WITHOUT
+//   ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+//   FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+//   more details.
+//
+//   You should have received a copy of the GNU General Public License along with
+//   this program; if not, write to the Free Software Foundation, Inc.,
+//   51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+//
+/////////////////////////////////////////////////////////////////////////////////////
+
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <locale.h>
+#include <errno.h>
+#include <iconv.h>
+
+#include "util.hpp"
+#include "String.hpp"
+#include "TimeStamp.hpp"
+#include "ByteBuffer.hpp"
+#include "MemArray.hpp"
+#include "SingletonKeeper.hpp"
+#include "BaseException.hpp"
+#include "NewlineCounter.hpp"
+#include "TextStorage.hpp"
+#include "LineIndex.hpp"
+#include "TextData.hpp"
+#include "ObjectArray.hpp"
+#include "EncodingConverter.hpp"
+#include "EncodingException.hpp"
+#include "CharUtil.hpp"
+#include "Utf8Parser.hpp"
+#include "ReplaceUtil.hpp"
+#include "File.hpp"
+#include "GlobalConfig.hpp"
+#include "DefaultConfig.hpp"
+#include "HilitedText.hpp"
+#include "HilitingBuffer.hpp"
+
+/**
+ * Micro benchmarks for the text handling of the editor.
+ *
+ * Build with "make benchmark" and run "./benchmark <name> [arguments]",
+ * without arguments the available benchmarks are listed. Each benchmark
+ * compares the current implementation with the straightforward code it 
+ * replaced, times are the best of several runs.
+ */
+
+using namespace LucED;
+
+namespace
+{
+
+double getSecondsSince(const TimeStamp& begin)
+{
+    TimePeriod period = TimeStamp::now() - begin;
+    return (long) period.getSeconds() + (long) period.getMicroSeconds() / 1e6;
+}
+
+/**
+ * Number of runs for measuring an operation on length bytes, so that
+ * about 256 MB are processed per measurement.
+ */
+long getNumberOfRuns(long length)
+{
+    return util::maximum(1L, 256L * 1024 * 1024 / util::maximum(1L, length));
+}
+
+enum { NUMBER_OF_MEASUREMENTS = 3 };
+
+MemArray<long> getSizesFromArguments(int argc, char** argv, const long* defaultSizes, int numberOfDefaultSizes)
+{
+    MemArray<long> rslt;
+    
+    for (int i = 0; i < argc; ++i) {
+        rslt.append(atol(argv[i]) * 1024 * 1024);
+    }
+    if (rslt.getLength() == 0) {
+        rslt.append(defaultSizes, numberOfDefaultSizes);
+    }
+    return rslt;
+}
+
+String getSizeString(long length)
+{
+    if (length >= 1024 * 1024) {
+        return String() << length / (1024 * 1024) << " MB";
+    } else {
+        return String() << length / 1024 << " KB";
+    }
+}
+
+double getGigaBytesPerSecond(long length, double seconds)
+{
+    return length / seconds / 1e9;
+}
+
+////////////////////////////////////////////////////////////////////////////
+// newlines
+
+/**
+ * The loop that TextData used for counting the lines of a text.
+ */
+long countNewlinesBytewise(const byte* buffer, long length)
+{
+    long lineCounter = 0;
+    for (long i = 0; i < length; ++i) {
+        if (buffer[i] == '\n') {
+            ++lineCounter;
+        }
+    }
+    return lineCounter;
+}
+
+double measureNewlineCounting(long (*count)(const byte*, long), const byte* buffer, long length, 
+                              long* numberOfNewlines)
+{
+    long   runs = getNumberOfRuns(length);
+    double best = 0;
+    
+    for (int m = 0; m < NUMBER_OF_MEASUREMENTS; ++m)
+    {
+        TimeStamp begin = TimeStamp::now();
+        for (long i = 0; i < runs; ++i) {
+            *numberOfNewlines = count(buffer, length);
+        }
+        double seconds = getSecondsSince(begin) / runs;
+        if (m == 0 || seconds < best) {
+            best = seconds;
+        }
+    }
+    return best;
+}
+
+void benchmarkNewlines(int argc, char** argv)
+{
+    const long defaultSizes[] = { 1L << 20, 100L << 20, 1L << 30 };
+    
+    MemArray<long> sizes = getSizesFromArguments(argc, argv, defaultSizes, 3);
+    
+    printf("Lines of 40 bytes, throughput in GB/s\n\n");
+    printf("%10s %12s %12s %16s %20s\n", "size", "lines", "old loop", "NewlineCounter", "LineIndex::rebuild");
+    
+    for (long s = 0; s < sizes.getLength(); ++s)
+    {
+        long length = sizes[s];
+        
+        ByteBuffer buffer;
+        byte* ptr = buffer.appendAmount(length);
+        for (long i = 0; i < length; ++i) {
+            ptr[i] = (i % 40 == 39) ? '\n' : 'a' + i % 26;
+        }
+        long loopCount;
+        long kernelCount;
+        
+        double loopSeconds   = measureNewlineCounting(&countNewlinesBytewise, ptr, length, &loopCount);
+        double kernelSeconds = measureNewlineCounting(&NewlineCounter::count, ptr, length, &kernelCount);
+        
+        TextStorage storage;
+        storage.setBackend(TextStorage::CHUNKED_BUFFER);
+        storage.takeOver(&buffer);
+        
+        LineIndex lineIndex(&storage);
+        long      runs         = getNumberOfRuns(length);
+        double    indexSeconds = 0;
+        
+        for (int m = 0; m < NUMBER_OF_MEASUREMENTS; ++m)
+        {
+            TimeStamp begin = TimeStamp::now();
+            for (long i = 0; i < runs; ++i) {
+                lineIndex.rebuild();
+            }
+            double seconds = getSecondsSince(begin) / runs;
+            if (m == 0 || seconds < indexSeconds) {
+                indexSeconds = seconds;
+            }
+        }
+        if (loopCount != kernelCount || lineIndex.getNumberOfLines() != kernelCount + 1) {
+            printf("line counts differ: %ld %ld %ld\n", loopCount, kernelCount, lineIndex.getNumberOfLines() - 1);
+        }
+        printf("%10s %12ld %12.2f %16.2f %20.2f\n", getSizeString(length).toCString(), 
+                                                   kernelCount,
+                                                   getGigaBytesPerSecond(length, loopSeconds),
+                                                   getGigaBytesPerSecond(length, kernelSeconds),
+                                                   getGigaBytesPerSecond(length, indexSeconds));
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////
+// marks
+
+enum EditPattern
+{
+    TYPING,
+    RANDOM_EDITS,
+    ALTERNATING_EDITS
+};
+
+/**
+ * Returns the time per edit in seconds. Typing inserts at one place,
+ * random and alternating edits insert and remove single bytes at random
+ * positions or alternately near the begin and the end of the text.
+ */
+double measureEdits(TextData::Ptr textData, EditPattern pattern)
+{
+    const long numberOfEdits = 20000;
+
+    TextData::TextMark mark   = textData->createNewMark();
+    long               pos    = textData->getLength() / 2;
+    TimeStamp          begin  = TimeStamp::now();
+    
+    srand(1);
+    
+    for (long i = 0; i < numberOfEdits; ++i)
+    {
+        long length = textData->getLength();
+        
+        switch (pattern) {
+            case TYPING:            break;
+            case RANDOM_EDITS:      pos = rand() % length; break;
+            case ALTERNATING_EDITS: pos = (i & 2) ? 100 : length - 100; break;
+        }
+        textData->moveMarkToPos(mark, pos);
+        
+        if (pattern == TYPING) {
+            textData->insertAtMark(mark, (byte)(i % 40 == 39 ? '\n' : 'x'));
+            ++pos;
+        }
+        else if (i & 1) {
+            textData->removeAtMark(mark, 1);
+        } else {
+            textData->insertAtMark(mark, (byte) 'x');
+        }
+        textData->flushPendingUpdates();
+    }
+    return getSecondsSince(begin) / numberOfEdits;
+}
+
+void benchmarkMarks(int argc, char** argv)
+{
+    MemArray<long> markCounts;
+    
+    for (int i = 0; i < argc; ++i) {
+        markCounts.append(atol(argv[i]));
+    }
+    if (markCounts.getLength() == 0) {
+        const long defaultCounts[] = { 0, 100, 1000, 10000 };
+        markCounts.append(defaultCounts, 4);
+    }
+    printf("20000 single byte edits in a text of 20000 lines, microseconds per edit\n\n");
+    printf("%10s %12s %12s %12s\n", "marks", "typing", "random", "alternating");
+
+    for (long c = 0; c < markCounts.getLength(); ++c)
+    {
+        long numberOfMarks = markCounts[c];
+        
+        TextData::Ptr textData = TextData::create();
+        {
+            String line = "some line of text with forty-two chars\n";
+            String text;
+            for (int i = 0; i < 20000; ++i) {
+                text << line;
+            }
+            textData->insertAtMark(textData->createNewMark(), text);
+            textData->flushPendingUpdates();
+        }
+        ObjectArray<TextData::TextMark> marks;
+        long length = textData->getLength();
+        
+        for (long i = 0; i < numberOfMarks; ++i)
+        {
+            marks.append(textData->createNewMark());
+            textData->moveMarkToPos(marks[i], 1 + (length - 2) * i / numberOfMarks);
+        }
+        double typing      = measureEdits(textData, TYPING);
+        double random      = measureEdits(textData, RANDOM_EDITS);
+        double alternating = measureEdits(textData, ALTERNATING_EDITS);
+        
+        printf("%10ld %12.2f %12.2f %12.2f\n", numberOfMarks, typing * 1e6, random * 1e6, alternating * 1e6);
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////
+// encodings
+
+/**
+ * Converts with one iconv call per megabyte of output, like 
+ * EncodingConverter::convertInPlace() did before it had an ASCII
+ * fast path. The result is written to a separate buffer.
+ */
+long convertWithIconv(const char* fromCodeset, const byte* input, long length, RawPtr<ByteBuffer> output)
+{
+    iconv_t converter = iconv_open("UTF-8", fromCodeset);
+    
+    char*  inPtr    = (char*) input;
+    size_t inLength = length;
+    
+    output->clear();
+    
+    while (inLength > 0)
+    {
+        const long windowLength = 1024 * 1024;
+        
+        long   outPos    = output->getLength();
+        char*  outPtr    = (char*) output->appendAmount(windowLength);
+        size_t outLength = windowLength;
+
+        size_t rc = iconv(converter, &inPtr, &inLength, &outPtr, &outLength);
+        
+        output->removeTail(outPos + windowLength - outLength);
+        
+        if (rc == (size_t) -1 && errno != E2BIG) {
+            break;
+        }
+    }
+    iconv_close(converter);
+    return output->getLength();
+}
+
+double measureConversion(const char* fromCodeset, const ByteBuffer& input, int method, long* outputLength)
+{
+    double best = 0;
+    
+    for (int m = 0; m < NUMBER_OF_MEASUREMENTS; ++m)
+    {
+        ByteBuffer output;
+        
+        if (method == 1) {
+            output.append(input.getTotalAmount(), input.getLength());
+        }
+        TimeStamp begin = TimeStamp::now();
+        
+        if (method == 0)
+        {
+            convertWithIconv(fromCodeset, input.getTotalAmount(), input.getLength(), &output);
+        }
+        else if (method == 1)
+        {
+            EncodingConverter(fromCodeset, "UTF-8").convertInPlace(&output);
+        }
+        else
+        {
+            // pieces as read by the FileLoader
+            
+            const long pieceLength = 64 * 1024;
+            
+            EncodingConverter::Stream::Ptr stream = EncodingConverter(fromCodeset, "UTF-8").createStream();
+            
+            for (long pos = 0; pos < input.getLength(); pos += pieceLength)
+            {
+                long amount = util::minimum(pieceLength, input.getLength() - pos);
+                stream->convert(input.getAmount(pos, amount), amount, &output);
+            }
+            stream->finish(&output);
+        }
+        double seconds = getSecondsSince(begin);
+        if (m == 0 || seconds < best) {
+            best = seconds;
+        }
+        *outputLength = output.getLength();
+    }
+    return best;
+}
+
+void benchmarkEncodings(int argc, char** argv)
+{
+    const long defaultSizes[] = { 100L << 20 };
+    
+    MemArray<long> sizes = getSizesFromArguments(argc, argv, defaultSizes, 1);
+    
+    printf("Lines of 80 characters, 0.1%% of them not ASCII, million characters per second\n\n");
+    printf("%10s %12s %12s %14s %12s\n", "size", "codeset", "iconv", "convertInPlace", "Stream");
+    
+    for (long s = 0; s < sizes.getLength(); ++s)
+    {
+        long length = sizes[s];
+        
+        ByteBuffer latin1;
+        ByteBuffer utf16;
+        
+        byte* ptr = latin1.appendAmount(length);
+        srand(1);
+        for (long i = 0; i < length; ++i) {
+            if (i % 80 == 79) {
+                ptr[i] = '\n';
+            } else if (rand() % 1000 == 0) {
+                ptr[i] = 0xE4;
+            } else {
+                ptr[i] = 'a' + rand() % 26;
+            }
+        }
+        byte* utf16Ptr = utf16.appendAmount(2 + 2 * length);
+        utf16Ptr[0] = 0xFF;  // byte order mark, little endian
+        utf16Ptr[1] = 0xFE;
+        for (long i = 0; i < length; ++i) {
+            utf16Ptr[2 + 2 * i]     = ptr[i];
+            utf16Ptr[2 + 2 * i + 1] = 0;
+        }
+        const char*       codesets[] = { "ISO-8859-1", "UTF-16" };
+        const ByteBuffer* inputs[]   = { &latin1,      &utf16   };
+        
+        for (int c = 0; c < 2; ++c)
+        {
+            long lengths[3];
+            double seconds[3];
+            
+            for (int method = 0; method < 3; ++method) {
+                seconds[method] = measureConversion(codesets[c], *inputs[c], method, &lengths[method]);
+            }
+            if (lengths[0] != lengths[1] || lengths[0] != lengths[2]) {
+                printf("output lengths differ: %ld %ld %ld\n", lengths[0], lengths[1], lengths[2]);
+            }
+            printf("%10s %12s %12.0f %14.0f %12.0f\n", getSizeString(length).toCString(),
+                                                       codesets[c],
+                                                       length / seconds[0] / 1e6,
+                                                       length / seconds[1] / 1e6,
+                                                       length / seconds[2] / 1e6);
+        }
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////
+// utf8
+
+/**
+ * Runs operation on the text repeatedly and returns the throughput in MB/s.
+ */
+template<class Operation
+        >
+double measureUtf8Operation(const ByteBuffer& text, Operation operation, long* rslt)
+{
+    long   length = text.getLength();
+    long   runs   = util::maximum(1L, getNumberOfRuns(length) / 4);
+    double best   = 0;
+    
+    for (int m = 0; m < NUMBER_OF_MEASUREMENTS; ++m)
+    {
+        TimeStamp begin = TimeStamp::now();
+        for (long i = 0; i < runs; ++i) {
+            *rslt = operation(text);
+        }
+        double seconds = getSecondsSince(begin) / runs;
+        if (m == 0 || seconds < best) {
+            best = seconds;
+        }
+    }
+    return length / best / 1e6;
+}
+
+// character by character with Utf8Parser, as before the kernels
+
+struct CountWCharsScalar {
+    long operator()(const ByteBuffer& text) const {
+        return Utf8Parser<ByteBuffer>(&text).getNumberOfWChars();
+    }
+};
+struct FindMiddleWCharScalar {
+    long operator()(const ByteBuffer& text) const {
+        Utf8Parser<ByteBuffer> parser(&text);
+        long pos = 0;
+        for (long i = 0; i < wcharIndex; ++i) {
+            pos = parser.getNextWCharPos(pos);
+        }
+        return pos;
+    }
+    long wcharIndex;
+};
+struct ValidateScalar {
+    // pcre checks the whole subject bytewise before matching the empty pattern
+    long operator()(const ByteBuffer& text) const {
+        int ovector[3];
+        int rc = pcre_exec(emptyPattern, NULL, (const char*) text.getTotalAmount(), text.getLength(), 
+                           0, 0, ovector, 3);
+        return rc == PCRE_ERROR_BADUTF8 ? ovector[0] : text.getLength();
+    }
+    pcre* emptyPattern;
+};
+
+// the kernels of CharUtil
+
+struct CountWCharsKernel {
+    long operator()(const ByteBuffer& text) const {
+        return CharUtil::getNumberOfWCharBegins(text.getTotalAmount(), text.getLength(), true);
+    }
+};
+struct FindMiddleWCharKernel {
+    long operator()(const ByteBuffer& text) const {
+        long index = wcharIndex;
+        return CharUtil::getOffsetOfWCharBegin(text.getTotalAmount(), text.getLength(), &index, true);
+    }
+    long wcharIndex;
+};
+struct ValidateKernel {
+    long operator()(const ByteBuffer& text) const {
+        return CharUtil::getValidUtf8PrefixLength(text.getTotalAmount(), text.getLength());
+    }
+};
+
+void benchmarkUtf8(int argc, char** argv)
+{
+    const long defaultSizes[] = { 24L << 20 };
+    
+    MemArray<long> sizes = getSizesFromArguments(argc, argv, defaultSizes, 1);
+    
+    printf("One line without newlines, throughput in MB/s\n\n");
+    printf("%10s %-12s %-18s %12s %12s\n", "size", "text", "operation", "scalar", "kernel");
+    
+    for (long s = 0; s < sizes.getLength(); ++s)
+    {
+        long length = sizes[s];
+        
+        for (int t = 0; t < 2; ++t)
+        {
+            // ASCII only or every 7th character with two bytes
+            
+            ByteBuffer text;
+            byte* ptr = text.appendAmount(length);
+            for (long i = 0; i < length; ++i) {
+                if (t == 1 && i % 8 == 0 && i + 1 < length) {
+                    ptr[i++] = 0xC3;
+                    ptr[i]   = 0xA4;
+                } else {
+                    ptr[i]   = 'a' + i % 26;
+                }
+            }
+            const char* textName = (t == 0) ? "ASCII" : "2-byte chars";
+            long        scalarResult;
+            long        kernelResult;
+            double      scalar;
+            double      kernel;
+            
+            scalar = measureUtf8Operation(text, CountWCharsScalar(), &scalarResult);
+            kernel = measureUtf8Operation(text, CountWCharsKernel(), &kernelResult);
+            if (scalarResult != kernelResult) {
+                printf("results differ: %ld %ld\n", scalarResult, kernelResult);
+            }
+            printf("%10s %-12s %-18s %12.0f %12.0f\n", getSizeString(length).toCString(), textName, "count characters", scalar, kernel);
+            
+            FindMiddleWCharScalar findScalar;
+            FindMiddleWCharKernel findKernel;
+            findScalar.wcharIndex = kernelResult / 2;
+            findKernel.wcharIndex = kernelResult / 2;
+            
+            scalar = measureUtf8Operation(text, findScalar, &scalarResult);
+            kernel = measureUtf8Operation(text, findKernel, &kernelResult);
+            if (scalarResult != kernelResult) {
+                printf("results differ: %ld %ld\n", scalarResult, kernelResult);
+            }
+            // only half of the text is processed
+
+            printf("%10s %-12s %-18s %12.0f %12.0f\n", getSizeString(length).toCString(), textName, "find middle char", scalar / 2, kernel / 2);
+            
+            ValidateScalar validateScalar;
+            const char*    errorText;
+            int            errorOffset;
+            validateScalar.emptyPattern = pcre_compile("", PCRE_UTF8, &errorText, &errorOffset, NULL);
+            
+            scalar = measureUtf8Operation(text, validateScalar, &scalarResult);
+            pcre_free(validateScalar.emptyPattern);
+            
+            kernel = measureUtf8Operation(text, ValidateKernel(), &kernelResult);
+            if (scalarResult != kernelResult) {
+                printf("results differ: %ld %ld\n", scalarResult, kernelResult);
+            }
+            printf("%10s %-12s %-18s %12.0f %12.0f\n", getSizeString(length).toCString(), textName, "validate", scalar, kernel);
+        }
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////
+// replace
+
+/**
+ * The replace all of ReplaceUtil before it worked in a single pass:
+ * every match is substituted in the text before the next one is searched.
+ */
+class PerMatchReplaceUtil : public ReplaceUtil
+{
+public:
+    PerMatchReplaceUtil(RawPtr<TextData> textData)
+        : ReplaceUtil(textData)
+    {}
+    
+    bool replaceAllBetween(long spos, long epos)
+    {
+        if (!FindUtil::wasInitialized()) {
+            FindUtil::initialize();
+        }
+        RawPtr<TextData> textData = getTextData();
+        TextData::TextMark textMark = textData->createNewMark();
+        textMark.moveToPos(spos);
+
+        FindUtil::setTextPosition(textMark.getPos());
+        FindUtil::setMaximalEndOfMatchPosition(epos);
+        FindUtil::setAllowMatchAtStartOfSearchFlag(true);
+        
+        bool wasAnythingReplaced = false;
+        
+        TextData::CompoundChange::Ptr compoundChange;
+
+        while (textMark.getPos() < epos)
+        {
+            FindUtil::findNext();
+            if (!FindUtil::wasFound()) {
+                break;
+            }
+            textMark.moveForwardToPos(FindUtil::getTextPosition());
+
+            if (FindUtil::getTextPosition() < epos)
+            {
+                if (!wasAnythingReplaced) {
+                    textData->rememberChangeAreaInHistory(spos, epos);
+                    compoundChange = textData->createCompoundChange(spos, epos);
+                    wasAnythingReplaced = true;
+                }
+                String substitutedString = getSubstitutedString();
+                textData->insertAtMark(textMark, substitutedString);
+
+                textMark.moveForwardToPos(textMark.getPos() + substitutedString.getLength());
+
+                textData->removeAtMark(textMark, FindUtil::getMatchLength());
+
+                if (FindUtil::getMatchLength() == 0) {
+                    textMark.inc();
+                }
+                epos += substitutedString.getLength() - FindUtil::getMatchLength();
+
+                FindUtil::setTextPosition(textMark.getPos());
+                FindUtil::setMaximalEndOfMatchPosition(epos);
+            }
+        }
+        FindUtil::setMaximalEndOfMatchPosition(-1);
+        return wasAnythingReplaced;
+    }
+};
+
+/**
+ * Replaces all matches in the whole text with replaceUtil and undoes the
+ * replacement afterwards. Returns the time of the replacement and of the
+ * undo in seconds and the text after the replacement.
+ */
+template<class Util
+        >
+void measureReplaceAll(TextData::Ptr textData, bool regexFlag, const String& findString, const String& replaceString, 
+                       double* replaceSeconds, double* undoSeconds, String* result)
+{
+    Util replaceUtil(textData);
+    replaceUtil.setSearchForwardFlag(true);
+    replaceUtil.setRegexFlag(regexFlag);
+    replaceUtil.setFindString(findString);
+    replaceUtil.setReplaceString(replaceString);
+    
+    textData->setHistorySeparator();
+    
+    TimeStamp begin = TimeStamp::now();
+    replaceUtil.replaceAllBetween(0, textData->getLength());
+    textData->flushPendingUpdates();
+    *replaceSeconds = getSecondsSince(begin);
+    
+    *result = textData->getSubstring(Pos(0), Len(textData->getLength()));
+    
+    textData->setHistorySeparator();
+    
+    TextData::TextMark mark = textData->createNewMark();
+    begin = TimeStamp::now();
+    textData->undo(mark);
+    textData->flushPendingUpdates();
+    *undoSeconds = getSecondsSince(begin);
+}
+
+void benchmarkReplace(int argc, char** argv)
+{
+    const long defaultSizes[] = { 5L << 20, 50L << 20 };
+    
+    MemArray<long> sizes = getSizesFromArguments(argc, argv, defaultSizes, 2);
+    
+    printf("Replace all in the whole text, one match per line of 48 bytes, seconds\n\n");
+    printf("%10s %8s %-18s %10s %10s %10s %10s\n", "size", "matches", "replace", 
+                                                   "per match", "undo", "one pass", "undo");
+    
+    for (long s = 0; s < sizes.getLength(); ++s)
+    {
+        long length = sizes[s];
+        
+        for (int t = 0; t < 2; ++t)
+        {
+            bool   regexFlag     = (t == 1);
+            String findString    = regexFlag ? "f(o+)"    : "foo";
+            String replaceString = regexFlag ? "qu\\1x"   : "quux";
+            String line          = "some words around the foo in a line of the text\n";
+            
+            TextData::Ptr textData = TextData::create();
+            textData->activateHistory();
+            {
+                String text;
+                while (text.getLength() + line.getLength() <= length) {
+                    text << line;
+                }
+                textData->insertAtMark(textData->createNewMark(), text);
+                textData->flushPendingUpdates();
+            }
+            long   numberOfMatches = textData->getLength() / line.getLength();
+            double perMatch;
+            double perMatchUndo;
+            double onePass;
+            double onePassUndo;
+            String perMatchResult;
+            String onePassResult;
+            
+            measureReplaceAll<PerMatchReplaceUtil>(textData, regexFlag, findString, replaceString, 
+                                                   &perMatch, &perMatchUndo, &perMatchResult);
+            measureReplaceAll<ReplaceUtil>        (textData, regexFlag, findString, replaceString, 
+                                                   &onePass,  &onePassUndo,  &onePassResult);
+            if (perMatchResult != onePassResult) {
+                printf("results differ\n");
+            }
+            String replaceName = String() << findString << " -> " << replaceString;
+
+            printf("%10s %8ld %-18s %10.2f %10.2f %10.2f %10.2f\n", getSizeString(length).toCString(), numberOfMatches,
+                                                                  replaceName.toCString(), perMatch, perMatchUndo, 
+                                                                  onePass, onePassUndo);
+        }
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////
+// hiliting
+
+/**
+ * Returns the time in seconds for hiliting the whole text with the 
+ * HilitedText, as the HilitingScheduler does in the background.
+ */
+double measureHilitedTextProcessing(HilitedText::Ptr hilitedText)
+{
+    TimeStamp begin = TimeStamp::now();
+
+    while (hilitedText->needsProcessing()) {
+        hilitedText->process(TimeStamp::now() + MilliSeconds(20));
+    }
+    return getSecondsSince(begin);
+}
+
+/**
+ * Returns the time in seconds for getting the text styles of all positions
+ * from a HilitingBuffer, as the TextWidget does while scrolling through
+ * the whole text. 
+ */
+double measureHilitingBuffer(HilitedText::Ptr hilitedText, long* checkSum)
+{
+    HilitingBuffer::Ptr hilitingBuffer = HilitingBuffer::create(hilitedText);
+    long                length         = hilitedText->getTextData()->getLength();
+    
+    TimeStamp begin = TimeStamp::now();
+    *checkSum = 0;
+    
+    for (long pos = 0; pos < length; ++pos) {
+        *checkSum += hilitingBuffer->getTextStyle(pos);
+    }
+    return getSecondsSince(begin);
+}
+
+/**
+ * The language mode is chosen by the file name as in the editor. The text
+ * styles of the syntax patterns need fonts, so this benchmark needs an X11 
+ * display.
+ */
+void benchmarkHiliting(int argc, char** argv)
+{
+    if (argc == 0) {
+        printf("No files given.\n");
+        return;
+    }
+    DefaultConfig::createMissingConfigFiles();
+    GlobalConfig::getInstance()->readConfig();
+
+    printf("Hiliting of the whole file, best of %d runs, throughput in MB/s\n\n", (int) NUMBER_OF_MEASUREMENTS);
+    printf("%-30s %-12s %10s %12s %12s\n", "file", "language", "size", "HilitedText", "buffer");
+
+    for (int i = 0; i < argc; ++i)
+    {
+        String            fileName     = argv[i];
+        LanguageMode::Ptr languageMode = GlobalConfig::getInstance()->getLanguageModeForFileName(fileName);
+        ByteBuffer        content;
+        
+        File(fileName).loadInto(&content);
+        
+        double bestProcessing = 0;
+        double bestBuffer     = 0;
+        long   checkSum       = 0;
+        
+        for (int m = 0; m < NUMBER_OF_MEASUREMENTS; ++m)
+        {
+            TextData::Ptr    textData    = TextData::create();
+            HilitedText::Ptr hilitedText = HilitedText::create(textData, languageMode);
+            
+            textData->insertAtMark(textData->createNewMark(), &content);
+            textData->flushPendingUpdates();
+            
+            double processing = measureHilitedTextProcessing(hilitedText);
+            double buffer     = measureHilitingBuffer(hilitedText, &checkSum);
+            
+            if (m == 0 || processing < bestProcessing) {
+                bestProcessing = processing;
+            }
+            if (m == 0 || buffer < bestBuffer) {
+                bestBuffer = buffer;
+            }
+        }
+        long length = content.getLength();
+        
+        printf("%-30s %-12s %10s %12.2f %12.2f\n", fileName.toCString(), languageMode->getName().toCString(),
+                                                   getSizeString(length).toCString(),
+                                                   length / bestProcessing / 1e6, length / bestBuffer / 1e6);
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////
+
+struct Benchmark
+{
+    const char* name;
+    const char* arguments;
+    const char* description;
+    void      (*run)(int argc, char** argv);
+};
+
+const Benchmark benchmarks[] = 
+{
+    { "newlines",  "[MB...]", "newline counting on load, default sizes 1, 100 and 1024 MB", &benchmarkNewlines },
+    { "marks",     "[count...]", "single byte edits with many marks, default 0, 100, 1000 and 10000 marks", &benchmarkMarks },
+    { "encodings", "[MB...]", "ISO-8859-1 and UTF-16 to UTF-8, default size 100 MB", &benchmarkEncodings },
+    { "utf8",      "[MB...]", "UTF-8 kernels against character by character code, default size 24 MB", &benchmarkUtf8 },
+    { "replace",   "[MB...]", "replace all per match and in one pass, default sizes 5 and 50 MB", &benchmarkReplace },
+    { "hiliting",  "file...", "syntax hiliting of the given files, needs an X11 display", &benchmarkHiliting },
+};
+
+const int NUMBER_OF_BENCHMARKS = sizeof(benchmarks) / sizeof(benchmarks[0]);
+
+void printUsage(const char* programName)
+{
+    printf("usage: %s <benchmark> [arguments]\n\n", programName);
+    
+    for (int i = 0; i < NUMBER_OF_BENCHMARKS; ++i) {
+        String call = String() << benchmarks[i].name << " " << benchmarks[i].arguments;
+        printf("    %-28s %s\n", call.toCString(), benchmarks[i].description);
+    }
+}
+
+} // anonymous namespace
+
+
+int main(int argc, char** argv)
+{
+    setlocale(LC_CTYPE, "");
+
+    if (argc < 2) {
+        printUsage(argv[0]);
+        return 1;
+    }
+    int rc = 1;
+    try
+    {
+        SingletonKeeper::Ptr singletonKeeper = SingletonKeeper::create();
+        
+        for (int i = 0; i < NUMBER_OF_BENCHMARKS; ++i) {
+            if (strcmp(argv[1], benchmarks[i].name) == 0) {
+                benchmarks[i].run(argc - 2, argv + 2);
+                rc = 0;
+            }
+        }
+        if (rc != 0) {
+            printUsage(argv[0]);
+        }
+    }
+    catch (BaseException& ex)
+    {
+        fprintf(stderr, "[%s]: %s\n", argv[0], ex.toString().toCString());
+        rc = 16;
+    }
+    return rc;
+}
@@ -71,6 +71,18 @@
 
 
 
+/* usage of inotify for watching files */
+
+#if !defined(LUCED_USE_INOTIFY)
+#  if HAVE_SYS_INOTIFY_H && !DISABLE_INOTIFY
+#    define LUCED_USE_INOTIFY 1
+#  else
+#    define LUCED_USE_INOTIFY 0
+#  endif
+#endif
+
+
+
 /* usage of c++ hashmap */
 
 #if !defined(LUCED_USE_STD_UNORDERED_MAP)              \